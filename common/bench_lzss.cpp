@@ -0,0 +1,374 @@
+/* Scumm Tools
+ * Copyright (C) 2004-2006  The ScummVM Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+/*
+ * Compares the LZSS decoders with the ring buffer based ones of
+ * extract_gob_stk they replaced, both for speed and for identical output.
+ * Build and run it with "make bench".
+ *
+ * Usage: bench_lzss [rounds] [file.stk...]
+ * The packed chunks of the given STK 1.0 archives are decoded, or a
+ * generated corpus of chunks if there are none.
+ */
+
+#include "common/lzss.h"
+#include "common/endian.h"
+#include "common/util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+namespace {
+
+struct PackedChunk {
+	std::vector<byte> data;
+	uint32 size;
+};
+
+// unpackData of extract_gob_stk, before it used the shared decoder. The
+// whole window is preset, as the new decoder does.
+void referenceUnpack(const byte *src, byte *dest, uint32 size) {
+	uint32 counter = size;
+	uint16 cmd;
+	byte tmpBuf[4114];
+	int16 off;
+	byte len;
+	uint16 tmpIndex;
+
+	memset(tmpBuf, 0x20, sizeof(tmpBuf));
+	tmpIndex = 4078;
+
+	cmd = 0;
+	while (1) {
+		cmd >>= 1;
+		if ((cmd & 0x0100) == 0) {
+			cmd = *src | 0xFF00;
+			src++;
+		}
+		if ((cmd & 1) != 0) {
+			*dest++ = *src;
+			tmpBuf[tmpIndex] = *src;
+			src++;
+			tmpIndex++;
+			tmpIndex %= 4096;
+			counter--;
+
+			if (counter == 0)
+				break;
+		} else {
+			off = *src++;
+			off |= (*src & 0xF0) << 4;
+			len = (*src & 0x0F) + 3;
+			src++;
+
+			for (int i = 0; i < len; i++) {
+				*dest++ = tmpBuf[(off + i) % 4096];
+				if (--counter == 0)
+					return;
+
+				tmpBuf[tmpIndex] = tmpBuf[(off + i) % 4096];
+				tmpIndex++;
+				tmpIndex %= 4096;
+			}
+		}
+	}
+}
+
+// unpackPreGobData of extract_gob_stk, without the header, before it used
+// the shared decoder
+uint32 referenceUnpackToEnd(const byte *src, uint32 srcSize, byte *dest) {
+	uint16 cmd;
+	byte tmpBuf[4114];
+	int16 off;
+	byte len;
+	uint16 tmpIndex;
+	int32 newCounter = srcSize;
+	uint32 size = 0;
+
+	memset(tmpBuf, 0x20, sizeof(tmpBuf));
+	tmpIndex = 4078;
+
+	cmd = 0;
+	while (1) {
+		cmd >>= 1;
+		if ((cmd & 0x0100) == 0) {
+			cmd = *src | 0xFF00;
+			src++;
+			newCounter--;
+			if (newCounter == 0)
+				break;
+		}
+
+		if ((cmd & 1) != 0) {
+			*dest++ = *src;
+			size++;
+			tmpBuf[tmpIndex] = *src;
+			src++;
+			newCounter--;
+
+			if (newCounter == 0)
+				break;
+
+			tmpIndex++;
+			tmpIndex %= 4096;
+		} else {
+			off = *src++;
+			off |= (*src & 0xF0) << 4;
+			len = (*src & 0x0F) + 3;
+			src++;
+			newCounter -= 2;
+
+			for (int i = 0; i < len; i++) {
+				*dest++ = tmpBuf[(off + i) % 4096];
+				size++;
+				tmpBuf[tmpIndex] = tmpBuf[(off + i) % 4096];
+				tmpIndex++;
+				tmpIndex %= 4096;
+			}
+			if (newCounter <= 0)
+				break;
+		}
+	}
+
+	return size;
+}
+
+// A greedy packer, only used to generate the corpus
+void pack(const std::vector<byte> &input, std::vector<byte> &output) {
+	const uint32 hashSize = 1 << 12;
+	std::vector<int32> head(hashSize, -1), prev(input.size(), -1);
+
+	uint32 pos = 0;
+	while (pos < input.size()) {
+		uint32 flagPos = output.size();
+		output.push_back(0);
+
+		for (int item = 0; item < 8 && pos < input.size(); item++) {
+			uint32 bestLen = 0, bestPos = 0;
+
+			if (pos + 3 <= input.size()) {
+				uint32 hash = (input[pos] * 33 * 33 + input[pos + 1] * 33 + input[pos + 2]) & (hashSize - 1);
+				int32 candidate = head[hash];
+				for (int tries = 0; candidate >= 0 && tries < 16; tries++) {
+					if (pos - candidate > 4000)
+						break;
+
+					uint32 len = 0;
+					while (len < 18 && pos + len < input.size() && input[candidate + len] == input[pos + len])
+						len++;
+					if (len > bestLen) {
+						bestLen = len;
+						bestPos = candidate;
+					}
+					candidate = prev[candidate];
+				}
+			}
+
+			uint32 step = 1;
+			if (bestLen >= 3) {
+				uint32 offset = (bestPos + 4078) & 4095;
+				output.push_back(offset & 0xFF);
+				output.push_back(((offset >> 4) & 0xF0) | (bestLen - 3));
+				step = bestLen;
+			} else {
+				output[flagPos] |= 1 << item;
+				output.push_back(input[pos]);
+			}
+
+			for (; step > 0; step--, pos++) {
+				if (pos + 3 <= input.size()) {
+					uint32 hash = (input[pos] * 33 * 33 + input[pos + 1] * 33 + input[pos + 2]) & (hashSize - 1);
+					prev[pos] = head[hash];
+					head[hash] = pos;
+				}
+			}
+		}
+	}
+}
+
+// Builds chunks of text like data, repeating words and runs of bytes
+void generateCorpus(std::vector<PackedChunk> &chunks) {
+	static const char *const words[] = {
+		"the ", "gob ", "script ", "total ", "sprite ", "palette ", "music ",
+		"goblin ", "inventory ", "animation ", "\r\n", "    ", "0000"
+	};
+
+	srand(1);
+	for (int c = 0; c < 64; c++) {
+		std::vector<byte> input;
+		uint32 size = 1024 + rand() % (128 * 1024);
+
+		while (input.size() < size) {
+			int kind = rand() % 8;
+			if (kind < 5) {
+				const char *word = words[rand() % ARRAYSIZE(words)];
+				input.insert(input.end(), word, word + strlen(word));
+			} else if (kind < 7) {
+				input.push_back((byte)rand());
+			} else {
+				input.insert(input.end(), 1 + rand() % 40, (byte)rand());
+			}
+		}
+		input.resize(size);
+
+		PackedChunk chunk;
+		chunk.size = size;
+		pack(input, chunk.data);
+		chunks.push_back(chunk);
+	}
+}
+
+// Reads the packed chunks of a STK 1.0 archive
+bool loadArchive(const char *filename, std::vector<PackedChunk> &chunks) {
+	FILE *f = fopen(filename, "rb");
+	if (!f)
+		return false;
+
+	std::vector<byte> stk;
+	byte buf[4096];
+	size_t read;
+	while ((read = fread(buf, 1, sizeof(buf), f)) > 0)
+		stk.insert(stk.end(), buf, buf + read);
+	fclose(f);
+
+	if (stk.size() < 2)
+		return false;
+
+	uint16 count = READ_LE_UINT16(&stk[0]);
+	for (uint16 i = 0; i < count; i++) {
+		uint32 entry = 2 + i * 22;
+		if (entry + 22 > stk.size())
+			return false;
+
+		uint32 size = READ_LE_UINT32(&stk[entry + 13]);
+		uint32 offset = READ_LE_UINT32(&stk[entry + 17]);
+		bool packed = stk[entry + 21] != 0;
+		if (!packed || size <= 4 || offset + size > stk.size())
+			continue;
+
+		PackedChunk chunk;
+		chunk.size = READ_LE_UINT32(&stk[offset]);
+		if (chunk.size == 0)
+			continue;
+		chunk.data.assign(stk.begin() + offset + 4, stk.begin() + offset + size);
+		chunks.push_back(chunk);
+	}
+
+	return true;
+}
+
+double seconds(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+bool benchSized(const std::vector<PackedChunk> &chunks, int rounds) {
+	std::vector<std::vector<byte> > expected(chunks.size()), actual(chunks.size());
+	for (uint c = 0; c < chunks.size(); c++)
+		expected[c].resize(chunks[c].size);
+
+	clock_t start = clock();
+	for (int r = 0; r < rounds; r++)
+		for (uint c = 0; c < chunks.size(); c++)
+			referenceUnpack(&chunks[c].data[0], &expected[c][0], chunks[c].size);
+	double before = seconds(start);
+
+	start = clock();
+	for (int r = 0; r < rounds; r++) {
+		for (uint c = 0; c < chunks.size(); c++) {
+			byte *data = Common::unpackLZSS(&chunks[c].data[0], chunks[c].data.size(), chunks[c].size);
+			if (r == rounds - 1)
+				actual[c].assign(data, data + chunks[c].size);
+			delete[] data;
+		}
+	}
+	double after = seconds(start);
+
+	bool same = (expected == actual);
+	printf("STK chunks:     %6.3fs -> %6.3fs %s\n", before, after, same ? "" : "(output differs!)");
+	return same;
+}
+
+bool benchToEnd(const std::vector<PackedChunk> &chunks, int rounds) {
+	std::vector<std::vector<byte> > expected(chunks.size()), actual(chunks.size());
+
+	// The old decoder wrote into a fixed buffer. Every compressed byte
+	// decodes to at most 9 bytes.
+	std::vector<byte> buffer;
+	for (uint c = 0; c < chunks.size(); c++)
+		if (buffer.size() < 9 * chunks[c].data.size())
+			buffer.resize(9 * chunks[c].data.size());
+
+	clock_t start = clock();
+	for (int r = 0; r < rounds; r++) {
+		for (uint c = 0; c < chunks.size(); c++) {
+			uint32 size = referenceUnpackToEnd(&chunks[c].data[0], chunks[c].data.size(), &buffer[0]);
+			if (r == rounds - 1)
+				expected[c].assign(buffer.begin(), buffer.begin() + size);
+		}
+	}
+	double before = seconds(start);
+
+	start = clock();
+	for (int r = 0; r < rounds; r++) {
+		for (uint c = 0; c < chunks.size(); c++) {
+			uint32 size;
+			byte *data = Common::unpackLZSSToEnd(&chunks[c].data[0], chunks[c].data.size(), size);
+			if (r == rounds - 1)
+				actual[c].assign(data, data + size);
+			delete[] data;
+		}
+	}
+	double after = seconds(start);
+
+	bool same = (expected == actual);
+	printf("Pre-Gob chunks: %6.3fs -> %6.3fs %s\n", before, after, same ? "" : "(output differs!)");
+	return same;
+}
+
+} // End of anonymous namespace
+
+int main(int argc, char *argv[]) {
+	const int rounds = (argc > 1) ? atoi(argv[1]) : 20;
+
+	std::vector<PackedChunk> chunks;
+	for (int i = 2; i < argc; i++) {
+		if (!loadArchive(argv[i], chunks)) {
+			fprintf(stderr, "Could not read STK archive %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (chunks.empty())
+		generateCorpus(chunks);
+
+	uint32 total = 0;
+	for (uint c = 0; c < chunks.size(); c++)
+		total += chunks[c].size;
+
+	printf("Decoding %d times %d chunks of %d KB in total, before -> after\n", rounds, (int)chunks.size(), total / 1024);
+	bool ok = benchSized(chunks, rounds);
+	ok = benchToEnd(chunks, rounds) && ok;
+
+	return ok ? 0 : 1;
+}
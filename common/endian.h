@@ -37,7 +37,7 @@
 #endif
 
 static inline uint32 SWAP_32(uint32 a) {
-	return uint16(((a >> 24) & 0xFF) | ((a >> 8) & 0xFF00) | ((a << 8) & 0xFF0000) |
+	return uint32(((a >> 24) & 0xFF) | ((a >> 8) & 0xFF00) | ((a << 8) & 0xFF0000) |
 		((a << 24) & 0xFF000000));
 }
 
@@ -21,14 +21,24 @@
  */
 
 #include "file.h"
+#include "endian.h"
+#include "util.h"
+#include <ctype.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include <sys/stat.h>   // for stat()
 #include <sys/types.h>
+#if defined(UNIX)
+#include <fcntl.h>
+#include <sys/mman.h>	// for mmap()
+#endif
 #ifndef _MSC_VER
 #include <unistd.h>	// for unlink()
+#include <dirent.h>	// for opendir()
 #else
+#include <io.h>	// for _findfirst()
 
 // Add a definition for S_IFDIR for MSVC
 #ifndef S_ISDIR
@@ -207,12 +217,22 @@ File::File() {
 	_file = NULL;
 	_mode = FILEMODE_READ;
 	_xormode = 0;
+	_mapData = NULL;
+	_mapSize = 0;
+	_mapPos = 0;
+	_mapIsView = false;
+	_mapIsBorrowed = false;
 }
 
 File::File(const Filename &filepath, const char *mode) {
 	_file = NULL;
 	_mode = FILEMODE_READ;
 	_xormode = 0;
+	_mapData = NULL;
+	_mapSize = 0;
+	_mapPos = 0;
+	_mapIsView = false;
+	_mapIsBorrowed = false;
 
 	open(filepath, mode);
 }
@@ -247,10 +267,115 @@ void File::open(const Filename &filepath, const char *mode) {
 		throw FileException("Could not open file " + filepath.getFullPath());
 }
 
+// Stands in for the contents of empty mapped files, so that _mapData is never NULL for them
+static const byte emptyMapping[1] = { 0 };
+
+void File::openMapped(const Filename &filepath) {
+
+	// Clean up previously opened file
+	close();
+
+	_mode = FileMode(FILEMODE_READ | FILEMODE_BINARY);
+	_name = filepath;
+	_xormode = 0;
+	_mapPos = 0;
+
+#if defined(UNIX)
+	int fd = ::open(filepath.getFullPath().c_str(), O_RDONLY);
+	if (fd < 0)
+		throw FileException("Could not open file " + filepath.getFullPath());
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			_mapData = (const byte *)data;
+			_mapSize = st.st_size;
+			_mapIsView = true;
+		}
+	}
+	::close(fd);
+
+	if (_mapData)
+		return;
+#endif
+
+	// Mapping is not possible, or the file is empty
+	readFileIntoMemory(filepath);
+}
+
+void File::openMemory(const byte *data, uint32 size, const Filename &name) {
+
+	// Clean up previously opened file
+	close();
+
+	_mode = FileMode(FILEMODE_READ | FILEMODE_BINARY);
+	_name = name;
+	_xormode = 0;
+	_mapData = size ? data : emptyMapping;
+	_mapSize = size;
+	_mapPos = 0;
+	_mapIsBorrowed = true;
+}
+
+void File::readFileIntoMemory(const Filename &filepath) {
+	FILE *file = fopen(filepath.getFullPath().c_str(), "rb");
+	if (!file)
+		throw FileException("Could not open file " + filepath.getFullPath());
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	if (size <= 0) {
+		fclose(file);
+		_mapData = emptyMapping;
+		_mapSize = 0;
+		_mapIsView = false;
+		return;
+	}
+
+	byte *data = new byte[size];
+	if (fread(data, 1, size, file) != (size_t)size) {
+		fclose(file);
+		delete[] data;
+		throw FileException("Could not read file " + filepath.getFullPath());
+	}
+	fclose(file);
+
+	_mapData = data;
+	_mapSize = size;
+	_mapIsView = false;
+}
+
 void File::close() {
 	if (_file)
 		fclose(_file);
 	_file = NULL;
+
+	if (_mapData && !_mapIsBorrowed) {
+#if defined(UNIX)
+		if (_mapIsView)
+			munmap((void *)_mapData, _mapSize);
+		else
+#endif
+		if (_mapData != emptyMapping)
+			delete[] _mapData;
+	}
+	_mapData = NULL;
+	_mapSize = 0;
+	_mapPos = 0;
+	_mapIsView = false;
+	_mapIsBorrowed = false;
+}
+
+const byte *File::mapBytes(size_t size) {
+	if (_mapPos > _mapSize || size > _mapSize - _mapPos)
+		throw FileException("Read beyond the end of file (" + _name.getFullPath() + ")");
+
+	const byte *data = _mapData + _mapPos;
+	_mapPos += size;
+	return data;
 }
 
 void File::setXorMode(uint8 xormode) {
@@ -258,6 +383,9 @@ void File::setXorMode(uint8 xormode) {
 }
 
 int File::readChar() {
+	if (_mapData)
+		return *mapBytes(1) ^ _xormode;
+
 	if (!_file)
 		throw FileException("File is not open");
 	if ((_mode & FILEMODE_READ) == 0)
@@ -276,6 +404,9 @@ uint8 File::readByte() {
 }
 
 uint16 File::readUint16BE() {
+	if (_mapData)
+		return READ_BE_UINT16(mapBytes(2)) ^ (uint16)(_xormode * 0x0101);
+
 	uint16 ret = 0;
 	ret |= uint16(readByte() << 8ul);
 	ret |= uint16(readByte());
@@ -283,6 +414,9 @@ uint16 File::readUint16BE() {
 }
 
 uint16 File::readUint16LE() {
+	if (_mapData)
+		return READ_LE_UINT16(mapBytes(2)) ^ (uint16)(_xormode * 0x0101);
+
 	uint16 ret = 0;
 	ret |= uint16(readByte());
 	ret |= uint16(readByte() << 8ul);
@@ -290,6 +424,9 @@ uint16 File::readUint16LE() {
 }
 
 uint32 File::readUint32BE() {
+	if (_mapData)
+		return READ_BE_UINT32(mapBytes(4)) ^ (uint32)(_xormode * 0x01010101);
+
 	uint32 ret = 0;
 	ret |= uint32(readByte() << 24);
 	ret |= uint32(readByte() << 16);
@@ -299,6 +436,9 @@ uint32 File::readUint32BE() {
 }
 
 uint32 File::readUint32LE() {
+	if (_mapData)
+		return READ_LE_UINT32(mapBytes(4)) ^ (uint32)(_xormode * 0x01010101);
+
 	uint32 ret = 0;
 	ret |= uint32(readByte());
 	ret |= uint32(readByte() << 8);
@@ -339,6 +479,58 @@ int32 File::readSint32LE() {
 	return ret;
 }
 
+// Helpers for the array readers and writers. These are simple loops over
+// contiguous data, which compilers turn into vector code.
+
+static void swapWords(byte *data, size_t count, int wordSize) {
+	if (wordSize == 2) {
+		uint16 *words = (uint16 *)data;
+		for (size_t i = 0; i < count; i++)
+			words[i] = SWAP_16(words[i]);
+	} else {
+		uint32 *words = (uint32 *)data;
+		for (size_t i = 0; i < count; i++)
+			words[i] = SWAP_32(words[i]);
+	}
+}
+
+static void xorBytes(byte *data, size_t size, uint8 xormode) {
+	for (size_t i = 0; i < size; i++)
+		data[i] ^= xormode;
+}
+
+#if defined(SCUMM_BIG_ENDIAN)
+static const bool hostIsBigEndian = true;
+#else
+static const bool hostIsBigEndian = false;
+#endif
+
+void File::readArray(void *data, size_t count, int wordSize, bool bigEndian) {
+	read_throwsOnError(data, count * wordSize);
+
+	// Unlike read_throwsOnError, the typed readers honor the xor mode
+	if (_xormode)
+		xorBytes((byte *)data, count * wordSize, _xormode);
+	if (bigEndian != hostIsBigEndian)
+		swapWords((byte *)data, count, wordSize);
+}
+
+void File::readUint16BEArray(uint16 *data, size_t count) {
+	readArray(data, count, 2, true);
+}
+
+void File::readUint16LEArray(uint16 *data, size_t count) {
+	readArray(data, count, 2, false);
+}
+
+void File::readUint32BEArray(uint32 *data, size_t count) {
+	readArray(data, count, 4, true);
+}
+
+void File::readUint32LEArray(uint32 *data, size_t count) {
+	readArray(data, count, 4, false);
+}
+
 void File::read_throwsOnError(void *dataPtr, size_t dataSize) {
 	size_t data_read = read_noThrow(dataPtr, dataSize);
 	if (data_read != dataSize)
@@ -346,6 +538,14 @@ void File::read_throwsOnError(void *dataPtr, size_t dataSize) {
 }
 
 size_t File::read_noThrow(void *dataPtr, size_t dataSize) {
+	if (_mapData) {
+		size_t available = (_mapPos < _mapSize) ? _mapSize - _mapPos : 0;
+		if (dataSize > available)
+			dataSize = available;
+		memcpy(dataPtr, mapBytes(dataSize), dataSize);
+		return dataSize;
+	}
+
 	if (!_file)
 		throw FileException("File is not open");
 	if ((_mode & FILEMODE_READ) == 0)
@@ -354,8 +554,15 @@ size_t File::read_noThrow(void *dataPtr, size_t dataSize) {
 	return fread(dataPtr, 1, dataSize, _file);
 }
 
+const byte *File::readSpan(size_t dataSize) {
+	if (!_mapData)
+		throw FileException("File is not mapped (" + _name.getFullPath() + ")");
+
+	return mapBytes(dataSize);
+}
+
 std::string File::readString() {
-	if (!_file)
+	if (!isOpen())
 		throw FileException("File is not open");
 	if ((_mode & FILEMODE_READ) == 0)
 		throw FileException("Tried to read from file opened in write mode (" + _name.getFullPath() + ")");
@@ -374,7 +581,7 @@ std::string File::readString() {
 }
 
 std::string File::readString(size_t len) {
-	if (!_file)
+	if (!isOpen())
 		throw FileException("File is not open");
 	if ((_mode & FILEMODE_READ) == 0)
 		throw FileException("Tried to read from file opened in write mode (" + _name.getFullPath() + ")");
@@ -391,6 +598,16 @@ std::string File::readString(size_t len) {
 }
 
 void File::scanString(char *result) {
+	if (_mapData) {
+		// Same as fscanf "%s": skip white space, then read up to the next one
+		while (_mapPos < _mapSize && isspace(_mapData[_mapPos]))
+			_mapPos++;
+		while (_mapPos < _mapSize && !isspace(_mapData[_mapPos]))
+			*result++ = _mapData[_mapPos++];
+		*result = 0;
+		return;
+	}
+
 	if (!_file)
 		throw FileException("File is not open");
 	if ((_mode & FILEMODE_READ) == 0)
@@ -400,6 +617,8 @@ void File::scanString(char *result) {
 }
 
 void File::writeChar(char i) {
+	if (_mapData)
+		throw FileException("Tried to write to a file opened in read mode (" + _name.getFullPath() + ")");
 	if (!_file)
 		throw FileException("File is not open");
 	if ((_mode & FILEMODE_WRITE) == 0)
@@ -439,7 +658,59 @@ void File::writeUint32LE(uint32 value) {
 	writeByte((uint8)(value >> 24));
 }
 
+void File::writeArray(const void *data, size_t count, int wordSize, bool bigEndian) {
+	if (_mapData)
+		throw FileException("Tried to write to a file opened in read mode (" + _name.getFullPath() + ")");
+	if (!_file)
+		throw FileException("File is not open");
+	if ((_mode & FILEMODE_WRITE) == 0)
+		throw FileException("Tried to write to a file opened in read mode (" + _name.getFullPath() + ")");
+
+	const bool swap = (bigEndian != hostIsBigEndian);
+	const byte *src = (const byte *)data;
+	size_t size = count * wordSize;
+
+	// Write the data as it is when possible, else convert it block by block
+	if (!swap && !_xormode) {
+		if (size && fwrite(src, 1, size, _file) != size)
+			throw FileException("Could not write to file (" + _name.getFullPath() + ")");
+		return;
+	}
+
+	uint32 buffer[1024];
+	while (size > 0) {
+		size_t blockSize = MIN<size_t>(size, sizeof(buffer));
+		memcpy(buffer, src, blockSize);
+		if (swap)
+			swapWords((byte *)buffer, blockSize / wordSize, wordSize);
+		if (_xormode)
+			xorBytes((byte *)buffer, blockSize, _xormode);
+		if (fwrite(buffer, 1, blockSize, _file) != blockSize)
+			throw FileException("Could not write to file (" + _name.getFullPath() + ")");
+		src += blockSize;
+		size -= blockSize;
+	}
+}
+
+void File::writeUint16BEArray(const uint16 *data, size_t count) {
+	writeArray(data, count, 2, true);
+}
+
+void File::writeUint16LEArray(const uint16 *data, size_t count) {
+	writeArray(data, count, 2, false);
+}
+
+void File::writeUint32BEArray(const uint32 *data, size_t count) {
+	writeArray(data, count, 4, true);
+}
+
+void File::writeUint32LEArray(const uint32 *data, size_t count) {
+	writeArray(data, count, 4, false);
+}
+
 size_t File::write(const void *dataPtr, size_t dataSize) {
+	if (_mapData)
+		throw FileException("Tried to write to a file opened in read mode (" + _name.getFullPath() + ")");
 	if (!_file)
 		throw FileException("File is not open");
 	if ((_mode & FILEMODE_WRITE) == 0)
@@ -455,6 +726,8 @@ size_t File::write(const void *dataPtr, size_t dataSize) {
 }
 
 void File::print(const char *format, ...) {
+	if (_mapData)
+		throw FileException("Tried to write to a file opened in read mode (" + _name.getFullPath() + ")");
 	if (!_file)
 		throw FileException("File is not open");
 	if ((_mode & FILEMODE_WRITE) == 0)
@@ -469,6 +742,14 @@ void File::print(const char *format, ...) {
 }
 
 void File::seek(long offset, int origin) {
+	if (_mapData) {
+		long base = (origin == SEEK_CUR) ? (long)_mapPos : (origin == SEEK_END) ? (long)_mapSize : 0;
+		if (base + offset < 0)
+			throw FileException("Could not seek in file (" + _name.getFullPath() + ")");
+		_mapPos = base + offset;
+		return;
+	}
+
 	if (!_file)
 		throw FileException("File is not open");
 
@@ -477,26 +758,40 @@ void File::seek(long offset, int origin) {
 }
 
 void File::rewind() {
+	if (_mapData) {
+		_mapPos = 0;
+		return;
+	}
 	return ::rewind(_file);
 }
 
 int File::pos() const {
+	if (_mapData)
+		return _mapPos;
 	return ftell(_file);
 }
 
 int File::err() const {
+	if (_mapData)
+		return 0;
 	return ferror(_file);
 }
 
 void File::clearErr() {
-	clearerr(_file);
+	if (!_mapData)
+		clearerr(_file);
 }
 
 bool File::eos() const {
+	if (_mapData)
+		return _mapPos >= _mapSize;
 	return feof(_file) != 0;
 }
 
 uint32 File::size() const {
+	if (_mapData)
+		return _mapSize;
+
 	uint32 sz;
 	uint32 p = ftell(_file);
 	fseek(_file, 0, SEEK_END);
@@ -514,5 +809,35 @@ bool isDirectory(const char *path) {
 	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
 }
 
+void listDirectory(const char *path, std::vector<std::string> &names) {
+	std::string dir(path);
+	if (!dir.empty() && dir[dir.size() - 1] != '/' && dir[dir.size() - 1] != '\\')
+		dir += '/';
+
+#ifdef _MSC_VER
+	struct _finddata_t entry;
+	intptr_t handle = _findfirst((dir + "*").c_str(), &entry);
+	if (handle == -1)
+		throw FileException(std::string("Could not read directory ") + path);
+	do {
+		if (!(entry.attrib & _A_SUBDIR))
+			names.push_back(entry.name);
+	} while (_findnext(handle, &entry) == 0);
+	_findclose(handle);
+#else
+	DIR *handle = opendir(path);
+	if (!handle)
+		throw FileException(std::string("Could not read directory ") + path);
+	struct dirent *entry;
+	while ((entry = readdir(handle)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+		if (!isDirectory((dir + entry->d_name).c_str()))
+			names.push_back(entry->d_name);
+	}
+	closedir(handle);
+#endif
+}
+
 } // End of namespace Common
 
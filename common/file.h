@@ -27,6 +27,7 @@
 #include "common/noncopyable.h"
 
 #include "tool_exception.h"
+#include <vector>
 
 
 namespace Common {
@@ -187,6 +188,29 @@ public:
 	 */
 	void open(const Filename &filename, const char *mode);
 
+	/**
+	 * Opens the given file path for reading only, mapping the whole file
+	 * into memory where the platform supports it (or reading it into memory
+	 * otherwise). All the read methods, seek() and friends then work on the
+	 * mapping, without any stdio overhead, and readSpan() gives direct
+	 * access to the data. Writing to the file is not possible, and
+	 * getFileHandle() returns NULL.
+	 *
+	 * @param filename	file to open
+	 */
+	void openMapped(const Filename &filename);
+
+	/**
+	 * Opens a block of memory for reading, like a file opened with
+	 * openMapped(). The memory is not copied and must stay valid until
+	 * the file is closed.
+	 *
+	 * @param data	the contents of the "file"
+	 * @param size	size of the data
+	 * @param name	name used in error messages
+	 */
+	void openMemory(const byte *data, uint32 size, const Filename &name);
+
 	/**
 	 * Closes the file, if it's open.
 	 */
@@ -195,7 +219,12 @@ public:
 	/**
 	 * Check whether the file is open.
 	 */
-	bool isOpen() const { return _file != 0; }
+	bool isOpen() const { return _file != 0 || _mapData != 0; }
+
+	/**
+	 * Check whether the file was opened with openMapped().
+	 */
+	bool isMapped() const { return _mapData != 0; }
 
 	/**
 	 * Sets the xor mode of the file, bytes written / read to the file
@@ -257,6 +286,31 @@ public:
 	 */
 	int32 readSint32LE();
 
+	/**
+	 * Read an array of 16-bit words, big endian. Much faster than reading
+	 * the words one at a time, as the data is read in one go and then
+	 * converted in place.
+	 * @throws FileException if file is not open / if read failed.
+	 *
+	 * @param data	buffer for the words read
+	 * @param count	number of words to read
+	 */
+	void readUint16BEArray(uint16 *data, size_t count);
+	/**
+	 * Read an array of 16-bit words, little endian.
+	 * @throws FileException if file is not open / if read failed.
+	 */
+	void readUint16LEArray(uint16 *data, size_t count);
+	/**
+	 * Read an array of 32-bit words, big endian.
+	 * @throws FileException if file is not open / if read failed.
+	 */
+	void readUint32BEArray(uint32 *data, size_t count);
+	/**
+	 * Read an array of 32-bit words, little endian.
+	 * @throws FileException if file is not open / if read failed.
+	 */
+	void readUint32LEArray(uint32 *data, size_t count);
 
 	/**
 	 * Works the same way as fread, but throws on error or if it could
@@ -277,6 +331,18 @@ public:
 	 */
 	size_t read_noThrow(void *dataPtr, size_t dataSize);
 
+	/**
+	 * Returns a pointer to the next dataSize bytes of a file opened with
+	 * openMapped(), and skips them. The data is not copied, and stays valid
+	 * until the file is closed. Like read_throwsOnError, the data is not
+	 * XORed.
+	 * @throws FileException if file is not mapped / if there is not enough data.
+	 *
+	 * @param dataSize	number of bytes to be read
+	 * @return pointer to the data
+	 */
+	const byte *readSpan(size_t dataSize);
+
 	/**
 	 * Reads a full string, until NULL or EOF.
 	 * @throws FileException if file is not open / if read failed.
@@ -328,6 +394,31 @@ public:
 	 */
 	void writeUint32LE(uint32 value);
 
+	/**
+	 * Writes an array of 16-bit words to the file, big endian. The words
+	 * are converted through an internal buffer and written in large blocks.
+	 * @throws FileException if file is not open / if write failed.
+	 *
+	 * @param data	the words to write
+	 * @param count	number of words to write
+	 */
+	void writeUint16BEArray(const uint16 *data, size_t count);
+	/**
+	 * Writes an array of 16-bit words to the file, little endian.
+	 * @throws FileException if file is not open / if write failed.
+	 */
+	void writeUint16LEArray(const uint16 *data, size_t count);
+	/**
+	 * Writes an array of 32-bit words to the file, big endian.
+	 * @throws FileException if file is not open / if write failed.
+	 */
+	void writeUint32BEArray(const uint32 *data, size_t count);
+	/**
+	 * Writes an array of 32-bit words to the file, little endian.
+	 * @throws FileException if file is not open / if write failed.
+	 */
+	void writeUint32LEArray(const uint32 *data, size_t count);
+
 	/**
 	 * Works the same way as fwrite, but throws on error or if
 	 * it could not write all data.
@@ -390,6 +481,23 @@ protected:
 	Filename _name;
 	/** xor with this value while reading/writing (default 0), does not work for "read"/"write", only for byte operations. */
 	uint8 _xormode;
+
+	/** Contents of a file opened with openMapped(), NULL otherwise. */
+	const byte *_mapData;
+	/** Size of the mapped file. */
+	uint32 _mapSize;
+	/** Read position in the mapped file, may be past its end after a seek. */
+	uint32 _mapPos;
+	/** True if _mapData is a view of the file, false if it was read into memory. */
+	bool _mapIsView;
+	/** True if _mapData belongs to the caller of openMemory(). */
+	bool _mapIsBorrowed;
+
+	/** Skips size bytes of the mapped file and returns a pointer to them, throws at the end of file. */
+	const byte *mapBytes(size_t size);
+	void readArray(void *data, size_t count, int wordSize, bool bigEndian);
+	void writeArray(const void *data, size_t count, int wordSize, bool bigEndian);
+	void readFileIntoMemory(const Filename &filepath);
 };
 
 
@@ -407,6 +515,16 @@ int removeFile(const char *path);
  */
 bool isDirectory(const char *path);
 
+/**
+ * Lists the names of the regular files in the specified directory, in no
+ * particular order. Subdirectories and the "." and ".." entries are skipped.
+ *
+ * @param path  The directory to list.
+ * @param names Receives the file names, without the directory.
+ * @throws FileException if the directory cannot be read.
+ */
+void listDirectory(const char *path, std::vector<std::string> &names);
+
 } // End of namespace Common
 
 
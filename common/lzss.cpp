@@ -0,0 +1,166 @@
+/* Scumm Tools
+ * Copyright (C) 2004-2006  The ScummVM Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#include "common/lzss.h"
+#include "common/util.h"
+#include "tool_exception.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace Common {
+
+enum {
+	kWindowSize = 4096,
+	kWindowStart = 4078,
+	kMaxMatch = 18,
+	// Matches are copied 8 bytes at a time, so they may write up to
+	// 7 bytes past their end
+	kSlack = 8
+};
+
+/**
+ * Makes sure the output can take another match, growing it if needed.
+ */
+static void reserveOutput(byte *&out, uint32 &capacity, uint32 used) {
+	if (used + kMaxMatch + kSlack <= capacity)
+		return;
+
+	uint32 newCapacity = 2 * capacity + kMaxMatch + kSlack;
+	byte *newOut = new byte[newCapacity];
+	memcpy(newOut, out, used);
+	delete[] out;
+
+	out = newOut;
+	capacity = newCapacity;
+}
+
+/**
+ * Copies a match of len bytes, starting dist bytes before dst.
+ */
+static inline void copyMatch(byte *out, uint32 outPos, uint32 dist, uint32 len) {
+	byte *dst = out + outPos;
+
+	if (dist > outPos) {
+		// The match starts in the preset part of the window
+		for (uint32 i = 0; i < len; i++) {
+			uint32 pos = outPos + i;
+			dst[i] = (pos >= dist) ? out[pos - dist] : 0x20;
+		}
+	} else if (dist >= 8) {
+		const byte *from = dst - dist;
+		for (uint32 i = 0; i < len; i += 8)
+			memcpy(dst + i, from + i, 8);
+	} else if (dist == 1) {
+		memset(dst, dst[-1], len);
+	} else {
+		// The match overlaps its own output
+		const byte *from = dst - dist;
+		for (uint32 i = 0; i < len; i++)
+			dst[i] = from[i];
+	}
+}
+
+/**
+ * The decoder behind unpackLZSS() and unpackLZSSToEnd().
+ *
+ * With a known size, decoding stops as soon as that many bytes have been
+ * decoded, possibly in the middle of a match. Otherwise it stops when the
+ * compressed data is used up.
+ */
+static byte *decodeLZSS(const byte *src, uint32 srcSize, uint32 &size, bool sized) {
+	uint32 capacity = (sized ? size : 4 * srcSize) + kMaxMatch + kSlack;
+	byte *out = new byte[capacity];
+	uint32 outPos = 0;
+	uint32 srcPos = 0;
+	uint16 flags = 0;
+
+	if (sized && size == 0)
+		return out;
+
+	while (true) {
+		flags >>= 1;
+		if ((flags & 0x100) == 0) {
+			if (srcPos >= srcSize)
+				break;
+
+			flags = src[srcPos++] | 0xFF00;
+			if (!sized && srcPos == srcSize)
+				break;
+		}
+
+		reserveOutput(out, capacity, outPos);
+
+		if ((flags & 1) != 0) {
+			if (srcPos >= srcSize)
+				break;
+
+			out[outPos++] = src[srcPos++];
+
+			if (sized ? (outPos == size) : (srcPos == srcSize))
+				break;
+		} else {
+			if (srcPos + 2 > srcSize)
+				break;
+
+			uint32 offset = src[srcPos] | ((src[srcPos + 1] & 0xF0) << 4);
+			uint32 len = (src[srcPos + 1] & 0x0F) + 3;
+			srcPos += 2;
+
+			// How far back the window position is, from 1 to 4096
+			uint32 dist = ((outPos + kWindowStart - offset - 1) & (kWindowSize - 1)) + 1;
+
+			copyMatch(out, outPos, dist, len);
+			outPos += len;
+
+			if (sized) {
+				if (outPos >= size) {
+					outPos = size;
+					break;
+				}
+			} else if (srcPos >= srcSize) {
+				break;
+			}
+		}
+	}
+
+	if (sized && outPos != size) {
+		delete[] out;
+
+		char buf[64];
+		sprintf(buf, "LZSS data ends after %d of %d bytes", outPos, size);
+		throw ToolException(buf);
+	}
+
+	size = outPos;
+	return out;
+}
+
+byte *unpackLZSS(const byte *src, uint32 srcSize, uint32 size) {
+	return decodeLZSS(src, srcSize, size, true);
+}
+
+byte *unpackLZSSToEnd(const byte *src, uint32 srcSize, uint32 &size) {
+	return decodeLZSS(src, srcSize, size, false);
+}
+
+} // End of namespace Common
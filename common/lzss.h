@@ -0,0 +1,70 @@
+/* Scumm Tools
+ * Copyright (C) 2004-2006  The ScummVM Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#ifndef COMMON_LZSS_H
+#define COMMON_LZSS_H
+
+#include "common/scummsys.h"
+
+namespace Common {
+
+/**
+ * Decoders for the LZSS variant of Haruhiko Okumura's LZSS.C, which is used
+ * by the Coktel Vision games among others.
+ *
+ * The data is a sequence of groups, each made of a flag byte and eight
+ * items, the lowest bit of the flag byte describing the first item. A set
+ * bit stands for a literal byte, a clear bit for a two byte match, which
+ * holds a 12 bit window position and a 4 bit length minus 3. The 4 KB
+ * window starts out filled with spaces, and the first decoded byte is put
+ * at position 4078.
+ *
+ * The decoders use the output as the window, so only matches which reach
+ * back before the start of the output look at the spaces, and matches are
+ * copied 8 bytes at a time unless they overlap their own output.
+ */
+
+/**
+ * Decodes LZSS data of a known decoded size.
+ * Throws a ToolException if the compressed data ends too early.
+ *
+ * @param src     The compressed data.
+ * @param srcSize Size of the compressed data.
+ * @param size    Size of the decoded data.
+ * @return The decoded data, allocated with new[].
+ */
+byte *unpackLZSS(const byte *src, uint32 srcSize, uint32 size);
+
+/**
+ * Decodes LZSS data of an unknown decoded size, until the compressed data
+ * is used up. The output grows as needed.
+ *
+ * @param src     The compressed data.
+ * @param srcSize Size of the compressed data.
+ * @param size    Receives the size of the decoded data.
+ * @return The decoded data, allocated with new[].
+ */
+byte *unpackLZSSToEnd(const byte *src, uint32 srcSize, uint32 &size);
+
+} // End of namespace Common
+
+#endif
@@ -0,0 +1,342 @@
+/* ScummVM Tools
+ * Copyright (C) 2002-2009 The ScummVM project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#include "common/thread.h"
+#include "common/file.h"
+
+#include <vector>
+
+#if defined(WIN32)
+#include <windows.h>
+#define USE_WIN32_THREADS
+#elif defined(USE_PTHREADS)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if !defined(WIN32)
+#include <sys/time.h>
+#endif
+
+namespace Common {
+
+// Mutex implementation
+
+#if defined(USE_WIN32_THREADS)
+
+Mutex::Mutex() {
+	CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+	InitializeCriticalSection(cs);
+	_mutex = cs;
+}
+
+Mutex::~Mutex() {
+	CRITICAL_SECTION *cs = (CRITICAL_SECTION *)_mutex;
+	DeleteCriticalSection(cs);
+	delete cs;
+}
+
+void Mutex::lock() {
+	EnterCriticalSection((CRITICAL_SECTION *)_mutex);
+}
+
+void Mutex::unlock() {
+	LeaveCriticalSection((CRITICAL_SECTION *)_mutex);
+}
+
+#elif defined(USE_PTHREADS)
+
+Mutex::Mutex() {
+	pthread_mutex_t *m = new pthread_mutex_t;
+	pthread_mutex_init(m, NULL);
+	_mutex = m;
+}
+
+Mutex::~Mutex() {
+	pthread_mutex_t *m = (pthread_mutex_t *)_mutex;
+	pthread_mutex_destroy(m);
+	delete m;
+}
+
+void Mutex::lock() {
+	pthread_mutex_lock((pthread_mutex_t *)_mutex);
+}
+
+void Mutex::unlock() {
+	pthread_mutex_unlock((pthread_mutex_t *)_mutex);
+}
+
+#else
+
+Mutex::Mutex() : _mutex(NULL) {
+}
+
+Mutex::~Mutex() {
+}
+
+void Mutex::lock() {
+}
+
+void Mutex::unlock() {
+}
+
+#endif
+
+// Thread local pointer implementation
+
+#if defined(USE_WIN32_THREADS)
+
+ThreadLocalPointer::ThreadLocalPointer() {
+	DWORD *index = new DWORD;
+	*index = TlsAlloc();
+	_key = index;
+}
+
+ThreadLocalPointer::~ThreadLocalPointer() {
+	DWORD *index = (DWORD *)_key;
+	TlsFree(*index);
+	delete index;
+}
+
+void *ThreadLocalPointer::get() const {
+	return TlsGetValue(*(DWORD *)_key);
+}
+
+void ThreadLocalPointer::set(void *value) {
+	TlsSetValue(*(DWORD *)_key, value);
+}
+
+#elif defined(USE_PTHREADS)
+
+ThreadLocalPointer::ThreadLocalPointer() {
+	pthread_key_t *key = new pthread_key_t;
+	pthread_key_create(key, NULL);
+	_key = key;
+}
+
+ThreadLocalPointer::~ThreadLocalPointer() {
+	pthread_key_t *key = (pthread_key_t *)_key;
+	pthread_key_delete(*key);
+	delete key;
+}
+
+void *ThreadLocalPointer::get() const {
+	return pthread_getspecific(*(pthread_key_t *)_key);
+}
+
+void ThreadLocalPointer::set(void *value) {
+	pthread_setspecific(*(pthread_key_t *)_key, value);
+}
+
+#else
+
+ThreadLocalPointer::ThreadLocalPointer() : _key(NULL) {
+}
+
+ThreadLocalPointer::~ThreadLocalPointer() {
+}
+
+void *ThreadLocalPointer::get() const {
+	return _key;
+}
+
+void ThreadLocalPointer::set(void *value) {
+	_key = value;
+}
+
+#endif
+
+// Parallel task runner
+
+namespace {
+
+/**
+ * State shared between the workers of a single runParallel() call.
+ */
+struct WorkQueue {
+	enum ErrorType {
+		kNoError,
+		kToolError,
+		kFileError,
+		kAbortError
+	};
+
+	ParallelTask *task;
+	uint count;
+	uint next;
+
+	Mutex mutex;
+	ErrorType errorType;
+	std::string errorMessage;
+	int errorCode;
+
+	/** Fetches the next item to process, returns false if there is none left. */
+	bool fetch(uint &index) {
+		StackLock lock(mutex);
+		if (errorType != kNoError || next >= count)
+			return false;
+		index = next++;
+		return true;
+	}
+
+	/** Records the first error thrown by an item. */
+	void fail(ErrorType type, const std::string &message, int code) {
+		StackLock lock(mutex);
+		if (errorType != kNoError)
+			return;
+		errorType = type;
+		errorMessage = message;
+		errorCode = code;
+	}
+
+	void work() {
+		uint index;
+		while (fetch(index)) {
+			try {
+				task->run(index);
+			} catch (AbortException &) {
+				fail(kAbortError, std::string(), -2);
+			} catch (FileException &err) {
+				fail(kFileError, err.what(), err._retcode);
+			} catch (ToolException &err) {
+				fail(kToolError, err.what(), err._retcode);
+			} catch (std::exception &err) {
+				fail(kToolError, err.what(), -1);
+			}
+		}
+	}
+
+	/** Rethrows the recorded error, if any, in the calling thread. */
+	void rethrow() {
+		switch (errorType) {
+		case kAbortError:
+			throw AbortException();
+		case kFileError:
+			throw FileException(errorMessage, errorCode);
+		case kToolError:
+			throw ToolException(errorMessage, errorCode);
+		default:
+			break;
+		}
+	}
+};
+
+#if defined(USE_WIN32_THREADS)
+DWORD WINAPI workerMain(LPVOID arg) {
+	((WorkQueue *)arg)->work();
+	return 0;
+}
+#elif defined(USE_PTHREADS)
+void *workerMain(void *arg) {
+	((WorkQueue *)arg)->work();
+	return NULL;
+}
+#endif
+
+} // End of anonymous namespace
+
+void runParallel(ParallelTask &task, uint count, uint numThreads) {
+	if (numThreads > count)
+		numThreads = count;
+
+#if !defined(USE_WIN32_THREADS) && !defined(USE_PTHREADS)
+	numThreads = 1;
+#endif
+
+	if (numThreads <= 1) {
+		for (uint i = 0; i < count; i++)
+			task.run(i);
+		return;
+	}
+
+	WorkQueue queue;
+	queue.task = &task;
+	queue.count = count;
+	queue.next = 0;
+	queue.errorType = WorkQueue::kNoError;
+	queue.errorCode = 0;
+
+	// The calling thread does its share of the work too
+#if defined(USE_WIN32_THREADS)
+	std::vector<HANDLE> threads;
+	for (uint i = 1; i < numThreads; i++) {
+		HANDLE thread = CreateThread(NULL, 0, workerMain, &queue, 0, NULL);
+		if (thread)
+			threads.push_back(thread);
+	}
+	queue.work();
+	for (uint i = 0; i < threads.size(); i++) {
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+#elif defined(USE_PTHREADS)
+	std::vector<pthread_t> threads;
+	for (uint i = 1; i < numThreads; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, workerMain, &queue) == 0)
+			threads.push_back(thread);
+	}
+	queue.work();
+	for (uint i = 0; i < threads.size(); i++)
+		pthread_join(threads[i], NULL);
+#endif
+
+	queue.rethrow();
+}
+
+uint getNumProcessors() {
+#if defined(USE_WIN32_THREADS)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (uint)info.dwNumberOfProcessors : 1;
+#elif defined(USE_PTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (uint)n : 1;
+#else
+	return 1;
+#endif
+}
+
+uint32 getMillis() {
+#if defined(WIN32)
+	return GetTickCount();
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint32)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+#endif
+}
+
+uint32 getMicros() {
+#if defined(WIN32)
+	LARGE_INTEGER frequency, counter;
+	if (!QueryPerformanceFrequency(&frequency) || !QueryPerformanceCounter(&counter))
+		return GetTickCount() * 1000;
+	return (uint32)(counter.QuadPart / frequency.QuadPart * 1000000 + counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint32)tv.tv_sec * 1000000 + (uint32)tv.tv_usec;
+#endif
+}
+
+} // End of namespace Common
@@ -0,0 +1,130 @@
+/* ScummVM Tools
+ * Copyright (C) 2002-2009 The ScummVM project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#ifndef COMMON_THREAD_H
+#define COMMON_THREAD_H
+
+#include "common/scummsys.h"
+#include "common/noncopyable.h"
+
+namespace Common {
+
+/**
+ * A simple (non-recursive) mutex.
+ * When the tools are built without thread support, locking is a no-op.
+ */
+class Mutex : public NonCopyable {
+public:
+	Mutex();
+	~Mutex();
+
+	void lock();
+	void unlock();
+
+private:
+	void *_mutex;
+};
+
+/**
+ * Locks a mutex for the lifetime of this object.
+ */
+class StackLock : public NonCopyable {
+public:
+	StackLock(Mutex &mutex) : _mutex(mutex) { _mutex.lock(); }
+	~StackLock() { _mutex.unlock(); }
+
+private:
+	Mutex &_mutex;
+};
+
+/**
+ * A pointer with a separate value for each thread, NULL until it is set.
+ * When the tools are built without thread support, it is a plain pointer.
+ */
+class ThreadLocalPointer : public NonCopyable {
+public:
+	ThreadLocalPointer();
+	~ThreadLocalPointer();
+
+	/** Returns the value of the calling thread. */
+	void *get() const;
+
+	/** Sets the value of the calling thread. */
+	void set(void *value);
+
+private:
+	void *_key;
+};
+
+/**
+ * A batch of independent work items, to be processed by runParallel().
+ */
+class ParallelTask {
+public:
+	virtual ~ParallelTask() {}
+
+	/**
+	 * Processes a single item. This is called from the worker threads, so
+	 * implementations may only modify state belonging to this item, or
+	 * must protect shared state with a Mutex.
+	 *
+	 * @param index The item to process, between 0 and count - 1.
+	 */
+	virtual void run(uint index) = 0;
+};
+
+/**
+ * Processes items 0 to count - 1 of a task on up to numThreads threads,
+ * including the calling one. Items are handed out in increasing order,
+ * and the function returns once all of them are done.
+ *
+ * If an item throws a ToolException, no further items are started and the
+ * exception is rethrown in the calling thread once all running items have
+ * finished. Without thread support, or if numThreads is 1, the items are
+ * simply processed in order on the calling thread.
+ *
+ * @param task       The work to do.
+ * @param count      The number of items.
+ * @param numThreads The maximum number of threads to use.
+ */
+void runParallel(ParallelTask &task, uint count, uint numThreads);
+
+/**
+ * Returns the number of processors available, 1 if it cannot be determined.
+ */
+uint getNumProcessors();
+
+/**
+ * Returns a wall clock time in milliseconds, for measuring how long
+ * something took. The starting point is unspecified and it may wrap.
+ */
+uint32 getMillis();
+
+/**
+ * Returns a wall clock time in microseconds, like getMillis(). As it wraps
+ * after about 71 minutes, it is only meant for measuring short durations.
+ */
+uint32 getMicros();
+
+} // End of namespace Common
+
+#endif
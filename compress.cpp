@@ -32,6 +32,7 @@
 
 #include "compress.h"
 #include "common/endian.h"
+#include "common/thread.h"
 
 #ifdef USE_VORBIS
 #include <vorbis/vorbisenc.h>
@@ -40,6 +41,9 @@
 #define FLAC__NO_DLL 1
 #include <FLAC/stream_encoder.h>
 #endif
+#ifdef USE_LAME
+#include <lame/lame.h>
+#endif
 
 struct lameparams {
 	int32 minBitr;
@@ -67,15 +71,10 @@ struct flaccparams {
 	bool silent;
 };
 
-struct rawtype {
-	bool isLittleEndian, isStereo;
-	uint8 bitsPerSample;
-};
-
 lameparams lameparms = { -1, -1, 32, VBR, algqualDef, vbrqualDef, 0, "lame" };
 oggencparams oggparms = { -1, -1, -1, (float)oggqualDef, 0 };
 flaccparams flacparms = { flacCompressDef, flacBlocksizeDef, false, false };
-rawtype	rawAudioType = { false, false, 8 };
+RawAudioType rawAudioType = { false, false, 8 };
 
 const char *tempEncoded = TEMP_MP3;
 
@@ -120,23 +119,31 @@ static int map2MP3Frequency(int freq) {
 }
 
 void CompressionTool::encodeAudio(const char *inname, bool rawInput, int rawSamplerate, const char *outname, AudioFormat compmode) {
+	encodeAudio(inname, rawInput, rawSamplerate, outname, compmode, rawAudioType);
+}
+
+void CompressionTool::encodeAudio(const char *inname, bool rawInput, int rawSamplerate, const char *outname, AudioFormat compmode, const RawAudioType &rawType) {
+#if !defined(USE_LAME) || !defined(USE_VORBIS) || !defined(USE_FLAC)
+	/* Formats without a linked in library are handled by external encoders */
 	bool err = false;
 	char fbuf[2048];
 	char *tmp = fbuf;
+#endif
 
+#ifndef USE_LAME
 	if (compmode == AUDIO_MP3) {
 		tmp += sprintf(tmp, "%s -t ", lameparms.lamePath.c_str());
 		if (rawInput) {
 			tmp += sprintf(tmp, "-r ");
-			tmp += sprintf(tmp, "--bitwidth %d ", rawAudioType.bitsPerSample);
+			tmp += sprintf(tmp, "--bitwidth %d ", rawType.bitsPerSample);
 
-			if (rawAudioType.isLittleEndian) {
+			if (rawType.isLittleEndian) {
 				tmp += sprintf(tmp, "--little-endian ");
 			} else {
 				tmp += sprintf(tmp, "--big-endian ");
 			}
 
-			tmp += sprintf(tmp, (rawAudioType.isStereo ? "-m j " : "-m m "));
+			tmp += sprintf(tmp, (rawType.isStereo ? "-m j " : "-m m "));
 			tmp += sprintf(tmp, "-s %d ", rawSamplerate);
 		}
 
@@ -183,16 +190,17 @@ void CompressionTool::encodeAudio(const char *inname, bool rawInput, int rawSamp
 			return;
 		}
 	}
+#endif
 
 #ifndef USE_VORBIS
 	if (compmode == AUDIO_VORBIS) {
 		tmp += sprintf(tmp, "oggenc ");
 		if (rawInput) {
 			tmp += sprintf(tmp, "--raw ");
-			tmp += sprintf(tmp, "--raw-chan=%d ", (rawAudioType.isStereo ? 2 : 1));
-			tmp += sprintf(tmp, "--raw-bits=%d ", rawAudioType.bitsPerSample);
+			tmp += sprintf(tmp, "--raw-chan=%d ", (rawType.isStereo ? 2 : 1));
+			tmp += sprintf(tmp, "--raw-bits=%d ", rawType.bitsPerSample);
 			tmp += sprintf(tmp, "--raw-rate=%d ", rawSamplerate);
-			tmp += sprintf(tmp, "--raw-endianness=%d ", (rawAudioType.isLittleEndian ? 0 : 1));
+			tmp += sprintf(tmp, "--raw-endianness=%d ", (rawType.isLittleEndian ? 0 : 1));
 		}
 
 		if (oggparms.nominalBitr != -1) {
@@ -236,11 +244,11 @@ void CompressionTool::encodeAudio(const char *inname, bool rawInput, int rawSamp
 
 		if (rawInput) {
 			tmp += sprintf(tmp, "--force-raw-format ");
-			tmp += sprintf(tmp, "--sign=%s ", ((rawAudioType.bitsPerSample == 8) ? "unsigned" : "signed"));
-			tmp += sprintf(tmp, "--channels=%d ", (rawAudioType.isStereo ? 2 : 1));
-			tmp += sprintf(tmp, "--bps=%d ", rawAudioType.bitsPerSample);
+			tmp += sprintf(tmp, "--sign=%s ", ((rawType.bitsPerSample == 8) ? "unsigned" : "signed"));
+			tmp += sprintf(tmp, "--channels=%d ", (rawType.isStereo ? 2 : 1));
+			tmp += sprintf(tmp, "--bps=%d ", rawType.bitsPerSample);
 			tmp += sprintf(tmp, "--sample-rate=%d ", rawSamplerate);
-			tmp += sprintf(tmp, "--endian=%s ", (rawAudioType.isLittleEndian ? "little" : "big"));
+			tmp += sprintf(tmp, "--endian=%s ", (rawType.isLittleEndian ? "little" : "big"));
 		}
 
 		if (flacparms.silent) {
@@ -276,335 +284,564 @@ void CompressionTool::encodeAudio(const char *inname, bool rawInput, int rawSamp
 		rawData = (char *)malloc(length);
 		inputRaw.read_throwsOnError(rawData, length);
 
-		encodeRaw(rawData, length, rawSamplerate, outname, compmode);
+		encodeRaw(rawData, length, rawSamplerate, outname, compmode, rawType);
 
 		free(rawData);
 	} else {
-		int fmtHeaderSize, length, numChannels, sampleRate, bitsPerSample;
-		char *wavData;
+		std::vector<byte> wavData;
+		std::vector<byte> encoded;
 
 		Common::File inputWav(inname, "rb");
+		wavData.resize(inputWav.size());
+		if (!wavData.empty())
+			inputWav.read_throwsOnError(&wavData[0], wavData.size());
 
-		/* Standard PCM fmt header is 16 bits, but at least Simon 1 and 2 use 18 bits */
-		inputWav.seek(16, SEEK_SET);
-		fmtHeaderSize = inputWav.readUint32LE();
+		encodeWAVToMemory(wavData.empty() ? NULL : &wavData[0], wavData.size(), compmode, encoded);
 
-		inputWav.seek(22, SEEK_SET);
-		numChannels = inputWav.readUint16LE();
-		sampleRate = inputWav.readUint32LE();
+		Common::File output(outname, "wb");
+		if (!encoded.empty())
+			output.write(&encoded[0], encoded.size());
+	}
+}
 
-		inputWav.seek(34, SEEK_SET);
-		bitsPerSample = inputWav.readUint16LE();
+void CompressionTool::encodeRaw(const char *rawData, int length, int samplerate, const char *outname, AudioFormat compmode) {
+	encodeRaw(rawData, length, samplerate, outname, compmode, rawAudioType);
+}
 
-		/* The size of the raw audio is after the RIFF chunk (12 bytes), fmt chunk (8 + fmtHeaderSize bytes), and data chunk id (4 bytes) */
-		inputWav.seek(24 + fmtHeaderSize, SEEK_SET);
-		length = inputWav.readUint32LE();
+void CompressionTool::encodeRaw(const char *rawData, int length, int samplerate, const char *outname, AudioFormat compmode, const RawAudioType &rawType) {
 
-		wavData = (char *)malloc(length);
-		inputWav.read_throwsOnError(wavData, length);
+	print(" - len=%ld, ch=%d, rate=%d, %dbits\n", length, (rawType.isStereo ? 2 : 1), samplerate, rawType.bitsPerSample);
 
-		setRawAudioType(true, numChannels == 2, (uint8)bitsPerSample);
-		encodeRaw(wavData, length, sampleRate, outname, compmode);
+	std::vector<byte> encoded;
+	encodeRawToMemory(rawData, length, samplerate, compmode, rawType, encoded);
 
-		free(wavData);
+	Common::File output(outname, "wb");
+	if (!encoded.empty())
+		output.write(&encoded[0], encoded.size());
+}
+
+/**
+ * Returns true if the encoder for the given format is linked in, and can
+ * thus be used without going through temporary files.
+ */
+static bool hasEncoderLibrary(AudioFormat format) {
+#ifdef USE_LAME
+	if (format == AUDIO_MP3)
+		return true;
+#endif
+#ifdef USE_VORBIS
+	if (format == AUDIO_VORBIS)
+		return true;
+#endif
+#ifdef USE_FLAC
+	if (format == AUDIO_FLAC)
+		return true;
+#endif
+	return false;
+}
+
+/**
+ * Converts raw PCM data into signed 16-bit samples in native byte order.
+ */
+static void convertToInt16(const char *rawData, uint32 length, const RawAudioType &rawType, std::vector<int16> &pcm) {
+	const byte *src = (const byte *)rawData;
+
+	if (rawType.bitsPerSample == 8) {
+		pcm.resize(length);
+		for (uint32 i = 0; i < length; i++)
+			pcm[i] = (int16)((src[i] - 128) << 8);
+	} else if (rawType.bitsPerSample == 16) {
+		pcm.resize(length / 2);
+		if (rawType.isLittleEndian) {
+			for (uint32 i = 0; i < pcm.size(); i++)
+				pcm[i] = (int16)READ_LE_UINT16(src + 2 * i);
+		} else {
+			for (uint32 i = 0; i < pcm.size(); i++)
+				pcm[i] = (int16)READ_BE_UINT16(src + 2 * i);
+		}
+	} else {
+		throw ToolException("Unsupported number of bits per sample");
 	}
 }
 
-void CompressionTool::encodeRaw(const char *rawData, int length, int samplerate, const char *outname, AudioFormat compmode) {
+void CompressionTool::encodeRawToMemory(const char *rawData, uint32 length, int samplerate, AudioFormat compmode, const RawAudioType &rawType, std::vector<byte> &out) {
+	out.clear();
+
+	if (!hasEncoderLibrary(compmode)) {
+		encodeWithExternalEncoder(rawData, length, samplerate, compmode, rawType, out);
+		return;
+	}
 
-	print(" - len=%ld, ch=%d, rate=%d, %dbits\n", length, (rawAudioType.isStereo ? 2 : 1), samplerate, rawAudioType.bitsPerSample);
+	std::vector<int16> pcm;
+	convertToInt16(rawData, length, rawType, pcm);
 
+	int numChannels = (rawType.isStereo ? 2 : 1);
+	encodePCMToMemory(pcm.empty() ? NULL : &pcm[0], pcm.size() / numChannels, numChannels, rawType.bitsPerSample, samplerate, compmode, out);
+}
+
+void CompressionTool::encodeToMemory(const int16 *pcm, uint32 frames, int numChannels, int samplerate, AudioFormat compmode, std::vector<byte> &out) {
+	out.clear();
+
+	if (!hasEncoderLibrary(compmode)) {
+#ifdef SCUMM_LITTLE_ENDIAN
+		RawAudioType nativeType = { true, numChannels == 2, 16 };
+#else
+		RawAudioType nativeType = { false, numChannels == 2, 16 };
+#endif
+		encodeWithExternalEncoder((const char *)pcm, frames * numChannels * 2, samplerate, compmode, nativeType, out);
+		return;
+	}
+
+	encodePCMToMemory(pcm, frames, numChannels, 16, samplerate, compmode, out);
+}
+
+void CompressionTool::encodeWAVToMemory(const byte *wavData, uint32 size, AudioFormat compmode, std::vector<byte> &out) {
+	if (size < 44 || READ_BE_UINT32(wavData) != 0x52494646 || READ_BE_UINT32(wavData + 8) != 0x57415645)
+		error("Invalid WAV data");
+
+	/* Standard PCM fmt header is 16 bits, but at least Simon 1 and 2 use 18 bits */
+	uint32 fmtHeaderSize = READ_LE_UINT32(wavData + 16);
+	int numChannels = READ_LE_UINT16(wavData + 22);
+	int sampleRate = READ_LE_UINT32(wavData + 24);
+	int bitsPerSample = READ_LE_UINT16(wavData + 34);
+
+	/* The size of the raw audio is after the RIFF chunk (12 bytes), fmt chunk (8 + fmtHeaderSize bytes), and data chunk id (4 bytes) */
+	if (24 + fmtHeaderSize + 4 > size)
+		error("Invalid WAV data");
+	uint32 length = READ_LE_UINT32(wavData + 24 + fmtHeaderSize);
+	const byte *samples = wavData + 28 + fmtHeaderSize;
+
+	if (length > size - (28 + fmtHeaderSize))
+		error("Truncated WAV data");
+
+	RawAudioType wavType = { true, numChannels == 2, (uint8)bitsPerSample };
+	encodeRawToMemory((const char *)samples, length, sampleRate, compmode, wavType, out);
+}
+
+void CompressionTool::encodePCMToMemory(const int16 *pcm, uint32 frames, int numChannels, int bitsPerSample, int samplerate, AudioFormat compmode, std::vector<byte> &out) {
+	switch (compmode) {
+#ifdef USE_LAME
+	case AUDIO_MP3:
+		encodeMP3ToMemory(pcm, frames, numChannels, samplerate, out);
+		break;
+#endif
 #ifdef USE_VORBIS
-	if (compmode == AUDIO_VORBIS) {
-		char outputString[256] = "";
-		int numChannels = (rawAudioType.isStereo ? 2 : 1);
-		int totalSamples = length / ((rawAudioType.bitsPerSample / 8) * numChannels);
-		int samplesLeft = totalSamples;
-		int eos = 0;
-		int totalBytes = 0;
-
-		vorbis_info vi;
-		vorbis_comment vc;
-		vorbis_dsp_state vd;
-		vorbis_block vb;
-
-		ogg_stream_state os;
-		ogg_page og;
-		ogg_packet op;
-
-		ogg_packet header;
-		ogg_packet header_comm;
-		ogg_packet header_code;
-
-		Common::File outputOgg(outname, "wb");
-
-		vorbis_info_init(&vi);
-
-		if (oggparms.nominalBitr > 0) {
-			int result = 0;
-
-			/* Input is in kbps, function takes bps */
-			result = vorbis_encode_setup_managed(&vi, numChannels, samplerate, (oggparms.maxBitr > 0 ? 1000 * oggparms.maxBitr : -1), (1000 * oggparms.nominalBitr), (oggparms.minBitr > 0 ? 1000 * oggparms.minBitr : -1));
-
-			if (result == OV_EFAULT) {
-				vorbis_info_clear(&vi);
-				error("Error: Internal Logic Fault");
-			} else if ((result == OV_EINVAL) || (result == OV_EIMPL)) {
-				vorbis_info_clear(&vi);
-				error("Error: Invalid bitrate parameters");
+	case AUDIO_VORBIS:
+		encodeVorbisToMemory(pcm, frames, numChannels, samplerate, out);
+		break;
+#endif
+#ifdef USE_FLAC
+	case AUDIO_FLAC:
+		encodeFlacToMemory(pcm, frames, numChannels, bitsPerSample, samplerate, out);
+		break;
+#endif
+	default:
+		throw ToolException("Unknown audio format");
+	}
+}
+
+/** Counter used to give each external encoder run its own temporary files. */
+static uint tempFileCounter = 0;
+static Common::Mutex tempFileMutex;
+
+void CompressionTool::encodeWithExternalEncoder(const char *rawData, uint32 length, int samplerate, AudioFormat compmode, const RawAudioType &rawType, std::vector<byte> &out) {
+	uint id;
+	{
+		Common::StackLock lock(tempFileMutex);
+		id = tempFileCounter++;
+	}
+
+	char rawName[32];
+	char encodedName[32];
+	sprintf(rawName, "tempenc%u.raw", id);
+	sprintf(encodedName, "tempenc%u%s", id, audio_extensions(compmode));
+
+	Common::File raw(rawName, "wb");
+	if (length)
+		raw.write(rawData, length);
+	raw.close();
+
+	try {
+		encodeAudio(rawName, true, samplerate, encodedName, compmode, rawType);
+
+		Common::File encoded(encodedName, "rb");
+		out.resize(encoded.size());
+		if (!out.empty())
+			encoded.read_throwsOnError(&out[0], out.size());
+	} catch (...) {
+		Common::removeFile(rawName);
+		Common::removeFile(encodedName);
+		throw;
+	}
+
+	Common::removeFile(rawName);
+	Common::removeFile(encodedName);
+}
+
+#ifdef USE_VORBIS
+static void appendOggPage(std::vector<byte> &out, const ogg_page &og) {
+	out.insert(out.end(), og.header, og.header + og.header_len);
+	out.insert(out.end(), og.body, og.body + og.body_len);
+}
+
+void CompressionTool::encodeVorbisToMemory(const int16 *pcm, uint32 frames, int numChannels, int samplerate, std::vector<byte> &out) {
+	char outputString[256] = "";
+	uint32 samplesLeft = frames;
+	int eos = 0;
+
+	vorbis_info vi;
+	vorbis_comment vc;
+	vorbis_dsp_state vd;
+	vorbis_block vb;
+
+	ogg_stream_state os;
+	ogg_page og;
+	ogg_packet op;
+
+	ogg_packet header;
+	ogg_packet header_comm;
+	ogg_packet header_code;
+
+	vorbis_info_init(&vi);
+
+	if (oggparms.nominalBitr > 0) {
+		int result = 0;
+
+		/* Input is in kbps, function takes bps */
+		result = vorbis_encode_setup_managed(&vi, numChannels, samplerate, (oggparms.maxBitr > 0 ? 1000 * oggparms.maxBitr : -1), (1000 * oggparms.nominalBitr), (oggparms.minBitr > 0 ? 1000 * oggparms.minBitr : -1));
+
+		if (result == OV_EFAULT) {
+			vorbis_info_clear(&vi);
+			error("Error: Internal Logic Fault");
+		} else if ((result == OV_EINVAL) || (result == OV_EIMPL)) {
+			vorbis_info_clear(&vi);
+			error("Error: Invalid bitrate parameters");
+		}
+
+		if (!oggparms.silent) {
+			sprintf(outputString, "Encoding at average bitrate %i kbps (", oggparms.nominalBitr);
+
+			if (oggparms.minBitr > 0) {
+				sprintf(outputString + strlen(outputString), "min %i kbps, ", oggparms.minBitr);
+			} else {
+				sprintf(outputString + strlen(outputString), "no min, ");
 			}
 
+			if (oggparms.maxBitr > 0) {
+				sprintf(outputString + strlen(outputString), "max %i kbps),\nusing full bitrate management engine\nSet optional hard quality restrictions\n", oggparms.maxBitr);
+			} else {
+				sprintf(outputString + strlen(outputString), "no max),\nusing full bitrate management engine\nSet optional hard quality restrictions\n");
+			}
+		}
+	} else {
+		int result = 0;
+
+		/* Quality input is -1 - 10, function takes -0.1 through 1.0 */
+		result = vorbis_encode_setup_vbr(&vi, numChannels, samplerate, oggparms.quality * 0.1f);
+
+		if (result == OV_EFAULT) {
+			vorbis_info_clear(&vi);
+			error("Internal Logic Fault");
+		} else if ((result == OV_EINVAL) || (result == OV_EIMPL)) {
+			vorbis_info_clear(&vi);
+			error("Invalid bitrate parameters");
+		}
+
+		if (!oggparms.silent) {
+			sprintf(outputString, "Encoding at quality %2.2f", oggparms.quality);
+		}
+
+		if ((oggparms.minBitr > 0) || (oggparms.maxBitr > 0)) {
+			struct ovectl_ratemanage_arg extraParam;
+			vorbis_encode_ctl(&vi, OV_ECTL_RATEMANAGE_GET, &extraParam);
+
+			extraParam.bitrate_hard_min = (oggparms.minBitr > 0 ? (1000 * oggparms.minBitr) : -1);
+			extraParam.bitrate_hard_max = (oggparms.maxBitr > 0 ? (1000 * oggparms.maxBitr) : -1);
+			extraParam.management_active = 1;
+
+			vorbis_encode_ctl(&vi, OV_ECTL_RATEMANAGE_SET, &extraParam);
+
 			if (!oggparms.silent) {
-				sprintf(outputString, "Encoding to\n         \"%s\"\nat average bitrate %i kbps (", outname, oggparms.nominalBitr);
+				sprintf(outputString + strlen(outputString), " using constrained VBR (");
 
-				if (oggparms.minBitr > 0) {
+				if (oggparms.minBitr != -1) {
 					sprintf(outputString + strlen(outputString), "min %i kbps, ", oggparms.minBitr);
 				} else {
 					sprintf(outputString + strlen(outputString), "no min, ");
 				}
 
-				if (oggparms.maxBitr > 0) {
-					sprintf(outputString + strlen(outputString), "max %i kbps),\nusing full bitrate management engine\nSet optional hard quality restrictions\n", oggparms.maxBitr);
+				if (oggparms.maxBitr != -1) {
+					sprintf(outputString + strlen(outputString), "max %i kbps)\nSet optional hard quality restrictions\n", oggparms.maxBitr);
 				} else {
-					sprintf(outputString + strlen(outputString), "no max),\nusing full bitrate management engine\nSet optional hard quality restrictions\n");
+					sprintf(outputString + strlen(outputString), "no max)\nSet optional hard quality restrictions\n");
 				}
 			}
 		} else {
-			int result = 0;
+			sprintf(outputString + strlen(outputString), "\n");
+		}
+	}
 
-			/* Quality input is -1 - 10, function takes -0.1 through 1.0 */
-			result = vorbis_encode_setup_vbr(&vi, numChannels, samplerate, oggparms.quality * 0.1f);
+	if (!oggparms.silent)
+		print("%s\n", outputString);
 
-			if (result == OV_EFAULT) {
-				vorbis_info_clear(&vi);
-				error("Internal Logic Fault");
-			} else if ((result == OV_EINVAL) || (result == OV_EIMPL)) {
-				vorbis_info_clear(&vi);
-				error("Invalid bitrate parameters");
-			}
+	vorbis_encode_setup_init(&vi);
+	vorbis_comment_init(&vc);
+	vorbis_analysis_init(&vd, &vi);
+	vorbis_block_init(&vd, &vb);
+	ogg_stream_init(&os, 0);
+	vorbis_analysis_headerout(&vd, &vc, &header, &header_comm, &header_code);
 
-			if (!oggparms.silent) {
-				sprintf(outputString, "Encoding to\n         \"%s\"\nat quality %2.2f", outname, oggparms.quality);
+	ogg_stream_packetin(&os, &header);
+	ogg_stream_packetin(&os, &header_comm);
+	ogg_stream_packetin(&os, &header_code);
+
+	while (ogg_stream_flush(&os, &og) != 0)
+		appendOggPage(out, og);
+
+	while (!eos) {
+		uint32 numSamples = ((samplesLeft < 2048) ? samplesLeft : 2048);
+		float **buffer = vorbis_analysis_buffer(&vd, numSamples);
+
+		/* We must tell the encoder that we have reached the end of the stream */
+		if (numSamples == 0) {
+			vorbis_analysis_wrote(&vd, 0);
+		} else {
+			for (uint32 i = 0; i < numSamples; i++) {
+				for (int j = 0; j < numChannels; j++) {
+					buffer[j][i] = pcm[i * numChannels + j] / 32768.0f;
+				}
 			}
 
-			if ((oggparms.minBitr > 0) || (oggparms.maxBitr > 0)) {
-				struct ovectl_ratemanage_arg extraParam;
-				vorbis_encode_ctl(&vi, OV_ECTL_RATEMANAGE_GET, &extraParam);
+			vorbis_analysis_wrote(&vd, numSamples);
+		}
 
-				extraParam.bitrate_hard_min = (oggparms.minBitr > 0 ? (1000 * oggparms.minBitr) : -1);
-				extraParam.bitrate_hard_max = (oggparms.maxBitr > 0 ? (1000 * oggparms.maxBitr) : -1);
-				extraParam.management_active = 1;
+		while (vorbis_analysis_blockout(&vd, &vb) == 1) {
+			vorbis_analysis(&vb, NULL);
+			vorbis_bitrate_addblock(&vb);
 
-				vorbis_encode_ctl(&vi, OV_ECTL_RATEMANAGE_SET, &extraParam);
+			while (vorbis_bitrate_flushpacket(&vd, &op)) {
+				ogg_stream_packetin(&os, &op);
 
-				if (!oggparms.silent) {
-					sprintf(outputString + strlen(outputString), " using constrained VBR (");
+				while (!eos) {
+					int result = ogg_stream_pageout(&os, &og);
 
-					if (oggparms.minBitr != -1) {
-						sprintf(outputString + strlen(outputString), "min %i kbps, ", oggparms.minBitr);
-					} else {
-						sprintf(outputString + strlen(outputString), "no min, ");
+					if (result == 0) {
+						break;
 					}
 
-					if (oggparms.maxBitr != -1) {
-						sprintf(outputString + strlen(outputString), "max %i kbps)\nSet optional hard quality restrictions\n", oggparms.maxBitr);
-					} else {
-						sprintf(outputString + strlen(outputString), "no max)\nSet optional hard quality restrictions\n");
+					appendOggPage(out, og);
+
+					if (ogg_page_eos(&og)) {
+						eos = 1;
 					}
 				}
-			} else {
-				sprintf(outputString + strlen(outputString), "\n");
 			}
 		}
 
-		puts(outputString);
+		pcm += numSamples * numChannels;
+		samplesLeft -= numSamples;
+	}
+
+	ogg_stream_clear(&os);
+	vorbis_block_clear(&vb);
+	vorbis_dsp_clear(&vd);
+	vorbis_comment_clear(&vc);
+	vorbis_info_clear(&vi);
+
+	if (!oggparms.silent) {
+		print("\n\tFile length:  %dm %ds\n", (int)(frames / samplerate / 60), (int)(frames / samplerate % 60));
+		print("\tAverage bitrate: %.1f kb/s\n\n", (8.0 * (double)out.size() / 1000.0) / ((double)frames / (double)samplerate));
+	}
+}
+#endif
+
+#ifdef USE_FLAC
+/**
+ * Output of the FLAC encoder. The encoder seeks back to update the
+ * STREAMINFO block once it is done, so writes may overwrite earlier data.
+ */
+struct FlacMemorySink {
+	std::vector<byte> *data;
+	size_t pos;
+};
 
-		vorbis_encode_setup_init(&vi);
-		vorbis_comment_init(&vc);
-		vorbis_analysis_init(&vd, &vi);
-		vorbis_block_init(&vd, &vb);
-		ogg_stream_init(&os, 0);
-		vorbis_analysis_headerout(&vd, &vc, &header, &header_comm, &header_code);
+static FLAC__StreamEncoderWriteStatus flacWriteCallback(const FLAC__StreamEncoder *, const FLAC__byte buffer[], size_t bytes, unsigned, unsigned, void *clientData) {
+	FlacMemorySink *sink = (FlacMemorySink *)clientData;
 
-		ogg_stream_packetin(&os, &header);
-		ogg_stream_packetin(&os, &header_comm);
-		ogg_stream_packetin(&os, &header_code);
+	if (sink->pos + bytes > sink->data->size())
+		sink->data->resize(sink->pos + bytes);
+	if (bytes)
+		memcpy(&(*sink->data)[sink->pos], buffer, bytes);
+	sink->pos += bytes;
 
-		while (!eos) {
-			int result = ogg_stream_flush(&os,&og);
+	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
 
-			if (result == 0) {
-				break;
-			}
+static FLAC__StreamEncoderSeekStatus flacSeekCallback(const FLAC__StreamEncoder *, FLAC__uint64 absoluteByteOffset, void *clientData) {
+	FlacMemorySink *sink = (FlacMemorySink *)clientData;
 
-			outputOgg.write(og.header, og.header_len);
-			outputOgg.write(og.body, og.body_len);
-		}
+	if (absoluteByteOffset > sink->data->size())
+		return FLAC__STREAM_ENCODER_SEEK_STATUS_ERROR;
+	sink->pos = (size_t)absoluteByteOffset;
 
-		while (!eos) {
-			int numSamples = ((samplesLeft < 2048) ? samplesLeft : 2048);
-			float **buffer = vorbis_analysis_buffer(&vd, numSamples);
+	return FLAC__STREAM_ENCODER_SEEK_STATUS_OK;
+}
 
-			/* We must tell the encoder that we have reached the end of the stream */
-			if (numSamples == 0) {
-				vorbis_analysis_wrote(&vd, 0);
-			} else {
-				/* Adapted from oggenc 1.1.1 */
-				if (rawAudioType.bitsPerSample == 8) {
-					const byte *rawDataUnsigned = (const byte *)rawData;
-					for (int i = 0; i < numSamples; i++) {
-						for (int j = 0; j < numChannels; j++) {
-							buffer[j][i] = ((int)(rawDataUnsigned[i * numChannels + j]) - 128) / 128.0f;
-						}
-					}
-				} else if (rawAudioType.bitsPerSample == 16) {
-					if (rawAudioType.isLittleEndian) {
-						for (int i = 0; i < numSamples; i++) {
-							for (int j = 0; j < numChannels; j++) {
-								buffer[j][i] = ((rawData[(i * 2 * numChannels) + (2 * j) + 1] << 8) | (rawData[(i * 2 * numChannels) + (2 * j)] & 0xff)) / 32768.0f;
-							}
-						}
-					} else {
-						for (int i = 0; i < numSamples; i++) {
-							for (int j = 0; j < numChannels; j++) {
-								buffer[j][i] = ((rawData[(i * 2 * numChannels) + (2 * j)] << 8) | (rawData[(i * 2 * numChannels) + (2 * j) + 1] & 0xff)) / 32768.0f;
-							}
-						}
-					}
-				}
+static FLAC__StreamEncoderTellStatus flacTellCallback(const FLAC__StreamEncoder *, FLAC__uint64 *absoluteByteOffset, void *clientData) {
+	FlacMemorySink *sink = (FlacMemorySink *)clientData;
+	*absoluteByteOffset = sink->pos;
 
-				vorbis_analysis_wrote(&vd, numSamples);
-			}
+	return FLAC__STREAM_ENCODER_TELL_STATUS_OK;
+}
 
-			while (vorbis_analysis_blockout(&vd, &vb) == 1) {
-				vorbis_analysis(&vb, NULL);
-				vorbis_bitrate_addblock(&vb);
+void CompressionTool::encodeFlacToMemory(const int16 *pcm, uint32 frames, int numChannels, int bitsPerSample, int samplerate, std::vector<byte> &out) {
+	FLAC__StreamEncoder *encoder;
+	FLAC__StreamEncoderInitStatus initStatus;
+	FlacMemorySink sink = { &out, 0 };
 
-				while (vorbis_bitrate_flushpacket(&vd, &op)) {
-					ogg_stream_packetin(&os, &op);
+	/* 8-bit input is encoded as such, so scale the samples back down */
+	std::vector<FLAC__int32> flacData(frames * numChannels);
+	for (uint32 i = 0; i < flacData.size(); i++)
+		flacData[i] = (bitsPerSample == 8) ? pcm[i] / 256 : pcm[i];
 
-					while (!eos) {
-						int result = ogg_stream_pageout(&os, &og);
+	if (!flacparms.silent) {
+		print("Encoding at compression level %d using blocksize %d\n\n", flacparms.compressionLevel, flacparms.blocksize);
+	}
 
-						if (result == 0) {
-							break;
-						}
+	encoder = FLAC__stream_encoder_new();
 
-						totalBytes += outputOgg.write(og.header, og.header_len);
-						totalBytes += outputOgg.write(og.body, og.body_len);
+	FLAC__stream_encoder_set_bits_per_sample(encoder, bitsPerSample);
+	FLAC__stream_encoder_set_blocksize(encoder, flacparms.blocksize);
+	FLAC__stream_encoder_set_channels(encoder, numChannels);
+	FLAC__stream_encoder_set_compression_level(encoder, flacparms.compressionLevel);
+	FLAC__stream_encoder_set_sample_rate(encoder, samplerate);
+	FLAC__stream_encoder_set_streamable_subset(encoder, false);
+	FLAC__stream_encoder_set_total_samples_estimate(encoder, frames);
+	FLAC__stream_encoder_set_verify(encoder, flacparms.verify);
 
-						if (ogg_page_eos(&og)) {
-							eos = 1;
-						}
-					}
-				}
-			}
+	initStatus = FLAC__stream_encoder_init_stream(encoder, flacWriteCallback, flacSeekCallback, flacTellCallback, NULL, &sink);
 
-			rawData += 2048 * (rawAudioType.bitsPerSample / 8) * numChannels;
-			samplesLeft -= 2048;
-		}
+	if (initStatus != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+		char buf[2048];
+		sprintf(buf, "Error in FLAC encoder. (check the parameters)\nExact error was:%s\n", FLAC__StreamEncoderInitStatusString[initStatus]);
+		FLAC__stream_encoder_delete(encoder);
+		throw ToolException(buf);
+	}
 
-		ogg_stream_clear(&os);
-		vorbis_block_clear(&vb);
-		vorbis_dsp_clear(&vd);
-		vorbis_info_clear(&vi);
+	if (frames)
+		FLAC__stream_encoder_process_interleaved(encoder, &flacData[0], frames);
 
-		if (!oggparms.silent) {
-			print("\nDone encoding file \"%s\"\n", outname);
-			print("\n\tFile length:  %dm %ds\n", (int)(totalSamples / samplerate / 60), (totalSamples / samplerate % 60));
-			print("\tAverage bitrate: %.1f kb/s\n\n", (8.0 * (double)totalBytes / 1000.0) / ((double)totalSamples / (double)samplerate));
-		}
+	FLAC__stream_encoder_finish(encoder);
+	FLAC__stream_encoder_delete(encoder);
+
+	if (!flacparms.silent) {
+		print("\n\tFile length:  %dm %ds\n\n", (int)(frames / samplerate / 60), (int)(frames / samplerate % 60));
 	}
+}
 #endif
 
-#ifdef USE_FLAC
-	if (compmode == AUDIO_FLAC) {
-		int i;
-		int numChannels = (rawAudioType.isStereo ? 2 : 1);
-		int samplesPerChannel = length / ((rawAudioType.bitsPerSample / 8) * numChannels);
-		FLAC__StreamEncoder *encoder;
-		FLAC__StreamEncoderInitStatus initStatus;
-		FLAC__int32 *flacData;
-
-		flacData = (FLAC__int32 *)malloc(samplesPerChannel * numChannels * sizeof(FLAC__int32));
-
-		if (rawAudioType.bitsPerSample == 8) {
-			for (i = 0; i < samplesPerChannel * numChannels; i++) {
-				FLAC__uint8 *rawDataUnsigned;
-				rawDataUnsigned = (FLAC__uint8 *)rawData;
-				flacData[i] = (FLAC__int32)rawDataUnsigned[i] - 0x80;
-			}
-		} else if (rawAudioType.bitsPerSample == 16) {
-			/* The rawData pointer is an 8-bit char so we must create a new pointer to access 16-bit samples */
-			FLAC__int16 *rawData16;
-			rawData16 = (FLAC__int16 *)rawData;
-			for (i = 0; i < samplesPerChannel * numChannels; i++) {
-				flacData[i] = (FLAC__int32)rawData16[i];
-			}
-		}
+#ifdef USE_LAME
+/** Older LAME versions set up shared tables while initializing an encoder. */
+static Common::Mutex lameInitMutex;
 
-		if (!flacparms.silent) {
-			print("Encoding to\n         \"%s\"\nat compression level %d using blocksize %d\n\n", outname, flacparms.compressionLevel, flacparms.blocksize);
-		}
+void CompressionTool::encodeMP3ToMemory(const int16 *pcm, uint32 frames, int numChannels, int samplerate, std::vector<byte> &out) {
+	lame_global_flags *gfp;
 
-		encoder = FLAC__stream_encoder_new();
+	{
+		Common::StackLock lock(lameInitMutex);
 
-		FLAC__stream_encoder_set_bits_per_sample(encoder, rawAudioType.bitsPerSample);
-		FLAC__stream_encoder_set_blocksize(encoder, flacparms.blocksize);
-		FLAC__stream_encoder_set_channels(encoder, numChannels);
-		FLAC__stream_encoder_set_compression_level(encoder, flacparms.compressionLevel);
-		FLAC__stream_encoder_set_sample_rate(encoder, samplerate);
-		FLAC__stream_encoder_set_streamable_subset(encoder, false);
-		FLAC__stream_encoder_set_total_samples_estimate(encoder, samplesPerChannel);
-		FLAC__stream_encoder_set_verify(encoder, flacparms.verify);
+		gfp = lame_init();
+		if (!gfp)
+			error("Unable to initialize the MP3 encoder");
 
-		initStatus = FLAC__stream_encoder_init_file(encoder, outname, NULL, NULL);
+		lame_set_num_channels(gfp, numChannels);
+		lame_set_in_samplerate(gfp, samplerate);
+		lame_set_mode(gfp, (numChannels == 2 ? JOINT_STEREO : MONO));
 
-		if (initStatus != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
-			char buf[2048];
-			sprintf(buf, "Error in FLAC encoder. (check the parameters)\nExact error was:%s\n", FLAC__StreamEncoderInitStatusString[initStatus]);
-			free(flacData);
-			throw ToolException(buf);
+		/* Same workaround for odd sample rates as in encodeAudio() */
+		lame_set_out_samplerate(gfp, map2MP3Frequency(97 * samplerate / 100));
+
+		if (lameparms.type == CBR) {
+			lame_set_VBR(gfp, vbr_off);
+			lame_set_brate(gfp, lameparms.targetBitr);
 		} else {
-			FLAC__stream_encoder_process_interleaved(encoder, flacData, samplesPerChannel);
+			if (lameparms.type == ABR) {
+				lame_set_VBR(gfp, vbr_abr);
+				lame_set_VBR_mean_bitrate_kbps(gfp, lameparms.targetBitr);
+			} else {
+				lame_set_VBR(gfp, vbr_mtrh);
+				lame_set_VBR_q(gfp, lameparms.vbrqual);
+			}
+
+			if (lameparms.minBitr != -1)
+				lame_set_VBR_min_bitrate_kbps(gfp, lameparms.minBitr);
+			if (lameparms.maxBitr != -1)
+				lame_set_VBR_max_bitrate_kbps(gfp, lameparms.maxBitr);
 		}
 
-		FLAC__stream_encoder_finish(encoder);
-		FLAC__stream_encoder_delete(encoder);
+		lame_set_quality(gfp, lameparms.algqual);
 
-		free(flacData);
+		/* Like "lame -t", ScummVM does not expect a Xing/LAME tag frame */
+		lame_set_bWriteVbrTag(gfp, 0);
 
-		if (!flacparms.silent) {
-			print("\nDone encoding file \"%s\"\n", outname);
-			print("\n\tFile length:  %dm %ds\n\n", (int)(samplesPerChannel / samplerate / 60), (samplesPerChannel / samplerate % 60));
+		if (lame_init_params(gfp) < 0) {
+			lame_close(gfp);
+			error("Error in MP3 encoder. (check parameters)");
 		}
 	}
-#endif
+
+	const uint32 chunkFrames = 4096;
+	/* Worst case output size, as documented in lame.h */
+	std::vector<unsigned char> buffer(5 * chunkFrames / 4 + 7200);
+	int written;
+
+	for (uint32 done = 0; done < frames; done += chunkFrames) {
+		int numFrames = (frames - done < chunkFrames) ? (int)(frames - done) : (int)chunkFrames;
+		short *chunk = (short *)(pcm + done * numChannels);
+
+		if (numChannels == 2)
+			written = lame_encode_buffer_interleaved(gfp, chunk, numFrames, &buffer[0], buffer.size());
+		else
+			written = lame_encode_buffer(gfp, chunk, chunk, numFrames, &buffer[0], buffer.size());
+
+		if (written < 0) {
+			lame_close(gfp);
+			error("Error in MP3 encoder (error code %d)", written);
+		}
+		out.insert(out.end(), buffer.begin(), buffer.begin() + written);
+	}
+
+	written = lame_encode_flush(gfp, &buffer[0], buffer.size());
+	if (written > 0)
+		out.insert(out.end(), buffer.begin(), buffer.begin() + written);
+
+	lame_close(gfp);
 }
+#endif
 
 void CompressionTool::extractAndEncodeWAV(const char *outName, Common::File &input, AudioFormat compMode) {
+	std::vector<byte> encoded;
+	extractAndEncodeWAV(input, compMode, encoded);
+
+	Common::File f(tempEncoded, "wb");
+	if (!encoded.empty())
+		f.write(&encoded[0], encoded.size());
+}
+
+void CompressionTool::extractAndEncodeWAV(Common::File &input, AudioFormat compMode, std::vector<byte> &out) {
 	unsigned int length;
-	char fbuf[2048];
-	size_t size;
 
 	input.seek(-4, SEEK_CUR);
 	length = input.readUint32LE();
 	length += 8;
 	input.seek(-8, SEEK_CUR);
 
-	/* Copy the WAV data to a temporary file */
-	Common::File f(outName, "wb");
-	while (length > 0) {
-		size = input.read_noThrow(fbuf, length > sizeof(fbuf) ? sizeof(fbuf) : length);
-		if (size <= 0)
-			break;
-		length -= (int)size;
-		f.write(fbuf, size);
-	}
-	f.close();
+	/* Read the whole WAV file into memory */
+	std::vector<byte> wavData(length);
+	if (length)
+		wavData.resize(input.read_noThrow(&wavData[0], length));
 
-	/* Convert the WAV temp file to OGG/MP3 */
-	encodeAudio(outName, false, -1, tempEncoded, compMode);
+	encodeWAVToMemory(wavData.empty() ? NULL : &wavData[0], wavData.size(), compMode, out);
 }
 
 void CompressionTool::extractAndEncodeAIFF(const char *inName, const char *outName, AudioFormat compmode) {
@@ -678,26 +915,39 @@ void CompressionTool::extractAndEncodeAIFF(const char *inName, const char *outNa
 	if (offset != 0 || blockSize != 0)
 		error("Error: AIFF file has block-aligned data, which is not supported");
 
-	// Get data and write to temporary file
+	// Get data and convert it to MP3/OGG/FLAC
 	uint32 size = numSampleFrames * numChannels * (bitsPerSample / 8);
 	inFile.seek(soundOffset, SEEK_SET);
 	char *aifData = (char *)malloc(size);
 	inFile.read_throwsOnError(aifData, size);
-	Common::File tmpFile(TEMP_RAW, "wb");
-	tmpFile.write(aifData, size);
-	tmpFile.close();
-	free(aifData);
 
-	// Convert the temporary raw file to MP3/OGG/FLAC
 	// Samples are always signed, and big endian.
-	setRawAudioType(false, numChannels == 2, bitsPerSample);
-	encodeAudio(TEMP_RAW, true, sampleRate, outName, compmode);
+	RawAudioType aifType = { false, numChannels == 2, (uint8)bitsPerSample };
+	encodeRaw(aifData, size, sampleRate, outName, compmode, aifType);
 
-	// Delete temporary file
-	Common::removeFile(TEMP_RAW);
+	free(aifData);
 }
 
 void CompressionTool::extractAndEncodeVOC(const char *outName, Common::File &input, AudioFormat compMode) {
+	std::vector<byte> encoded;
+	extractAndEncodeVOC(input, compMode, encoded);
+
+	Common::File f(tempEncoded, "wb");
+	if (!encoded.empty())
+		f.write(&encoded[0], encoded.size());
+}
+
+void CompressionTool::extractAndEncodeVOC(Common::File &input, AudioFormat compMode, std::vector<byte> &out) {
+	std::vector<byte> rawData;
+	int samplerate = extractVOC(input, rawData);
+
+	setRawAudioType(false, false, 8);
+
+	/* Convert the raw data to OGG/MP3 */
+	encodeRawToMemory(rawData.empty() ? NULL : (const char *)&rawData[0], rawData.size(), samplerate, compMode, rawAudioType, out);
+}
+
+int CompressionTool::extractVOC(Common::File &input, std::vector<byte> &rawData) {
 	int bits;
 	int blocktype;
 	int channels;
@@ -708,8 +958,6 @@ void CompressionTool::extractAndEncodeVOC(const char *outName, Common::File &inp
 	size_t size;
 	int real_samplerate = -1;
 
-	Common::File f(outName, "wb");
-
 	while ((blocktype = input.readByte())) {
 		if (blocktype != 1 && blocktype != 9) {
 			/*
@@ -759,7 +1007,7 @@ void CompressionTool::extractAndEncodeVOC(const char *outName, Common::File &inp
 			error("Cannot handle compressed VOC data");
 		}
 
-		/* Copy the raw data to a temporary file */
+		/* Collect the raw data */
 		while (length > 0) {
 			size = input.read_noThrow(fbuf, length > sizeof(fbuf) ? sizeof(fbuf) : (uint32)length);
 
@@ -768,18 +1016,81 @@ void CompressionTool::extractAndEncodeVOC(const char *outName, Common::File &inp
 			}
 
 			length -= (int)size;
-			f.write(fbuf, size);
+			rawData.insert(rawData.end(), (byte *)fbuf, (byte *)fbuf + size);
 		}
 	}
 
-	f.close();
-
 	assert(real_samplerate != -1);
 
-	setRawAudioType(false, false, 8);
+	return real_samplerate;
+}
+
+/**
+ * Encodes the jobs of a CompressionTool's audio queue, see encodeQueuedAudio().
+ */
+class AudioJobTask : public Common::ParallelTask {
+public:
+	AudioJobTask(CompressionTool *tool) : _tool(tool) {}
+
+	virtual void run(uint index) {
+		_tool->encodeJob(_tool->_audioQueue[index]);
+	}
+
+private:
+	CompressionTool *_tool;
+};
+
+uint CompressionTool::queueAudio(const void *rawData, uint32 length, int samplerate) {
+	_audioQueue.push_back(AudioJob());
+
+	AudioJob &job = _audioQueue.back();
+	job.rawData.assign((const byte *)rawData, (const byte *)rawData + length);
+	job.rawType = rawAudioType;
+	job.samplerate = samplerate;
+
+	return _audioQueue.size() - 1;
+}
+
+uint CompressionTool::queueAudio(std::vector<byte> &rawData, int samplerate) {
+	_audioQueue.push_back(AudioJob());
+
+	AudioJob &job = _audioQueue.back();
+	job.rawData.swap(rawData);
+	job.rawType = rawAudioType;
+	job.samplerate = samplerate;
+
+	return _audioQueue.size() - 1;
+}
 
-	/* Convert the raw temp file to OGG/MP3 */
-	encodeAudio(outName, true, real_samplerate, tempEncoded, compMode);
+void CompressionTool::encodeQueuedAudio() {
+	AudioJobTask task(this);
+	Common::runParallel(task, _audioQueue.size(), _numJobs);
+}
+
+const std::vector<byte> &CompressionTool::getEncodedAudio(uint index) const {
+	assert(index < _audioQueue.size());
+	return _audioQueue[index].encoded;
+}
+
+uint CompressionTool::getQueuedAudioCount() const {
+	return _audioQueue.size();
+}
+
+bool CompressionTool::isAudioQueueFull() const {
+	// Queue a few jobs per thread, so that short and long samples even out
+	return _audioQueue.size() >= 4 * (_numJobs > 0 ? _numJobs : 1);
+}
+
+void CompressionTool::clearAudioQueue() {
+	_audioQueue.clear();
+}
+
+void CompressionTool::encodeJob(AudioJob &job) {
+	const char *rawData = job.rawData.empty() ? NULL : (const char *)&job.rawData[0];
+	encodeRawToMemory(rawData, job.rawData.size(), job.samplerate, _format, job.rawType, job.encoded);
+
+	// The raw data is not needed anymore
+	std::vector<byte>().swap(job.rawData);
 }
 
 // mp3 settings
@@ -1088,6 +1399,7 @@ bool CompressionTool::processFlacParms(){
 CompressionTool::CompressionTool(const std::string &name, ToolType type) : Tool(name, type) {
 	_supportedFormats = AUDIO_ALL;
 	_format = AUDIO_MP3;
+	_numJobs = 1;
 }
 
 void CompressionTool::parseAudioArguments() {
@@ -1096,6 +1408,7 @@ void CompressionTool::parseAudioArguments() {
 
 	_format = AUDIO_MP3;
 
+	bool hasFormat = true;
 	if (_arguments.front() ==  "--mp3")
 		_format = AUDIO_MP3;
 	else if (_arguments.front() == "--vorbis")
@@ -1104,27 +1417,31 @@ void CompressionTool::parseAudioArguments() {
 		_format = AUDIO_FLAC;
 	else
 		// No audio arguments then
-		return;
+		hasFormat = false;
 
-	_arguments.pop_front();
+	if (hasFormat) {
+		_arguments.pop_front();
 
-	// Need workaround to be sign-correct
-	switch (_format) {
-	case AUDIO_MP3:
-		if (!processMp3Parms())
-			throw ToolException("Could not parse command line arguments, use --help for options");
-		break;
-	case AUDIO_VORBIS:
-		if (!processOggParms())
-			throw ToolException("Could not parse command line arguments, use --help for options");
-		break;
-	case AUDIO_FLAC:
-		if (!processFlacParms())
-			throw ToolException("Could not parse arguments: Use --help for options");
-		break;
-	default: // cannot occur but we check anyway to avoid compiler warnings
-		throw ToolException("Unknown audio format, should be impossible!");
+		// Need workaround to be sign-correct
+		switch (_format) {
+		case AUDIO_MP3:
+			if (!processMp3Parms())
+				throw ToolException("Could not parse command line arguments, use --help for options");
+			break;
+		case AUDIO_VORBIS:
+			if (!processOggParms())
+				throw ToolException("Could not parse command line arguments, use --help for options");
+			break;
+		case AUDIO_FLAC:
+			if (!processFlacParms())
+				throw ToolException("Could not parse arguments: Use --help for options");
+			break;
+		default: // cannot occur but we check anyway to avoid compiler warnings
+			throw ToolException("Unknown audio format, should be impossible!");
+		}
 	}
+
+	parseJobsArgument(_numJobs);
 }
 
 void CompressionTool::setTempFileName() {
@@ -1194,6 +1511,10 @@ std::string CompressionTool::getHelp() const {
 		os << " --silent     the output of FLAC is hidden (default:disabled)\n";
 	}
 
+	os << "\nParallel encoding:\n";
+	os << " --jobs <n>   encode up to <n> samples or frames at once, 0 uses one per processor (default:1)\n";
+	os << "(If specified, it must follow the mode params.)\n";
+
 	os << "\n --help     this help message\n";
 
 	os << "\n\nIf a parameter is not given the default value is used\n";
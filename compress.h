@@ -25,6 +25,8 @@
 
 #include "tool.h"
 
+#include <vector>
+
 
 enum {
 	/* These are the defaults parameters for the Lame invocation */
@@ -66,6 +68,14 @@ enum CompressionType {
 	VBR
 };
 
+/**
+ * Describes the layout of raw PCM data, see CompressionTool::setRawAudioType.
+ */
+struct RawAudioType {
+	bool isLittleEndian, isStereo;
+	uint8 bitsPerSample;
+};
+
 const char *audio_extensions(AudioFormat format);
 int compression_format(AudioFormat format);
 
@@ -90,6 +100,9 @@ public:
 
 	AudioFormat _format;
 
+	/** Number of threads used to encode queued audio (see queueAudio()) or video frames. */
+	uint _numJobs;
+
 	// Settings
 	// These functions are used by the GUI Tools and by CLI argument parsing functions
 	// mp3 settings
@@ -116,7 +129,6 @@ public:
 	void unsetOggMinBitrate();
 	void unsetOggMaxBitrate();
 
-
 public:
 	bool processMp3Parms();
 	bool processOggParms();
@@ -127,14 +139,122 @@ public:
 	void extractAndEncodeVOC(const char *outName, Common::File &input, AudioFormat compMode);
 	void extractAndEncodeWAV(const char *outName, Common::File &input, AudioFormat compMode);
 
+	/**
+	 * Reads a VOC or WAV file embedded at the current position of the input
+	 * file, and encodes it into memory instead of the temporary file.
+	 */
+	void extractAndEncodeVOC(Common::File &input, AudioFormat compMode, std::vector<byte> &out);
+	void extractAndEncodeWAV(Common::File &input, AudioFormat compMode, std::vector<byte> &out);
+
+	/**
+	 * Reads the sound data blocks of a VOC file embedded at the current
+	 * position of the input file, without encoding them.
+	 *
+	 * @param input   The file, positioned after the VOC header.
+	 * @param rawData Receives the unsigned 8-bit mono samples.
+	 * @return The sample rate.
+	 */
+	int extractVOC(Common::File &input, std::vector<byte> &rawData);
+
 	void extractAndEncodeAIFF(const char *inName, const char *outName, AudioFormat compMode);
 
 	void encodeAudio(const char *inname, bool rawInput, int rawSamplerate, const char *outname, AudioFormat compmode);
 	void setRawAudioType(bool isLittleEndian, bool isStereo, uint8 bitsPerSample);
 
+	/**
+	 * Encodes signed 16-bit PCM samples in native byte order into memory.
+	 * The linked encoder library is used if there is one for the format,
+	 * otherwise the external encoder is run on uniquely named temporary
+	 * files. This may be called from several threads at once.
+	 *
+	 * @param pcm         The interleaved samples.
+	 * @param frames      Number of samples per channel.
+	 * @param numChannels 1 for mono, 2 for stereo.
+	 * @param samplerate  Sample rate of the data.
+	 * @param compmode    The format to encode to.
+	 * @param out         Receives the encoded data.
+	 */
+	void encodeToMemory(const int16 *pcm, uint32 frames, int numChannels, int samplerate, AudioFormat compmode, std::vector<byte> &out);
+
+	/**
+	 * Like encodeToMemory(), but for raw data of the given type.
+	 */
+	void encodeRawToMemory(const char *rawData, uint32 length, int samplerate, AudioFormat compmode, const RawAudioType &rawType, std::vector<byte> &out);
+
+	/**
+	 * Encodes a complete WAV file, held in memory, into memory.
+	 */
+	void encodeWAVToMemory(const byte *wavData, uint32 size, AudioFormat compmode, std::vector<byte> &out);
+
+	/**
+	 * Queues raw PCM data for encoding into the current format. The data
+	 * is copied, and described by the current raw audio type.
+	 *
+	 * Queued audio is encoded by encodeQueuedAudio(), possibly on several
+	 * threads, so a tool can queue many samples, encode them at once and
+	 * then write the results in the original order.
+	 *
+	 * @param rawData    The PCM data.
+	 * @param length     Size of the data in bytes.
+	 * @param samplerate Sample rate of the data.
+	 * @return The index of the job, to be passed to getEncodedAudio().
+	 */
+	uint queueAudio(const void *rawData, uint32 length, int samplerate);
+
+	/**
+	 * Queues raw PCM data for encoding, like above, but takes over the
+	 * contents of rawData instead of copying them. rawData is left empty.
+	 */
+	uint queueAudio(std::vector<byte> &rawData, int samplerate);
+
+	/**
+	 * Encodes all queued audio, using up to _numJobs threads.
+	 */
+	void encodeQueuedAudio();
+
+	/**
+	 * Returns the encoded data of a queued job, once encodeQueuedAudio()
+	 * has been called. The data is valid until clearAudioQueue().
+	 */
+	const std::vector<byte> &getEncodedAudio(uint index) const;
+
+	/** Returns the number of jobs in the queue. */
+	uint getQueuedAudioCount() const;
+
+	/**
+	 * Returns true if enough jobs have been queued to keep all threads
+	 * busy, tools should then encode and write them out before queueing more.
+	 */
+	bool isAudioQueueFull() const;
+
+	/** Removes all jobs from the queue. */
+	void clearAudioQueue();
+
 protected:
+	/** A piece of raw audio waiting to be encoded, see queueAudio(). */
+	struct AudioJob {
+		std::vector<byte> rawData;
+		RawAudioType rawType;
+		int samplerate;
+		std::vector<byte> encoded;
+	};
+
+	std::deque<AudioJob> _audioQueue;
 
+	void encodeAudio(const char *inname, bool rawInput, int rawSamplerate, const char *outname, AudioFormat compmode, const RawAudioType &rawType);
 	void encodeRaw(const char *rawData, int length, int samplerate, const char *outname, AudioFormat compmode);
+	void encodeRaw(const char *rawData, int length, int samplerate, const char *outname, AudioFormat compmode, const RawAudioType &rawType);
+	void encodeJob(AudioJob &job);
+
+	void encodePCMToMemory(const int16 *pcm, uint32 frames, int numChannels, int bitsPerSample, int samplerate, AudioFormat compmode, std::vector<byte> &out);
+	void encodeWithExternalEncoder(const char *rawData, uint32 length, int samplerate, AudioFormat compmode, const RawAudioType &rawType, std::vector<byte> &out);
+
+	// Only defined if the respective library is linked in
+	void encodeVorbisToMemory(const int16 *pcm, uint32 frames, int numChannels, int samplerate, std::vector<byte> &out);
+	void encodeFlacToMemory(const int16 *pcm, uint32 frames, int numChannels, int bitsPerSample, int samplerate, std::vector<byte> &out);
+	void encodeMP3ToMemory(const int16 *pcm, uint32 frames, int numChannels, int samplerate, std::vector<byte> &out);
+
+	friend class AudioJobTask;
 };
 
 /*
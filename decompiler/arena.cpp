@@ -0,0 +1,137 @@
+/* ScummVM Tools
+ * Copyright (C) 2010 The ScummVM project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#include "arena.h"
+#include "refcounted.h"
+
+#include "common/thread.h"
+
+#include <new>
+
+/**
+ * The current Arena of each thread.
+ */
+static Common::ThreadLocalPointer currentArena;
+
+/**
+ * Header in front of the memory of each RefCounted object, telling where
+ * the memory came from. The union keeps the object itself aligned.
+ */
+union AllocationHeader {
+	Arena *_arena; ///< The Arena the memory was allocated from, or NULL for the heap.
+	double _align; ///< Unused, only for alignment.
+};
+
+Arena::Arena() : _pools(kMaxChunkSize / kGranularity + 1, (Common::MemoryPool *)NULL), _dupIndex(0), _allocatedBytes(0), _peakBytes(0) {
+	_previous = getCurrent();
+	currentArena.set(this);
+}
+
+Arena::~Arena() {
+	for (size_t i = 0; i < _pools.size(); i++)
+		delete _pools[i];
+	currentArena.set(_previous);
+}
+
+Arena *Arena::getCurrent() {
+	return (Arena *)currentArena.get();
+}
+
+void *Arena::allocate(size_t size) {
+	_allocatedBytes += size;
+	if (_allocatedBytes > _peakBytes)
+		_peakBytes = _allocatedBytes;
+
+	size_t index = (size + kGranularity - 1) / kGranularity;
+	if (index >= _pools.size())
+		return ::operator new(size);
+	if (_pools[index] == NULL)
+		_pools[index] = new Common::MemoryPool(index * kGranularity);
+	return _pools[index]->allocChunk();
+}
+
+void Arena::deallocate(void *ptr, size_t size) {
+	_allocatedBytes -= size;
+
+	size_t index = (size + kGranularity - 1) / kGranularity;
+	if (index >= _pools.size())
+		::operator delete(ptr);
+	else
+		_pools[index]->freeChunk(ptr);
+}
+
+size_t Arena::resetPeakBytes() {
+	size_t peak = _peakBytes;
+	_peakBytes = _allocatedBytes;
+	return peak;
+}
+
+void Arena::raisePeakBytes(size_t bytes) {
+	if (bytes > _peakBytes)
+		_peakBytes = bytes;
+}
+
+const std::string *Arena::intern(const std::string &s) {
+	return &*_strings.insert(s).first;
+}
+
+static std::set<std::string> heapStrings; ///< Pool for strings created outside an Arena.
+static Common::Mutex heapStringsMutex;     ///< Guards heapStrings, which is shared by all threads.
+
+/**
+ * Interns a string in the current Arena, or in the pool for strings created outside an Arena.
+ */
+static const std::string *internString(const std::string &s) {
+	if (Arena::getCurrent() != NULL)
+		return Arena::getCurrent()->intern(s);
+	Common::StackLock lock(heapStringsMutex);
+	return &*heapStrings.insert(s).first;
+}
+
+InternedString::InternedString() {
+	static const std::string empty;
+	_str = &empty;
+}
+
+InternedString::InternedString(const std::string &s) : _str(internString(s)) {
+}
+
+InternedString::InternedString(const char *s) : _str(internString(s)) {
+}
+
+void *RefCounted::operator new(size_t size) {
+	Arena *arena = Arena::getCurrent();
+	size_t total = sizeof(AllocationHeader) + size;
+	AllocationHeader *header = (AllocationHeader *)(arena != NULL ? arena->allocate(total) : ::operator new(total));
+	header->_arena = arena;
+	return header + 1;
+}
+
+void RefCounted::operator delete(void *ptr, size_t size) {
+	if (ptr == NULL)
+		return;
+	AllocationHeader *header = (AllocationHeader *)ptr - 1;
+	if (header->_arena != NULL)
+		header->_arena->deallocate(header, sizeof(AllocationHeader) + size);
+	else
+		::operator delete(header);
+}
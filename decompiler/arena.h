@@ -0,0 +1,217 @@
+/* ScummVM Tools
+ * Copyright (C) 2010 The ScummVM project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#ifndef DEC_ARENA_H
+#define DEC_ARENA_H
+
+#include "common/scummsys.h"
+#include "common/memorypool.h"
+
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * Owner of the memory for the objects created while decompiling a script.
+ *
+ * Instructions, Values and Groups are allocated through RefCounted, which
+ * takes their memory from the current Arena, if there is one. The memory
+ * comes from a Common::MemoryPool for each size, and is handed back to the
+ * pool when an object is deleted, so creating and deleting the many small
+ * objects of a script does not go through malloc and free. Strings interned
+ * in the Arena are stored once for the whole script.
+ *
+ * An Arena is the current one of its thread from its construction to its
+ * destruction, and the previous one becomes current again afterwards. It
+ * must outlive all objects allocated while it is current. Scripts may be
+ * decompiled on several threads at once, each with its own Arena.
+ */
+class Arena {
+private:
+	std::vector<Common::MemoryPool *> _pools; ///< The memory pools, indexed by chunk size in units of kGranularity.
+	std::set<std::string> _strings;           ///< The interned strings.
+	Arena *_previous;                         ///< The Arena which was current before this one.
+	int _dupIndex;                            ///< The index of the last duplicated stack entry.
+	size_t _allocatedBytes;                   ///< The number of bytes currently allocated.
+	size_t _peakBytes;                        ///< The highest number of bytes allocated since the last resetPeakBytes().
+
+	Arena(const Arena &);
+	Arena &operator=(const Arena &);
+
+public:
+	enum {
+		kGranularity = 8,  ///< Chunk sizes are multiples of this.
+		kMaxChunkSize = 256 ///< Larger objects are allocated on the heap.
+	};
+
+	/**
+	 * Constructor for Arena. Makes the new Arena the current one.
+	 */
+	Arena();
+
+	/**
+	 * Destructor for Arena. Frees all memory of the Arena, and makes the previous Arena current again.
+	 */
+	~Arena();
+
+	/**
+	 * Gets the current Arena of the calling thread.
+	 *
+	 * @returns The current Arena, or NULL if there is none.
+	 */
+	static Arena *getCurrent();
+
+	/**
+	 * Gets an index for a duplicated stack entry, unique within the script.
+	 *
+	 * @returns The next index, starting at 1.
+	 */
+	int nextDupIndex() { return ++_dupIndex; }
+
+	/**
+	 * Allocates memory.
+	 *
+	 * @param size The number of bytes to allocate.
+	 * @returns The allocated memory.
+	 */
+	void *allocate(size_t size);
+
+	/**
+	 * Frees memory allocated by allocate().
+	 *
+	 * @param ptr  The memory to free.
+	 * @param size The number of bytes that were allocated.
+	 */
+	void deallocate(void *ptr, size_t size);
+
+	/**
+	 * Interns a string.
+	 *
+	 * @param s The string to intern.
+	 * @returns The stored copy of the string, which lives as long as the Arena.
+	 */
+	const std::string *intern(const std::string &s);
+
+	/**
+	 * Gets the number of bytes currently allocated by allocate().
+	 *
+	 * @returns The number of bytes.
+	 */
+	size_t getAllocatedBytes() const { return _allocatedBytes; }
+
+	/**
+	 * Gets the highest number of bytes allocated at once since the Arena
+	 * was created, or since the last call to resetPeakBytes().
+	 *
+	 * @returns The number of bytes.
+	 */
+	size_t getPeakBytes() const { return _peakBytes; }
+
+	/**
+	 * Starts measuring the peak number of bytes allocated anew.
+	 *
+	 * @returns The peak number of bytes before the reset.
+	 */
+	size_t resetPeakBytes();
+
+	/**
+	 * Raises the peak number of bytes, used to restore an outer
+	 * measurement after resetPeakBytes() was used for an inner one.
+	 *
+	 * @param bytes The new peak, if it is higher than the current one.
+	 */
+	void raisePeakBytes(size_t bytes);
+};
+
+/**
+ * A string interned in the current Arena, or in a pool shared by everything
+ * created outside an Arena. Equal strings share the same storage, so copying
+ * an InternedString only copies a pointer.
+ */
+class InternedString {
+private:
+	const std::string *_str; ///< The interned string.
+
+public:
+	/**
+	 * Constructor for an empty InternedString.
+	 */
+	InternedString();
+
+	/**
+	 * Constructor for InternedString.
+	 *
+	 * @param s The string to intern.
+	 */
+	InternedString(const std::string &s);
+
+	/**
+	 * Constructor for InternedString.
+	 *
+	 * @param s The string to intern.
+	 */
+	InternedString(const char *s);
+
+	/**
+	 * Gets the string.
+	 *
+	 * @returns The string.
+	 */
+	const std::string &str() const { return *_str; }
+
+	/**
+	 * Gets the string.
+	 *
+	 * @returns The string.
+	 */
+	operator const std::string &() const { return *_str; }
+
+	/**
+	 * Compares the string to another string.
+	 *
+	 * @param s The string to compare with.
+	 * @returns True if the strings are equal, false if they are not.
+	 */
+	bool operator==(const std::string &s) const { return *_str == s; }
+
+	/**
+	 * Compares the string to another string.
+	 *
+	 * @param s The string to compare with.
+	 * @returns True if the strings are equal, false if they are not.
+	 */
+	bool operator==(const char *s) const { return *_str == s; }
+
+	/**
+	 * Outputs an InternedString to an std::ostream.
+	 *
+	 * @param output The std::ostream to output to.
+	 * @param s      The InternedString to output.
+	 * @returns The std::ostream used for output.
+	 */
+	friend std::ostream &operator<<(std::ostream &output, const InternedString &s) {
+		return output << *s._str;
+	}
+};
+
+#endif
@@ -25,11 +25,8 @@
 
 #include <algorithm>
 #include <iostream>
-#include <set>
 #include <boost/format.hpp>
 
-#define GET(vertex) (boost::get(boost::vertex_name, _g, vertex))
-#define GET_EDGE(edge) (boost::get(boost::edge_attribute, _g, edge))
 
 std::string CodeGenerator::constructFuncSignature(const Function &func) {
 	return "";
@@ -44,59 +41,71 @@ std::string CodeGenerator::indentString(std::string s) {
 CodeGenerator::CodeGenerator(Engine *engine, std::ostream &output, ArgOrder binOrder, ArgOrder callOrder) : _output(output), _binOrder(binOrder), _callOrder(callOrder) {
 	_engine = engine;
 	_indentLevel = 0;
+	_functionStats = NULL;
 }
 
-typedef std::pair<GraphVertex, ValueStack> DFSEntry;
+void CodeGenerator::collectStats(std::vector<FunctionStats> *stats) {
+	_functionStats = stats;
+}
+
+typedef std::pair<int, ValueStack> DFSEntry;
 
 void CodeGenerator::generate(const Graph &g) {
-	_g = g;
+	_flat = FlatGraph(g);
+
+	// Function number which last reached each block
+	std::vector<int> seen(_flat.size(), -1);
+	int fnNum = 0;
+	for (FuncMap::iterator fn = _engine->_functions.begin(); fn != _engine->_functions.end(); ++fn, ++fnNum) {
+		FunctionStats stats;
+		stats._address = fn->first;
+		stats._name = fn->second._name;
+		StageTimer timer(stats._codeGen);
 
-	for (FuncMap::iterator fn = _engine->_functions.begin(); fn != _engine->_functions.end(); ++fn) {
 		_indentLevel = 0;
 		while (!_stack.empty())
 			_stack.pop();
-		GraphVertex entryPoint = fn->second._v;
+		int entryPoint = _flat.block(g, fn->second._v);
 		std::string funcSignature = constructFuncSignature(fn->second);
 		bool printFuncSignature = !funcSignature.empty();
 		if (printFuncSignature) {
-			_curGroup = GET(entryPoint);
+			_curGroup = _flat.group(entryPoint);
 			if (!(fn == _engine->_functions.begin()))
 				addOutputLine("");
 			addOutputLine(funcSignature, false, true);
 		}
 
-		GroupPtr lastGroup = GET(entryPoint);
+		// Blocks are ordered by address
+		int lastBlock = entryPoint;
 
-		// DFS from entry point to process each vertex
+		// DFS from entry point to process each block
 		Stack<DFSEntry> dfsStack;
-		std::set<GraphVertex> seen;
 		dfsStack.push(DFSEntry(entryPoint, ValueStack()));
-		seen.insert(entryPoint);
+		seen[entryPoint] = fnNum;
 		while (!dfsStack.empty()) {
 			DFSEntry e = dfsStack.pop();
-			GroupPtr tmp = GET(e.first);
-			if ((*tmp->_start)->_address > (*lastGroup->_start)->_address)
-				lastGroup = tmp;
+			lastBlock = std::max(lastBlock, e.first);
 			_stack = e.second;
-			GraphVertex v = e.first;
-			process(v);
-			OutEdgeRange r = boost::out_edges(v, _g);
-			for (OutEdgeIterator i = r.first; i != r.second; ++i) {
-				GraphVertex target = boost::target(*i, _g);
-				if (seen.find(target) == seen.end()) {
-					dfsStack.push(DFSEntry(target, _stack));
-					seen.insert(target);
+			process(e.first);
+			GroupPtr gr = _flat.group(e.first);
+			stats._groups++;
+			stats._instructions += gr->_end - gr->_start + 1;
+			stats._edges += _flat.outDegree(e.first);
+			for (const FlatEdge *i = _flat.succBegin(e.first); i != _flat.succEnd(e.first); ++i) {
+				if (seen[i->_block] != fnNum) {
+					dfsStack.push(DFSEntry(i->_block, _stack));
+					seen[i->_block] = fnNum;
 				}
 			}
 		}
 
 		if (printFuncSignature) {
-			_curGroup = lastGroup;
+			_curGroup = _flat.group(lastBlock);
 			addOutputLine("}", true, false);
 		}
 
 		// Print output
-		GroupPtr p = GET(entryPoint);
+		GroupPtr p = _flat.group(entryPoint);
 		while (p != NULL) {
 			for (std::vector<CodeLine>::iterator it = p->_code.begin(); it != p->_code.end(); ++it) {
 				if (it->_unindentBefore) {
@@ -112,6 +121,10 @@ void CodeGenerator::generate(const Graph &g) {
 
 		if (_indentLevel != 0)
 			std::cerr << boost::format("WARNING: Indent level for function at %d ended at %d\n") % fn->first % _indentLevel;
+
+		timer.stop();
+		if (_functionStats)
+			_functionStats->push_back(stats);
 	}
 }
 
@@ -125,21 +138,19 @@ void CodeGenerator::writeAssignment(ValuePtr dst, ValuePtr src) {
 	addOutputLine(s.str());
 }
 
-void CodeGenerator::process(GraphVertex v) {
-	_curVertex = v;
-	_curGroup = GET(v);
+void CodeGenerator::process(int b) {
+	_curBlock = b;
+	_curGroup = _flat.group(b);
 
 	// Check if we should add else start
 	if (_curGroup->_startElse)
 		addOutputLine("} else {", true, true);
 
 	// Check ingoing edges to see if we want to add any extra output
-	InEdgeRange ier = boost::in_edges(v, _g);
-	for (InEdgeIterator ie = ier.first; ie != ier.second; ++ie) {
-		GraphVertex in = boost::source(*ie, _g);
-		GroupPtr inGroup = GET(in);
+	for (const FlatEdge *ie = _flat.predBegin(b); ie != _flat.predEnd(b); ++ie) {
+		const GroupPtr &inGroup = _flat.group(ie->_block);
 
-		if (!boost::get(boost::edge_attribute, _g, *ie)._isJump || inGroup->_stackLevel == -1)
+		if (!ie->_isJump || inGroup->_stackLevel == -1)
 			continue;
 
 		switch (inGroup->_type) {
@@ -177,10 +188,9 @@ void CodeGenerator::processInst(const InstPtr inst) {
 		switch (_curGroup->_type) {
 		case kIfCondGroupType:
 			if (_curGroup->_startElse && _curGroup->_code.size() == 1) {
-				OutEdgeRange oer = boost::out_edges(_curVertex, _g);
 				bool coalesceElse = false;
-				for (OutEdgeIterator oe = oer.first; oe != oer.second; ++oe) {
-					GroupPtr oGr = GET(boost::target(*oe, _g))->_prev;
+				for (const FlatEdge *oe = _flat.succBegin(_curBlock); oe != _flat.succEnd(_curBlock); ++oe) {
+					Group *oGr = _flat.group(oe->_block)->_prev;
 					if (std::find(oGr->_endElse.begin(), oGr->_endElse.end(), _curGroup.get()) != oGr->_endElse.end())
 						coalesceElse = true;
 				}
@@ -215,10 +225,9 @@ void CodeGenerator::processInst(const InstPtr inst) {
 		default:
 			{
 				bool printJump = true;
-				OutEdgeRange r = boost::out_edges(_curVertex, _g);
-				for (OutEdgeIterator e = r.first; e != r.second && printJump; ++e) {
+				for (const FlatEdge *e = _flat.succBegin(_curBlock); e != _flat.succEnd(_curBlock) && printJump; ++e) {
 					// Don't output jump to next vertex
-					if (boost::target(*e, _g) == _curGroup->_next->_vertex) {
+					if (e->_block == _curBlock + 1) {
 						printJump = false;
 						break;
 					}
@@ -230,10 +239,9 @@ void CodeGenerator::processInst(const InstPtr inst) {
 					}
 
 
-					OutEdgeRange targetR = boost::out_edges(boost::target(*e, _g), _g);
-					for (OutEdgeIterator targetE = targetR.first; targetE != targetR.second; ++targetE) {
+					for (const FlatEdge *targetE = _flat.succBegin(e->_block); targetE != _flat.succEnd(e->_block); ++targetE) {
 						// Don't output jump to while loop that has jump to next vertex
-						if (boost::target(*targetE, _g) == _curGroup->_next->_vertex)
+						if (targetE->_block == _curBlock + 1)
 							printJump = false;
 					}
 				}
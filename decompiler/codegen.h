@@ -20,7 +20,9 @@
  *
  */
 
+#include "flat_graph.h"
 #include "graph.h"
+#include "stats.h"
 #include "value.h"
 
 #include <ostream>
@@ -50,21 +52,22 @@ enum ArgOrder {
  */
 class CodeGenerator {
 private:
-	Graph _g;                  ///< The annotated graph of the script.
+	FlatGraph _flat;                            ///< Compact copy of the annotated graph of the script.
+	std::vector<FunctionStats> *_functionStats; ///< Receives measurements of each function, NULL if they are not wanted.
 
 	/**
-	 * Processes a GraphVertex.
+	 * Processes a block.
 	 *
-	 * @param v The vertex to process.
+	 * @param b Index of the block to process.
 	 */
-	void process(GraphVertex v);
+	void process(int b);
 
 protected:
 	Engine *_engine;        ///< Pointer to the Engine used for the script.
 	std::ostream &_output;  ///< The std::ostream to output the code to.
 	ValueStack _stack;      ///< The stack currently being processed.
 	uint _indentLevel;      ///< Indentation level.
-	GraphVertex _curVertex; ///< Graph vertex currently being processed.
+	int _curBlock;          ///< Index of the block currently being processed.
 
 	/**
 	 * Processes an instruction. Called by process() for each instruction.
@@ -115,6 +118,13 @@ public:
 	 */
 	void generate(const Graph &g);
 
+	/**
+	 * Requests measurements of the code generation for each function.
+	 *
+	 * @param stats Receives the measurements when generate() is called, NULL to stop collecting them.
+	 */
+	void collectStats(std::vector<FunctionStats> *stats);
+
 	/**
 	 * Adds a line of code to the current group.
 	 *
@@ -34,6 +34,37 @@
 #define PUT_ID(vertex, id) boost::put(boost::vertex_index, _g, vertex, id);
 #define GET(vertex) (boost::get(boost::vertex_name, _g, vertex))
 #define GET_EDGE(edge) (boost::get(boost::edge_attribute, _g, edge))
+#define ADDRESS(group) ((*(group)->_start)->_address)
+
+void RangeBounds::reset(int size) {
+	_size = size;
+	_lo.assign(2 * size, 0xFFFFFFFF);
+	_hi.assign(2 * size, 0);
+}
+
+void RangeBounds::add(int pos, uint32 value) {
+	// Values are only ever added, so the nodes above just widen
+	for (int i = pos + _size; i > 0; i >>= 1) {
+		_lo[i] = std::min(_lo[i], value);
+		_hi[i] = std::max(_hi[i], value);
+	}
+}
+
+bool RangeBounds::inside(int from, int to, uint32 min, uint32 max) const {
+	for (int l = from + _size, r = to + _size; l < r; l >>= 1, r >>= 1) {
+		if (l & 1) {
+			if (_lo[l] < min || _hi[l] > max)
+				return false;
+			l++;
+		}
+		if (r & 1) {
+			r--;
+			if (_lo[r] < min || _hi[r] > max)
+				return false;
+		}
+	}
+	return true;
+}
 
 ControlFlow::ControlFlow(const InstVec &insts, Engine *engine) : _insts(insts) {
 	_engine = engine;
@@ -45,10 +76,11 @@ ControlFlow::ControlFlow(const InstVec &insts, Engine *engine) : _insts(insts) {
 
 	GroupPtr prev = NULL;
 	int id = 0;
+	_vertices.reserve(insts.size());
 	// Create vertices
 	for (ConstInstIterator it = insts.begin(); it != insts.end(); ++it) {
 		GraphVertex cur = boost::add_vertex(_g);
-		_addrMap[(*it)->_address] = cur;
+		_vertices.push_back(cur);
 		PUT(cur, new Group(cur, it, it, prev));
 		PUT_ID(cur, id);
 		id++;
@@ -92,18 +124,28 @@ ControlFlow::ControlFlow(const InstVec &insts, Engine *engine) : _insts(insts) {
 }
 
 GraphVertex ControlFlow::find(const InstPtr inst) {
-	return _addrMap[inst->_address];
+	return find(inst->_address);
 }
 
 GraphVertex ControlFlow::find(ConstInstIterator it) {
-	return _addrMap[(*it)->_address];
+	return _vertices[it - _insts.begin()];
+}
+
+/**
+ * Orders an instruction before an address.
+ */
+static bool instBefore(const InstPtr &inst, uint32 address) {
+	return inst->_address < address;
 }
 
 GraphVertex ControlFlow::find(uint32 address) {
-	std::map<uint32, GraphVertex>::iterator it = _addrMap.find(address);
-	if (it == _addrMap.end())
+	// The instructions are ordered by address
+	ConstInstIterator it = std::lower_bound(_insts.begin(), _insts.end(), address, instBefore);
+	if (it == _insts.end() || (*it)->_address != address) {
 		std::cerr << "Request for instruction at unknown address " << boost::format("0x%08x") % address << std::endl;
-	return it->second;
+		return GraphVertex();
+	}
+	return find(it);
 }
 
 void ControlFlow::merge(GraphVertex g1, GraphVertex g2) {
@@ -113,10 +155,10 @@ void ControlFlow::merge(GraphVertex g1, GraphVertex g2) {
 	gr1->_end = gr2->_end;
 	PUT(g1, gr1);
 
-	// Update address map
+	// Update vertex table
 	ConstInstIterator it = gr2->_start;
 	do {
-		_addrMap[(*it)->_address] = g1;
+		_vertices[it - _insts.begin()] = g1;
 		++it;
 	} while (gr2->_start != gr2->_end && it != gr2->_end);
 
@@ -377,27 +419,89 @@ void ControlFlow::detectShortCircuit() {
 }
 
 const Graph &ControlFlow::analyze() {
+	// The analysis only changes the groups, not the structure of the graph
+	_flat = FlatGraph(_g);
+	_elseStarts.reset(_flat.size());
+	for (int b = 0; b < _flat.size(); b++) {
+		for (ElseEndIterator it = _flat.group(b)->_endElse.begin(); it != _flat.group(b)->_endElse.end(); ++it)
+			_elseStarts.add(b, ADDRESS(*it));
+	}
+
 	detectDoWhile();
 	detectWhile();
+	computeLoopSpans();
 	detectBreak();
 	detectContinue();
 	detectIf();
+	computeConditionSpans();
 	detectElse();
 	return _g;
 }
 
+void ControlFlow::computeLoopSpans() {
+	// Lowest and highest address of the while and do-while conditions jumping to each block
+	std::vector<uint32> whileLo(_flat.size(), 0xFFFFFFFF), whileHi(_flat.size(), 0);
+	std::vector<uint32> doWhileLo(_flat.size(), 0xFFFFFFFF), doWhileHi(_flat.size(), 0);
+	for (int b = 0; b < _flat.size(); b++) {
+		const GroupPtr &gr = _flat.group(b);
+		if (gr->_type != kWhileCondGroupType && gr->_type != kDoWhileCondGroupType)
+			continue;
+		std::vector<uint32> &lo = (gr->_type == kWhileCondGroupType ? whileLo : doWhileLo);
+		std::vector<uint32> &hi = (gr->_type == kWhileCondGroupType ? whileHi : doWhileHi);
+		for (const FlatEdge *e = _flat.succBegin(b); e != _flat.succEnd(b); ++e) {
+			lo[e->_block] = std::min(lo[e->_block], ADDRESS(gr));
+			hi[e->_block] = std::max(hi[e->_block], ADDRESS(gr));
+		}
+	}
+
+	// A loop condition spans its jump targets, and the loop conditions of the other type jumping to those
+	_whileSpans.reset(_flat.size());
+	_doWhileSpans.reset(_flat.size());
+	for (int b = 0; b < _flat.size(); b++) {
+		const GroupPtr &gr = _flat.group(b);
+		if (gr->_type != kWhileCondGroupType && gr->_type != kDoWhileCondGroupType)
+			continue;
+		RangeBounds &spans = (gr->_type == kWhileCondGroupType ? _whileSpans : _doWhileSpans);
+		const std::vector<uint32> &otherLo = (gr->_type == kWhileCondGroupType ? doWhileLo : whileLo);
+		const std::vector<uint32> &otherHi = (gr->_type == kWhileCondGroupType ? doWhileHi : whileHi);
+		for (const FlatEdge *e = _flat.succBegin(b); e != _flat.succEnd(b); ++e) {
+			spans.add(b, ADDRESS(_flat.group(e->_block)));
+			if (otherLo[e->_block] <= otherHi[e->_block]) {
+				spans.add(b, otherLo[e->_block]);
+				spans.add(b, otherHi[e->_block]);
+			}
+		}
+	}
+}
+
+void ControlFlow::computeConditionSpans() {
+	_condTargets.reset(_flat.size());
+	_condSources.reset(_flat.size());
+	for (int b = 0; b < _flat.size(); b++) {
+		const GroupPtr &gr = _flat.group(b);
+		if (gr->_type != kIfCondGroupType && gr->_type != kWhileCondGroupType && gr->_type != kDoWhileCondGroupType)
+			continue;
+		// Conditions starting with an unconditional jump may jump into an else block from outside
+		bool uncondStart = (*gr->_start)->isUncondJump();
+		for (const FlatEdge *e = _flat.succBegin(b); e != _flat.succEnd(b); ++e) {
+			const GroupPtr &targetGr = _flat.group(e->_block);
+			_condTargets.add(b, ADDRESS(targetGr));
+			// Groups starting with an unconditional jump may be jumped to from anywhere
+			if (!uncondStart && !(*targetGr->_start)->isUncondJump())
+				_condSources.add(e->_block, ADDRESS(gr));
+		}
+	}
+}
+
 void ControlFlow::detectWhile() {
-	VertexRange vr = boost::vertices(_g);
-	for (VertexIterator v = vr.first; v != vr.second; ++v) {
-		GroupPtr gr = GET(*v);
+	for (int b = 0; b < _flat.size(); b++) {
+		const GroupPtr &gr = _flat.group(b);
 		// Undetermined block that ends with conditional jump
-		if (out_degree(*v, _g) == 2 && gr->_type == kNormalGroupType) {
-			InEdgeRange ier = boost::in_edges(*v, _g);
+		if (_flat.outDegree(b) == 2 && gr->_type == kNormalGroupType) {
 			bool isWhile = false;
-			for (InEdgeIterator e = ier.first; e != ier.second; ++e) {
-				GroupPtr sourceGr = GET(boost::source(*e, _g));
+			for (const FlatEdge *e = _flat.predBegin(b); e != _flat.predEnd(b); ++e) {
 				// Block has ingoing edge from block later in the code that isn't a do-while condition
-				if ((*sourceGr->_start)->_address > (*gr->_start)->_address && sourceGr->_type != kDoWhileCondGroupType)
+				if (e->_block > b && _flat.group(e->_block)->_type != kDoWhileCondGroupType)
 					isWhile = true;
 			}
 			if (isWhile)
@@ -407,16 +511,13 @@ void ControlFlow::detectWhile() {
 }
 
 void ControlFlow::detectDoWhile() {
-	VertexRange vr = boost::vertices(_g);
-	for (VertexIterator v = vr.first; v != vr.second; ++v) {
-		GroupPtr gr = GET(*v);
+	for (int b = 0; b < _flat.size(); b++) {
+		const GroupPtr &gr = _flat.group(b);
 		// Undetermined block that ends with conditional jump...
-		if (out_degree(*v, _g) == 2 && gr->_type == kNormalGroupType) {
-			OutEdgeRange oer = boost::out_edges(*v, _g);
-			for (OutEdgeIterator e = oer.first; e != oer.second; ++e) {
-				GroupPtr targetGr = GET(boost::target(*e, _g));
+		if (_flat.outDegree(b) == 2 && gr->_type == kNormalGroupType) {
+			for (const FlatEdge *e = _flat.succBegin(b); e != _flat.succEnd(b); ++e) {
 				// ...to earlier in code
-				if ((*targetGr->_start)->_address < (*gr->_start)->_address)
+				if (e->_block < b)
 					gr->_type = kDoWhileCondGroupType;
 			}
 		}
@@ -424,23 +525,19 @@ void ControlFlow::detectDoWhile() {
 }
 
 void ControlFlow::detectBreak() {
-	VertexRange vr = boost::vertices(_g);
-	for (VertexIterator v = vr.first; v != vr.second; ++v) {
-		GroupPtr gr = GET(*v);
+	for (int b = 0; b < _flat.size(); b++) {
+		const GroupPtr &gr = _flat.group(b);
 		// Undetermined block with unconditional jump...
-		if (gr->_type == kNormalGroupType && ((*gr->_end)->isUncondJump()) && out_degree(*v, _g) == 1) {
-			OutEdgeIterator oe = boost::out_edges(*v, _g).first;
-			GraphVertex target = boost::target(*oe, _g);
-			GroupPtr targetGr = GET(target);
+		if (gr->_type == kNormalGroupType && ((*gr->_end)->isUncondJump()) && _flat.outDegree(b) == 1) {
+			int target = _flat.succBegin(b)->_block;
 			// ...to somewhere later in the code...
-			if ((*gr->_start)->_address >= (*targetGr->_start)->_address)
+			if (b >= target)
 				continue;
-			InEdgeRange ier = boost::in_edges(target, _g);
-			for (InEdgeIterator ie = ier.first; ie != ier.second; ++ie) {
-				GroupPtr sourceGr = GET(boost::source(*ie, _g));
+			for (const FlatEdge *e = _flat.predBegin(target); e != _flat.predEnd(target); ++e) {
+				GroupType sourceType = _flat.group(e->_block)->_type;
 				// ...to block immediately after a do-while condition, or to jump target of a while condition
-				if ((targetGr->_prev == sourceGr && sourceGr->_type == kDoWhileCondGroupType) || sourceGr->_type == kWhileCondGroupType) {
-					if (validateBreakOrContinue(gr, sourceGr))
+				if ((e->_block == target - 1 && sourceType == kDoWhileCondGroupType) || sourceType == kWhileCondGroupType) {
+					if (validateBreakOrContinue(b, e->_block))
 						gr->_type = kBreakGroupType;
 				}
 			}
@@ -449,78 +546,62 @@ void ControlFlow::detectBreak() {
 }
 
 void ControlFlow::detectContinue() {
-	VertexRange vr = boost::vertices(_g);
-	for (VertexIterator v = vr.first; v != vr.second; ++v) {
-		GroupPtr gr = GET(*v);
+	for (int b = 0; b < _flat.size(); b++) {
+		const GroupPtr &gr = _flat.group(b);
 		// Undetermined block with unconditional jump...
-		if (gr->_type == kNormalGroupType && ((*gr->_end)->isUncondJump()) && out_degree(*v, _g) == 1) {
-			OutEdgeIterator oe = boost::out_edges(*v, _g).first;
-			GraphVertex target = boost::target(*oe, _g);
-			GroupPtr targetGr = GET(target);
+		if (gr->_type == kNormalGroupType && ((*gr->_end)->isUncondJump()) && _flat.outDegree(b) == 1) {
+			int target = _flat.succBegin(b)->_block;
+			GroupType targetType = _flat.group(target)->_type;
 			// ...to a while or do-while condition...
-			if (targetGr->_type == kWhileCondGroupType || targetGr->_type == kDoWhileCondGroupType) {
+			if (targetType == kWhileCondGroupType || targetType == kDoWhileCondGroupType) {
 				bool isContinue = true;
 				// ...unless...
-				OutEdgeRange toer = boost::out_edges(target, _g);
 				bool afterJumpTargets = true;
-				for (OutEdgeIterator toe = toer.first; toe != toer.second; ++toe) {
+				for (const FlatEdge *e = _flat.succBegin(target); e != _flat.succEnd(target); ++e) {
 					// ...it is targeting a while condition which jumps to the next sequential group
-					if (targetGr->_type == kWhileCondGroupType && GET(boost::target(*toe, _g)) == gr->_next)
+					if (targetType == kWhileCondGroupType && e->_block == b + 1)
 						isContinue = false;
 					// ...or the instruction is placed after all jump targets from condition
-					if ((*GET(boost::target(*toe, _g))->_start)->_address > (*gr->_start)->_address)
+					if (e->_block > b)
 						afterJumpTargets = false;
 				}
 				if (afterJumpTargets)
 					isContinue = false;
 
-				if (isContinue && validateBreakOrContinue(gr, targetGr))
+				if (isContinue && validateBreakOrContinue(b, target))
 					gr->_type = kContinueGroupType;
 			}
 		}
 	}
 }
 
-bool ControlFlow::validateBreakOrContinue(GroupPtr gr, GroupPtr condGr) {
-	GroupPtr from, to, cursor;
+bool ControlFlow::validateBreakOrContinue(int b, int condB) {
+	int from, to;
 
-	if (condGr->_type == kDoWhileCondGroupType) {
-		to = condGr;
-		from = gr;
+	if (_flat.group(condB)->_type == kDoWhileCondGroupType) {
+		to = condB;
+		from = b;
 	}	else {
-		to = gr;
-		from = condGr->_next;
+		to = b;
+		from = condB + 1;
 	}
 
-	GroupType ogt = (condGr->_type == kDoWhileCondGroupType ? kWhileCondGroupType : kDoWhileCondGroupType);
-	// Verify that destination deals with innermost while/do-while
-	for (cursor = from; cursor->_next != NULL && cursor != to; cursor = cursor->_next) {
-		if (cursor->_type == condGr->_type) {
-			OutEdgeRange oerValidate = boost::out_edges(find(cursor->_start), _g);
-			for (OutEdgeIterator oeValidate = oerValidate.first; oeValidate != oerValidate.second; ++oeValidate) {
-				GraphVertex vValidate = boost::target(*oeValidate, _g);
-				GroupPtr gValidate = GET(vValidate);
-				// For all other loops of same type found in range, all targets must fall within that range
-				if ((*gValidate->_start)->_address < (*from->_start)->_address || (*gValidate->_start)->_address > (*to->_start)->_address )
-					return false;
-
-				InEdgeRange ierValidate = boost::in_edges(vValidate, _g);
-				for (InEdgeIterator ieValidate = ierValidate.first; ieValidate != ierValidate.second; ++ieValidate) {
-					GroupPtr igValidate = GET(boost::source(*ieValidate, _g));
-					// All loops of other type going into range must be placed within range
-					if (igValidate->_type == ogt && ((*igValidate->_start)->_address < (*from->_start)->_address || (*igValidate->_start)->_address > (*to->_start)->_address ))
-					return false;
-				}
-			}
-		}
-	}
-	return true;
+	// The blocks from "from" up to "to", leaving out the last block in the script
+	int last = _flat.size() - 1;
+	if (from == to)
+		last = from;
+	else if (to > from)
+		last = std::min(last, to);
+
+	// Verify that destination deals with innermost while/do-while: for all other loops of same type found in range,
+	// all targets must fall within that range, and all loops of other type going into those targets must be placed within range
+	const RangeBounds &spans = (_flat.group(condB)->_type == kDoWhileCondGroupType ? _doWhileSpans : _whileSpans);
+	return spans.inside(from, std::max(from, last), ADDRESS(_flat.group(from)), ADDRESS(_flat.group(to)));
 }
 
 void ControlFlow::detectIf() {
-	VertexRange vr = boost::vertices(_g);
-	for (VertexIterator v = vr.first; v != vr.second; ++v) {
-		GroupPtr gr = GET(*v);
+	for (int b = 0; b < _flat.size(); b++) {
+		const GroupPtr &gr = _flat.group(b);
 		// if: Undetermined block with conditional jump
 		if (gr->_type == kNormalGroupType && ((*gr->_end)->isCondJump())) {
 			gr->_type = kIfCondGroupType;
@@ -529,87 +610,74 @@ void ControlFlow::detectIf() {
 }
 
 void ControlFlow::detectElse() {
-	VertexRange vr = boost::vertices(_g);
-	for (VertexIterator v = vr.first; v != vr.second; ++v) {
-		GroupPtr gr = GET(*v);
+	for (int b = 0; b < _flat.size(); b++) {
+		const GroupPtr &gr = _flat.group(b);
 		if (gr->_type == kIfCondGroupType) {
-			OutEdgeRange oer = boost::out_edges(*v, _g);
-			GraphVertex target;
-			uint32 maxAddress = 0;
-			GroupPtr targetGr;
 			// Find jump target
-			for (OutEdgeIterator oe = oer.first; oe != oer.second; ++oe) {
-				targetGr = GET(boost::target(*oe, _g));
-				if ((*targetGr->_start)->_address > maxAddress) {
-					target = boost::target(*oe, _g);
-					maxAddress = (*targetGr->_start)->_address;
-				}
-			}
-			targetGr = GET(target);
+			int target = 0;
+			for (const FlatEdge *e = _flat.succBegin(b); e != _flat.succEnd(b); ++e)
+				target = std::max(target, e->_block);
+			const GroupPtr &targetGr = _flat.group(target);
+			const GroupPtr &prevGr = _flat.group(target - 1);
 			// else: Jump target of if immediately preceded by an unconditional jump...
-			if (!(*targetGr->_prev->_end)->isUncondJump())
+			if (!(*prevGr->_end)->isUncondJump())
 				continue;
 			// ...which is not a break or a continue...
-			if (targetGr->_prev->_type == kContinueGroupType || targetGr->_prev->_type == kBreakGroupType)
+			if (prevGr->_type == kContinueGroupType || prevGr->_type == kBreakGroupType)
 				continue;
 			// ...to later in the code
-			OutEdgeIterator toe = boost::out_edges(find((*targetGr->_prev->_start)->_address), _g).first;
-			GroupPtr targetTargetGr = GET(boost::target(*toe, _g));
-			if ((*targetTargetGr->_start)->_address > (*targetGr->_end)->_address) {
-				if (validateElseBlock(gr, targetGr, targetTargetGr)) {
+			int targetTarget = _flat.succBegin(target - 1)->_block;
+			if (ADDRESS(_flat.group(targetTarget)) > (*targetGr->_end)->_address) {
+				if (validateElseBlock(b, target, targetTarget)) {
 					targetGr->_startElse = true;
-					targetTargetGr->_prev->_endElse.push_back(targetGr.get());
+					_flat.group(targetTarget - 1)->_endElse.push_back(targetGr.get());
+					_elseStarts.add(targetTarget - 1, ADDRESS(targetGr));
 				}
 			}
 		}
 	}
 }
 
-bool ControlFlow::validateElseBlock(GroupPtr ifGroup, GroupPtr start, GroupPtr end) {
-	for (GroupPtr cursor = start; cursor != end; cursor = cursor->_next) {
-		if (cursor->_type == kIfCondGroupType || cursor->_type == kWhileCondGroupType || cursor->_type == kDoWhileCondGroupType) {
-			// Validate outgoing edges of conditions
-			OutEdgeRange oer = boost::out_edges(find(cursor->_start), _g);
-			for (OutEdgeIterator oe = oer.first; oe != oer.second; ++oe) {
-				GraphVertex target = boost::target(*oe, _g);
-				GroupPtr targetGr = GET(target);
-				// Each edge from condition must not leave the range [start, end]
-				if ((*start->_start)->_address > (*targetGr->_start)->_address || (*targetGr->_start)->_address > (*end->_start)->_address)
-					return false;
-			}
-		}
+bool ControlFlow::validateElseBlock(int ifB, int start, int end) {
+	uint32 startAddress = ADDRESS(_flat.group(start));
+	uint32 endAddress = ADDRESS(_flat.group(end));
+
+	// Each edge from a condition in the range must not leave the range [start, end]
+	if (!_condTargets.inside(start, end, startAddress, endAddress))
+		return false;
+
+	// If previous group ends an else, that else must start inside the range
+	if (!_elseStarts.inside(start - 1, end - 1, startAddress, 0xFFFFFFFF))
+		return false;
+
+	// Edges going to a group in the range which is not a simple unconditional jump must not come from
+	// a condition outside the range [start, end], unless the edge is from the if condition associated with
+	// this else. The groups that condition jumps to are checked edge by edge.
+	std::vector<int> ifTargets;
+	for (const FlatEdge *e = _flat.succBegin(ifB); e != _flat.succEnd(ifB); ++e) {
+		if (e->_block >= start && e->_block < end)
+			ifTargets.push_back(e->_block);
+	}
+	std::sort(ifTargets.begin(), ifTargets.end());
 
-		// If previous group ends an else, that else must start inside the range
-		for (ElseEndIterator it = cursor->_prev->_endElse.begin(); it != cursor->_prev->_endElse.end(); ++it)
-		{
-			if ((*(*it)->_start)->_address < (*start->_start)->_address)
-				return false;
-		}
+	int from = start;
+	for (std::vector<int>::iterator it = ifTargets.begin(); it != ifTargets.end(); ++it) {
+		if (!_condSources.inside(from, *it, startAddress, endAddress))
+			return false;
+		from = *it + 1;
 
-		// Unless group is a simple unconditional jump...
-		if ((*cursor->_start)->isUncondJump())
+		if ((*_flat.group(*it)->_start)->isUncondJump())
 			continue;
-
-		// ...validate ingoing edges
-		InEdgeRange ier = boost::in_edges(find(cursor->_start), _g);
-		for (InEdgeIterator ie = ier.first; ie != ier.second; ++ie) {
-			GraphVertex source = boost::source(*ie, _g);
-			GroupPtr sourceGr = GET(source);
-
-			// Edges going to conditions...
+		for (const FlatEdge *e = _flat.predBegin(*it); e != _flat.predEnd(*it); ++e) {
+			const GroupPtr &sourceGr = _flat.group(e->_block);
 			if (sourceGr->_type == kIfCondGroupType || sourceGr->_type == kWhileCondGroupType || sourceGr->_type == kDoWhileCondGroupType) {
-				// ...must not come from outside the range [start, end]...
-				if ((*start->_start)->_address > (*sourceGr->_start)->_address || (*sourceGr->_start)->_address > (*end->_start)->_address) {
-					// ...unless source is simple unconditional jump...
-					if ((*sourceGr->_start)->isUncondJump())
-						continue;
-					// ...or the edge is from the if condition associated with this else
-					if (ifGroup == sourceGr)
+				if (e->_block < start || e->_block > end) {
+					if ((*sourceGr->_start)->isUncondJump() || e->_block == ifB)
 						continue;
 					return false;
 				}
 			}
 		}
 	}
-	return true;
+	return _condSources.inside(from, end, startAddress, endAddress);
 }
@@ -25,6 +25,46 @@
 
 #include "graph.h"
 #include "engine.h"
+#include "flat_graph.h"
+
+/**
+ * Lowest and highest values added at each position of a sequence, kept in a
+ * segment tree so they can be checked for a range of positions in
+ * logarithmic time.
+ */
+class RangeBounds {
+private:
+	int _size;               ///< Number of positions.
+	std::vector<uint32> _lo; ///< Lowest value per tree node, 0xFFFFFFFF if there is none.
+	std::vector<uint32> _hi; ///< Highest value per tree node, 0 if there is none.
+
+public:
+	/**
+	 * Clears all values and sets the number of positions.
+	 *
+	 * @param size The number of positions.
+	 */
+	void reset(int size);
+
+	/**
+	 * Adds a value at a position.
+	 *
+	 * @param pos   The position to add the value at.
+	 * @param value The value to add.
+	 */
+	void add(int pos, uint32 value);
+
+	/**
+	 * Checks if all values at a range of positions lie within [min, max].
+	 *
+	 * @param from First position of the range.
+	 * @param to   Position after the last position of the range.
+	 * @param min  Lowest allowed value.
+	 * @param max  Highest allowed value.
+	 * @returns True if no value in the range lies outside [min, max].
+	 */
+	bool inside(int from, int to, uint32 min, uint32 max) const;
+};
 
 /**
  * Class for doing code flow analysis.
@@ -34,7 +74,13 @@ private:
 	Graph _g;                               ///< The control flow graph.
 	Engine *_engine;                        ///< Pointer to the Engine used for the script.
 	const InstVec &_insts;                  ///< The instructions being analyzed
-	std::map<uint32, GraphVertex> _addrMap; ///< Map between addresses and vertices.
+	std::vector<GraphVertex> _vertices;     ///< The vertex for each instruction, indexed by position in _insts.
+	FlatGraph _flat;                        ///< Compact copy of the graph for the analysis, set up by analyze().
+	RangeBounds _whileSpans;                ///< Addresses the while conditions are connected to, see computeLoopSpans.
+	RangeBounds _doWhileSpans;              ///< Addresses the do-while conditions are connected to, see computeLoopSpans.
+	RangeBounds _condTargets;               ///< Jump targets of the conditions.
+	RangeBounds _condSources;               ///< Conditions jumping to each group, unless it starts with an unconditional jump.
+	RangeBounds _elseStarts;                ///< Start of the else blocks ending in each group.
 
 	/**
 	 * Finds a graph vertex through an instruction.
@@ -73,6 +119,19 @@ private:
 	 */
 	void setStackLevel(GraphVertex g, int level);
 
+	/**
+	 * Collects, for each while and do-while condition, the addresses of its jump targets
+	 * and of the loop conditions of the other type jumping to those targets.
+	 * Do-while and while detection must be completed before running this method.
+	 */
+	void computeLoopSpans();
+
+	/**
+	 * Collects the jump targets of the conditions, and the conditions jumping to each group.
+	 * If detection must be completed before running this method.
+	 */
+	void computeConditionSpans();
+
 	/**
 	 * Merged groups that are part of the same short-circuited condition check.
 	 */
@@ -104,11 +163,11 @@ private:
 	/**
 	 * Checks if a candidate break/continue goes to the closest loop.
 	 *
-	 * @param gr     The group containing the candidate break/continue.
-	 * @param condGr The group containing the respective loop condition.
+	 * @param b     The block containing the candidate break/continue.
+	 * @param condB The block containing the respective loop condition.
 	 * @returns True if the validation succeeded, false if it did not.
 	 */
-	bool validateBreakOrContinue(GroupPtr gr, GroupPtr condGr);
+	bool validateBreakOrContinue(int b, int condB);
 
 	/**
 	 * Detects if blocks.
@@ -125,12 +184,12 @@ private:
 	/**
 	 * Checks if a candidate else block will cross block boundaries.
 	 *
-	 * @param ifGroup The group containing the if this else candidate is associated with.
-	 * @param start   The group containing the start of the else.
-	 * @param end     The group immediately after the group ending the else.
+	 * @param ifB   The block containing the if this else candidate is associated with.
+	 * @param start The block containing the start of the else.
+	 * @param end   The block immediately after the block ending the else.
 	 * @returns True if the validation succeeded, false if it did not.
 	 */
-	bool validateElseBlock(GroupPtr ifGroup, GroupPtr start, GroupPtr end);
+	bool validateElseBlock(int ifB, int start, int end);
 
 public:
 	/**
@@ -163,6 +222,8 @@ public:
 	/**
 	 * Performs control flow analysis.
 	 * The constructs are detected in the following order: do-while, while, break, continue, if/else.
+	 * The checks of break, continue and else candidates against the surrounding groups are
+	 * range queries on bounds collected once, so the analysis takes O(n log n) time.
 	 *
 	 * @returns The control flow graph after analysis.
 	 */
@@ -20,6 +20,7 @@
  *
  */
 
+#include "arena.h"
 #include "objectFactory.h"
 
 #include "disassembler.h"
@@ -27,14 +28,21 @@
 #include "instruction.h"
 
 #include "control_flow.h"
+#include "stats.h"
+
+#include "common/file.h"
+#include "common/thread.h"
 
 #include "groovie/engine.h"
 #include "kyra/engine.h"
 #include "scummv6/engine.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <vector>
 #include <boost/program_options.hpp>
@@ -44,6 +52,286 @@ namespace po = boost::program_options;
 
 #define ENGINE(id, description, engineClass) engines[std::string(id)] = description; engineFactory.addEntry<engineClass>(std::string(id));
 
+/**
+ * Outputs the control flow graph of a script in dot format.
+ *
+ * @param out    The std::ostream to output to.
+ * @param g      The graph to output.
+ * @param engine The engine the script originates from.
+ */
+static void writeGraph(std::ostream &out, const Graph &g, Engine *engine) {
+	boost::write_graphviz(out, g, boost::make_label_writer(get(boost::vertex_name, g)), boost::makeArrowheadWriter(get(boost::edge_attribute, g)), GraphProperties(engine, g));
+}
+
+/**
+ * Decompiles a single script. The script is disassembled, and unless the
+ * options say otherwise, or the engine does not support it, its control
+ * flow is analyzed and code is generated for it.
+ *
+ * @param engine       The engine the script originates from.
+ * @param inputFile    The script to decompile.
+ * @param vm           The command line options.
+ * @param out          The std::ostream to output the result to.
+ * @param disassembly  The std::ostream to dump the disassembly to, or NULL to not dump it.
+ * @param graph        The std::ostream to output the control flow graph to, or NULL to not output it.
+ * @param stats        Receives measurements of the stages. Those of each function are only collected if --stats is given.
+ */
+static void decompileScript(Engine *engine, const std::string &inputFile, const po::variables_map &vm, std::ostream &out, std::ostream *disassembly, std::ostream *graph, ScriptStats &stats) {
+	// Instructions, values and groups of the script are allocated from here
+	Arena arena;
+
+	// Disassembly
+	StageTimer disassemblyTimer(stats._disassembly);
+	InstVec insts;
+	std::auto_ptr<Disassembler> disassembler(engine->getDisassembler(insts));
+	disassembler->open(inputFile.c_str());
+	disassembler->disassemble();
+	disassemblyTimer.stop();
+	stats._instructions = insts.size();
+
+	if (disassembly)
+		disassembler->dumpDisassembly(*disassembly);
+
+	if (!engine->supportsCodeFlow() || vm.count("only-disassembly") || insts.empty()) {
+		if (!disassembly)
+			disassembler->dumpDisassembly(out);
+		return;
+	}
+
+	disassembler.reset();
+
+	// Control flow analysis
+	StageTimer createGroupsTimer(stats._createGroups);
+	std::auto_ptr<ControlFlow> cf(new ControlFlow(insts, engine));
+	cf->createGroups();
+	createGroupsTimer.stop();
+
+	StageTimer analysisTimer(stats._analysis);
+	const Graph &g = cf->analyze();
+	analysisTimer.stop();
+	stats._groups = boost::num_vertices(g);
+	stats._edges = boost::num_edges(g);
+
+	if (graph)
+		writeGraph(*graph, g, engine);
+
+	if (!engine->supportsCodeGen() || vm.count("only-graph")) {
+		if (!graph)
+			writeGraph(out, g, engine);
+		return;
+	}
+
+	// Post-processing of CFG
+	StageTimer codeGenTimer(stats._codeGen);
+	engine->postCFG(insts, g);
+
+	// Code generation
+	std::auto_ptr<CodeGenerator> cg(engine->getCodeGenerator(out));
+	if (vm.count("stats"))
+		cg->collectStats(&stats._functions);
+	cg->generate(g);
+	codeGenTimer.stop();
+
+	if (vm.count("show-unreachable")) {
+		std::vector<GroupPtr> unreachable;
+		VertexRange vr = boost::vertices(g);
+		for (VertexIterator v = vr.first; v != vr.second; ++v)
+		{
+			GroupPtr gr = boost::get(boost::vertex_name, g, *v);
+			if (gr->_stackLevel == -1)
+				unreachable.push_back(gr);
+		}
+		if (!unreachable.empty()) {
+			for (size_t i = 0; i < unreachable.size(); i++) {
+				if (i == 0) {
+					if (unreachable.size() == 1)
+						out << boost::format("\n%d unreachable group detected.\n") % unreachable.size();
+					else
+						out << boost::format("\n%d unreachable groups detected.\n") % unreachable.size();
+				}
+				out << "Group " << (i + 1) << ":\n";
+				ConstInstIterator inst = unreachable[i]->_start;
+				do {
+					out << *inst;
+				} while (inst++ != unreachable[i]->_end);
+				out << "----------\n";
+			}
+		}
+	}
+}
+
+/**
+ * Outputs measurements of scripts in JSON format.
+ *
+ * @param fileName The file to output to.
+ * @param stats    The measurements to output.
+ */
+static void outputStats(const std::string &fileName, const std::vector<ScriptStats> &stats) {
+	std::ofstream of(fileName.c_str());
+	if (!of)
+		throw Common::FileException("Could not open output file " + fileName);
+	writeStats(of, stats);
+}
+
+/**
+ * Decompiles a set of scripts on several threads, each script with its own
+ * Engine, writing the output for each to its own file.
+ */
+class BatchTask : public Common::ParallelTask {
+private:
+	/**
+	 * A script to decompile, and the outcome.
+	 */
+	struct Job {
+		std::string _outputFile; ///< The output file, without extension.
+		uint32 _size;            ///< Size of the script in bytes.
+		ScriptStats _stats;      ///< The script, and the measurements of decompiling it.
+	};
+
+	ObjectFactory<std::string, Engine> &_engineFactory; ///< Creates the engines for the jobs.
+	const po::variables_map &_vm;                       ///< The command line options.
+	std::vector<Job> _jobs;                             ///< The scripts, in the order they were given.
+	std::vector<size_t> _order;                         ///< Indices into _jobs, largest script first.
+
+	/**
+	 * Orders jobs by decreasing script size.
+	 */
+	struct LargerScript {
+		const std::vector<Job> &_jobs;
+
+		LargerScript(const std::vector<Job> &jobs) : _jobs(jobs) { }
+
+		bool operator()(size_t a, size_t b) const {
+			return _jobs[a]._size > _jobs[b]._size;
+		}
+	};
+
+public:
+	/**
+	 * Constructor for BatchTask.
+	 *
+	 * @param engineFactory Creates the engines for the jobs.
+	 * @param vm            The command line options.
+	 */
+	BatchTask(ObjectFactory<std::string, Engine> &engineFactory, const po::variables_map &vm) : _engineFactory(engineFactory), _vm(vm) { }
+
+	/**
+	 * Adds the scripts to decompile. Directories are replaced by the files in them.
+	 *
+	 * @param inputs    The scripts and directories given on the command line.
+	 * @param outputDir The directory to write the output files to.
+	 */
+	void addScripts(const std::vector<std::string> &inputs, const std::string &outputDir) {
+		std::vector<std::string> files;
+		for (size_t i = 0; i < inputs.size(); i++) {
+			if (!Common::isDirectory(inputs[i].c_str())) {
+				files.push_back(inputs[i]);
+				continue;
+			}
+
+			std::vector<std::string> names;
+			Common::listDirectory(inputs[i].c_str(), names);
+			std::sort(names.begin(), names.end());
+			Common::Filename dir(inputs[i]);
+			if (!dir.directory())
+				dir._path += '/';
+			for (size_t j = 0; j < names.size(); j++)
+				files.push_back(dir.getPath() + names[j]);
+		}
+
+		Common::Filename out(outputDir);
+		if (!out.directory())
+			out._path += '/';
+
+		std::set<std::string> outputs;
+		for (size_t i = 0; i < files.size(); i++) {
+			Job job;
+			job._stats._file = files[i];
+			job._outputFile = out.getPath() + Common::Filename(files[i]).getFullName();
+			if (!outputs.insert(job._outputFile).second)
+				throw Common::FileException("Several scripts are named " + Common::Filename(files[i]).getFullName());
+			Common::File f(files[i], "rb");
+			job._size = f.size();
+			_jobs.push_back(job);
+		}
+
+		// Starting with the largest scripts keeps a few large ones from
+		// being left for the end, when the other threads are idle
+		_order.resize(_jobs.size());
+		for (size_t i = 0; i < _order.size(); i++)
+			_order[i] = i;
+		std::stable_sort(_order.begin(), _order.end(), LargerScript(_jobs));
+	}
+
+	/**
+	 * Gets the number of scripts to decompile.
+	 *
+	 * @returns The number of scripts.
+	 */
+	uint size() const { return _jobs.size(); }
+
+	void run(uint index) {
+		Job &job = _jobs[_order[index]];
+		Engine *engine = _engineFactory.create(_vm["engine"].as<std::string>());
+		engine->_variant = _vm["variant"].as<std::string>();
+
+		try {
+			std::ofstream out((job._outputFile + ".txt").c_str());
+			std::ofstream disassembly, graph;
+			if (_vm.count("dump-disassembly"))
+				disassembly.open((job._outputFile + ".dis").c_str());
+			if (_vm.count("dump-graph"))
+				graph.open((job._outputFile + ".dot").c_str());
+			if (!out || (_vm.count("dump-disassembly") && !disassembly) || (_vm.count("dump-graph") && !graph))
+				throw Common::FileException("Could not open output file " + job._outputFile);
+
+			decompileScript(engine, job._stats._file, _vm, out, _vm.count("dump-disassembly") ? &disassembly : NULL, _vm.count("dump-graph") ? &graph : NULL, job._stats);
+		} catch (std::exception &e) {
+			job._stats._error = e.what();
+		}
+
+		delete engine;
+	}
+
+	/**
+	 * Outputs the stage timings of each script, and the totals.
+	 *
+	 * @param output The std::ostream to output to.
+	 * @returns The number of scripts which could not be decompiled.
+	 */
+	int report(std::ostream &output) const {
+		// In microseconds, which may not fit in 32 bits for a whole game
+		double disassembly = 0, analysis = 0, codeGen = 0;
+		int failed = 0;
+		for (size_t i = 0; i < _jobs.size(); i++) {
+			const ScriptStats &stats = _jobs[i]._stats;
+			output << stats._file << ": ";
+			if (!stats._error.empty()) {
+				output << "ERROR: " << stats._error << "\n";
+				failed++;
+				continue;
+			}
+			uint32 scriptAnalysis = stats._createGroups._time + stats._analysis._time;
+			output << boost::format("disassembly %d ms, control flow %d ms, code generation %d ms\n") % (stats._disassembly._time / 1000) % (scriptAnalysis / 1000) % (stats._codeGen._time / 1000);
+			disassembly += stats._disassembly._time;
+			analysis += scriptAnalysis;
+			codeGen += stats._codeGen._time;
+		}
+		output << boost::format("%d scripts, %d failed: disassembly %d ms, control flow %d ms, code generation %d ms\n") % _jobs.size() % failed % (uint32)(disassembly / 1000) % (uint32)(analysis / 1000) % (uint32)(codeGen / 1000);
+		return failed;
+	}
+
+	/**
+	 * Gets the measurements of all scripts.
+	 *
+	 * @param stats Receives the measurements, in the order the scripts were given.
+	 */
+	void getStats(std::vector<ScriptStats> &stats) const {
+		for (size_t i = 0; i < _jobs.size(); i++)
+			stats.push_back(_jobs[i]._stats);
+	}
+};
+
 int main(int argc, char** argv) {
 	try {
 		std::map<std::string, std::string> engines;
@@ -64,11 +352,14 @@ int main(int argc, char** argv) {
 			("only-graph,G", "Stops after control flow graph has been generated. Implies -g.")
 			("show-unreachable,u", "Show the address and contents of unreachable groups in the script.")
 			("variant,v", po::value<std::string>()->default_value(""), "Tell the engine that the script is from a specific variant. To see a list of variants supported by a specific engine, use the -h option and the -e option together.")
-			("no-stack-effect,s", "Leave out the stack effect when printing raw instructions.");
+			("no-stack-effect,s", "Leave out the stack effect when printing raw instructions.")
+			("batch,b", po::value<std::string>(), "Decompile all given scripts, and all files in given directories, writing the output for each to a file in this directory. -d and -g write to files there too.")
+			("jobs,j", po::value<uint>(), "Number of scripts to decompile at once with -b. Defaults to the number of processors, as does 0.")
+			("stats", po::value<std::string>(), "Output the time, memory use and size of each stage and function in JSON format to a file.");
 
 		po::options_description args("");
 		args.add(visible).add_options()
-			("input-file", po::value<std::string>(), "Input file");
+			("input-file", po::value<std::vector<std::string> >(), "Input file");
 
 		po::positional_options_description fileArg;
 		fileArg.add("input-file", -1);
@@ -94,6 +385,7 @@ int main(int argc, char** argv) {
 
 		if (vm.count("help") || !vm.count("input-file")) {
 			std::cout << "Usage: " << argv[0] << " [option...] file" << "\n";
+			std::cout << "       " << argv[0] << " [option...] -b outputdir file|directory..." << "\n";
 			std::cout << visible << "\n";
 			if (vm.count("engine") && engines.find(vm["engine"].as<std::string>()) != engines.end()) {
 				Engine *engine = engineFactory.create(vm["engine"].as<std::string>());
@@ -126,107 +418,63 @@ int main(int argc, char** argv) {
 			setOutputStackEffect(false);
 		}
 
-		Engine *engine = engineFactory.create(vm["engine"].as<std::string>());
-		engine->_variant = vm["variant"].as<std::string>();
-		std::string inputFile = vm["input-file"].as<std::string>();
+		std::vector<std::string> inputFiles = vm["input-file"].as<std::vector<std::string> >();
 
-		// Disassembly
-		InstVec insts;
-		Disassembler *disassembler = engine->getDisassembler(insts);
-		disassembler->open(inputFile.c_str());
+		if (vm.count("batch")) {
+			uint32 start = Common::getMillis();
+			BatchTask batch(engineFactory, vm);
+			batch.addScripts(inputFiles, vm["batch"].as<std::string>());
 
-		disassembler->disassemble();
-		if (vm.count("dump-disassembly")) {
-			std::streambuf *buf;
-			std::ofstream of;
+			uint numThreads = vm.count("jobs") ? vm["jobs"].as<uint>() : 0;
+			if (numThreads == 0)
+				numThreads = Common::getNumProcessors();
+			Common::runParallel(batch, batch.size(), numThreads);
 
-			if (vm["dump-disassembly"].as<std::string>() != "") {
-				of.open(vm["dump-disassembly"].as<std::string>().c_str());
-				buf = of.rdbuf();
-			} else {
-				buf = std::cout.rdbuf();
-			}
-			std::ostream out(buf);
-			disassembler->dumpDisassembly(out);
-		}
+			int failed = batch.report(std::cout);
+			std::cout << boost::format("Finished in %d ms\n") % (Common::getMillis() - start);
 
-		if (!engine->supportsCodeFlow() || vm.count("only-disassembly") || insts.empty()) {
-			if (!vm.count("dump-disassembly")) {
-				disassembler->dumpDisassembly(std::cout);
+			if (vm.count("stats")) {
+				std::vector<ScriptStats> stats;
+				batch.getStats(stats);
+				outputStats(vm["stats"].as<std::string>(), stats);
 			}
-			delete disassembler;
-			delete engine;
-			return 0;
+			return failed ? 5 : 0;
 		}
 
-		delete disassembler;
-
-		// Control flow analysis
-		ControlFlow *cf = new ControlFlow(insts, engine);
-		cf->createGroups();
-		Graph g = cf->analyze();
+		if (inputFiles.size() != 1) {
+			std::cout << "Only one script can be decompiled at a time, unless -b is specified.\n";
+			return 1;
+		}
 
-		if (vm.count("dump-graph")) {
-			std::streambuf *buf;
-			std::ofstream of;
+		Engine *engine = engineFactory.create(vm["engine"].as<std::string>());
+		engine->_variant = vm["variant"].as<std::string>();
 
-			if (vm["dump-graph"].as<std::string>() != "") {
-				of.open(vm["dump-graph"].as<std::string>().c_str());
-				buf = of.rdbuf();
+		std::ofstream disassemblyFile, graphFile;
+		std::ostream *disassembly = NULL, *graph = NULL;
+		if (vm.count("dump-disassembly")) {
+			if (vm["dump-disassembly"].as<std::string>() != "") {
+				disassemblyFile.open(vm["dump-disassembly"].as<std::string>().c_str());
+				disassembly = &disassemblyFile;
 			} else {
-				buf = std::cout.rdbuf();
+				disassembly = &std::cout;
 			}
-			std::ostream out(buf);
-			boost::write_graphviz(out, g, boost::make_label_writer(get(boost::vertex_name, g)), boost::makeArrowheadWriter(get(boost::edge_attribute, g)), GraphProperties(engine, g));
-		}
-
-		if (!engine->supportsCodeGen() || vm.count("only-graph")) {
-			if (!vm.count("dump-graph")) {
-				boost::write_graphviz(std::cout, g, boost::make_label_writer(get(boost::vertex_name, g)), boost::makeArrowheadWriter(get(boost::edge_attribute, g)), GraphProperties(engine, g));
-			}
-			delete cf;
-			delete engine;
-			return 0;
 		}
-
-		// Post-processing of CFG
-		engine->postCFG(insts, g);
-
-		// Code generation
-		CodeGenerator *cg = engine->getCodeGenerator(std::cout);
-		cg->generate(g);
-
-		if (vm.count("show-unreachable")) {
-			std::vector<GroupPtr> unreachable;
-			VertexRange vr = boost::vertices(g);
-			for (VertexIterator v = vr.first; v != vr.second; ++v)
-			{
-				GroupPtr gr = boost::get(boost::vertex_name, g, *v);
-				if (gr->_stackLevel == -1)
-					unreachable.push_back(gr);
-			}
-			if (!unreachable.empty()) {
-				for (size_t i = 0; i < unreachable.size(); i++) {
-					if (i == 0) {
-						if (unreachable.size() == 1)
-							std::cout << boost::format("\n%d unreachable group detected.\n") % unreachable.size();
-						else
-							std::cout << boost::format("\n%d unreachable groups detected.\n") % unreachable.size();
-					}
-					std::cout << "Group " << (i + 1) << ":\n";
-					ConstInstIterator inst = unreachable[i]->_start;
-					do {
-						std::cout << *inst;
-					} while (inst++ != unreachable[i]->_end);
-					std::cout << "----------\n";
-				}
+		if (vm.count("dump-graph")) {
+			if (vm["dump-graph"].as<std::string>() != "") {
+				graphFile.open(vm["dump-graph"].as<std::string>().c_str());
+				graph = &graphFile;
+			} else {
+				graph = &std::cout;
 			}
 		}
 
-		// Free memory
-		delete cf;
-		delete cg;
+		std::vector<ScriptStats> stats(1);
+		stats[0]._file = inputFiles[0];
+		decompileScript(engine, inputFiles[0], vm, std::cout, disassembly, graph, stats[0]);
 		delete engine;
+
+		if (vm.count("stats"))
+			outputStats(vm["stats"].as<std::string>(), stats);
 	} catch (UnknownOpcodeException &e) {
 		std::cerr << "ERROR: " << e.what() << "\n";
 		return 3;
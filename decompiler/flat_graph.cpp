@@ -0,0 +1,85 @@
+/* ScummVM Tools
+ * Copyright (C) 2010 The ScummVM project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#include "flat_graph.h"
+
+#include <algorithm>
+
+/**
+ * Orders edges by the address of the block at the other end.
+ */
+static bool edgeBefore(const FlatEdge &e1, const FlatEdge &e2) {
+	return e1._block < e2._block;
+}
+
+FlatGraph::FlatGraph(const Graph &g) {
+	// Vertices are never added after the graph is created, only merged away, so they are still ordered by address
+	VertexRange vr = boost::vertices(g);
+	int maxIndex = -1;
+	for (VertexIterator v = vr.first; v != vr.second; ++v) {
+		_blocks.push_back(boost::get(boost::vertex_name, g, *v));
+		maxIndex = std::max(maxIndex, boost::get(boost::vertex_index, g, *v));
+	}
+
+	_blockIndex.assign(maxIndex + 1, -1);
+	int b = 0;
+	for (VertexIterator v = vr.first; v != vr.second; ++v, ++b)
+		_blockIndex[boost::get(boost::vertex_index, g, *v)] = b;
+
+	_succStart.reserve(_blocks.size() + 1);
+	_predStart.reserve(_blocks.size() + 1);
+	_succs.reserve(boost::num_edges(g) + 1);
+	_preds.reserve(boost::num_edges(g) + 1);
+	for (VertexIterator v = vr.first; v != vr.second; ++v) {
+		_succStart.push_back(_succs.size());
+		OutEdgeRange oer = boost::out_edges(*v, g);
+		for (OutEdgeIterator oe = oer.first; oe != oer.second; ++oe)
+			_succs.push_back(FlatEdge(block(g, boost::target(*oe, g)), boost::get(boost::edge_attribute, g, *oe)._isJump));
+		std::sort(_succs.begin() + _succStart.back(), _succs.end(), edgeBefore);
+
+		_predStart.push_back(_preds.size());
+		InEdgeRange ier = boost::in_edges(*v, g);
+		for (InEdgeIterator ie = ier.first; ie != ier.second; ++ie)
+			_preds.push_back(FlatEdge(block(g, boost::source(*ie, g)), boost::get(boost::edge_attribute, g, *ie)._isJump));
+		std::sort(_preds.begin() + _predStart.back(), _preds.end(), edgeBefore);
+	}
+	_succStart.push_back(_succs.size());
+	_predStart.push_back(_preds.size());
+
+	// Keep the edge arrays from being empty, so their first element can always be addressed
+	_succs.push_back(FlatEdge(-1, false));
+	_preds.push_back(FlatEdge(-1, false));
+}
+
+/**
+ * Orders a block address before an address.
+ */
+static bool blockBefore(const GroupPtr &gr, uint32 address) {
+	return (*gr->_start)->_address < address;
+}
+
+int FlatGraph::blockAt(uint32 address) const {
+	std::vector<GroupPtr>::const_iterator it = std::lower_bound(_blocks.begin(), _blocks.end(), address, blockBefore);
+	if (it != _blocks.end() && (*(*it)->_start)->_address == address)
+		return it - _blocks.begin();
+	return (it - _blocks.begin()) - 1;
+}
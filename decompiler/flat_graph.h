@@ -0,0 +1,155 @@
+/* ScummVM Tools
+ * Copyright (C) 2010 The ScummVM project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#ifndef DEC_FLAT_GRAPH_H
+#define DEC_FLAT_GRAPH_H
+
+#include "graph.h"
+
+#include <vector>
+
+/**
+ * Structure representing an edge in a FlatGraph.
+ */
+struct FlatEdge {
+	int _block;   ///< Index of the block at the other end of the edge.
+	bool _isJump; ///< Whether or not the edge is a jump.
+
+	/**
+	 * Constructor for FlatEdge.
+	 *
+	 * @param block  Index of the block at the other end of the edge.
+	 * @param isJump Whether or not the edge is a jump.
+	 */
+	FlatEdge(int block, bool isJump) : _block(block), _isJump(isJump) { }
+};
+
+/**
+ * Compact copy of the structure of a code flow graph, for the passes which
+ * only read the structure. The blocks are kept in one array, ordered by
+ * address, so the group following block b is block b + 1. The edges of all
+ * blocks are kept in two arrays in compressed sparse row form, one for the
+ * outgoing and one for the ingoing edges. The edges of a block are ordered by
+ * the address of the block at the other end, where the Graph orders them by
+ * where the vertices happen to be allocated.
+ *
+ * The Graph stays the representation the groups are created on, and the one
+ * which is handed to the engines and written out in dot format.
+ */
+class FlatGraph {
+private:
+	std::vector<GroupPtr> _blocks;  ///< The groups, ordered by address.
+	std::vector<int> _succStart;    ///< Index of the first outgoing edge of each block in _succs, followed by the number of edges.
+	std::vector<FlatEdge> _succs;   ///< The outgoing edges of all blocks.
+	std::vector<int> _predStart;    ///< Index of the first ingoing edge of each block in _preds, followed by the number of edges.
+	std::vector<FlatEdge> _preds;   ///< The ingoing edges of all blocks.
+	std::vector<int> _blockIndex;   ///< Index of the block for each vertex index, -1 if there is no vertex with that index.
+
+public:
+	/**
+	 * Constructor for an empty FlatGraph.
+	 */
+	FlatGraph() { }
+
+	/**
+	 * Constructor for FlatGraph.
+	 *
+	 * @param g The graph to copy the structure of.
+	 */
+	FlatGraph(const Graph &g);
+
+	/**
+	 * Gets the number of blocks.
+	 *
+	 * @returns The number of blocks.
+	 */
+	int size() const { return _blocks.size(); }
+
+	/**
+	 * Gets the group of a block.
+	 *
+	 * @param b Index of the block.
+	 * @returns The group of the block.
+	 */
+	const GroupPtr &group(int b) const { return _blocks[b]; }
+
+	/**
+	 * Finds the block of a vertex.
+	 *
+	 * @param g The graph the FlatGraph was created from.
+	 * @param v The vertex to find the block for.
+	 * @returns Index of the block.
+	 */
+	int block(const Graph &g, GraphVertex v) const { return _blockIndex[boost::get(boost::vertex_index, g, v)]; }
+
+	/**
+	 * Finds the block starting at an address, or the one containing it.
+	 *
+	 * @param address The address to find the block for.
+	 * @returns Index of the block, or -1 if the address comes before the first block.
+	 */
+	int blockAt(uint32 address) const;
+
+	/**
+	 * Gets the first outgoing edge of a block.
+	 *
+	 * @param b Index of the block.
+	 */
+	const FlatEdge *succBegin(int b) const { return &_succs[0] + _succStart[b]; }
+
+	/**
+	 * Gets the end of the outgoing edges of a block.
+	 *
+	 * @param b Index of the block.
+	 */
+	const FlatEdge *succEnd(int b) const { return &_succs[0] + _succStart[b + 1]; }
+
+	/**
+	 * Gets the number of outgoing edges of a block.
+	 *
+	 * @param b Index of the block.
+	 */
+	int outDegree(int b) const { return _succStart[b + 1] - _succStart[b]; }
+
+	/**
+	 * Gets the first ingoing edge of a block.
+	 *
+	 * @param b Index of the block.
+	 */
+	const FlatEdge *predBegin(int b) const { return &_preds[0] + _predStart[b]; }
+
+	/**
+	 * Gets the end of the ingoing edges of a block.
+	 *
+	 * @param b Index of the block.
+	 */
+	const FlatEdge *predEnd(int b) const { return &_preds[0] + _predStart[b + 1]; }
+
+	/**
+	 * Gets the number of ingoing edges of a block.
+	 *
+	 * @param b Index of the block.
+	 */
+	int inDegree(int b) const { return _predStart[b + 1] - _predStart[b]; }
+};
+
+#endif
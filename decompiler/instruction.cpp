@@ -150,8 +150,8 @@ void UnaryOpPostfixStackInstruction::processInst(ValueStack &stack, Engine *engi
 
 void KernelCallStackInstruction::processInst(ValueStack &stack, Engine *engine, CodeGenerator *codeGen) {
 	codeGen->_argList.clear();
-	bool returnsValue = (_codeGenData.find("r") == 0);
-	std::string metadata = (!returnsValue ? _codeGenData : _codeGenData.substr(1));
+	bool returnsValue = (_codeGenData.str().find("r") == 0);
+	std::string metadata = (!returnsValue ? _codeGenData.str() : _codeGenData.str().substr(1));
 	for (size_t i = 0; i < metadata.length(); i++)
 		codeGen->processSpecialMetadata(this, metadata[i], i);
 	stack.push(new CallValue(_name, codeGen->_argList));
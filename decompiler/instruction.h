@@ -29,6 +29,7 @@
 #include <boost/intrusive_ptr.hpp>
 
 #include "common/scummsys.h"
+#include "arena.h"
 #include "refcounted.h"
 #include "value.h"
 #include "wrongtype.h"
@@ -74,10 +75,10 @@ struct Instruction : public RefCounted {
 public:
 	uint32 _opcode;                 ///< The instruction opcode.
 	uint32 _address;                ///< The instruction address.
-	std::string _name;              ///< The instruction name (opcode name).
+	InternedString _name;           ///< The instruction name (opcode name).
 	int16 _stackChange;             ///< How much this instruction changes the stack pointer by.
 	std::vector<ValuePtr> _params;  ///< Array of parameters used for the instruction.
-	std::string _codeGenData;       ///< String containing metadata for code generation. See the extended documentation for details.
+	InternedString _codeGenData;    ///< String containing metadata for code generation. See the extended documentation for details.
 
 	/**
 	 * Operator overload to output an Instruction to a std::ostream.
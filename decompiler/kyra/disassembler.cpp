@@ -589,6 +589,6 @@ void Kyra::Kyra2Disassembler::doDisassemble() throw(std::exception) {
 				((Kyra2UncondJumpInstruction *) (*it).get())->_isCall = true;
 			}
 		}
-		lastWasPushPos = ((*it)->_name.compare("pushPos") == 0);
+		lastWasPushPos = ((*it)->_name == "pushPos");
 	}
 }
@@ -44,7 +44,7 @@ void Kyra::Kyra2Engine::postCFG(InstVec &insts, Graph g) {
 		it->second._name = s.str();
 		int maxArg = 0;
 		for (ConstInstIterator instIt = it->second._startIt; instIt != it->second._endIt; ++instIt) {
-			if ((*instIt)->_name.compare("pushBPAdd") == 0) {
+			if ((*instIt)->_name == "pushBPAdd") {
 				if (maxArg < (*instIt)->_params[0]->getSigned()) {
 					maxArg = (*instIt)->_params[0]->getSigned();
 				}
@@ -203,8 +203,8 @@ void Kyra::Kyra2UncondJumpInstruction::processInst(ValueStack &stack, Engine *en
 void Kyra::Kyra2KernelCallInstruction::processInst(ValueStack &stack, Engine *engine, CodeGenerator *codeGen) {
 	Kyra2CodeGenerator *cg = (Kyra2CodeGenerator *)codeGen;
 	cg->_argList.clear();
-	bool returnsValue = (_codeGenData.find("r") == 0);
-	std::string metadata = (!returnsValue ? _codeGenData : _codeGenData.substr(1));
+	bool returnsValue = (_codeGenData.str().find("r") == 0);
+	std::string metadata = (!returnsValue ? _codeGenData.str() : _codeGenData.str().substr(1));
 	for (size_t i = 0; i < metadata.length(); i++)
 		cg->processSpecialMetadata(this, metadata[i], i);
 	stack.push(new CallValue(_name, cg->_argList));
@@ -23,6 +23,8 @@
 #ifndef REFCOUNTED_H
 #define REFCOUNTED_H
 
+#include <cstddef>
+
 class RefCounted;
 
 namespace boost {
@@ -42,6 +44,23 @@ private:
 protected:
 	RefCounted() : _refCount(0) { }
 	virtual ~RefCounted() { }
+
+public:
+	/**
+	 * Allocates memory for an object from the current Arena, or from the heap if there is none.
+	 *
+	 * @param size The size of the object.
+	 * @returns Memory for the object.
+	 */
+	static void *operator new(size_t size);
+
+	/**
+	 * Frees the memory of an object, returning it to where it was allocated from.
+	 *
+	 * @param ptr  The memory of the object.
+	 * @param size The size of the object.
+	 */
+	static void operator delete(void *ptr, size_t size);
 };
 
 namespace boost {
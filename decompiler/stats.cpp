@@ -0,0 +1,85 @@
+/* ScummVM Tools
+ * Copyright (C) 2010 The ScummVM project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#include "stats.h"
+
+#include <boost/format.hpp>
+
+/**
+ * Outputs a string as a JSON string literal.
+ */
+static void writeString(std::ostream &output, const std::string &s) {
+	output << '"';
+	for (size_t i = 0; i < s.size(); i++) {
+		unsigned char c = s[i];
+		if (c == '"' || c == '\\')
+			output << '\\' << c;
+		else if (c < 0x20)
+			output << boost::format("\\u%04x") % (int)c;
+		else
+			output << c;
+	}
+	output << '"';
+}
+
+/**
+ * Outputs the measurements of a stage as a JSON object.
+ */
+static void writeStage(std::ostream &output, const StageStats &stage) {
+	output << "{\"time_us\": " << stage._time << ", \"peak_bytes\": " << stage._peakBytes << "}";
+}
+
+void writeStats(std::ostream &output, const std::vector<ScriptStats> &scripts) {
+	output << "{\n\t\"scripts\": [";
+	for (size_t i = 0; i < scripts.size(); i++) {
+		const ScriptStats &script = scripts[i];
+		output << (i ? ",\n" : "\n") << "\t\t{\n\t\t\t\"file\": ";
+		writeString(output, script._file);
+		if (!script._error.empty()) {
+			output << ",\n\t\t\t\"error\": ";
+			writeString(output, script._error);
+		}
+		output << ",\n\t\t\t\"instructions\": " << script._instructions;
+		output << ",\n\t\t\t\"groups\": " << script._groups;
+		output << ",\n\t\t\t\"edges\": " << script._edges;
+		output << ",\n\t\t\t\"stages\": {";
+		output << "\n\t\t\t\t\"disassembly\": ";
+		writeStage(output, script._disassembly);
+		output << ",\n\t\t\t\t\"create_groups\": ";
+		writeStage(output, script._createGroups);
+		output << ",\n\t\t\t\t\"analysis\": ";
+		writeStage(output, script._analysis);
+		output << ",\n\t\t\t\t\"code_generation\": ";
+		writeStage(output, script._codeGen);
+		output << "\n\t\t\t},\n\t\t\t\"functions\": [";
+		for (size_t j = 0; j < script._functions.size(); j++) {
+			const FunctionStats &fn = script._functions[j];
+			output << (j ? ",\n" : "\n") << "\t\t\t\t{\"address\": " << fn._address << ", \"name\": ";
+			writeString(output, fn._name);
+			output << ", \"groups\": " << fn._groups << ", \"instructions\": " << fn._instructions << ", \"edges\": " << fn._edges << ", \"code_generation\": ";
+			writeStage(output, fn._codeGen);
+			output << "}";
+		}
+		output << (script._functions.empty() ? "]" : "\n\t\t\t]") << "\n\t\t}";
+	}
+	output << (scripts.empty() ? "]" : "\n\t]") << "\n}\n";
+}
@@ -0,0 +1,121 @@
+/* ScummVM Tools
+ * Copyright (C) 2010 The ScummVM project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#ifndef DEC_STATS_H
+#define DEC_STATS_H
+
+#include "arena.h"
+
+#include "common/scummsys.h"
+#include "common/thread.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Measurements of a stage of decompiling a script, or of generating the
+ * code for a single function.
+ */
+struct StageStats {
+	uint32 _time;      ///< Wall time spent, in microseconds.
+	size_t _peakBytes; ///< Highest number of bytes allocated from the Arena at once, 0 if there was no Arena.
+
+	StageStats() : _time(0), _peakBytes(0) { }
+};
+
+/**
+ * Measurements of generating the code for a function.
+ */
+struct FunctionStats {
+	uint32 _address;      ///< Address of the first instruction of the function.
+	std::string _name;    ///< Name of the function.
+	size_t _groups;       ///< Number of groups in the function.
+	size_t _instructions; ///< Number of instructions in the function.
+	size_t _edges;        ///< Number of edges leaving the groups of the function.
+	StageStats _codeGen;  ///< Measurements of the code generation.
+
+	FunctionStats() : _address(0), _groups(0), _instructions(0), _edges(0) { }
+};
+
+/**
+ * Measurements of decompiling a script.
+ */
+struct ScriptStats {
+	std::string _file;                     ///< The script.
+	std::string _error;                    ///< Why decompiling the script failed, empty if it did not.
+	size_t _instructions;                  ///< Number of instructions in the script.
+	size_t _groups;                        ///< Number of groups in the control flow graph.
+	size_t _edges;                         ///< Number of edges in the control flow graph.
+	StageStats _disassembly;               ///< Measurements of Disassembler::disassemble.
+	StageStats _createGroups;              ///< Measurements of ControlFlow::createGroups.
+	StageStats _analysis;                  ///< Measurements of ControlFlow::analyze.
+	StageStats _codeGen;                   ///< Measurements of Engine::postCFG and CodeGenerator::generate.
+	std::vector<FunctionStats> _functions; ///< Measurements of each function, if they were requested.
+
+	ScriptStats() : _instructions(0), _groups(0), _edges(0) { }
+};
+
+/**
+ * Measures a stage from construction to stop(). Measurements may be
+ * nested, the peak allocation of the outer one includes the inner one.
+ */
+class StageTimer {
+private:
+	StageStats &_stats; ///< Receives the measurements.
+	Arena *_arena;      ///< The Arena to measure allocations from, NULL if there is none.
+	size_t _outerPeak;  ///< The peak number of bytes of the enclosing measurement.
+	uint32 _start;      ///< Time the stage started, in microseconds.
+
+public:
+	/**
+	 * Constructor for StageTimer. Starts measuring.
+	 *
+	 * @param stats Receives the measurements.
+	 */
+	StageTimer(StageStats &stats) : _stats(stats), _arena(Arena::getCurrent()), _outerPeak(0) {
+		if (_arena)
+			_outerPeak = _arena->resetPeakBytes();
+		_start = Common::getMicros();
+	}
+
+	/**
+	 * Stops measuring and records the measurements.
+	 */
+	void stop() {
+		_stats._time = Common::getMicros() - _start;
+		if (_arena) {
+			_stats._peakBytes = _arena->getPeakBytes();
+			_arena->raisePeakBytes(_outerPeak);
+		}
+	}
+};
+
+/**
+ * Outputs measurements of scripts as a JSON object.
+ *
+ * @param output  The std::ostream to output to.
+ * @param scripts The measurements to output.
+ */
+void writeStats(std::ostream &output, const std::vector<ScriptStats> &scripts);
+
+#endif
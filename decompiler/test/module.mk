@@ -8,9 +8,13 @@
 TESTS        := $(srcdir)/decompiler/test/*.h
 TEST_LIBS    := \
 	common/file.o\
+	common/memorypool.o \
+	common/thread.o \
+	decompiler/arena.o \
 	decompiler/codegen.o \
 	decompiler/control_flow.o \
 	decompiler/disassembler.o \
+	decompiler/flat_graph.o \
 	decompiler/instruction.o \
 	decompiler/simple_disassembler.o \
 	decompiler/value.o \
@@ -21,6 +21,7 @@
  */
 
 #include "value.h"
+#include "arena.h"
 
 #include <boost/format.hpp>
 #include <map>
@@ -28,10 +29,9 @@
 #include <string>
 
 static int dupindex = 0;
-static std::map<std::string, int> binaryOpPrecedence;
-static std::map<std::string, std::string> negateMap;
 
-void initPrecedence() {
+static std::map<std::string, int> createPrecedenceMap() {
+	std::map<std::string, int> binaryOpPrecedence;
 	binaryOpPrecedence["||"] = kLogicalOrPrecedence;
 	binaryOpPrecedence["&&"] = kLogicalAndPrecedence;
 	binaryOpPrecedence["|"] = kBitwiseOrPrecedence;
@@ -50,17 +50,24 @@ void initPrecedence() {
 	binaryOpPrecedence["*"] = kMultOpPrecedence;
 	binaryOpPrecedence["/"] = kMultOpPrecedence;
 	binaryOpPrecedence["%"] = kMultOpPrecedence;
+	return binaryOpPrecedence;
 }
 
-void initNegateMap() {
+static std::map<std::string, std::string> createNegateMap() {
+	std::map<std::string, std::string> negateMap;
 	negateMap["=="] = "!=";
 	negateMap["!="] = "==";
 	negateMap["<"] = ">=";
 	negateMap["<="] = ">";
 	negateMap[">="] = "<";
 	negateMap[">"] = "<=";
+	return negateMap;
 }
 
+// Filled before main(), as scripts may be decompiled on several threads
+static const std::map<std::string, int> binaryOpPrecedence = createPrecedenceMap();
+static const std::map<std::string, std::string> negateMap = createNegateMap();
+
 bool Value::isInteger() {
 	return false;
 }
@@ -82,7 +89,8 @@ uint32 Value::getUnsigned() throw(WrongTypeException) {
 }
 
 ValuePtr Value::dup(std::ostream &output) {
-	ValuePtr dupValue = new DupValue(++dupindex);
+	Arena *arena = Arena::getCurrent();
+	ValuePtr dupValue = new DupValue(arena != NULL ? arena->nextDupIndex() : ++dupindex);
 	output << dupValue << " = " << this << ";";
 	return dupValue;
 }
@@ -200,18 +208,16 @@ std::ostream &BinaryOpValue::print(std::ostream &output) const {
 }
 
 int BinaryOpValue::precedence() const {
-	if (binaryOpPrecedence.empty())
-		initPrecedence();
-	return binaryOpPrecedence[_op];
+	std::map<std::string, int>::const_iterator it = binaryOpPrecedence.find(_op);
+	return it != binaryOpPrecedence.end() ? it->second : 0;
 }
 
 ValuePtr BinaryOpValue::negate() throw(WrongTypeException) {
-	if (negateMap.empty())
-		initNegateMap();
-	if (negateMap.find(_op) == negateMap.end())
+	std::map<std::string, std::string>::const_iterator it = negateMap.find(_op);
+	if (it == negateMap.end())
 		return Value::negate();
 	else
-		return new BinaryOpValue(_lhs, _rhs, negateMap[_op]);
+		return new BinaryOpValue(_lhs, _rhs, it->second);
 }
 
 std::ostream &UnaryOpValue::print(std::ostream &output) const {
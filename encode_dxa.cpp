@@ -22,12 +22,14 @@
  */
 
 #include <stdlib.h>
+#include <algorithm>
 #include <sys/stat.h>
 #include <png.h>
 #include <zlib.h>
 
 #include "encode_dxa.h"
 #include "common/endian.h"
+#include "common/thread.h"
 
 const uint32 typeDEXA = 0x41584544;
 const uint32 typeFRAM = 0x4d415246;
@@ -47,6 +49,148 @@ struct DiffStruct {
 	byte pixels[BLOCKW*BLOCKH];
 };
 
+/* 4x4 and 2x2 blocks are compared one row at a time, as a single word */
+static inline bool blocksAreEqual(const byte *b1, const byte *b2, int pitch, int w, int h) {
+	for (int yc = 0; yc < h; yc++) {
+		if (w == 4) {
+			if (READ_LE_UINT32(b1) != READ_LE_UINT32(b2))
+				return false;
+		} else if (w == 2) {
+			if (READ_LE_UINT16(b1) != READ_LE_UINT16(b2))
+				return false;
+		} else if (memcmp(b1, b2, w)) {
+			return false;
+		}
+		b1 += pitch;
+		b2 += pitch;
+	}
+	return true;
+}
+
+/**
+ * Index of all the blocks of a given size in a frame, at every pixel
+ * position, used to find motion vectors without trying every offset.
+ * Positions are bucketed by a hash of the block contents and kept in
+ * raster order, so the first match found is the one a scan of the search
+ * window would have found. The index is only built on first use.
+ */
+class DxaBlockIndex {
+public:
+	DxaBlockIndex(const byte *frame, int width, int height, int blockw, int blockh)
+		: _frame(frame), _width(width), _height(height), _blockw(blockw), _blockh(blockh), _built(false) {}
+
+	/* find the first block equal to the one at block in the window of
+	 * top-left positions [xmin, xmax) x [ymin, ymax) */
+	bool find(const byte *block, int xmin, int ymin, int xmax, int ymax, int &fx, int &fy);
+
+private:
+	enum { kHashBits = 16 };
+
+	const byte *_frame;
+	int _width, _height, _blockw, _blockh;
+	bool _built;
+
+	std::vector<uint32> _bucketStart;
+	std::vector<uint32> _positions;
+
+	uint32 hash(const byte *block) const;
+	void build();
+};
+
+uint32 DxaBlockIndex::hash(const byte *block) const {
+	uint32 h = 0;
+	for (int yc = 0; yc < _blockh; yc++) {
+		uint32 row = (_blockw == 4) ? READ_LE_UINT32(block) : READ_LE_UINT16(block);
+		h = (h ^ row) * 0x9E3779B1;
+		block += _width;
+	}
+	return h >> (32 - kHashBits);
+}
+
+void DxaBlockIndex::build() {
+	int lastx = _width - _blockw, lasty = _height - _blockh;
+	std::vector<uint16> hashes;
+
+	_bucketStart.assign((1 << kHashBits) + 1, 0);
+	_built = true;
+
+	if (lastx < 0 || lasty < 0)
+		return;
+
+	/* counting sort of the positions by hash, keeping them in raster order */
+	hashes.resize((lasty + 1) * (lastx + 1));
+	uint16 *hp = &hashes[0];
+	for (int y = 0; y <= lasty; y++) {
+		for (int x = 0; x <= lastx; x++) {
+			*hp = hash(_frame + x + y * _width);
+			_bucketStart[*hp + 1]++;
+			hp++;
+		}
+	}
+
+	for (int i = 0; i < (1 << kHashBits); i++)
+		_bucketStart[i + 1] += _bucketStart[i];
+
+	std::vector<uint32> next(_bucketStart.begin(), _bucketStart.end() - 1);
+	_positions.resize(hashes.size());
+	hp = &hashes[0];
+	for (int y = 0; y <= lasty; y++) {
+		for (int x = 0; x <= lastx; x++)
+			_positions[next[*hp++]++] = x + y * _width;
+	}
+}
+
+bool DxaBlockIndex::find(const byte *block, int xmin, int ymin, int xmax, int ymax, int &fx, int &fy) {
+	if (!_built)
+		build();
+
+	if (_blockw != 4 && _blockw != 2)
+		return false;
+
+	uint32 h = hash(block);
+	if (_bucketStart[h] == _bucketStart[h + 1])
+		return false;
+
+	const uint32 *first = &_positions[0] + _bucketStart[h];
+	const uint32 *last = &_positions[0] + _bucketStart[h + 1];
+	uint32 lastPos = (ymax - 1) * _width + (xmax - 1);
+
+	for (const uint32 *p = std::lower_bound(first, last, (uint32)(ymin * _width + xmin)); p != last && *p <= lastPos; p++) {
+		int x = *p % _width;
+		if (x < xmin || x >= xmax)
+			continue;
+		if (blocksAreEqual(_frame + *p, block, _width, _blockw, _blockh)) {
+			fx = x;
+			fy = *p / _width;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* the ways of compressing a changed frame, tried by DxaEncoder::encodeCandidate() */
+enum {
+	kCandidateM13,
+	kCandidateXor,
+	kCandidateRaw,
+	kNumCandidates
+};
+
+struct DxaFrame {
+	byte *image;
+	byte *palette;
+
+	/* set by DxaEncoder::beginBatch() */
+	const byte *prevImage;
+	bool keyFrame;
+	bool changed;
+
+	/* compressed candidates, empty if not tried or failed */
+	std::vector<byte> packed[kNumCandidates];
+
+	DxaFrame() : image(0), palette(0), prevImage(0), keyFrame(false), changed(false) {}
+};
+
 class DxaEncoder {
 private:
 	Common::File _dxa;
@@ -54,21 +198,28 @@ private:
 	uint8 *_prevframe, *_prevpalette;
 	ScaleMode _scaleMode;
 
-	byte *_codeBuf, *_dataBuf, *_motBuf, *_maskBuf;
 	void grabBlock(byte *frame, int x, int y, int blockw, int blockh, byte *block);
-	bool m13blocksAreEqual(byte *frame, int x, int y, int x2, int y2, int w, int h);
+	bool m13blocksAreEqual(const byte *prev, byte *frame, int x, int y, int x2, int y2, int w, int h);
 	bool m13blockIsSolidColor(byte *frame, int x, int y, int w, int h, byte &color);
-	void m13blockDelta(byte *frame, int x, int y, int x2, int y2, DiffStruct &diff);
-	bool m13motionVector(byte *frame, int x, int y, int w, int h, int &mx, int &my);
+	void m13blockDelta(const byte *prev, byte *frame, int x, int y, int x2, int y2, DiffStruct &diff);
+	bool m13motionVector(DxaBlockIndex &index, byte *frame, int x, int y, int w, int h, int &mx, int &my);
 	int m13countColors(byte *block, byte *pixels, unsigned long &code, int &codeSize);
-	uLong m13encode(byte *frame, byte *outbuf);
+	uLong m13encode(const byte *prev, byte *frame, byte *outbuf);
+	void compressCandidate(const byte *data, uLong size, std::vector<byte> &out);
 
 public:
 	DxaEncoder(Tool &tool, Common::Filename filename, int width, int height, int framerate, ScaleMode scaleMode);
 	~DxaEncoder();
 	void writeHeader();
 	void writeNULL();
-	void writeFrame(uint8 *frame, uint8 *palette);
+
+	/* frames are encoded in batches: beginBatch() compares each frame to the
+	 * previous one, encodeCandidate() may then be called from several threads
+	 * for every frame and candidate, and writeFrame() finally stores the
+	 * smallest candidate, for each frame in order */
+	void beginBatch(DxaFrame *frames, uint count);
+	void encodeCandidate(DxaFrame &frame, int candidate);
+	void writeFrame(DxaFrame &frame);
 };
 
 DxaEncoder::DxaEncoder(Tool &tool, Common::Filename filename, int width, int height, int framerate, ScaleMode scaleMode) {
@@ -82,11 +233,6 @@ DxaEncoder::DxaEncoder(Tool &tool, Common::Filename filename, int width, int hei
 	_scaleMode = scaleMode;
 	_workheight = _scaleMode == S_NONE ? _height : _height / 2;
 
-	_codeBuf = new byte[_width * _height / 16];
-	_dataBuf = new byte[_width * _height];
-	_motBuf = new byte[_width * _height];
-	_maskBuf = new byte[_width * _height];
-
 	writeHeader();
 }
 
@@ -95,11 +241,6 @@ DxaEncoder::~DxaEncoder() {
 
 	writeHeader();
 
-	delete[] _codeBuf;
-	delete[] _dataBuf;
-	delete[] _motBuf;
-	delete[] _maskBuf;
-
 	delete[] _prevframe;
 	delete[] _prevpalette;
 }
@@ -128,110 +269,100 @@ void DxaEncoder::writeNULL() {
 	_dxa.writeUint32LE(typeNULL);
 }
 
-void DxaEncoder::writeFrame(byte *frame, byte *palette) {
-
-	if (_framecount == 0 || memcmp(_prevpalette, palette, 768)) {
-		_dxa.writeUint32LE(typeCMAP);
-		_dxa.write(palette, 768);
-		memcpy(_prevpalette, palette, 768);
-	} else {
-		writeNULL();
-	}
+void DxaEncoder::beginBatch(DxaFrame *frames, uint count) {
+	for (uint i = 0; i < count; i++) {
+		DxaFrame &frame = frames[i];
 
-	if (_framecount == 0 || memcmp(_prevframe, frame, _width * _workheight)) {
-		//FRAM
-		byte compType;
+		/* the previous frame is either part of this batch or already written */
+		frame.prevImage = (i == 0) ? _prevframe : frames[i - 1].image;
+		frame.keyFrame = (_framecount + i == 0);
+		frame.changed = frame.keyFrame || memcmp(frame.prevImage, frame.image, _width * _workheight);
 
-		_dxa.writeUint32LE(typeFRAM);
+		for (int c = 0; c < kNumCandidates; c++)
+			frame.packed[c].clear();
+	}
+}
 
-		if (_framecount == 0)
-			compType = 2;
-		else
-			compType = 13;
-
-		switch (compType) {
-
-		case 2:
-			{
-				uLong outsize = _width * _workheight;
-				byte *outbuf = new byte[outsize];
-				compress2(outbuf, &outsize, frame, _width * _workheight, 9);
-				_dxa.writeByte(compType);
-				_dxa.writeUint32BE(outsize);
-				_dxa.write(outbuf, outsize);
-				delete[] outbuf;
-				break;
-			}
+void DxaEncoder::compressCandidate(const byte *data, uLong size, std::vector<byte> &out) {
+	uLongf outsize = compressBound(size);
+	out.resize(outsize);
 
-		case 13:
-			{
-				int r;
-				uLong frameoutsize;
-				byte *frameoutbuf;
+	if (compress2(&out[0], &outsize, data, size, 9) != Z_OK)
+		out.clear();
+	else
+		out.resize(outsize);
+}
 
-				byte *xorbuf = new byte[_width * _workheight];
-				uLong xorsize_z = _width * _workheight;
-				byte *xorbuf_z = new byte[xorsize_z];
+void DxaEncoder::encodeCandidate(DxaFrame &frame, int candidate) {
+	if (!frame.changed)
+		return;
 
-				uLong rawsize_z = _width * _workheight;
-				byte *rawbuf_z = new byte[rawsize_z];
+	/* the first frame is always stored with mode 2 */
+	if (frame.keyFrame && candidate != kCandidateRaw)
+		return;
 
-				uLong m13size = _width * _workheight * 2;
-				byte *m13buf = new byte[m13size];
-				uLong m13size_z = _width * _workheight;
-				byte *m13buf_z = new byte[m13size_z];
+	uLong size = _width * _workheight;
 
-				/* encode the delta frame with mode 12 */
-				m13size = m13encode(frame, m13buf);
+	switch (candidate) {
+	case kCandidateM13:
+		{
+			/* encode the delta frame with mode 12 */
+			byte *m13buf = new byte[size * 2];
+			uLong m13size = m13encode(frame.prevImage, frame.image, m13buf);
+			compressCandidate(m13buf, m13size, frame.packed[candidate]);
+			delete[] m13buf;
+			break;
+		}
 
-				/* create the xor buffer */
-				for (int i = 0; i < _width * _workheight; i++)
-					xorbuf[i] = _prevframe[i] ^ frame[i];
+	case kCandidateXor:
+		{
+			byte *xorbuf = new byte[size];
+			for (uLong i = 0; i < size; i++)
+				xorbuf[i] = frame.prevImage[i] ^ frame.image[i];
+			compressCandidate(xorbuf, size, frame.packed[candidate]);
+			delete[] xorbuf;
+			break;
+		}
 
-				/* compress the m13 buffer */
-				compress2(m13buf_z, &m13size_z, m13buf, m13size, 9);
+	case kCandidateRaw:
+		compressCandidate(frame.image, size, frame.packed[candidate]);
+		break;
+	}
+}
 
-				/* compress the xor buffer */
-				xorsize_z = m13size_z;
-				r = compress2(xorbuf_z, &xorsize_z, xorbuf, _width * _workheight, 9);
-				if (r != Z_OK) xorsize_z = 0xFFFFFFF;
+void DxaEncoder::writeFrame(DxaFrame &frame) {
 
-				if (m13size_z < xorsize_z) {
-					compType = 13;
-					frameoutsize = m13size_z;
-					frameoutbuf = m13buf_z;
-				} else {
-					compType = 3;
-					frameoutsize = xorsize_z;
-					frameoutbuf = xorbuf_z;
-				}
+	if (_framecount == 0 || memcmp(_prevpalette, frame.palette, 768)) {
+		_dxa.writeUint32LE(typeCMAP);
+		_dxa.write(frame.palette, 768);
+		memcpy(_prevpalette, frame.palette, 768);
+	} else {
+		writeNULL();
+	}
 
-				/* compress the raw frame */
-				rawsize_z = frameoutsize;
-				r = compress2(rawbuf_z, &rawsize_z, frame, _width * _workheight, 9);
-				if (r != Z_OK) rawsize_z = 0xFFFFFFF;
+	if (frame.changed) {
+		//FRAM
+		static const byte compTypes[kNumCandidates] = { 13, 3, 2 };
+		uLong sizes[kNumCandidates];
+		int best;
 
-				if (rawsize_z < frameoutsize) {
-					compType = 2;
-					frameoutsize = rawsize_z;
-					frameoutbuf = rawbuf_z;
-				}
+		for (int c = 0; c < kNumCandidates; c++)
+			sizes[c] = frame.packed[c].empty() ? 0xFFFFFFF : frame.packed[c].size();
 
-				_dxa.writeByte(compType);
-				_dxa.writeUint32BE(frameoutsize);
-				_dxa.write(frameoutbuf, frameoutsize);
+		/* xor wins over mode 13 on equal sizes, and either wins over the raw frame */
+		best = (sizes[kCandidateM13] < sizes[kCandidateXor]) ? kCandidateM13 : kCandidateXor;
+		if (frame.keyFrame || sizes[kCandidateRaw] < sizes[best])
+			best = kCandidateRaw;
 
-				delete[] xorbuf_z;
-				delete[] rawbuf_z;
-				delete[] m13buf_z;
-				delete[] m13buf;
-				delete[] xorbuf;
+		if (frame.packed[best].empty())
+			throw ToolException("Could not compress a frame of the video");
 
-				break;
-			}
-		}
+		_dxa.writeUint32LE(typeFRAM);
+		_dxa.writeByte(compTypes[best]);
+		_dxa.writeUint32BE(frame.packed[best].size());
+		_dxa.write(&frame.packed[best][0], frame.packed[best].size());
 
-		memcpy(_prevframe, frame, _width * _workheight);
+		memcpy(_prevframe, frame.image, _width * _workheight);
 
 	} else {
 		writeNULL();
@@ -240,43 +371,48 @@ void DxaEncoder::writeFrame(byte *frame, byte *palette) {
 	_framecount++;
 }
 
-bool DxaEncoder::m13blocksAreEqual(byte *frame, int x, int y, int x2, int y2, int w, int h) {
-	byte *b1 = _prevframe + x + y * _width;
-	byte *b2 = frame + x2 + y2 * _width;
-	for (int yc = 0; yc < h; yc++) {
-		if (memcmp(b1, b2, w))
-			return false;
-		b1 += _width;
-		b2 += _width;
-	}
-	return true;
+bool DxaEncoder::m13blocksAreEqual(const byte *prev, byte *frame, int x, int y, int x2, int y2, int w, int h) {
+	return blocksAreEqual(prev + x + y * _width, frame + x2 + y2 * _width, _width, w, h);
 }
 
 bool DxaEncoder::m13blockIsSolidColor(byte *frame, int x, int y, int w, int h, byte &color) {
 	byte *b2 = frame + x + y * _width;
 	color = *b2;
 	for (int yc = 0; yc < h; yc++) {
-		for (int xc = 0; xc < w; xc++) {
-			if (b2[xc] != color)
+		if (w == 4) {
+			if (READ_LE_UINT32(b2) != color * 0x01010101U)
 				return false;
+		} else if (w == 2) {
+			if (READ_LE_UINT16(b2) != color * 0x0101U)
+				return false;
+		} else {
+			for (int xc = 0; xc < w; xc++) {
+				if (b2[xc] != color)
+					return false;
+			}
 		}
 		b2 += _width;
 	}
 	return true;
 }
 
-void DxaEncoder::m13blockDelta(byte *frame, int x, int y, int x2, int y2, DiffStruct &diff) {
-	byte *b1 = _prevframe + x + y * _width;
+void DxaEncoder::m13blockDelta(const byte *prev, byte *frame, int x, int y, int x2, int y2, DiffStruct &diff) {
+	const byte *b1 = prev + x + y * _width;
 	byte *b2 = frame + x2 + y2 * _width;
 	diff.count = 0;
 	diff.map = 0;
 	for (int yc = 0; yc < BLOCKH; yc++) {
-		for (int xc = 0; xc < BLOCKW; xc++) {
-			if (b1[xc] != b2[xc]) {
-				diff.map = (diff.map << 1) | 1;
-				diff.pixels[diff.count++] = b2[xc];
-			} else {
-				diff.map = (diff.map << 1) | 0;
+		/* skip unchanged rows as a whole */
+		if (READ_LE_UINT32(b1) == READ_LE_UINT32(b2)) {
+			diff.map <<= BLOCKW;
+		} else {
+			for (int xc = 0; xc < BLOCKW; xc++) {
+				if (b1[xc] != b2[xc]) {
+					diff.map = (diff.map << 1) | 1;
+					diff.pixels[diff.count++] = b2[xc];
+				} else {
+					diff.map = (diff.map << 1) | 0;
+				}
 			}
 		}
 		b1 += _width;
@@ -284,19 +420,17 @@ void DxaEncoder::m13blockDelta(byte *frame, int x, int y, int x2, int y2, DiffSt
 	}
 }
 
-bool DxaEncoder::m13motionVector(byte *frame, int x, int y, int w, int h, int &mx, int &my) {
+bool DxaEncoder::m13motionVector(DxaBlockIndex &index, byte *frame, int x, int y, int w, int h, int &mx, int &my) {
+	/* only consider source blocks which lie entirely within the frame */
 	int xmin = (0 > x-7) ? 0 : x-7;
 	int ymin = (0 > y-7) ? 0 : y-7;
-	int xmax = (_width < x+8) ? _width : x+8;
-	int ymax = (_workheight < y+8) ? _height : y+8;
-	for (int yc = ymin; yc < ymax; yc++) {
-		for (int xc = xmin; xc < xmax; xc++) {
-			if (m13blocksAreEqual(frame, xc, yc, x, y, w, h)) {
-				mx = xc - x;
-				my = yc - y;
-				return true;
-			}
-		}
+	int xmax = (_width - w + 1 < x+8) ? _width - w + 1 : x+8;
+	int ymax = (_workheight - h + 1 < y+8) ? _workheight - h + 1 : y+8;
+	int xc, yc;
+	if (index.find(frame + x + y * _width, xmin, ymin, xmax, ymax, xc, yc)) {
+		mx = xc - x;
+		my = yc - y;
+		return true;
 	}
 	return false;
 }
@@ -306,33 +440,34 @@ int DxaEncoder::m13countColors(byte *block, byte *pixels, unsigned long &code, i
 	code = 0;
 	codeSize = 0;
 
-	/* count the number of colors used in this block */
+	/* count the number of colors used in this block; only blocks with up to
+	   four colors can be stored this way, so stop counting after five */
 	int count = 0;
-	int colTab[256];
-	for (int i = 0; i < 256; i++)
-		colTab[i] = -1;
+	byte colIndex[BLOCKW * BLOCKH];
 
 	for (int i = 0; i < BLOCKW * BLOCKH; i++) {
-		if (colTab[block[i]] == -1) {
-			colTab[block[i]] = count;
-			pixels[count] = block[i];
-			count++;
+		int c = 0;
+		while (c < count && pixels[c] != block[i])
+			c++;
+		if (c == count) {
+			if (count == 4)
+				return 5;
+			pixels[count++] = block[i];
 		}
+		colIndex[i] = c;
 	}
 
-	if (count <= 4) {
-		/* set the bitmask */
-		if (count == 2) {
-			for (int i = 15; i >= 0; i--) {
-				code = (code << 1) | colTab[block[i]];
-			}
-			codeSize = 2;
-		} else if (count == 4 || count == 3) {
-			for (int i = 15; i >= 0; i--) {
-				code = (code << 2) | colTab[block[i]];
-			}
-			codeSize = 4;
+	/* set the bitmask */
+	if (count == 2) {
+		for (int i = 15; i >= 0; i--) {
+			code = (code << 1) | colIndex[i];
+		}
+		codeSize = 2;
+	} else if (count == 4 || count == 3) {
+		for (int i = 15; i >= 0; i--) {
+			code = (code << 2) | colIndex[i];
 		}
+		codeSize = 4;
 	}
 
 	return count;
@@ -347,26 +482,36 @@ void DxaEncoder::grabBlock(byte *frame, int x, int y, int blockw, int blockh, by
 	}
 }
 
-uLong DxaEncoder::m13encode(byte *frame, byte *outbuf) {
+uLong DxaEncoder::m13encode(const byte *prev, byte *frame, byte *outbuf) {
 
-	byte *codeB = _codeBuf;
-	byte *dataB = _dataBuf;
-	byte *motB = _motBuf;
-	byte *maskB = _maskBuf;
+	/* scratch buffers, local so that frames can be encoded concurrently */
+	byte *codeBuf = new byte[_width * _height / 16];
+	byte *dataBuf = new byte[_width * _height];
+	byte *motBuf = new byte[_width * _height];
+	byte *maskBuf = new byte[_width * _height];
+
+	/* previous frame blocks, for the motion vector search */
+	DxaBlockIndex blockIndex(prev, _width, _workheight, BLOCKW, BLOCKH);
+	DxaBlockIndex subBlockIndex(prev, _width, _workheight, BLOCKW/2, BLOCKH/2);
+
+	byte *codeB = codeBuf;
+	byte *dataB = dataBuf;
+	byte *motB = motBuf;
+	byte *maskB = maskBuf;
 
 	byte *outb = outbuf;
 	byte color;
 	int mx, my;
 	DiffStruct diff;
 
-	memset(_codeBuf, 0, _width * _height / 16);
-	memset(_dataBuf, 0, _width * _height);
-	memset(_motBuf, 0, _width * _height);
-	memset(_maskBuf, 0, _width * _height);
+	memset(codeBuf, 0, _width * _height / 16);
+	memset(dataBuf, 0, _width * _height);
+	memset(motBuf, 0, _width * _height);
+	memset(maskBuf, 0, _width * _height);
 
 	for (int by = 0; by < _workheight; by += BLOCKH) {
 		for (int bx = 0; bx < _width; bx += BLOCKW) {
-			if (m13blocksAreEqual(frame, bx, by, bx, by, BLOCKW, BLOCKH)) {
+			if (m13blocksAreEqual(prev, frame, bx, by, bx, by, BLOCKW, BLOCKH)) {
 				*codeB++ = 0;
 				continue;
 			}
@@ -377,7 +522,7 @@ uLong DxaEncoder::m13encode(byte *frame, byte *outbuf) {
 				continue;
 			}
 
-			if (m13motionVector(frame, bx, by, BLOCKW, BLOCKH, mx, my)) {
+			if (m13motionVector(blockIndex, frame, bx, by, BLOCKW, BLOCKH, mx, my)) {
 				/* motion vector */
 				byte motionByte = 0;
 				if (mx < 0) motionByte |= 0x80;
@@ -408,7 +553,7 @@ uLong DxaEncoder::m13encode(byte *frame, byte *outbuf) {
 				byte scolor;
 				int smx, smy;
 
-				if (m13blocksAreEqual(frame, sx, sy, sx, sy, BLOCKW/2, BLOCKH/2)) {
+				if (m13blocksAreEqual(prev, frame, sx, sy, sx, sy, BLOCKW/2, BLOCKH/2)) {
 					subMask = (subMask << 2) | 0;
 					continue;
 				}
@@ -419,7 +564,7 @@ uLong DxaEncoder::m13encode(byte *frame, byte *outbuf) {
 					continue;
 				}
 
-				if (m13motionVector(frame, sx, sy, BLOCKW/2, BLOCKH/2, smx, smy)) {
+				if (m13motionVector(subBlockIndex, frame, sx, sy, BLOCKW/2, BLOCKH/2, smx, smy)) {
 					byte motionByte = 0;
 					if (smx < 0) motionByte |= 0x80;
 					motionByte |= (abs(smx) & 7) << 4;
@@ -442,7 +587,7 @@ uLong DxaEncoder::m13encode(byte *frame, byte *outbuf) {
 
 			int blockSize = 0;
 
-			m13blockDelta(frame, bx, by, bx, by, diff);
+			m13blockDelta(prev, frame, bx, by, bx, by, diff);
 
 			byte block[16];
 			grabBlock(frame, bx, by, BLOCKW, BLOCKW, block);
@@ -512,32 +657,84 @@ uLong DxaEncoder::m13encode(byte *frame, byte *outbuf) {
 
 	int size;
 
-	size = dataB - _dataBuf;
+	size = dataB - dataBuf;
 	WRITE_BE_UINT32(outb, size);
 	outb += 4;
-	size = motB - _motBuf;
+	size = motB - motBuf;
 	WRITE_BE_UINT32(outb, size);
 	outb += 4;
-	size = maskB - _maskBuf;
+	size = maskB - maskBuf;
 	WRITE_BE_UINT32(outb, size);
 	outb += 4;
 
 	/* this size is always constant throughout a DXA */
-	memcpy(outb, _codeBuf, codeB - _codeBuf);
-	outb += codeB - _codeBuf;
+	memcpy(outb, codeBuf, codeB - codeBuf);
+	outb += codeB - codeBuf;
 
-	memcpy(outb, _dataBuf, dataB - _dataBuf);
-	outb += dataB - _dataBuf;
+	memcpy(outb, dataBuf, dataB - dataBuf);
+	outb += dataB - dataBuf;
 
-	memcpy(outb, _motBuf, motB - _motBuf);
-	outb += motB - _motBuf;
+	memcpy(outb, motBuf, motB - motBuf);
+	outb += motB - motBuf;
 
-	memcpy(outb, _maskBuf, maskB - _maskBuf);
-	outb += maskB - _maskBuf;
+	memcpy(outb, maskBuf, maskB - maskBuf);
+	outb += maskB - maskBuf;
+
+	delete[] codeBuf;
+	delete[] dataBuf;
+	delete[] motBuf;
+	delete[] maskBuf;
 
 	return outb - outbuf;
 }
 
+/**
+ * One step of the video pipeline: encodes the candidates of a batch of frames
+ * while the PNG files of the next batch are being decoded.
+ */
+class DxaPipelineTask : public Common::ParallelTask {
+public:
+	DxaPipelineTask(EncodeDXA &tool, DxaEncoder &encoder, const DxaVideoInfo &info)
+		: _tool(tool), _encoder(encoder), _info(info),
+		  _encodeFrames(0), _encodeCount(0), _decodeFrames(0), _decodeCount(0), _firstDecoded(0) {}
+
+	void setEncodeBatch(DxaFrame *frames, uint count) {
+		_encodeFrames = frames;
+		_encodeCount = count;
+	}
+
+	void setDecodeBatch(DxaFrame *frames, uint count, int firstFrame) {
+		_decodeFrames = frames;
+		_decodeCount = count;
+		_firstDecoded = firstFrame;
+	}
+
+	uint getItemCount() const {
+		return _encodeCount * kNumCandidates + _decodeCount;
+	}
+
+	virtual void run(uint index) {
+		// Encoding items come first, as they take the longest
+		if (index < _encodeCount * kNumCandidates)
+			_encoder.encodeCandidate(_encodeFrames[index / kNumCandidates], index % kNumCandidates);
+		else {
+			index -= _encodeCount * kNumCandidates;
+			_tool.decodeFrame(_info, _firstDecoded + index, _decodeFrames[index]);
+		}
+	}
+
+private:
+	EncodeDXA &_tool;
+	DxaEncoder &_encoder;
+	const DxaVideoInfo &_info;
+
+	DxaFrame *_encodeFrames;
+	uint _encodeCount;
+	DxaFrame *_decodeFrames;
+	uint _decodeCount;
+	int _firstDecoded;
+};
+
 EncodeDXA::EncodeDXA(const std::string &name) : CompressionTool(name, TOOLTYPE_COMPRESSION) {
 
 	ToolInput input;
@@ -551,8 +748,7 @@ EncodeDXA::EncodeDXA(const std::string &name) : CompressionTool(name, TOOLTYPE_C
 }
 
 void EncodeDXA::execute() {
-	int width, height, framerate, frames;
-	ScaleMode scaleMode;
+	DxaVideoInfo info;
 	Common::Filename inpath(_inputPaths[0].path);
 	Common::Filename outpath(_outputPath);
 
@@ -570,72 +766,107 @@ void EncodeDXA::execute() {
 	}
 
 	// read some data from the Bink or Smacker file.
-	readVideoInfo(&inpath, width, height, framerate, frames, scaleMode);
+	readVideoInfo(&inpath, info.width, info.height, info.framerate, info.frames, info.scaleMode);
+	info.basePath = inpath.getFullPath();
 
 	print("Width = %d, Height = %d, Framerate = %d, Frames = %d\n",
-		   width, height, framerate, frames);
+		   info.width, info.height, info.framerate, info.frames);
 
 	// create the encoder object
 	outpath.setExtension(".dxa");
-	DxaEncoder dxe(*this, outpath, width, height, framerate, scaleMode);
+	DxaEncoder dxe(*this, outpath, info.width, info.height, info.framerate, info.scaleMode);
 
 	// No sound block
 	dxe.writeNULL();
 
-	uint8 *image = NULL;
-	uint8 *palette = NULL;
-	int framenum = 0;
-
 	print("Encoding video...");
 
-	char fullname[1024];
-	strcpy(fullname, inpath.getFullPath().c_str());
-	for (int f = 0; f < frames; f++) {
-		char strbuf[1024];
-		if (frames > 999)
-			sprintf(strbuf, "%s%04d.png", fullname, framenum);
-		else if (frames > 99)
-			sprintf(strbuf, "%s%03d.png", fullname, framenum);
-		else if (frames > 9)
-			sprintf(strbuf, "%s%02d.png", fullname, framenum);
-		else
-			sprintf(strbuf, "%s%d.png", fullname, framenum);
-		inpath.setFullName(strbuf);
-
-		int r = read_png_file(inpath.getFullPath().c_str(), image, palette, width, height);
-
-		if (!palette) {
-			error("8-bit 256-color image expected");
-		}
+	// Frames are processed in batches: while the frames of one batch are
+	// being encoded, the PNG files of the next one are decoded. The encoded
+	// frames are then written in order.
+	uint batchSize = 4 * (_numJobs > 0 ? _numJobs : 1);
+	std::vector<DxaFrame> current(batchSize), next(batchSize);
+	uint currentCount = 0;
+	int decoded = 0, framenum = 0;
 
-		if (!r) {
-			if (scaleMode != S_NONE) {
-				byte *unscaledImage = new byte[width * height / 2];
+	DxaPipelineTask task(*this, dxe, info);
 
-				for (int y = 0; y < height; y += 2)
-					memcpy(&unscaledImage[(width*y)/2], &image[width*y], width);
+	try {
+		do {
+			uint nextCount = (info.frames - decoded < (int)batchSize) ? info.frames - decoded : batchSize;
 
-				dxe.writeFrame(unscaledImage, palette);
-				delete[] unscaledImage;
-			} else {
-				dxe.writeFrame(image, palette);
+			if (currentCount)
+				dxe.beginBatch(&current[0], currentCount);
+			task.setEncodeBatch(currentCount ? &current[0] : NULL, currentCount);
+			task.setDecodeBatch(nextCount ? &next[0] : NULL, nextCount, decoded);
+			Common::runParallel(task, task.getItemCount(), _numJobs);
+			decoded += nextCount;
+
+			for (uint i = 0; i < currentCount; i++) {
+				dxe.writeFrame(current[i]);
+				freeFrame(current[i]);
+
+				framenum++;
+
+				if (framenum % 20 == 0) {
+					print("Encoding video...%d%% (%d of %d)", 100 * framenum / info.frames, framenum, info.frames);
+				}
 			}
+
+			current.swap(next);
+			currentCount = nextCount;
+		} while (currentCount);
+	} catch (...) {
+		for (uint i = 0; i < batchSize; i++) {
+			freeFrame(current[i]);
+			freeFrame(next[i]);
 		}
+		throw;
+	}
 
-		delete[] image;
-		delete[] palette;
+	print("Encoding video...100%% (%d of %d)\n", info.frames, info.frames);
+}
 
-		if (r)
-			break;
+void EncodeDXA::decodeFrame(const DxaVideoInfo &info, int framenum, DxaFrame &frame) {
+	char strbuf[1024];
+	if (info.frames > 999)
+		sprintf(strbuf, "%s%04d.png", info.basePath.c_str(), framenum);
+	else if (info.frames > 99)
+		sprintf(strbuf, "%s%03d.png", info.basePath.c_str(), framenum);
+	else if (info.frames > 9)
+		sprintf(strbuf, "%s%02d.png", info.basePath.c_str(), framenum);
+	else
+		sprintf(strbuf, "%s%d.png", info.basePath.c_str(), framenum);
+
+	int width, height;
+	int r = read_png_file(strbuf, frame.image, frame.palette, width, height);
+
+	if (r || !frame.palette) {
+		freeFrame(frame);
+		error("8-bit 256-color image expected");
+	}
 
-		framenum++;
+	if (width != info.width || height != info.height) {
+		freeFrame(frame);
+		error("Frame %s is %dx%d, %dx%d expected", strbuf, width, height, info.width, info.height);
+	}
 
-		if (framenum % 20 == 0) {
-			print("Encoding video...%d%% (%d of %d)", 100 * framenum / frames, framenum, frames);
-		}
+	if (info.scaleMode != S_NONE) {
+		byte *unscaledImage = new byte[width * height / 2];
+
+		for (int y = 0; y < height; y += 2)
+			memcpy(&unscaledImage[(width*y)/2], &frame.image[width*y], width);
+
+		delete[] frame.image;
+		frame.image = unscaledImage;
 	}
+}
 
-	print("Encoding video...100%% (%d of %d)\n", frames, frames);
+void EncodeDXA::freeFrame(DxaFrame &frame) {
+	delete[] frame.image;
+	delete[] frame.palette;
+	frame.image = NULL;
+	frame.palette = NULL;
 }
 
 int EncodeDXA::read_png_file(const char* filename, unsigned char *&image, unsigned char *&palette, int &width, int &height) {
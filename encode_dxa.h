@@ -33,6 +33,17 @@ enum ScaleMode {
 	S_DOUBLE
 };
 
+struct DxaFrame;
+
+/** The properties of the video being encoded, as read by readVideoInfo(). */
+struct DxaVideoInfo {
+	int width, height, framerate, frames;
+	ScaleMode scaleMode;
+
+	/** Path of the video, to which the frame number is appended to get the PNG files. */
+	std::string basePath;
+};
+
 class EncodeDXA : public CompressionTool {
 public:
 	EncodeDXA(const std::string &name = "encode_dxa");
@@ -45,6 +56,12 @@ protected:
 	void convertWAV(const Common::Filename *inpath, const Common::Filename* outpath);
 	void readVideoInfo(Common::Filename *filename, int &width, int &height, int &framerate, int &frames, ScaleMode &scaleMode);
 	int read_png_file(const char* filename, unsigned char *&image, unsigned char *&palette, int &width, int &height);
+
+	/** Reads the PNG file of a frame, may be called from several threads at once. */
+	void decodeFrame(const DxaVideoInfo &info, int framenum, DxaFrame &frame);
+	void freeFrame(DxaFrame &frame);
+
+	friend class DxaPipelineTask;
 };
 
 #endif
@@ -66,9 +66,6 @@ void CompressAgos::end() {
 	/* And some clean-up :-) */
 	Common::removeFile(TEMP_IDX);
 	Common::removeFile(TEMP_DAT);
-	Common::removeFile(TEMP_RAW);
-	Common::removeFile(tempEncoded);
-	Common::removeFile(TEMP_WAV);
 }
 
 
@@ -103,10 +100,7 @@ int CompressAgos::get_offsets_mac(size_t maxcount, uint32 filenums[], uint32 off
 
 
 uint32 CompressAgos::get_sound(uint32 offset) {
-	uint32 tot_size;
-	char outname[256];
-	int size;
-	char fbuf[2048];
+	std::vector<byte> encoded;
 	char buf[8];
 
 	_input.seek(offset, SEEK_SET);
@@ -115,24 +109,19 @@ uint32 CompressAgos::get_sound(uint32 offset) {
 	if (!memcmp(buf, "Creative", 8)) {
 		print("VOC found (pos = %d) :\n", offset);
 		_input.seek(18, SEEK_CUR);
-		extractAndEncodeVOC(TEMP_RAW, _input, _format);
+		extractAndEncodeVOC(_input, _format, encoded);
 	} else if (!memcmp(buf, "RIFF", 4)) {
 		print("WAV found (pos = %d) :\n", offset);
-		extractAndEncodeWAV(TEMP_WAV, _input, _format);
+		extractAndEncodeWAV(_input, _format, encoded);
 	} else {
 		error("Unexpected data at offset: %d", offset);
 	}
 
 	/* Append the converted data to the master output file */
-	sprintf(outname, "%s", tempEncoded);
-	Common::File f(outname, "rb");
-	tot_size = 0;
-	while ((size = f.read_noThrow(fbuf, 2048)) > 0) {
-		tot_size += size;
-		_output_snd.write(fbuf, size);
-	}
+	if (!encoded.empty())
+		_output_snd.write(&encoded[0], encoded.size());
 
-	return(tot_size);
+	return(encoded.size());
 }
 
 
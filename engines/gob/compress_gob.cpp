@@ -21,8 +21,11 @@
  */
 
 #include <string.h>
+#include <algorithm>
+#include <set>
 
 #include "compress_gob.h"
+#include "common/hashmap.h"
 
 struct CompressGob::Chunk {
 	char name[64];
@@ -36,6 +39,30 @@ struct CompressGob::Chunk {
 };
 
 
+/**
+ * Identifies the contents of a file by its size and the FNV-1a hash of its
+ * data, see readChunkConf().
+ */
+struct ContentKey {
+	uint32 size;
+	uint32 hash;
+
+	ContentKey(const byte *data, uint32 dataSize) : size(dataSize), hash(2166136261U) {
+		for (uint32 i = 0; i < dataSize; i++) {
+			hash ^= data[i];
+			hash *= 16777619U;
+		}
+	}
+};
+
+struct ContentKey_Hash {
+	uint operator()(const ContentKey &key) const { return key.hash ^ (key.size * 2654435761U); }
+};
+
+struct ContentKey_EqualTo {
+	bool operator()(const ContentKey &a, const ContentKey &b) const { return a.size == b.size && a.hash == b.hash; }
+};
+
 CompressGob::CompressGob(const std::string &name) : CompressionTool(name, TOOLTYPE_COMPRESSION) {
 	_execMode = MODE_NORMAL;
 	_chunks = NULL;
@@ -47,9 +74,11 @@ CompressGob::CompressGob(const std::string &name) : CompressionTool(name, TOOLTY
 
 	_shorthelp = "Compresses Gobliiins! data files.";
 	_helptext =
-		"\nUsage: " + getName() + " [-o <output path>] [-f] <conf file>\n"
+		"\nUsage: " + getName() + " [-o <output path>] [-f] [--optimal] <conf file>\n"
 		"<conf file> is a .gob file generated extract_gob_stk\n"
-		"<-f> forces compression for all files\n\n"
+		"<-f> forces compression for all files\n"
+		"<--optimal> chooses between characters and copies by cost, which is slower\n"
+		"            but gives slightly smaller archives\n\n"
 		"The stick archive (STK/ITK/LTK) will be created in the directory specified by the '-o' parameter.\n";
 }
 
@@ -58,8 +87,13 @@ CompressGob::~CompressGob() {
 }
 
 void CompressGob::parseExtraArguments() {
-	if (!_arguments.empty() && _arguments.front() == "-f") {
-		_execMode |= MODE_FORCE;
+	while (!_arguments.empty()) {
+		if (_arguments.front() == "-f")
+			_execMode |= MODE_FORCE;
+		else if (_arguments.front() == "--optimal")
+			_execMode |= MODE_OPTIMAL;
+		else
+			break;
 		_arguments.pop_front();
 	}
 }
@@ -102,15 +136,21 @@ void CompressGob::execute() {
  * It creates the output archive file and a list of chunks containing the file
  * and compression information.
  * In order to have a slightly better compression ration in some cases (Playtoons), it
- * also detects duplicate files.
+ * also detects duplicate files. Every file is hashed once while reading the
+ * config file, and only the files whose size and hash match those of an
+ * earlier file are compared byte by byte.
  */
 CompressGob::Chunk *CompressGob::readChunkConf(Common::File &gobConf, Common::Filename &stkName, uint16 &chunkCount) {
+	typedef Common::HashMap<ContentKey, Chunk *, ContentKey_Hash, ContentKey_EqualTo> ContentIndex;
+
 	Chunk *chunks = new Chunk;
 	Chunk *curChunk = chunks;
-	Chunk *parseChunk;
 	Common::File src1;
 	Common::Filename srcName("");
 	char buffer[1024];
+	ContentIndex contentIndex;
+	std::set<std::string> names;
+	uint32 duplicateCount = 0, duplicateSize = 0;
 
 	chunkCount = 1;
 
@@ -136,32 +176,35 @@ CompressGob::Chunk *CompressGob::readChunkConf(Common::File &gobConf, Common::Fi
 		strcpy(curChunk->name, buffer);
 		srcName.setFullName(buffer);
 
+		if (!names.insert(curChunk->name).second)
+			error("Duplicate filename found in conf file: %s", curChunk->name);
+
 		gobConf.scanString(buffer);
 		if ((strcmp(buffer, "1") == 0 )|| (_execMode & MODE_FORCE))
 			curChunk->packed = true;
 		else
 			curChunk->packed = false;
-		src1.open(srcName, "rb");
-		src1.seek(0, SEEK_END);
+		src1.openMapped(srcName);
 // if file is too small, force 'Store' method
-		if ((curChunk->realSize = src1.pos()) < 8)
+		if ((curChunk->realSize = src1.size()) < 8)
 			curChunk->packed = 0;
 
-		parseChunk = chunks;
-		while (parseChunk != curChunk) {
-			if ((parseChunk->realSize == curChunk->realSize) & (parseChunk->packed != 2)) {
-				if (strcmp(parseChunk->name, curChunk->name) == 0)
-					error("Duplicate filename found in conf file: %s", parseChunk->name);
-				srcName.setFullName(parseChunk->name);
-				if (filcmp(src1, srcName)) {
+		ContentKey key(src1.readSpan(curChunk->realSize), curChunk->realSize);
+		ContentIndex::iterator original = contentIndex.find(key);
+		if (original == contentIndex.end()) {
+			contentIndex[key] = curChunk;
+		} else {
+			Chunk *parseChunk = original->_value;
+			srcName.setFullName(parseChunk->name);
+// The sizes and hashes match, make sure the contents do too
+			if (filcmp(src1, srcName)) {
 // If files are identical, use the same compressed chunk instead of re-compressing the same thing
-					curChunk->packed = 2;
-					curChunk->replChunk = parseChunk;
-					print("Identical files : %s %s (%d bytes)\n", curChunk->name, parseChunk->name, curChunk->realSize);
-					break;
-				}
+				curChunk->packed = 2;
+				curChunk->replChunk = parseChunk;
+				print("Identical files : %s %s (%d bytes)\n", curChunk->name, parseChunk->name, curChunk->realSize);
+				duplicateCount++;
+				duplicateSize += curChunk->realSize;
 			}
-			parseChunk = parseChunk->next;
 		}
 		src1.close();
 
@@ -173,6 +216,10 @@ CompressGob::Chunk *CompressGob::readChunkConf(Common::File &gobConf, Common::Fi
 			chunkCount++;
 		}
 	}
+
+	if (duplicateCount)
+		print("%d duplicate files (%d bytes) will be stored once\n", duplicateCount, duplicateSize);
+
 	return chunks;
 }
 
@@ -206,13 +253,16 @@ void CompressGob::writeBody(Common::Filename *inpath, Common::File &stk, Chunk *
 	Chunk *curChunk = chunks;
 	Common::File src;
 	uint32 tmpSize;
+	uint32 savedSize = 0;
 
 	while (curChunk) {
 		inpath->setFullName(curChunk->name);
 		src.open(*inpath, "rb");
 
-		if (curChunk->packed == 2)
+		if (curChunk->packed == 2) {
 			print("Identical file %12s\t(compressed size %d bytes)\n", curChunk->name, curChunk->replChunk->size);
+			savedSize += curChunk->replChunk->size;
+		}
 
 		curChunk->offset = stk.pos();
 		if (curChunk->packed == 1) {
@@ -235,6 +285,9 @@ void CompressGob::writeBody(Common::Filename *inpath, Common::File &stk, Chunk *
 		}
 		curChunk = curChunk->next;
 	}
+
+	if (savedSize)
+		print("Storing duplicate files once saved %d bytes\n", savedSize);
 }
 
 /*! \brief Rewrites the header of the archive file
@@ -322,6 +375,126 @@ uint32 CompressGob::writeBodyStoreFile(Common::File &stk, Common::File &src) {
 	return tmpSize;
 }
 
+/*! \brief Finds LZSS matches in the data being compressed
+ *
+ * The STK packer works on a 4096 bytes ring dictionary, initialized with
+ * spaces, in which every unpacked byte is written in turn, starting at 4078.
+ * The matches are searched in a copy of the data, preceded by a whole ring
+ * of spaces and the 4078 spaces before the first byte, so that the ring
+ * position of a byte is simply its index modulo 4096, and all the spaces the
+ * unpacker starts with are within reach. The positions are kept in a sorted
+ * list for each hash of their first three bytes, and only the list of the
+ * current position needs to be searched.
+ */
+class LZSSMatchFinder {
+public:
+	enum {
+		kRingSize  = 4096,
+		kRingStart = 4078,
+		kBufStart  = kRingSize + kRingStart,
+		kMinLength = 3,
+		kMaxLength = 18,
+		kHashBits  = 14
+	};
+
+	LZSSMatchFinder(const byte *data, uint32 size) : _next(0), _chains(1 << kHashBits) {
+		_buf.resize(kBufStart + size, 0x20);
+		if (size)
+			memcpy(&_buf[kBufStart], data, size);
+	}
+
+	/*! \brief Returns the position in the buffer of a byte of the data */
+	uint32 bufPos(uint32 dataPos) const { return kBufStart + dataPos; }
+
+	/*! \brief Adds all positions before pos to the hash lists */
+	void insertUntil(uint32 pos) {
+		for (; _next < pos && _next + kMinLength <= _buf.size(); _next++)
+			_chains[hash(_next)].push_back(_next);
+	}
+
+	/*! \brief Finds the longest match for the bytes at pos
+	 * \param pos Position in the buffer, all previous positions must be inserted
+	 * \param ringPos Position of the match in the ring dictionary
+	 * \return Length of the match, 0 if there is none
+	 *
+	 * A match may not overlap the bytes being written, as the dictionary is only
+	 * updated after the match has been found. Of the longest matches, the one
+	 * at the lowest ring position is used, as the original packer did.
+	 */
+	uint8 findLongest(uint32 pos, uint16 &ringPos) const {
+		uint32 maxLength = _buf.size() - pos;
+		if (maxLength > kMaxLength)
+			maxLength = kMaxLength;
+		if (maxLength < kMinLength)
+			return 0;
+
+		const std::vector<uint32> &chain = _chains[hash(pos)];
+		uint32 bestLength = kMinLength - 1;
+		const byte *cur = &_buf[pos];
+
+		// Find the length first, most recent matches are the likeliest to be long
+		for (size_t i = chain.size(); i-- > 0; ) {
+			uint32 cand = chain[i];
+			uint32 dist = pos - cand;
+			if (dist > kRingSize)
+				break;
+
+			uint32 limit = (dist < maxLength) ? dist : maxLength;
+			if (limit <= bestLength || _buf[cand + bestLength] != cur[bestLength])
+				continue;
+
+			uint32 length = matchLength(cand, pos, limit);
+			if (length > bestLength) {
+				bestLength = length;
+				if (length == maxLength)
+					break;
+			}
+		}
+
+		if (bestLength < kMinLength)
+			return 0;
+
+		// Ring positions go up from 0 at the last multiple of the ring size
+		// before pos, and the window wraps to the highest ones before that
+		uint32 wrap = (pos - 1) / kRingSize * kRingSize;
+		if (!findFirst(chain, wrap, pos, pos, bestLength, ringPos))
+			findFirst(chain, pos - kRingSize, wrap, pos, bestLength, ringPos);
+
+		return bestLength;
+	}
+
+private:
+	std::vector<byte> _buf;
+	uint32 _next;
+	std::vector<std::vector<uint32> > _chains;
+
+	uint32 hash(uint32 pos) const {
+		return ((_buf[pos] << 6) ^ (_buf[pos + 1] << 3) ^ _buf[pos + 2] ^ (_buf[pos] >> 2)) & ((1 << kHashBits) - 1);
+	}
+
+	/*! \brief Returns how many bytes at cand, up to limit, match those at pos */
+	uint32 matchLength(uint32 cand, uint32 pos, uint32 limit) const {
+		const byte *match = &_buf[cand];
+		const byte *cur = &_buf[pos];
+		uint32 length = 0;
+		while (length < limit && match[length] == cur[length])
+			length++;
+		return length;
+	}
+
+	/*! \brief Finds the first position from begin to end with a match of the given length */
+	bool findFirst(const std::vector<uint32> &chain, uint32 begin, uint32 end, uint32 pos, uint32 length, uint16 &ringPos) const {
+		std::vector<uint32>::const_iterator it = std::lower_bound(chain.begin(), chain.end(), begin);
+		for (; it != chain.end() && *it < end; ++it) {
+			if (pos - *it >= length && matchLength(*it, pos, length) == length) {
+				ringPos = *it % kRingSize;
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
 /*! \brief Compress a file in the archive file
  * \param stk STK/ITK archive file
  * \param src File to be stored
@@ -330,88 +503,59 @@ uint32 CompressGob::writeBodyStoreFile(Common::File &stk, Common::File &src) {
  * This function compress a file in the STK archive
  */
 uint32 CompressGob::writeBodyPackFile(Common::File &stk, Common::File &src) {
-	byte dico[4114];
 	byte writeBuffer[17];
-	uint32 counter;
-	uint16 dicoIndex;
 	uint32 unpackedIndex, size;
 	uint8 cmd;
 	uint8 buffIndex, cpt;
-	uint16 resultcheckpos;
-	byte resultchecklength;
 
 	size = src.size();
 
 	byte *unpacked = new byte [size + 1];
-
-	memset(dico, 0x20, 4114);
 	memset(unpacked, 0, size + 1);
 
 	src.read_throwsOnError(unpacked, size);
 
+	std::vector<Token> tokens;
+	if (_execMode & MODE_OPTIMAL)
+		parseOptimal(unpacked, size, tokens);
+	else
+		parseGreedy(unpacked, size, tokens);
+
 	writeBuffer[0] = size & 0xFF;
 	writeBuffer[1] = size >> 8;
 	writeBuffer[2] = size >> 16;
 	writeBuffer[3] = size >> 24;
 	stk.write(writeBuffer, 4);
 
-// Size is already checked : small files (less than 8 characters)
-// are not compressed, so copying the first three bytes is safe.
-	dicoIndex = 4078;
-	dico[dicoIndex] = unpacked[0];
-	dico[dicoIndex+1] = unpacked[1];
-	dico[dicoIndex+2] = unpacked[2];
-	dicoIndex += 3;
-
-// writeBuffer[0] is reserved for the command byte
-	writeBuffer[1] = unpacked[0];
-	writeBuffer[2] = unpacked[1];
-	writeBuffer[3] = unpacked[2];
-// Force the 3 first operation bits to 'copy character'
-	cmd = (1 << 3) - 1;
-
-	counter = size - 3;
-	unpackedIndex = 3;
-	cpt = 3;
-	buffIndex = 4;
-
-	size=4;
-	resultcheckpos = 0;
-	resultchecklength = 0;
-
-	while (counter>0) {
-		if (!checkDico(unpacked, unpackedIndex, counter, dico, dicoIndex, resultcheckpos, resultchecklength)) {
-			dico[dicoIndex] = unpacked[unpackedIndex];
+	unpackedIndex = 0;
+	buffIndex = 1;
+	cmd = 0;
+	cpt = 0;
+
+	size = 4;
+
+	for (uint i = 0; i < tokens.size(); i++) {
+		if (tokens[i].length == 0) {
 			writeBuffer[buffIndex] = unpacked[unpackedIndex];
 // set the operation bit : copy character
 			cmd |= (1 << cpt);
 			unpackedIndex++;
-			dicoIndex = (dicoIndex + 1) % 4096;
 			buffIndex++;
-			counter--;
 		} else {
-// Copy the string in the dictionary
-			for (int i = 0; i < resultchecklength; i++)
-				dico[((dicoIndex + i) % 4096)] = dico[((resultcheckpos + i) % 4096)];
-
 // Write the copy string command
-			writeBuffer[buffIndex] = resultcheckpos & 0xFF;
-			writeBuffer[buffIndex + 1] = ((resultcheckpos & 0x0F00) >> 4) + (resultchecklength - 3);
+			writeBuffer[buffIndex] = tokens[i].pos & 0xFF;
+			writeBuffer[buffIndex + 1] = ((tokens[i].pos & 0x0F00) >> 4) + (tokens[i].length - 3);
 
 // Do not set the operation bit : copy string from dictionary
 //			cmd |= (0 << cpt);
 
-			unpackedIndex += resultchecklength;
-			dicoIndex = (dicoIndex + resultchecklength) % 4096;
-			resultcheckpos = (resultcheckpos + resultchecklength) % 4096;
-
+			unpackedIndex += tokens[i].length;
 			buffIndex += 2;
-			counter -= resultchecklength;
 		}
 
 // The command byte is complete when the file is entirely compressed, or
 // when the 8 operation bits are set.
-		if ((cpt == 7) | (counter == 0)) {
+		if ((cpt == 7) | (i == tokens.size() - 1)) {
 			writeBuffer[0] = cmd;
 			stk.write(writeBuffer, buffIndex);
 			size += buffIndex;
@@ -426,13 +570,91 @@ uint32 CompressGob::writeBodyPackFile(Common::File &stk, Common::File &src) {
 	return size;
 }
 
+/*! \brief Splits data into literals and dictionary matches, greedily
+ * \param unpacked Data to be compressed
+ * \param size Size of the data
+ * \param tokens Resulting list of literals and matches
+ *
+ * At every position, the longest match available is used.
+ */
+void CompressGob::parseGreedy(const byte *unpacked, uint32 size, std::vector<Token> &tokens) {
+	LZSSMatchFinder finder(unpacked, size);
+	Token token;
+
+// Size is already checked : small files (less than 8 characters)
+// are not compressed, so forcing the first three bytes to literals is safe.
+	uint32 unpackedIndex = 0;
+	token.pos = 0;
+	token.length = 0;
+	for (; unpackedIndex < 3 && unpackedIndex < size; unpackedIndex++)
+		tokens.push_back(token);
+
+	while (unpackedIndex < size) {
+		uint32 pos = finder.bufPos(unpackedIndex);
+		finder.insertUntil(pos);
+
+		token.length = finder.findLongest(pos, token.pos);
+		tokens.push_back(token);
+		unpackedIndex += token.length ? token.length : 1;
+	}
+}
+
+/*! \brief Splits data into literals and dictionary matches, minimizing the size
+ * \param unpacked Data to be compressed
+ * \param size Size of the data
+ * \param tokens Resulting list of literals and matches
+ *
+ * A literal costs 9 bits and a match 17 bits, whatever its length. Since a
+ * match can be shortened at will, the longest match found at each position
+ * is enough to compute the cheapest parse from the end of the data.
+ */
+void CompressGob::parseOptimal(const byte *unpacked, uint32 size, std::vector<Token> &tokens) {
+	LZSSMatchFinder finder(unpacked, size);
+	std::vector<Token> longest(size);
+	std::vector<uint32> cost(size + 1);
+	std::vector<uint8> choice(size, 0);
+	Token token;
+
+	uint32 start = (size < 3) ? size : 3;
+
+	for (uint32 i = start; i < size; i++) {
+		uint32 pos = finder.bufPos(i);
+		finder.insertUntil(pos);
+		longest[i].length = finder.findLongest(pos, longest[i].pos);
+	}
+
+	cost[size] = 0;
+	for (uint32 i = size; i-- > start; ) {
+		cost[i] = cost[i + 1] + 9;
+		for (uint8 length = 3; length <= longest[i].length; length++) {
+			if (cost[i + length] + 17 < cost[i]) {
+				cost[i] = cost[i + length] + 17;
+				choice[i] = length;
+			}
+		}
+	}
+
+	token.pos = 0;
+	token.length = 0;
+	for (uint32 i = 0; i < start; i++)
+		tokens.push_back(token);
+
+	for (uint32 i = start; i < size; ) {
+		token.length = choice[i];
+		token.pos = longest[i].pos;
+		tokens.push_back(token);
+		i += token.length ? token.length : 1;
+	}
+}
+
 /*! \brief Compare a file to a file defined in a chunk
  * \param src1 File to be compared
  * \param compChunk Chunk containing information on second file to be compared
  * \return whether they are identical or not.
  *
  * This function compares a file to another defined in a chunk. The file sizes
- * are already tested outside the function.
+ * are already tested outside the function. It is only used to confirm that
+ * files with the same content hash are identical.
  */
 bool CompressGob::filcmp(Common::File &src1, Common::Filename &stkName) {
 	uint16 readCount;
@@ -457,59 +679,6 @@ bool CompressGob::filcmp(Common::File &src1, Common::Filename &stkName) {
 	return checkFl;
 }
 
-/*! \brief Compare a file to a file defined in a chunk
- * \param unpacked Buffer being compressed
- * \param unpackedIndex Current 'read' position in this buffer
- * \param counter Number of bytes still to be compressed in the file
- * \param dico Dictionary
- * \param currIndex Current 'write' position in the dictionary (used to avoid dictionary collision)
- * \param pos Position of the better match found, if any
- * \param length Length of the better match found, if any
- * \return whether a match has been found or not or not.
- *
- * This function search in the dictionary for matches with the characters still to be compressed.
- * 'A match' is when at least three characters of the buffer (comparing from the current 'read' position)
- * are found in the dictionary. The match lengths are limited to 18 characters, as the
- * length (minus 3) is stored on 4 bits.
- */
-bool CompressGob::checkDico(byte *unpacked, uint32 unpackedIndex, int32 counter, byte *dico, uint16 currIndex, uint16 &pos, uint8 &length) {
-	uint16 tmpPos, bestPos;
-	uint8 tmpLength, bestLength, i;
-
-	bestPos = 0;
-	bestLength = 2;
-
-	if (counter < 3)
-		return false;
-
-	for (tmpPos = 0; tmpPos < 0x1000; tmpPos++) {
-		tmpLength = 0;
-		for (i = 0; ((i < 18) & (i < counter)); i++)
-			if ((unpacked[unpackedIndex + i] == dico[(tmpPos + i) % 4096]) &
-				// avoid dictionary collision
-				(((tmpPos + i) % 4096 != currIndex) | (i == 0)))
-				tmpLength++;
-			else
-				break;
-		if (tmpLength > bestLength)
-		{
-			bestPos = tmpPos;
-			if ((bestLength = tmpLength) == 18)
-				break;
-		}
-	}
-
-	pos = bestPos;
-	length = bestLength;
-
-	if (bestLength > 2)
-		return true;
-	else {
-		length = 0;
-		return false;
-	}
-}
-
 #ifdef STANDALONE_MAIN
 int main(int argc, char *argv[]) {
 	CompressGob gob(argv[0]);
@@ -29,10 +29,11 @@
 #define confSTK10 "STK10"
 
 enum {
-	MODE_NORMAL = 0,
-	MODE_HELP   = 1,
-	MODE_FORCE  = 2,
-	MODE_SET    = 4
+	MODE_NORMAL  = 0,
+	MODE_HELP    = 1,
+	MODE_FORCE   = 2,
+	MODE_SET     = 4,
+	MODE_OPTIMAL = 8
 };
 
 class CompressGob : public CompressionTool {
@@ -45,6 +46,12 @@ public:
 protected:
 	struct Chunk;
 
+	/*! A literal character (length 0), or a copy from the dictionary */
+	struct Token {
+		uint16 pos;
+		uint8 length;
+	};
+
 	uint8 _execMode;
 	Chunk *_chunks;
 
@@ -57,7 +64,8 @@ protected:
 	uint32 writeBodyPackFile(Common::File &stk, Common::File &src);
 	void rewriteHeader(Common::File &stk, uint16 chunkCount, Chunk *chunks);
 	bool filcmp(Common::File &src1, Common::Filename &stkName);
-	bool checkDico(byte *unpacked, uint32 unpackedIndex, int32 counter, byte *dico, uint16 currIndex, uint16 &pos, uint8 &length);
+	void parseGreedy(const byte *unpacked, uint32 size, std::vector<Token> &tokens);
+	void parseOptimal(const byte *unpacked, uint32 size, std::vector<Token> &tokens);
 
 };
 
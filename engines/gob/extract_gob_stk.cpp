@@ -22,9 +22,15 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <vector>
 
 #include "extract_gob_stk.h"
 #include "common/endian.h"
+#include "common/lzss.h"
+#include "common/thread.h"
+#include "common/util.h"
 
 #define confSTK10 "STK10"
 #define confSTK21 "STK21"
@@ -43,19 +49,24 @@ struct ExtractGobStk::Chunk {
 
 ExtractGobStk::ExtractGobStk(const std::string &name) : Tool(name, TOOLTYPE_EXTRACTION) {
 	_chunks = NULL;
+	_numJobs = 1;
 
 	ToolInput input;
 	input.format = "*.stk";
 	_inputPaths.push_back(input);
 
 	_shorthelp = "Extract the files from a Stick file used by 'gob' engine (.STK/.ITK/.LTK).";
-	_helptext  = "Usage: " + getName() + " [-o outputname] stickname\nwhere\n  ouputname is used to force the gob config filename (used by compress_gob)\n  stickname is the name of the file to extract/decompress";
+	_helptext  = "Usage: " + getName() + " [-o outputname] [--jobs <n>] stickname\nwhere\n  ouputname is used to force the gob config filename (used by compress_gob)\n  <n> is the number of chunks to unpack at once, 0 uses one per processor (default: 1)\n  stickname is the name of the file to extract/decompress";
 }
 
 ExtractGobStk::~ExtractGobStk() {
 	delete _chunks;
 }
 
+void ExtractGobStk::parseExtraArguments() {
+	parseJobsArgument(_numJobs);
+}
+
 void ExtractGobStk::execute() {
 	char signature[7];
 	Common::File stk;
@@ -66,7 +77,7 @@ void ExtractGobStk::execute() {
 
 	Common::Filename inpath(_inputPaths[0].path);
 
-	stk.open(inpath.getFullPath(), "rb");
+	stk.openMapped(inpath);
 
 	if (_outputPath.empty()) {
 		_outputPath = inpath;
@@ -257,189 +268,134 @@ void ExtractGobStk::readChunkListV2(Common::File &stk, Common::File &gobConf) {
 	}
 }
 
-void ExtractGobStk::extractChunks(Common::Filename &outpath, Common::File &stk) {
-	Chunk *curChunk = _chunks;
-	byte *unpackedData = NULL;
-
-	while (curChunk != 0) {
-		print("Extracting \"%s\"\n", curChunk->name);
-
-		outpath.setFullName(curChunk->name);
+/**
+ * Unpacks and writes chunks of an archive, see ExtractGobStk::extractChunks().
+ */
+class ExtractChunkTask : public Common::ParallelTask {
+public:
+	struct Item {
+		const ExtractGobStk::Chunk *chunk;
+		const byte *data;
+	};
+
+	ExtractChunkTask(ExtractGobStk *tool, const Common::Filename &outpath, const std::vector<Item> &items, uint first) :
+		_tool(tool), _outpath(outpath), _items(items), _first(first) {}
+
+	virtual void run(uint index) {
+		index += _first;
+		const ExtractGobStk::Chunk *chunk = _items[index].chunk;
+		const byte *data = _items[index].data;
+
+		Common::Filename outpath(_outpath);
+		outpath.setFullName(chunk->name);
 		Common::File chunkFile(outpath, "wb");
 
-		if (curChunk->size > 0) {
-			stk.seek(curChunk->offset, SEEK_SET);
+		if (chunk->size == 0)
+			return;
 
-			byte *data = new byte[curChunk->size];
+		if (!chunk->packed) {
+			chunkFile.write(data, chunk->size);
+			return;
+		}
 
-			stk.read_throwsOnError(data, curChunk->size);
+		uint32 realSize;
+		byte *unpackedData;
+		if (chunk->preGob)
+			unpackedData = _tool->unpackPreGobData(data, realSize, chunk->size);
+		else
+			unpackedData = _tool->unpackData(data, realSize, chunk->size);
+
+		try {
+			chunkFile.write(unpackedData, realSize);
+		} catch(...) {
+			delete[] unpackedData;
+			throw;
+		}
+		delete[] unpackedData;
+	}
+
+private:
+	ExtractGobStk *_tool;
+	const Common::Filename &_outpath;
+	const std::vector<Item> &_items;
+	uint _first;
+};
 
-			try {
-				if (curChunk->packed) {
-					uint32 realSize;
+static bool compareByOffset(const ExtractChunkTask::Item &a, const ExtractChunkTask::Item &b) {
+	return a.chunk->offset < b.chunk->offset;
+}
 
-					if (curChunk->preGob) {
-						unpackedData = unpackPreGobData(data, realSize, curChunk->size);
-					} else {
-						unpackedData = unpackData(data, realSize);
-					}
+void ExtractGobStk::extractChunks(Common::Filename &outpath, Common::File &stk) {
+	// If a name is used more than once, the last chunk of that name wins,
+	// as it would when writing the chunks one after the other
+	std::map<std::string, const Chunk *> lastChunks;
+	for (Chunk *curChunk = _chunks; curChunk != 0; curChunk = curChunk->next)
+		lastChunks[curChunk->name] = curChunk;
+
+	std::vector<ExtractChunkTask::Item> items;
+	for (Chunk *curChunk = _chunks; curChunk != 0; curChunk = curChunk->next) {
+		if (lastChunks[curChunk->name] != curChunk)
+			continue;
+
+		ExtractChunkTask::Item item;
+		item.chunk = curChunk;
+		item.data = NULL;
+		items.push_back(item);
+	}
 
-					chunkFile.write(unpackedData, realSize);
+	// Read the chunks in the order they are stored in, so that the archive
+	// is read from start to end
+	std::stable_sort(items.begin(), items.end(), compareByOffset);
 
-					delete[] unpackedData;
-				} else {
-					chunkFile.write(data, curChunk->size);
-				}
-			} catch(...) {
-				delete[] data;
-				delete[] unpackedData;
-				throw;
-			}
-			delete[] data;
+	for (uint i = 0; i < items.size(); i++) {
+		if (items[i].chunk->size > 0) {
+			stk.seek(items[i].chunk->offset, SEEK_SET);
+			items[i].data = stk.readSpan(items[i].chunk->size);
 		}
-		curChunk = curChunk->next;
 	}
-}
 
-// Some LZ77-variant
-byte *ExtractGobStk::unpackData(byte *src, uint32 &size) {
-	uint32 counter;
-	uint16 cmd;
-	byte tmpBuf[4114];
-	int16 off;
-	byte len;
-	uint16 tmpIndex;
+	// The chunks are then unpacked and written on all threads, a few at a
+	// time to be able to show the progress
+	const uint batchSize = 4 * _numJobs;
 
-	counter = size = READ_LE_UINT32(src);
+	for (uint first = 0; first < items.size(); first += batchSize) {
+		uint count = MIN<uint>(batchSize, items.size() - first);
 
-	for (int i = 0; i < 4078; i++)
-		tmpBuf[i] = 0x20;
-	tmpIndex = 4078;
+		for (uint i = first; i < first + count; i++)
+			print("Extracting \"%s\"\n", items[i].chunk->name);
 
-	src += 4;
+		ExtractChunkTask task(this, outpath, items, first);
+		Common::runParallel(task, count, _numJobs);
+		updateProgress(first + count, items.size());
+	}
+}
 
-	byte *unpacked = new byte[size];
-	byte *dest = unpacked;
+byte *ExtractGobStk::unpackData(const byte *src, uint32 &size, uint32 compSize) {
+	if (compSize < 4)
+		error("Packed chunk is too small");
 
-	cmd = 0;
-	while (1) {
-		cmd >>= 1;
-		if ((cmd & 0x0100) == 0) {
-			cmd = *src | 0xFF00;
-			src++;
-		}
-		if ((cmd & 1) != 0) { /* copy */
-			*dest++ = *src;
-			tmpBuf[tmpIndex] = *src;
-			src++;
-			tmpIndex++;
-			tmpIndex %= 4096;
-			counter--;
-
-			if (counter == 0)
-				break;
-		} else { /* copy string */
-			off = *src++;
-			off |= (*src & 0xF0) << 4;
-			len = (*src & 0x0F) + 3;
-			src++;
-
-			for (int i = 0; i < len; i++) {
-				*dest++ = tmpBuf[(off + i) % 4096];
-				if (--counter == 0)
-					return unpacked;
-
-				tmpBuf[tmpIndex] = tmpBuf[(off + i) % 4096];
-				tmpIndex++;
-				tmpIndex %= 4096;
-			}
-		}
-	}
+	size = READ_LE_UINT32(src);
 
-	return unpacked;
+	return Common::unpackLZSS(src + 4, compSize - 4, size);
 }
 
-// Some LZ77-variant
-byte *ExtractGobStk::unpackPreGobData(byte *src, uint32 &size, uint32 &compSize) {
-	uint16 cmd;
-	byte tmpBuf[4114];
-	int16 off;
-	byte len;
-	uint16 tmpIndex;
-	uint32 dummy1;
-	int32 newCounter;
-
-	newCounter = compSize;
-	size = 0;
+byte *ExtractGobStk::unpackPreGobData(const byte *src, uint32 &size, uint32 compSize) {
+	if (compSize < 6)
+		error("Packed chunk is too small");
 
-	dummy1 = READ_LE_UINT16(src);
-	src += 2;
-	newCounter -= 2;
+	uint16 dummy1 = READ_LE_UINT16(src);
 
 //  The 6 first bytes are grouped by 2 :
 //  - bytes 0&1 : if set to 0xFFFF, the real size is in bytes 2&3. Else : unknown
 //  - bytes 2&3 : Either the real size or 0x007D. Directly related to the size of the file.
 //  - bytes 4&5 : 0x0000 (files are small) ;)
 	if (dummy1 == 0xFFFF)
-		print("Real size %d", READ_LE_UINT32(src));
+		print("Real size %d", READ_LE_UINT32(src + 2));
 	else
 		print("Unknown real size %xX %xX", dummy1>>8, dummy1 & 0x00FF);
 
-//	counter = size = READ_LE_UINT32(src);
-
-	for (int i = 0; i < 4078; i++)
-		tmpBuf[i] = 0x20;
-	tmpIndex = 4078;
-
-	src += 4;
-	newCounter -= 4;
-
-	byte *unpacked = new byte[500000];//[size] Replaced by dummy as real size is not always known;
-	byte *dest = unpacked;
-
-	cmd = 0;
-	while (1) {
-		cmd >>= 1;
-		if ((cmd & 0x0100) == 0) {
-			cmd = *src | 0xFF00;
-			src++;
-			newCounter--;
-			if (newCounter == 0)
-				break;
-		}
-
-		if ((cmd & 1) != 0) { /* copy */
-			*dest++ = *src;
-			size++;
-			tmpBuf[tmpIndex] = *src;
-			src++;
-			newCounter--;
-
-			if (newCounter == 0)
-				break;
-
-			tmpIndex++;
-			tmpIndex %= 4096;
-		} else { /* copy string */
-			off = *src++;
-			off |= (*src & 0xF0) << 4;
-			len = (*src & 0x0F) + 3;
-			src++;
-			newCounter -= 2;
-
-			for (int i = 0; i < len; i++) {
-				*dest++ = tmpBuf[(off + i) % 4096];
-				size++;
-				tmpBuf[tmpIndex] = tmpBuf[(off + i) % 4096];
-				tmpIndex++;
-				tmpIndex %= 4096;
-			}
-			if (newCounter <= 0)
-				break;
-		}
-	}
-
-	return unpacked;
+	// The real size is not always known, so decode until the data is used up
+	return Common::unpackLZSSToEnd(src + 6, compSize - 6, size);
 }
 
 #ifdef STANDALONE_MAIN
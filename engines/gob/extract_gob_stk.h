@@ -36,11 +36,18 @@ protected:
 
 	Chunk *_chunks;
 
+	/** Number of threads used to unpack and write the chunks. */
+	uint _numJobs;
+
+	void parseExtraArguments();
+
 	void readChunkList(Common::File &stk, Common::File &gobConf);
 	void readChunkListV2(Common::File &stk, Common::File &gobConf);
 	void extractChunks(Common::Filename &outpath, Common::File &stk);
-	byte *unpackData(byte *src, uint32 &size);
-	byte *unpackPreGobData(byte *src, uint32 &size, uint32 &compSize);
+	byte *unpackData(const byte *src, uint32 &size, uint32 compSize);
+	byte *unpackPreGobData(const byte *src, uint32 &size, uint32 compSize);
+
+	friend class ExtractChunkTask;
 };
 
 #endif
@@ -23,6 +23,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 
 #include "compress_kyra.h"
@@ -30,8 +31,6 @@
 #include "compress.h"
 #include "kyra_pak.h"
 
-#define TEMPFILE "TEMP.VOC"
-
 CompressKyra::CompressKyra(const std::string &name) : CompressionTool(name, TOOLTYPE_COMPRESSION) {
 	ToolInput input;
 	input.format = "*.*";
@@ -77,42 +76,70 @@ void CompressKyra::process(Common::Filename *infile, Common::Filename *outfile)
 	if (!output.loadFile(NULL, false))
 		return;
 
-	PAKFile::cFileList *list = input.getFileList();
+	// The VOC files are decoded straight from the archive and queued, every
+	// few files the queue is encoded on all threads and the results are
+	// added to the output in their original order
+	std::vector<std::string> queuedNames;
+	setRawAudioType(false, false, 8);
+
+	const uint fileCount = input.getFileCount();
+	for (uint i = 0; i < fileCount; ++i) {
+		updateProgress(i, fileCount);
+
+		const char *filename = input.getFileName(i);
+		uint32 size = 0;
+		const uint8 *data = input.getFileData(i, &size);
 
-	for (; list; list = list->next) {
 		// Detect VOC file from content instead of extension. This is needed for Lands of Lore TLK files.
-		if (memcmp(list->data, "Creative Voice File", 19) != 0)
+		if (size < 27 || memcmp(data, "Creative Voice File", 19) != 0)
 			continue;
 
-		if (list->data[26] != 1) {
-			warning("'%s' contains broken VOC file '%s' skipping it...", infile->getFullPath().c_str(), list->filename);
+		if (data[26] != 1) {
+			warning("'%s' contains broken VOC file '%s' skipping it...", infile->getFullPath().c_str(), filename);
 			continue;
 		}
 
-		Common::Filename outputName;
-		input.outputFileAs(list->filename, TEMPFILE);
-		outputName._path = list->filename;
+		Common::File vocFile;
+		vocFile.openMemory(data, size, filename);
+		vocFile.seek(26, SEEK_SET);
 
-		Common::File tempFile(TEMPFILE, "rb");
-		tempFile.seek(26, SEEK_CUR);
-		extractAndEncodeVOC(TEMP_RAW, tempFile, _format);
-		tempFile.close();
+		std::vector<byte> rawData;
+		int rate = extractVOC(vocFile, rawData);
+		queueAudio(rawData, rate);
 
+		Common::Filename outputName;
+		outputName._path = filename;
 		outputName.setExtension(audio_extensions(_format));
+		queuedNames.push_back(outputName.getFullPath());
 
-		output.addFile(outputName.getFullPath().c_str(), tempEncoded);
-
-		Common::removeFile(TEMPFILE);
-		Common::removeFile(TEMP_RAW);
-		Common::removeFile(tempEncoded);
+		if (isAudioQueueFull())
+			addQueuedFiles(output, queuedNames);
 	}
 
-	if (output.getFileList())
+	addQueuedFiles(output, queuedNames);
+
+	if (output.getFileCount())
 		output.saveFile(outfile->getFullPath().c_str());
 	else
 		print("file '%s' doesn't contain any .voc files\n", infile->getFullPath().c_str());
 }
 
+void CompressKyra::addQueuedFiles(PAKFile &output, std::vector<std::string> &names) {
+	encodeQueuedAudio();
+
+	for (uint i = 0; i < names.size(); ++i) {
+		const std::vector<byte> &encoded = getEncodedAudio(i);
+
+		uint8 *data = new uint8[encoded.size()];
+		if (!encoded.empty())
+			memcpy(data, &encoded[0], encoded.size());
+		output.addFile(names[i].c_str(), data, encoded.size());
+	}
+
+	clearAudioQueue();
+	names.clear();
+}
+
 // Kyra3 specifc code
 
 uint16 CompressKyra::clip8BitSample(int16 sample) {
@@ -324,9 +351,14 @@ void CompressKyra::processKyra3(Common::Filename *infile, Common::Filename *outf
 		DuplicatedFile *red = new DuplicatedFile[files];
 		memset(red, 0, sizeof(DuplicatedFile)*files);
 
+		// The table is made of (filename, offset) pairs
+		std::vector<uint32> table(files * 2);
+		if (files)
+			input.readUint32LEArray(&table[0], table.size());
+
 		for (uint16 i = 0; i < files; ++i) {
-			uint32 resFilename = input.readUint32LE();
-			uint32 resOffset = input.readUint32LE();
+			uint32 resFilename = table[i * 2];
+			uint32 resOffset = table[i * 2 + 1];
 
 			char outname[16];
 			snprintf(outname, 16, "%.08u%s", resFilename, audio_extensions(_format));
@@ -356,7 +388,7 @@ void CompressKyra::processKyra3(Common::Filename *infile, Common::Filename *outf
 
 		delete[] red;
 
-		if (output.getFileList())
+		if (output.getFileCount())
 			output.saveFile(outfile->getFullPath().c_str());
 	} else {
 		error("Unsupported file '%s'", infile->getFullPath().c_str());
@@ -384,10 +416,12 @@ bool CompressKyra::detectKyra3File(Common::Filename *infile) {
 			error("Unknown filetype of file: '%s'", infile->getFullPath().c_str());
 		}
 
-		uint32 offset = 0;
+		std::vector<uint32> table(entries * 2);
+		if (entries)
+			f.readUint32LEArray(&table[0], table.size());
+
 		for (uint16 i = 0; i < entries; ++i) {
-			f.readUint32LE();
-			offset = f.readUint32LE();
+			uint32 offset = table[i * 2 + 1];
 
 			if (offset > filesize)
 				error("Unknown filetype of file: '%s'", infile->getFullPath().c_str());
@@ -25,6 +25,8 @@
 
 #include "compress.h"
 
+class PAKFile;
+
 class CompressKyra : public CompressionTool {
 public:
 	CompressKyra(const std::string &name = "compress_kyra");
@@ -41,6 +43,7 @@ protected:
 	void compressAUDFile(Common::File &input, const char *outfile);
 	const DuplicatedFile *findDuplicatedFile(uint32 resOffset, const DuplicatedFile *list, const uint32 maxEntries);
 	void process(Common::Filename *infile, Common::Filename *output);
+	void addQueuedFiles(PAKFile &output, std::vector<std::string> &names);
 	void processKyra3(Common::Filename *infile, Common::Filename *output);
 	bool detectKyra3File(Common::Filename *infile);
 };
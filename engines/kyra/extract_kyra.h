@@ -97,7 +97,12 @@ public:
 
 	typedef const FileList cFileList;
 
-	virtual cFileList *getFileList() const = 0;
+	/**
+	 * Returns the files of extractors which keep them in a FileList, which
+	 * the default output functions above work on. Extractors which store
+	 * their files differently return 0 and override those functions.
+	 */
+	virtual cFileList *getFileList() const { return 0; }
 };
 
 #endif
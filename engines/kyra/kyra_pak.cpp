@@ -83,24 +83,19 @@ bool PAKFile::loadFile(const char *file, const bool isAmiga) {
 	if (!file)
 		return true;
 
-	delete _fileList;
-	_fileList = 0;
+	clearFile();
 
-	Common::File pakfile(file, "rb");
+	// The files stay in the mapped archive, only added files get their own buffers
+	_archive.openMapped(file);
 
-	uint32 filesize = pakfile.size();
-
-	// TODO: get rid of temp. buffer
-	uint8 *buffer = new uint8[filesize];
-	assert(buffer);
-
-	pakfile.read_throwsOnError(buffer, filesize);
+	uint32 filesize = _archive.size();
+	const uint8 *buffer = _archive.readSpan(filesize);
 
 	const char *currentName = 0;
 
 	uint32 startoffset = _isAmiga ? READ_BE_UINT32(buffer) : READ_LE_UINT32(buffer);
 	uint32 endoffset = 0;
-	uint8* position = buffer + 4;
+	const uint8 *position = buffer + 4;
 
 	while (true) {
 		uint32 strlgt = (uint32)strlen((const char*)position);
@@ -118,11 +113,10 @@ bool PAKFile::loadFile(const char *file, const bool isAmiga) {
 		}
 		position += 4;
 
-		uint8 *data = new uint8[endoffset - startoffset];
-		assert(data);
-		memcpy(data, buffer + startoffset, endoffset - startoffset);
-		addFile(currentName, data, endoffset - startoffset);
-		data = 0;
+		if (endoffset < startoffset)
+			error("Invalid offset of file '%s' in '%s'", currentName, file);
+
+		addEntry(currentName, buffer + startoffset, endoffset - startoffset, 0);
 
 		if (endoffset == filesize)
 			break;
@@ -130,30 +124,31 @@ bool PAKFile::loadFile(const char *file, const bool isAmiga) {
 		startoffset = endoffset;
 	}
 
-	delete[] buffer;
 	loadLinkEntry();
 	return true;
 }
 
 bool PAKFile::saveFile(const char *file) {
-	if (!_fileList)
+	if (_entries.empty())
 		return true;
 	generateLinkEntry();
 
 	Common::File f(file, "wb");
 
 	// TODO: implement error handling
-	uint32 startAddr = _fileList->getTableSize()+5+4;
+	uint32 startAddr = 5 + 4;
+	for (uint i = 0; i < _entries.size(); ++i)
+		startAddr += _entries[i].filename.size() + 1 + 4;
 	static const char *zeroName = "\0\0\0\0\0";
 
 	uint32 curAddr = startAddr;
-	for (FileList *cur = _fileList; cur; cur = cur->next) {
+	for (uint i = 0; i < _entries.size(); ++i) {
 		if (_isAmiga)
 			f.writeUint32BE(curAddr);
 		else
 			f.writeUint32LE(curAddr);
-		f.write(cur->filename, strlen(cur->filename) + 1);
-		curAddr += cur->size;
+		f.write(_entries[i].filename.c_str(), _entries[i].filename.size() + 1);
+		curAddr += _entries[i].size;
 	}
 	if (_isAmiga)
 		f.writeUint32BE(curAddr);
@@ -161,32 +156,73 @@ bool PAKFile::saveFile(const char *file) {
 		f.writeUint32LE(curAddr);
 	f.write(zeroName, 5);
 
-	for (FileList *cur = _fileList; cur; cur = cur->next)
-		f.write(cur->data, cur->size);
+	for (uint i = 0; i < _entries.size(); ++i)
+		f.write(_entries[i].data, _entries[i].size);
 
 	return true;
 }
 
+void PAKFile::clearFile() {
+	for (uint i = 0; i < _entries.size(); ++i)
+		delete[] _entries[i].ownedData;
+	_entries.clear();
+	_entryIndex.clear();
+	_links.clear();
+	_linkIndex.clear();
+	_archive.close();
+}
+
+uint32 PAKFile::getFileSize() const {
+	uint32 size = 5 + 4;
+	for (uint i = 0; i < _entries.size(); ++i)
+		size += _entries[i].filename.size() + 1 + 4 + _entries[i].size;
+	return size;
+}
+
+const PAKFile::Entry *PAKFile::findEntry(const char *name) const {
+	NameIndex::const_iterator i = _entryIndex.find(name);
+	return (i != _entryIndex.end()) ? &_entries[i->_value] : 0;
+}
+
+const PAKFile::Link *PAKFile::findLink(const char *name) const {
+	NameIndex::const_iterator i = _linkIndex.find(name);
+	return (i != _linkIndex.end()) ? &_links[i->_value] : 0;
+}
+
+void PAKFile::rebuildIndex() {
+	_entryIndex.clear();
+	for (uint i = 0; i < _entries.size(); ++i)
+		_entryIndex[_entries[i].filename.c_str()] = i;
+
+	_linkIndex.clear();
+	for (uint i = 0; i < _links.size(); ++i)
+		_linkIndex[_links[i].filename.c_str()] = i;
+}
+
 const uint8 *PAKFile::getFileData(const char *file, uint32 *size) {
-	if (_links) {
-		LinkList *entry = _links->findSrcEntry(file);
-		if (entry)
-			file = entry->linksTo;
-	}
+	const Link *link = findLink(file);
+	if (link)
+		file = link->linksTo.c_str();
 
-	FileList *cur = (_fileList != 0) ? _fileList->findEntry(file) : 0;
+	const Entry *entry = findEntry(file);
 
-	if (!cur)
+	if (!entry)
 		return 0;
 
 	if (size)
-		*size = cur->size;
-	return cur->data;
+		*size = entry->size;
+	return entry->data;
+}
+
+const uint8 *PAKFile::getFileData(uint index, uint32 *size) const {
+	if (size)
+		*size = _entries[index].size;
+	return _entries[index].data;
 }
 
 bool PAKFile::addFile(const char *name, const char *file) {
-	if ((_fileList && _fileList->findEntry(name)) || (_links && _links->findSrcEntry(name))) {
-		error("entry '%s' already exists");
+	if (findEntry(name) || findLink(name)) {
+		error("entry '%s' already exists", name);
 		return false;
 	}
 
@@ -200,229 +236,196 @@ bool PAKFile::addFile(const char *name, const char *file) {
 }
 
 bool PAKFile::addFile(const char *name, uint8 *data, uint32 size) {
-	if ((_fileList && _fileList->findEntry(name)) || (_links && _links->findSrcEntry(name))) {
+	return addEntry(name, data, size, data);
+}
+
+bool PAKFile::addEntry(const char *name, const uint8 *data, uint32 size, uint8 *ownedData) {
+	if (findEntry(name) || findLink(name)) {
 		uint32 origSize = 0;
 		const uint8 *fileData = getFileData(name, &origSize);
 
-		if (size != origSize) {
-			error("entry '%s' already exists");
-			return false;
-		}
-
-		if (memcmp(fileData, data, size) == 0)
+		// Adding the same file twice is fine
+		if (size == origSize && memcmp(fileData, data, size) == 0) {
+			delete[] ownedData;
 			return true;
+		}
 
-		error("entry '%s' already exists");
+		error("entry '%s' already exists", name);
 		return false;
 	}
 
-	FileList *newEntry = new FileList;
-	assert(newEntry);
-	newEntry->filename = new char[strlen(name)+1];
-	assert(newEntry->filename);
-	strncpy(newEntry->filename, name, strlen(name)+1);
-	newEntry->size = size;
-	newEntry->data = data;
+	Entry entry;
+	entry.filename = name;
+	entry.size = size;
+	entry.data = data;
+	entry.ownedData = ownedData;
 
-	if (_fileList)
-		_fileList->addEntry(newEntry);
-	else
-		_fileList = newEntry;
+	_entryIndex[name] = _entries.size();
+	_entries.push_back(entry);
 	return true;
 }
 
 bool PAKFile::linkFiles(const char *name, const char *linkTo) {
-	if (!_fileList)
+	const Entry *dest = findEntry(linkTo);
+	if (!dest)
 		error("Cannot find file '%s' in file list", linkTo);
-	if (!_fileList->findEntry(linkTo))
-		error("Cannot find file '%s' in file list", linkTo);
-	if ((_fileList && _fileList->findEntry(name)) || (_links && _links->findSrcEntry(name)))
-		error("entry '%s' already exists");
-
-	LinkList *entry = new LinkList;
-	assert(entry);
+	if (findEntry(name) || findLink(name))
+		error("entry '%s' already exists", name);
 
-	entry->filename = new char[strlen(name)+1];
-	assert(entry->filename);
-	strncpy(entry->filename, name, strlen(name)+1);
-	entry->linksTo = _fileList->findEntry(linkTo)->filename;
+	Link link;
+	link.filename = name;
+	link.linksTo = dest->filename;
 
-	if (!_links)
-		_links = entry;
-	else
-		_links->addEntry(entry);
+	_linkIndex[name] = _links.size();
+	_links.push_back(link);
 
 	return true;
 }
 
-static bool isInList(const char * const *linkList, const char *linkTo, const int maxSize) {
-	for (int i = 0; i < maxSize; ++i) {
-		if (scumm_stricmp(linkList[i], linkTo) == 0)
-			return true;
-	}
-
-	return false;
+static void writeUint32BE(std::vector<uint8> &buf, uint32 value) {
+	uint8 bytes[4];
+	WRITE_BE_UINT32(bytes, value);
+	buf.insert(buf.end(), bytes, bytes + 4);
 }
 
 void PAKFile::generateLinkEntry() {
 	removeFile("LINKLIST");
-	if (!_links)
+	if (_links.empty())
 		return;
 
-	const int countLinks = _links->size();
-	Common::File output("LINKLIST.TMP", "wb");
-
-	const char **linkList = new const char *[countLinks];
-	int usedLinks = 0;
-
-	const LinkList *entry = _links;
-	for (int i = 0; i < countLinks && entry; ++i, entry = entry->next) {
-		if (isInList(linkList, entry->linksTo, usedLinks))
-			continue;
-
-		linkList[usedLinks++] = entry->linksTo;
-	}
-
-	output.writeUint32BE(MKID_BE('SCVM'));
-	output.writeUint32BE(usedLinks);
-	for (int i = 0; i < usedLinks; ++i) {
-		int count = 0;
-		entry = _links;
-		while (entry) {
-			if (scumm_stricmp(entry->linksTo, linkList[i]) == 0)
-				++count;
-			entry = entry->next;
+	// Group the links by their destination, in the order the destinations
+	// are first linked to
+	NameIndex destIndex;
+	std::vector<std::vector<uint> > groups;
+	for (uint i = 0; i < _links.size(); ++i) {
+		NameIndex::const_iterator dest = destIndex.find(_links[i].linksTo.c_str());
+		if (dest == destIndex.end()) {
+			destIndex[_links[i].linksTo.c_str()] = groups.size();
+			groups.push_back(std::vector<uint>(1, i));
+		} else {
+			groups[dest->_value].push_back(i);
 		}
+	}
 
-		const char *p = linkList[i];
-		while (*p)
-			output.writeByte(*p++);
-		output.writeByte(0);
-
-		output.writeUint32BE(count);
-		for (entry = _links; entry; entry = entry->next) {
-			if (scumm_stricmp(entry->linksTo, linkList[i]) != 0)
-				continue;
-
-			p = entry->filename;
-			while (*p)
-				output.writeByte(*p++);
-			output.writeByte(0);
+	std::vector<uint8> linkList;
+	writeUint32BE(linkList, MKID_BE('SCVM'));
+	writeUint32BE(linkList, groups.size());
+	for (uint i = 0; i < groups.size(); ++i) {
+		const std::string &linksTo = _links[groups[i][0]].linksTo;
+		linkList.insert(linkList.end(), linksTo.c_str(), linksTo.c_str() + linksTo.size() + 1);
+
+		writeUint32BE(linkList, groups[i].size());
+		for (uint j = 0; j < groups[i].size(); ++j) {
+			const std::string &filename = _links[groups[i][j]].filename;
+			linkList.insert(linkList.end(), filename.c_str(), filename.c_str() + filename.size() + 1);
 		}
 	}
-	output.close();
 
-	addFile("LINKLIST", "LINKLIST.TMP");
-
-	Common::removeFile("LINKLIST.TMP");
-	delete[] linkList;
+	uint8 *data = new uint8[linkList.size()];
+	memcpy(data, &linkList[0], linkList.size());
+	addFile("LINKLIST", data, linkList.size());
 }
 
 void PAKFile::loadLinkEntry() {
-	delete _links; _links = 0;
-
-	if (_fileList && _fileList->findEntry("LINKLIST")) {
-		const FileList *entry = _fileList->findEntry("LINKLIST");
-		const uint8 *src = entry->data;
-
-		uint32 magic = READ_BE_UINT32(src); src += 4;
-		if (magic != MKID_BE('SCVM'))
-			error("LINKLIST file does not contain 'SCVM' header");
-		uint32 links = READ_BE_UINT32(src); src += 4;
-		for (uint32 i = 0; i < links; ++i) {
-			const char *linksTo = (const char *)src;
-
-			if (!_fileList->findEntry(linksTo))
-				error("Couldn't find link destination '%s'", linksTo);
-			src += strlen(linksTo) + 1;
-
-			uint32 sources = READ_BE_UINT32(src); src += 4;
-			for (uint32 j = 0; j < sources; ++j) {
-				LinkList *newEntry = new LinkList;
-				assert(newEntry);
-
-				newEntry->linksTo = _fileList->findEntry(linksTo)->filename;
-				newEntry->filename = new char[strlen((const char *)src) + 1];
-				assert(newEntry->filename);
-				strcpy(newEntry->filename, (const char *)src);
-				src += strlen((const char *)src) + 1;
-
-				if (_links)
-					_links->addEntry(newEntry);
-				else
-					_links = newEntry;
-			}
+	_links.clear();
+	_linkIndex.clear();
+
+	const Entry *entry = findEntry("LINKLIST");
+	if (!entry)
+		return;
+
+	const uint8 *src = entry->data;
+
+	uint32 magic = READ_BE_UINT32(src); src += 4;
+	if (magic != MKID_BE('SCVM'))
+		error("LINKLIST file does not contain 'SCVM' header");
+	uint32 links = READ_BE_UINT32(src); src += 4;
+	for (uint32 i = 0; i < links; ++i) {
+		const char *linksTo = (const char *)src;
+
+		const Entry *dest = findEntry(linksTo);
+		if (!dest)
+			error("Couldn't find link destination '%s'", linksTo);
+		src += strlen(linksTo) + 1;
+
+		uint32 sources = READ_BE_UINT32(src); src += 4;
+		for (uint32 j = 0; j < sources; ++j) {
+			Link link;
+			link.linksTo = dest->filename;
+			link.filename = (const char *)src;
+			src += strlen((const char *)src) + 1;
+
+			_linkIndex[link.filename.c_str()] = _links.size();
+			_links.push_back(link);
 		}
 	}
 }
 
 bool PAKFile::removeFile(const char *name) {
-	if (_links) {
-		LinkList *link = _links->findEntry(name);
-		while (link) {
-			warning("Implicitly removing link '%s' to file '%s'", link->filename, name);
-
-			LinkList *last = _links;
-			while (last != link)
-				last = last->next;
-
-			if (last == _links)
-				_links = link->next;
-			else
-				last->next = link->next;
-
-			link->next = 0;
-			delete link;
-		}
-
-		if ((link = _links->findSrcEntry(name)) != 0) {
-			LinkList *last = _links;
-			while (last != link)
-				last = last->next;
+	const Link *link = findLink(name);
+	if (link) {
+		_links.erase(_links.begin() + (link - &_links[0]));
+		rebuildIndex();
+		return true;
+	}
 
-			if (last == _links)
-				_links = link->next;
-			else
-				last->next = link->next;
+	const Entry *entry = findEntry(name);
+	if (!entry)
+		return false;
 
-			link->next = 0;
-			delete link;
-			return true;
+	// Links to the file go away with it
+	for (uint i = 0; i < _links.size(); ) {
+		if (scumm_stricmp(_links[i].linksTo.c_str(), entry->filename.c_str()) == 0) {
+			warning("Implicitly removing link '%s' to file '%s'", _links[i].filename.c_str(), name);
+			_links.erase(_links.begin() + i);
+		} else {
+			++i;
 		}
 	}
 
-	for (FileList *cur = _fileList, *last = 0; cur; last = cur, cur = cur->next) {
-		if (scumm_stricmp(cur->filename, name) == 0) {
-			FileList *next = cur->next;
-			cur->next = 0;
-			delete cur;
-			if (last)
-				last->next = next;
-			else
-				_fileList = next;
-			return true;
-		}
-	}
-	return false;
+	delete[] entry->ownedData;
+	_entries.erase(_entries.begin() + (entry - &_entries[0]));
+	rebuildIndex();
+	return true;
 }
 
 void PAKFile::drawFileList() {
-	Extractor::drawFileList();
+	for (uint i = 0; i < _entries.size(); ++i)
+		printf("Common::Filename: '%s' size: %d\n", _entries[i].filename.c_str(), _entries[i].size);
 
-	if (_links) {
-		printf("Linked files (count: %d):\n", _links->size());
-		for (const LinkList *i = _links; i; i = i->next)
-			printf("Common::Filename: '%s' -> '%s'\n", i->filename, i->linksTo);
+	if (!_links.empty()) {
+		printf("Linked files (count: %d):\n", (int)_links.size());
+		for (uint i = 0; i < _links.size(); ++i)
+			printf("Common::Filename: '%s' -> '%s'\n", _links[i].filename.c_str(), _links[i].linksTo.c_str());
 	}
 }
 
-bool PAKFile::outputAllFiles(Common::Filename *outputPath) {
-	if (!Extractor::outputAllFiles(outputPath))
+bool PAKFile::writeEntry(const Entry &entry, const char *outputName) {
+	FILE *file = fopen(outputName, "wb");
+	if (!file) {
+		error("couldn't open file '%s' for writing", outputName);
 		return false;
+	}
+	bool ok = fwrite(entry.data, 1, entry.size, file) == entry.size;
+	fclose(file);
+	return ok;
+}
+
+bool PAKFile::outputAllFiles(Common::Filename *outputPath) {
+	for (uint i = 0; i < _entries.size(); ++i) {
+		outputPath->setFullName(_entries[i].filename);
+		printf("Extracting file '%s'...", _entries[i].filename.c_str());
+		if (writeEntry(_entries[i], outputPath->getFullPath().c_str())) {
+			printf("OK\n");
+		} else {
+			printf("FAILED\n");
+			return false;
+		}
+	}
 
-	for (const LinkList *entry = _links; entry; entry = entry->next) {
-		outputPath->setFullName(entry->filename);
-		if (!outputFileAs(entry->linksTo, outputPath->getFullPath().c_str()))
+	for (uint i = 0; i < _links.size(); ++i) {
+		outputPath->setFullName(_links[i].filename);
+		if (!outputFileAs(_links[i].linksTo.c_str(), outputPath->getFullPath().c_str()))
 			return false;
 	}
 
@@ -430,14 +433,24 @@ bool PAKFile::outputAllFiles(Common::Filename *outputPath) {
 }
 
 bool PAKFile::outputFileAs(const char *file, const char *outputName) {
-	for (const LinkList *entry = _links; entry; entry = entry->next) {
-		if (scumm_stricmp(entry->filename, file) == 0) {
-			file = entry->linksTo;
-			break;
-		}
+	const Link *link = findLink(file);
+	if (link)
+		file = link->linksTo.c_str();
+
+	const Entry *entry = findEntry(file);
+	if (!entry) {
+		error("file '%s' not found", file);
+		return false;
 	}
 
-	return Extractor::outputFileAs(file, outputName);
+	printf("Extracting file '%s' to file '%s'...", entry->filename.c_str(), outputName);
+	if (writeEntry(*entry, outputName)) {
+		printf("OK\n");
+	} else {
+		printf("FAILED\n");
+		return false;
+	}
+	return true;
 }
 
 //HACK: move this to another file
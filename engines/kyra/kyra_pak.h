@@ -24,19 +24,23 @@
 #define KYRA_PAK_H
 
 #include "extract_kyra.h"
+#include "common/hash-str.h"
+
+#include <string>
+#include <vector>
 
 class PAKFile : public Extractor {
 public:
-	PAKFile() : _fileList(0), _isAmiga(false), _links(0) {}
-	~PAKFile() { delete _fileList; }
+	PAKFile() : _isAmiga(false) {}
+	~PAKFile() { clearFile(); }
 
 	static bool isPakFile(const char *file);
 
 	bool loadFile(const char *file, const bool isAmiga);
 	bool saveFile(const char *file);
-	void clearFile() { delete _fileList; _fileList = 0; }
+	void clearFile();
 
-	uint32 getFileSize() const { return _fileList->getTableSize()+5+4+_fileList->getFileSize(); }
+	uint32 getFileSize() const;
 
 	const uint8 *getFileData(const char *file, uint32 *size);
 
@@ -47,56 +51,53 @@ public:
 
 	bool removeFile(const char *name);
 
-	cFileList *getFileList() const { return _fileList; }
+	/** Returns the number of files in the archive, not counting links. */
+	uint getFileCount() const { return _entries.size(); }
+	const char *getFileName(uint index) const { return _entries[index].filename.c_str(); }
+	const uint8 *getFileData(uint index, uint32 *size) const;
 
 	void drawFileList();
 	bool outputAllFiles(Common::Filename *outputPath);
 	bool outputFileAs(const char *file, const char *outputName);
 private:
-	FileList *_fileList;
 	bool _isAmiga;
 
-	struct LinkList {
-		LinkList() : filename(0), linksTo(0), next(0) {}
-		~LinkList() { delete[] filename; delete next; }
-
-		char *filename;
-		const char *linksTo;
-
-		LinkList *next;
-
-		LinkList *findEntry(const char *linkDest) {
-			for (LinkList *cur = this; cur; cur = cur->next) {
-				if (scumm_stricmp(cur->linksTo, linkDest) == 0)
-					return cur;
-			}
-			return 0;
-		}
-
-		LinkList *findSrcEntry(const char *f) {
-			for (LinkList *cur = this; cur; cur = cur->next) {
-				if (scumm_stricmp(cur->filename, f) == 0)
-					return cur;
-			}
-			return 0;
-		}
-
-		void addEntry(LinkList *e) {
-			if (next)
-				next->addEntry(e);
-			else
-				next = e;
-		}
-
-		int size() const {
-			return 1 + (next ? next->size() : 0);
-		}
+	/**
+	 * The archive loaded by loadFile(), mapped into memory. The files of the
+	 * archive point into it, until they are replaced.
+	 */
+	Common::File _archive;
+
+	struct Entry {
+		std::string filename;
+		uint32 size;
+		const uint8 *data;
+		/** The data of an added file, owned by the entry. NULL if data points into _archive. */
+		uint8 *ownedData;
+	};
+
+	struct Link {
+		std::string filename;
+		std::string linksTo;
 	};
 
-	LinkList *_links;
+	typedef Common::HashMap<Common::String, uint, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> NameIndex;
+
+	std::vector<Entry> _entries;
+	NameIndex _entryIndex;
+
+	std::vector<Link> _links;
+	NameIndex _linkIndex;
+
+	const Entry *findEntry(const char *name) const;
+	const Link *findLink(const char *name) const;
+	bool addEntry(const char *name, const uint8 *data, uint32 size, uint8 *ownedData);
+	void rebuildIndex();
+
+	bool writeEntry(const Entry &entry, const char *outputName);
+
 	void generateLinkEntry();
 	void loadLinkEntry();
 };
 
 #endif
-
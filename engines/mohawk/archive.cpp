@@ -21,6 +21,7 @@
  */
 
 #include "engines/mohawk/archive.h"
+#include "common/algorithm.h"
 
 inline uint32 SWAP_BYTES_32(uint32 a) {
 	const uint16 low = (uint16)a, high = (uint16)(a >> 16);
@@ -45,21 +46,77 @@ Common::String MohawkArchive::tag2string(uint32 tag) {
 
 MohawkArchive::MohawkArchive() {
 	_mhk = NULL;
+	_mhkData = NULL;
 	_curFile.clear();
 	_types = NULL;
 	_fileTable = NULL;
-	_curExType = 0;
-	_curExTypeIndex = 0;
+	_curExEntry = 0;
 }
 
 void MohawkArchive::close() {
 	delete _mhk; _mhk = NULL;
+	_mhkData = NULL;
 	delete[] _types; _types = NULL;
 	delete[] _fileTable; _fileTable = NULL;
 
 	_curFile.clear();
-	_curExType = 0;
-	_curExTypeIndex = 0;
+	_extractOrder.clear();
+	_curExEntry = 0;
+	_typeIndex.clear();
+	_idIndex.clear();
+	_nameIndex.clear();
+}
+
+void MohawkArchive::setResourceData(MohawkOutputStream &output, uint32 begin, uint32 end) {
+	if (_mhkData) {
+		// Don't let a broken directory point outside of the archive
+		end = MIN(end, _mhk->size());
+		begin = MIN(begin, end);
+		output.data = _mhkData + begin;
+	} else
+		output.stream = new Common::SeekableSubReadStream(_mhk, begin, end);
+
+	output.size = end - begin;
+}
+
+void MohawkArchive::addTypeToIndex(uint16 typeIndex, uint32 tag) {
+	// Like a search of the type table, the first type with a tag wins
+	if (!_typeIndex.contains(tag))
+		_typeIndex[tag] = typeIndex;
+}
+
+void MohawkArchive::addResourceToIndex(uint16 typeIndex, uint16 idIndex, uint16 id, uint32 offset) {
+	uint32 key = (typeIndex << 16) | id;
+	if (!_idIndex.contains(key))
+		_idIndex[key] = idIndex;
+
+	ResourceLocation location;
+	location.offset = offset;
+	location.typeIndex = typeIndex;
+	location.idIndex = idIndex;
+	_extractOrder.push_back(location);
+}
+
+static bool compareByOffset(const ResourceLocation &a, const ResourceLocation &b) {
+	if (a.offset != b.offset)
+		return a.offset < b.offset;
+	if (a.typeIndex != b.typeIndex)
+		return a.typeIndex < b.typeIndex;
+	return a.idIndex < b.idIndex;
+}
+
+static bool compareByType(const ResourceLocation &a, const ResourceLocation &b) {
+	if (a.typeIndex != b.typeIndex)
+		return a.typeIndex < b.typeIndex;
+	return a.idIndex < b.idIndex;
+}
+
+void MohawkArchive::setExtractByOffset(bool byOffset) {
+	if (byOffset)
+		Common::sort(_extractOrder.begin(), _extractOrder.end(), compareByOffset);
+	else
+		Common::sort(_extractOrder.begin(), _extractOrder.end(), compareByType);
+	_curExEntry = 0;
 }
 
 void MohawkArchive::open(Common::SeekableReadStream *stream) {
@@ -179,6 +236,24 @@ void MohawkArchive::open(Common::SeekableReadStream *stream) {
 
 		debug (4, "File[%02x]: Offset = %08x  DataSize = %07x  Flags = %02x  Unk = %04x", i, _fileTable[i].offset, _fileTable[i].dataSize, _fileTable[i].flags, _fileTable[i].unk);
 	}
+
+	// Index the directory, so that looking up a resource doesn't have to
+	// search the tables
+	for (uint16 i = 0; i < _typeTable.resource_types; i++) {
+		addTypeToIndex(i, _types[i].tag);
+
+		for (uint16 j = 0; j < _types[i].resTable.resources; j++) {
+			uint16 fileTableIndex = _types[i].resTable.entries[j].index - 1;
+			uint32 offset = (fileTableIndex < _fileTableAmount) ? _fileTable[fileTableIndex].offset : 0;
+			addResourceToIndex(i, j, _types[i].resTable.entries[j].id, offset);
+		}
+
+		for (uint16 j = 0; j < _types[i].nameTable.num; j++) {
+			uint32 key = (i << 16) | _types[i].nameTable.entries[j].index;
+			if (!_nameIndex.contains(key))
+				_nameIndex[key] = j;
+		}
+	}
 }
 
 bool MohawkArchive::hasResource(uint32 tag, uint16 id) {
@@ -194,7 +269,7 @@ bool MohawkArchive::hasResource(uint32 tag, uint16 id) {
 }
 
 MohawkOutputStream MohawkArchive::getRawData(uint32 tag, uint16 id) {
-	MohawkOutputStream output = { 0, 0, 0, 0, 0, "" };
+	MohawkOutputStream output;
 
 	if (!_mhk)
 		return output;
@@ -209,75 +284,46 @@ MohawkOutputStream MohawkArchive::getRawData(uint32 tag, uint16 id) {
 	if (idIndex < 0)
 		return output;
 
-	// Note: the fileTableIndex is based off 1, not 0. So, subtract 1
-	uint16 fileTableIndex = _types[typeIndex].resTable.entries[idIndex].index - 1;
-
-	// WORKAROUND: tMOV resources pretty much ignore the size part of the file table,
-	// as the original just passed the full Mohawk file to QuickTime and the offset.
-	// We need to do this because of the way Mohawk is set up (this is much more "proper"
-	// than passing _mhk at the right offset). We may want to do that in the future, though.
-	if (_types[typeIndex].tag == ID_TMOV) {
-		if (fileTableIndex == _fileTableAmount - 1)
-			output.stream = new Common::SeekableSubReadStream(_mhk, _fileTable[fileTableIndex].offset, _mhk->size());
-		else
-			output.stream = new Common::SeekableSubReadStream(_mhk, _fileTable[fileTableIndex].offset, _fileTable[fileTableIndex + 1].offset);
-	} else
-		output.stream = new Common::SeekableSubReadStream(_mhk, _fileTable[fileTableIndex].offset, _fileTable[fileTableIndex].offset + _fileTable[fileTableIndex].dataSize);
-
-	output.tag = tag;
-	output.id = id;
-	output.index = fileTableIndex;
-	output.flags = _fileTable[fileTableIndex].flags;
-	for (uint16 i = 0; i < _types[typeIndex].nameTable.num; i++) {
-		if (_types[typeIndex].nameTable.entries[i].index == fileTableIndex+1) {
-			output.name = _types[typeIndex].nameTable.entries[i].name;
-			break;
-		}
-	}
-
-	return output;
+	return getResource(typeIndex, idIndex);
 }
 
 MohawkOutputStream MohawkArchive::getNextFile() {
-	MohawkOutputStream output = { 0, 0, 0, 0, 0, "" };
+	MohawkOutputStream output;
 
-	if (_curExType >= _typeTable.resource_types) // No more!
+	if (_curExEntry >= _extractOrder.size()) // No more!
 		return output;
 
-	if (_curExTypeIndex >= _types[_curExType].resTable.resources) {
-		_curExType++;
-		_curExTypeIndex = 0;
+	const ResourceLocation &location = _extractOrder[_curExEntry++];
+	return getResource(location.typeIndex, location.idIndex);
+}
 
-		if (_curExType >= _typeTable.resource_types) // No more!
-			return output;
-	}
+MohawkOutputStream MohawkArchive::getResource(uint16 typeIndex, uint16 idIndex) {
+	MohawkOutputStream output;
 
-	uint16 fileTableIndex = _types[_curExType].resTable.entries[_curExTypeIndex].index - 1;
+	// Note: the fileTableIndex is based off 1, not 0. So, subtract 1
+	uint16 fileTableIndex = _types[typeIndex].resTable.entries[idIndex].index - 1;
 
-	// For some unknown reason, all tMOV resources have incorrect sizes. We correct this by getting the differences between offsets.
-	uint32 dataSize = 0;
-	if (_types[_curExType].tag == ID_TMOV) {
+	// WORKAROUND: tMOV resources pretty much ignore the size part of the file table,
+	// as the original just passed the full Mohawk file to QuickTime and the offset.
+	// We need to do this because of the way Mohawk is set up (this is much more "proper"
+	// than passing _mhk at the right offset). We may want to do that in the future, though.
+	if (_types[typeIndex].tag == ID_TMOV) {
 		if (fileTableIndex == _fileTableAmount - 1)
-			dataSize = _mhk->size() - _fileTable[fileTableIndex].offset;
+			setResourceData(output, _fileTable[fileTableIndex].offset, _mhk->size());
 		else
-			dataSize = _fileTable[fileTableIndex + 1].offset - _fileTable[fileTableIndex].offset;
+			setResourceData(output, _fileTable[fileTableIndex].offset, _fileTable[fileTableIndex + 1].offset);
 	} else
-		dataSize = _fileTable[fileTableIndex].dataSize;
+		setResourceData(output, _fileTable[fileTableIndex].offset, _fileTable[fileTableIndex].offset + _fileTable[fileTableIndex].dataSize);
 
-	output.stream = new Common::SeekableSubReadStream(_mhk, _fileTable[fileTableIndex].offset, _fileTable[fileTableIndex].offset + dataSize, false);
-	output.tag = _types[_curExType].tag;
-	output.id = _types[_curExType].resTable.entries[_curExTypeIndex].id;
+	output.tag = _types[typeIndex].tag;
+	output.id = _types[typeIndex].resTable.entries[idIndex].id;
 	output.index = fileTableIndex;
 	output.flags = _fileTable[fileTableIndex].flags;
 
-	for (uint16 i = 0; i < _types[_curExType].nameTable.num; i++) {
-		if (_types[_curExType].nameTable.entries[i].index == fileTableIndex+1) {
-			output.name = _types[_curExType].nameTable.entries[i].name;
-			break;
-		}
-	}
+	Common::HashMap<uint32, uint16>::iterator name = _nameIndex.find((typeIndex << 16) | (fileTableIndex + 1));
+	if (name != _nameIndex.end())
+		output.name = _types[typeIndex].nameTable.entries[name->_value].name;
 
-	_curExTypeIndex++;
 	return output;
 }
 
@@ -365,10 +411,19 @@ void LivingBooksArchive_v1::open(Common::SeekableReadStream *stream) {
 	} else
 		error("Could not determine type of Old Mohawk resource");
 
+	indexOldTypes();
+}
+
+void LivingBooksArchive_v1::indexOldTypes() {
+	for (uint16 i = 0; i < _typeTable.resource_types; i++) {
+		addTypeToIndex(i, _types[i].tag);
+		for (uint16 j = 0; j < _types[i].resTable.resources; j++)
+			addResourceToIndex(i, j, _types[i].resTable.entries[j].id, _types[i].resTable.entries[j].offset);
+	}
 }
 
 MohawkOutputStream LivingBooksArchive_v1::getRawData(uint32 tag, uint16 id) {
-	MohawkOutputStream output = { 0, 0, 0, 0, 0, "" };
+	MohawkOutputStream output;
 
 	if (!_mhk)
 		return output;
@@ -383,7 +438,7 @@ MohawkOutputStream LivingBooksArchive_v1::getRawData(uint32 tag, uint16 id) {
 	if (idIndex < 0)
 		return output;
 
-	output.stream = new Common::SeekableSubReadStream(_mhk, _types[typeIndex].resTable.entries[idIndex].offset, _types[typeIndex].resTable.entries[idIndex].offset + _types[typeIndex].resTable.entries[idIndex].size);
+	setResourceData(output, _types[typeIndex].resTable.entries[idIndex].offset, _types[typeIndex].resTable.entries[idIndex].offset + _types[typeIndex].resTable.entries[idIndex].size);
 	output.tag = tag;
 	output.id = id;
 	output.index = idIndex;
@@ -392,25 +447,19 @@ MohawkOutputStream LivingBooksArchive_v1::getRawData(uint32 tag, uint16 id) {
 }
 
 MohawkOutputStream LivingBooksArchive_v1::getNextFile() {
-	MohawkOutputStream output = { 0, 0, 0, 0, 0, "" };
+	MohawkOutputStream output;
 
-	if (_curExType >= _typeTable.resource_types) // No more!
+	if (_curExEntry >= _extractOrder.size()) // No more!
 		return output;
 
-	if (_curExTypeIndex >= _types[_curExType].resTable.resources) {
-		_curExType++;
-		_curExTypeIndex = 0;
+	const ResourceLocation &location = _extractOrder[_curExEntry++];
+	const OldType::ResourceTable::Entries &entry = _types[location.typeIndex].resTable.entries[location.idIndex];
 
-		if (_curExType >= _typeTable.resource_types) // No more!
-			return output;
-	}
+	setResourceData(output, entry.offset, entry.offset + entry.size);
+	output.tag = _types[location.typeIndex].tag;
+	output.id = entry.id;
+	output.index = location.typeIndex;
 
-	output.stream = new Common::SeekableSubReadStream(_mhk, _types[_curExType].resTable.entries[_curExTypeIndex].offset, _types[_curExType].resTable.entries[_curExTypeIndex].offset + _types[_curExType].resTable.entries[_curExTypeIndex].size);
-	output.tag = _types[_curExType].tag;
-	output.id = _types[_curExType].resTable.entries[_curExTypeIndex].id;
-	output.index = _curExType;
-
-	_curExTypeIndex++;
 	return output;
 }
 
@@ -456,6 +505,17 @@ void CSWorldDeluxeArchive::open(Common::SeekableReadStream *stream) {
 		_mhk->seek(oldPos);
 		debug (3, "\n");
 	}
+
+	indexOldTypes();
+}
+
+MohawkArchive *MohawkArchive::createMohawkArchive(Common::MemoryReadStream *stream) {
+	MohawkArchive *mohawkArchive = createMohawkArchive((Common::SeekableReadStream *)stream);
+
+	if (mohawkArchive)
+		mohawkArchive->_mhkData = stream->getData();
+
+	return mohawkArchive;
 }
 
 MohawkArchive *MohawkArchive::createMohawkArchive(Common::SeekableReadStream *stream) {
@@ -23,6 +23,8 @@
 #ifndef MOHAWK_ARCHIVE_H
 #define MOHAWK_ARCHIVE_H
 
+#include "common/array.h"
+#include "common/hashmap.h"
 #include "common/str.h"
 #include "common/endian.h"
 #include "common/util.h"
@@ -120,6 +122,12 @@
 
 #define tag2str(x)	MohawkArchive::tag2string(x).c_str()
 
+/**
+ * A resource returned by an archive. If the archive was created from a
+ * MemoryReadStream, data points to the contents of the resource in the
+ * archive and stream is NULL. Otherwise data is NULL, and stream must be
+ * deleted by the caller.
+ */
 struct MohawkOutputStream {
 	Common::SeekableSubReadStream *stream;
 	uint32 tag;
@@ -127,6 +135,13 @@ struct MohawkOutputStream {
 	uint32 index;
 	byte flags;
 	Common::String name;
+	const byte *data;
+	uint32 size;
+
+	MohawkOutputStream() : stream(0), tag(0), id(0), index(0), flags(0), name(""), data(0), size(0) {}
+
+	/** Returns true if a resource was found. */
+	bool exists() const { return stream || data; }
 };
 
 struct FileTable {
@@ -164,6 +179,13 @@ struct Type {
 	} nameTable;
 };
 
+/** Where a resource is stored, used to walk the archive in offset order. */
+struct ResourceLocation {
+	uint32 offset;
+	uint16 typeIndex;
+	uint16 idIndex;
+};
+
 struct TypeTable {
 	uint16 name_offset;
 	uint16 resource_types;
@@ -186,6 +208,10 @@ public:
 	// Detect new/old Mohawk archive format. Return NULL if the file is neither.
 	static MohawkArchive *createMohawkArchive(Common::SeekableReadStream *stream);
 
+	// Same, for an archive held in memory: its resources are returned as
+	// views of the memory instead of as streams.
+	static MohawkArchive *createMohawkArchive(Common::MemoryReadStream *stream);
+
 	virtual void open(Common::SeekableReadStream *stream);
 	void close();
 
@@ -193,19 +219,47 @@ public:
 	virtual MohawkOutputStream getRawData(uint32 tag, uint16 id);
 	virtual MohawkOutputStream getNextFile();
 
+	/**
+	 * Selects the order in which getNextFile() returns the resources, and
+	 * starts over with the first one. By default they are grouped by type,
+	 * in the order of the type and resource tables. Sorted by offset, the
+	 * archive is read sequentially, which is much faster when extracting
+	 * everything from a CD.
+	 */
+	void setExtractByOffset(bool byOffset);
+
 	static Common::String tag2string(uint32 tag);
 
 protected:
 	Common::SeekableReadStream *_mhk;
+	const byte *_mhkData; // The contents of _mhk if it is in memory, NULL otherwise
 	TypeTable _typeTable;
 	Common::String _curFile;
 
 	// Extraction Variables
-	uint32 _curExType;
-	uint32 _curExTypeIndex;
+	Common::Array<ResourceLocation> _extractOrder;
+	uint32 _curExEntry;
 
 	FileTable *_fileTable;
 
+	// Resource Directory Index, filled in by open()
+	Common::HashMap<uint32, uint16> _typeIndex; // tag -> type
+	Common::HashMap<uint32, uint16> _idIndex;   // (type << 16) | id -> resource table entry
+
+	void setResourceData(MohawkOutputStream &output, uint32 begin, uint32 end);
+	void addTypeToIndex(uint16 typeIndex, uint32 tag);
+	void addResourceToIndex(uint16 typeIndex, uint16 idIndex, uint16 id, uint32 offset);
+
+	int16 getTypeIndex(uint32 tag) {
+		Common::HashMap<uint32, uint16>::iterator i = _typeIndex.find(tag);
+		return (i != _typeIndex.end()) ? i->_value : -1;
+	}
+
+	int16 getIdIndex(int16 typeIndex, uint16 id) {
+		Common::HashMap<uint32, uint16>::iterator i = _idIndex.find((typeIndex << 16) | id);
+		return (i != _idIndex.end()) ? i->_value : -1;
+	}
+
 private:
 	bool _hasData;
 	uint32 _fileSize;
@@ -215,19 +269,10 @@ private:
 	uint16 _resourceTableAmount;
 	uint16 _fileTableAmount;
 
-	virtual int16 getTypeIndex(uint32 tag) {
-		for (uint16 i = 0; i < _typeTable.resource_types; i++)
-			if (_types[i].tag == tag)
-				return i;
-		return -1;	// not found
-	}
+	// (type << 16) | file table index -> name table entry
+	Common::HashMap<uint32, uint16> _nameIndex;
 
-	virtual int16 getIdIndex(int16 typeIndex, uint16 id) {
-		for (uint16 i = 0; i < _types[typeIndex].resTable.resources; i++)
-			if (_types[typeIndex].resTable.entries[i].id == id)
-				return i;
-		return -1;	// not found
-	}
+	MohawkOutputStream getResource(uint16 typeIndex, uint16 idIndex);
 };
 
 class LivingBooksArchive_v1 : public MohawkArchive {
@@ -253,19 +298,7 @@ protected:
 		} resTable;
 	} *_types;
 
-	int16 getTypeIndex(uint32 tag) {
-		for (uint16 i = 0; i < _typeTable.resource_types; i++)
-			if (_types[i].tag == tag)
-				return i;
-		return -1;	// not found
-	}
-
-	int16 getIdIndex(int16 typeIndex, uint16 id) {
-		for (uint16 i = 0; i < _types[typeIndex].resTable.resources; i++)
-			if (_types[typeIndex].resTable.entries[i].id == id)
-				return i;
-		return -1;	// not found
-	}
+	void indexOldTypes();
 };
 
 class CSWorldDeluxeArchive : public LivingBooksArchive_v1 {
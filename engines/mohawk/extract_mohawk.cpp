@@ -26,11 +26,6 @@
 
 #include <assert.h>
 
-// Have a maximum buffer size
-#define MAX_BUF_SIZE 16384
-
-static byte *outputBuffer = NULL;
-
 bool fileExists(const char *filename) {
 	FILE *outputFile = fopen(filename, "rb");
 	if (outputFile != NULL) {
@@ -58,12 +53,8 @@ void dumpRawResource(MohawkOutputStream output) {
 		return;
 	}
 
-	assert(outputBuffer);
-
-	while (output.stream->pos() < output.stream->size()) {
-		uint32 size = output.stream->read(outputBuffer, MAX_BUF_SIZE);
-		fwrite(outputBuffer, 1, size, outputFile);
-	}
+	// The archive is in memory, so the resource is written straight from it
+	fwrite(output.data, 1, output.size, outputFile);
 
 	fclose(outputFile);
 }
@@ -96,29 +87,23 @@ void convertMIDIResource(MohawkOutputStream output) {
 		return;
 	}
 
-	// Read the Mohawk MIDI header
-	assert(output.stream->readUint32BE() == ID_MHWK);
-	output.stream->readUint32BE(); // Skip size
-	assert(output.stream->readUint32BE() == ID_MIDI);
-
-	uint32 size = output.stream->size() - 12; // Skip MHWK header's size
+	Common::MemoryReadStream stream(output.data, output.size);
 
-	byte *midiData = (byte *)malloc(size);
+	// Read the Mohawk MIDI header
+	assert(stream.readUint32BE() == ID_MHWK);
+	stream.readUint32BE(); // Skip size
+	assert(stream.readUint32BE() == ID_MIDI);
 
-	// Read the MThd Data
-	output.stream->read(midiData, 14);
+	// Output the MThd Data
+	fwrite(output.data + stream.pos(), 1, 14, outputFile);
+	stream.skip(14);
 
 	// Skip the unknown Prg# section
-	assert(output.stream->readUint32BE() == ID_PRG);
-	output.stream->skip(output.stream->readUint32BE());
-
-	// Read the MTrk Data
-	uint32 mtrkSize = output.stream->size() - output.stream->pos();
-	output.stream->read(midiData + 14, mtrkSize);
+	assert(stream.readUint32BE() == ID_PRG);
+	stream.skip(stream.readUint32BE());
 
-	// Output the data to the file.
-	fwrite(midiData, 1, 14 + mtrkSize, outputFile);
-	free(midiData);
+	// Output the MTrk Data
+	fwrite(output.data + stream.pos(), 1, stream.size() - stream.pos(), outputFile);
 
 	fclose(outputFile);
 }
@@ -234,7 +219,9 @@ int main(int argc, char *argv[]) {
 	}
 
 	// Open the file as a Mohawk archive
-	MohawkArchive *mohawkArchive = MohawkArchive::createMohawkArchive(new Common::File(file));
+	// The archive is mapped, so that resources can be dumped without reading
+	// them into buffers first
+	MohawkArchive *mohawkArchive = MohawkArchive::createMohawkArchive(new Common::MappedFile(file));
 
 	if (!mohawkArchive) {
 		printf("\'%s\' is not a valid Mohawk archive\n", argv[archiveArg]);
@@ -242,32 +229,30 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
-	// Allocate a buffer for the output
-	outputBuffer = (byte *)malloc(MAX_BUF_SIZE);
-
 	if (argc == archiveArg - 2 - 1) {
 		uint32 tag = READ_BE_UINT32(argv[archiveArg + 1]);
 		uint16 id = (uint16)atoi(argv[archiveArg + 2]);
 
 		MohawkOutputStream output = mohawkArchive->getRawData(tag, id);
 
-		if (output.stream) {
+		if (output.exists()) {
 			outputMohawkStream(output, doConversion, fileTableIndex, fileTableFlags);
-			delete output.stream;
 		} else {
 			printf ("Could not find specified data!\n");
 		}
 	} else {
+		// Dump the resources in the order they are stored, so the archive
+		// is read from start to end
+		mohawkArchive->setExtractByOffset(true);
+
 		MohawkOutputStream output = mohawkArchive->getNextFile();
-		while (output.stream) {
+		while (output.exists()) {
 			outputMohawkStream(output, doConversion, fileTableIndex, fileTableFlags);
-			delete output.stream;
 			output = mohawkArchive->getNextFile();
 		}
 	}
 
 	printf("Done!\n");
-	free(outputBuffer);
 	mohawkArchive->close();
 	fclose(file);
 	delete mohawkArchive;
@@ -23,6 +23,11 @@
 #include "common/util.h"
 #include "engines/mohawk/utils/file.h"
 
+#if defined(UNIX)
+#include <sys/mman.h>	// for mmap()
+#include <sys/stat.h>
+#endif
+
 
 namespace Common {
 
@@ -114,4 +119,46 @@ uint32 File::read(void *ptr, uint32 len) {
 	return (uint32)real_len;
 }
 
+MappedFile::MappedFile(FILE *file)
+	: MemoryReadStream(NULL, 0), _isMapped(false) {
+
+#if defined(UNIX)
+	struct stat st;
+	if (fstat(fileno(file), &st) == 0 && st.st_size > 0) {
+		void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+		if (data != MAP_FAILED) {
+			_ptr = (const byte *)data;
+			_size = st.st_size;
+			_isMapped = true;
+			return;
+		}
+	}
+#endif
+
+	// Mapping is not possible, read the whole file instead
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size <= 0)
+		return;
+
+	byte *data = new byte[size];
+	if (fread(data, 1, size, file) != (size_t)size) {
+		delete[] data;
+		error("MappedFile: Could not read the file");
+	}
+	_ptr = data;
+	_size = size;
+}
+
+MappedFile::~MappedFile() {
+#if defined(UNIX)
+	if (_isMapped) {
+		munmap((void *)_ptr, _size);
+		return;
+	}
+#endif
+	delete[] _ptr;
+}
+
 }	// End of namespace Common
@@ -60,6 +60,24 @@ public:
 	uint32 read(void *dataPtr, uint32 dataSize);
 };
 
+/**
+ * A read only file which is held in memory as a whole, mapped if possible,
+ * so that its contents can be accessed directly with getData(). Like File,
+ * it does not close the handle it is created with.
+ */
+class MappedFile : public MemoryReadStream {
+private:
+	MappedFile(const MappedFile &f);
+	MappedFile &operator  =(const MappedFile &f);
+
+	/** True if the data is mapped, false if it was read into a buffer. */
+	bool _isMapped;
+
+public:
+	MappedFile(FILE *file);
+	virtual ~MappedFile();
+};
+
 } // End of namespace Common
 
 #endif
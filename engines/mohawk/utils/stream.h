@@ -146,6 +146,61 @@ public:
 	void skip(uint32 offset) { seek(offset, SEEK_CUR); }
 };
 
+/**
+ * Simple memory based 'stream', which implements the SeekableReadStream
+ * interface for a plain memory block. The data is not copied, so it must
+ * stay valid for as long as the stream is used.
+ */
+class MemoryReadStream : public SeekableReadStream {
+protected:
+	const byte *_ptr;
+	uint32 _size;
+	uint32 _pos;
+	bool _eos;
+public:
+	MemoryReadStream(const byte *dataPtr, uint32 dataSize)
+		: _ptr(dataPtr),
+		  _size(dataSize),
+		  _pos(0),
+		  _eos(false) {
+	}
+
+	/** Returns the memory block which is read. */
+	const byte *getData() const { return _ptr; }
+
+	virtual bool eos() const { return _eos; }
+	virtual uint32 pos() const { return _pos; }
+	virtual uint32 size() const { return _size; }
+
+	virtual void seek(int32 offset, int whence = SEEK_SET) {
+		switch(whence) {
+		case SEEK_END:
+			offset = _size + offset;
+			// fallthrough
+		case SEEK_SET:
+			_pos = offset;
+			break;
+		case SEEK_CUR:
+			_pos += offset;
+		}
+
+		assert(_pos <= _size);
+		_eos = false;
+	}
+
+	virtual uint32 read(void *dataPtr, uint32 dataSize) {
+		if (dataSize > _size - _pos) {
+			dataSize = _size - _pos;
+			_eos = true;
+		}
+
+		memcpy(dataPtr, _ptr + _pos, dataSize);
+		_pos += dataSize;
+
+		return dataSize;
+	}
+};
+
 /**
  * SubReadStream provides access to a ReadStream restricted to the range
  * [currentPosition, currentPosition+end).
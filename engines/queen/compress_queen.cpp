@@ -33,7 +33,6 @@ const uint32 QTBL = 'QTBL';
 
 #define TEMP_DAT	"tempfile.dat"
 #define TEMP_TBL	"tempfile.tbl"
-#define TEMP_SB		"tempfile.sb"
 
 #define CURRENT_TBL_VERSION	2
 #define EXTRA_TBL_HEADER 8
@@ -173,7 +172,7 @@ void CompressQueen::createFinalFile(Common::Filename outPath) {
 }
 
 void CompressQueen::execute() {
-	Common::File inputData, inputTbl, outputTbl, outputData, compFile;
+	Common::File inputData, inputTbl, outputTbl, outputData;
 	char tmp[5];
 	int size, i = 1;
 	uint32 prevOffset;
@@ -239,7 +238,6 @@ void CompressQueen::execute() {
 			int headerSize;
 
 			/* Read in .SB */
-			Common::File tmpFile(TEMP_SB, "wb");
 			inputData.seek(_entry.offset, SEEK_SET);
 
 			inputData.seek(2, SEEK_CUR);
@@ -261,22 +259,19 @@ void CompressQueen::execute() {
 			inputData.seek(headerSize - 4, SEEK_CUR);
 			_entry.size -= headerSize;
 
-			fromFileToFile(inputData, tmpFile, _entry.size);
-			tmpFile.close();
+			std::vector<byte> sbData(_entry.size);
+			if (_entry.size)
+				inputData.read_throwsOnError(&sbData[0], _entry.size);
 
 			/* Invoke encoder */
-			setRawAudioType(false, false, 8);
-			encodeAudio(TEMP_SB, true, 11840, tempEncoded, _format);
+			RawAudioType sbType = { false, false, 8 };
+			std::vector<byte> encoded;
+			encodeRawToMemory(sbData.empty() ? NULL : (const char *)&sbData[0], sbData.size(), 11840, _format, sbType, encoded);
 
 			/* Append MP3/OGG to data file */
-			compFile.open(tempEncoded, "rb");
-			_entry.size = compFile.size();
-			fromFileToFile(compFile, outputData, _entry.size);
-			compFile.close();
-
-			/* Delete temporary files */
-			Common::removeFile(TEMP_SB);
-			Common::removeFile(tempEncoded);
+			_entry.size = encoded.size();
+			if (!encoded.empty())
+				outputData.write(&encoded[0], encoded.size());
 		} else {
 			/* Non .SB file */
 			bool patched = false;
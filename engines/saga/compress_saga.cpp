@@ -107,11 +107,6 @@ static CompressSaga::GameDescription gameDescriptions[] = {
 
 };
 
-typedef struct  {
-	uint32 offset;
-	uint32 size;
-} Record;
-
 // Constructor
 CompressSaga::CompressSaga(const std::string &name) : CompressionTool(name, TOOLTYPE_COMPRESSION) {
 	_currentGameDescription = NULL;
@@ -179,45 +174,6 @@ bool CompressSaga::detectFile(const Common::Filename *infile) {
 	return false;
 }
 
-uint32 CompressSaga::copyFile(const char *fromFileName, Common::File &outputFile) {
-	size_t size;
-	char fbuf[2048];
-	Common::File tempf(fromFileName, "rb");
-
-	if (!tempf.isOpen())
-		error("Unable to open %s", fromFileName);
-
-	while ((size = tempf.read_noThrow(fbuf, sizeof(fbuf))) > 0) {
-		outputFile.write(fbuf, size);
-	}
-	size = tempf.pos();
-	return size;
-}
-
-void CompressSaga::copyFile(Common::File &inputFile, uint32 inputSize, const char *toFileName) {
-	size_t size;
-	char fbuf[2048];
-	Common::File tempf(toFileName, "wb");
-
-	if (!tempf.isOpen())
-		error("Unable to open %s", toFileName);
-	while (inputSize > 0) {
-		size = inputFile.read_noThrow(fbuf, inputSize > sizeof(fbuf) ? sizeof(fbuf) : inputSize);
-		if (size == 0) {
-			error("Unable to copy file");
-		}
-		tempf.write(fbuf, size);
-		inputSize -= size;
-	}
-}
-
-void CompressSaga::writeBufferToFile(uint8 *data, uint32 inputSize, const char *toFileName) {
-	Common::File tempf(toFileName, "wb");
-	if (!tempf.isOpen())
-		error("Unable to open %s", toFileName);
-	tempf.write(data, inputSize);
-}
-
 byte CompressSaga::compression_format(AudioFormat format) {
 	switch(format) {
 	case AUDIO_MP3:
@@ -232,15 +188,15 @@ byte CompressSaga::compression_format(AudioFormat format) {
 	}
 }
 
-void CompressSaga::writeHeader(Common::File &outputFile) {
+void CompressSaga::writeHeader(Common::File &outputFile, const QueuedEntry &entry) {
 	outputFile.writeByte(compression_format(_format));
-	outputFile.writeUint16LE(_sampleRate);
-	outputFile.writeUint32LE(_sampleSize);
-	outputFile.writeByte(_sampleBits);
-	outputFile.writeByte(_sampleStereo);
+	outputFile.writeUint16LE(entry.sampleRate);
+	outputFile.writeUint32LE(entry.sampleSize);
+	outputFile.writeByte(entry.sampleBits);
+	outputFile.writeByte(entry.sampleStereo);
 }
 
-uint32 CompressSaga::encodeEntry(Common::File &inputFile, uint32 inputSize, Common::File &outputFile) {
+void CompressSaga::queueEntry(Common::File &inputFile, uint32 inputSize, QueuedEntry &entry) {
 	uint8 *inputData = 0;
 	byte *buffer = 0;
 	int rate, size;
@@ -249,66 +205,63 @@ uint32 CompressSaga::encodeEntry(Common::File &inputFile, uint32 inputSize, Comm
 	if (_currentFileDescription->resourceType == kSoundVOC) {
 		inputData = Audio::loadVOCFromStream(inputFile, size, rate);
 
-		_sampleSize = size;
-		_sampleRate = rate;
-		_sampleBits = 8;
-		_sampleStereo = 0;
-		writeHeader(outputFile);
-
-		writeBufferToFile(inputData, _sampleSize, TEMP_RAW);
-		free(inputData);
+		entry.sampleSize = size;
+		entry.sampleRate = rate;
+		entry.sampleBits = 8;
+		entry.sampleStereo = 0;
 
 		setRawAudioType( true, false, 8);
-		encodeAudio(TEMP_RAW, true, _sampleRate, tempEncoded, _format);
-		return copyFile(tempEncoded, outputFile) + HEADER_SIZE;
+		entry.job = queueAudio(inputData, entry.sampleSize, entry.sampleRate);
+		free(inputData);
+		return;
 	}
 	if (_currentFileDescription->resourceType == kSoundPCM) {
-		_sampleSize = inputSize;
-		_sampleRate = (uint16)_currentFileDescription->frequency;
-		_sampleBits = 16;
-		_sampleStereo = _currentFileDescription->stereo;
-		writeHeader(outputFile);
+		entry.sampleSize = inputSize;
+		entry.sampleRate = (uint16)_currentFileDescription->frequency;
+		entry.sampleBits = 16;
+		entry.sampleStereo = _currentFileDescription->stereo;
 
-		copyFile(inputFile, inputSize, TEMP_RAW);
+		buffer = (byte *)malloc(inputSize);
+		inputFile.read_throwsOnError(buffer, inputSize);
 
-		setRawAudioType( !_currentFileDescription->swapEndian, _sampleStereo != 0, _sampleBits);
-		encodeAudio(TEMP_RAW, true, _sampleRate, tempEncoded, _format);
-		return copyFile(tempEncoded, outputFile) + HEADER_SIZE;
+		setRawAudioType( !_currentFileDescription->swapEndian, entry.sampleStereo != 0, entry.sampleBits);
+		entry.job = queueAudio(buffer, inputSize, entry.sampleRate);
+		free(buffer);
+		return;
 	}
 	if (_currentFileDescription->resourceType == kSoundWAV) {
 		if (!Audio::loadWAVFromStream(inputFile, size, rate, flags))
 			error("Unable to read WAV");
 
-		_sampleSize = size;
-		_sampleRate = rate;
-		_sampleBits = ((flags & Audio::Mixer::FLAG_16BITS) != 0) ? 16 : 8;
-		_sampleStereo = ((flags & Audio::Mixer::FLAG_STEREO) != 0);
-		writeHeader(outputFile);
+		entry.sampleSize = size;
+		entry.sampleRate = rate;
+		entry.sampleBits = ((flags & Audio::Mixer::FLAG_16BITS) != 0) ? 16 : 8;
+		entry.sampleStereo = ((flags & Audio::Mixer::FLAG_STEREO) != 0);
 
-		copyFile(inputFile, size, TEMP_RAW);
+		buffer = (byte *)malloc(size);
+		inputFile.read_throwsOnError(buffer, size);
 
-		setRawAudioType( true, _sampleStereo != 0, _sampleBits);
-		encodeAudio(TEMP_RAW, true, _sampleRate, tempEncoded, _format);
-		return copyFile(tempEncoded, outputFile) + HEADER_SIZE;
+		setRawAudioType( true, entry.sampleStereo != 0, entry.sampleBits);
+		entry.job = queueAudio(buffer, size, entry.sampleRate);
+		free(buffer);
+		return;
 	}
 	if (_currentFileDescription->resourceType == kSoundVOX) {
-		_sampleSize = inputSize * 4;
-		_sampleRate = (uint16)_currentFileDescription->frequency;
-		_sampleBits = 16;
-		_sampleStereo = _currentFileDescription->stereo;
-		writeHeader(outputFile);
+		entry.sampleSize = inputSize * 4;
+		entry.sampleRate = (uint16)_currentFileDescription->frequency;
+		entry.sampleBits = 16;
+		entry.sampleStereo = _currentFileDescription->stereo;
 
 		Audio::AudioStream *voxStream = Audio::makeADPCMStream(&inputFile, inputSize, Audio::kADPCMOki);
-		buffer = (byte *)malloc(_sampleSize);
+		buffer = (byte *)malloc(entry.sampleSize);
 		uint32 voxSize = voxStream->readBuffer((int16*)buffer, inputSize * 2);
 		if (voxSize != inputSize * 2)
 			error("Wrong VOX output size");
-		writeBufferToFile((uint8 *)buffer, _sampleSize, TEMP_RAW);
-		free(buffer);
 
-		setRawAudioType( !_currentFileDescription->swapEndian, _sampleStereo != 0, _sampleBits);
-		encodeAudio(TEMP_RAW, true, _sampleRate, tempEncoded, _format);
-		return copyFile(tempEncoded, outputFile) + HEADER_SIZE;
+		setRawAudioType( !_currentFileDescription->swapEndian, entry.sampleStereo != 0, entry.sampleBits);
+		entry.job = queueAudio(buffer, entry.sampleSize, entry.sampleRate);
+		free(buffer);
+		return;
 	}
 	if (_currentFileDescription->resourceType == kSoundMacPCM) {
 		error("MacBinary files are not supported yet");
@@ -316,23 +269,40 @@ uint32 CompressSaga::encodeEntry(Common::File &inputFile, uint32 inputSize, Comm
 		// Note: MacBinary files are unsigned. With the pending changes to setRawAudioType, there will need
 		// to be some changes here
 		/*
-		copyFile(inputFile, inputSize, TEMP_RAW);
-		_sampleSize = inputSize - 36;
-		_sampleRate = (uint16)currentFileDescription->frequency;
+		entry.sampleSize = inputSize - 36;
+		entry.sampleRate = (uint16)currentFileDescription->frequency;
 		// The MAC CD Guild version has 8 bit sound, whereas the other versions have 16 bit sound
-		_sampleBits = 8;
-		_sampleStereo = currentFileDescription->stereo;
-		writeHeader(outputFile);
+		entry.sampleBits = 8;
+		entry.sampleStereo = currentFileDescription->stereo;
 
-		setRawAudioType( !currentFileDescription->swapEndian, currentFileDescription->stereo, _sampleBits);
-		encodeAudio(TEMP_RAW, true, currentFileDescription->frequency, tempEncoded, gCompMode);
-		return copyFile(tempEncoded, outputFile) + HEADER_SIZE;
+		setRawAudioType( !currentFileDescription->swapEndian, currentFileDescription->stereo, entry.sampleBits);
+		entry.job = queueAudio(buffer, entry.sampleSize, currentFileDescription->frequency);
+		return;
 		*/
 	}
 
 	error("Unsupported resourceType %ul\n", _currentFileDescription->resourceType);
-	// Never reached
-	return 0;
+}
+
+void CompressSaga::writeQueuedEntries(Common::File &outputFile, Record *outputTable) {
+	encodeQueuedAudio();
+
+	for (uint i = 0; i < _queuedEntries.size(); i++) {
+		const QueuedEntry &entry = _queuedEntries[i];
+
+		outputTable[entry.index].offset = outputFile.pos();
+		if (entry.job < 0)
+			continue;	// Empty sound resource
+
+		const std::vector<byte> &encoded = getEncodedAudio(entry.job);
+		writeHeader(outputFile, entry);
+		if (!encoded.empty())
+			outputFile.write(&encoded[0], encoded.size());
+		outputTable[entry.index].size = encoded.size() + HEADER_SIZE;
+	}
+
+	_queuedEntries.clear();
+	clearAudioQueue();
 }
 
 void CompressSaga::sagaEncode(Common::Filename *inpath, Common::Filename *outpath) {
@@ -401,19 +371,31 @@ void CompressSaga::sagaEncode(Common::Filename *inpath, Common::Filename *outpat
 	}
 	outputFile.open(*outpath, "wb");
 
+	clearAudioQueue();
+	_queuedEntries.clear();
+
 	for (i = 0; i < resTableCount; i++) {
 		// This is where compression takes place, and where all time is spent
 		updateProgress(i, resTableCount);
 
 		inputFile.seek(inputTable[i].offset, SEEK_SET);
-		outputTable[i].offset = outputFile.pos();
+
+		QueuedEntry entry;
+		entry.index = i;
+		entry.job = -1;
 
 		if (inputTable[i].size >= 8) {
-			outputTable[i].size = encodeEntry(inputFile, inputTable[i].size, outputFile);
+			queueEntry(inputFile, inputTable[i].size, entry);
 		} else {
 			outputTable[i].size = inputTable[i].size;	// Empty sound resource
 		}
+		_queuedEntries.push_back(entry);
+
+		// Entries are encoded in batches and written in their original order
+		if (isAudioQueueFull())
+			writeQueuedEntries(outputFile, outputTable);
 	}
+	writeQueuedEntries(outputFile, outputTable);
 	inputFile.close();
 
 	resTableOffset = outputFile.pos();
@@ -429,10 +411,6 @@ void CompressSaga::sagaEncode(Common::Filename *inpath, Common::Filename *outpat
 	free(inputTable);
 	free(outputTable);
 
-	// Cleanup
-	Common::removeFile(TEMP_RAW);
-	Common::removeFile(tempEncoded);
-
 	print("Done!\n");
 }
 
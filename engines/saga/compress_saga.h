@@ -70,17 +70,27 @@ protected:
 	GameDescription *_currentGameDescription;
 	GameFileDescription *_currentFileDescription;
 
-	uint16 _sampleRate;
-	uint32 _sampleSize;
-	uint8 _sampleBits;
-	uint8 _sampleStereo;
+	struct Record {
+		uint32 offset;
+		uint32 size;
+	};
+
+	/** A resource waiting to be encoded and written to the output file. */
+	struct QueuedEntry {
+		uint32 index;	///< Index in the resource table
+		int job;		///< Index into the audio queue, -1 for an empty resource
+		uint16 sampleRate;
+		uint32 sampleSize;
+		uint8 sampleBits;
+		uint8 sampleStereo;
+	};
+
+	std::vector<QueuedEntry> _queuedEntries;
 
 	bool detectFile(const Common::Filename *infile);
-	uint32 copyFile(const char *fromFileName, Common::File &outputFile);
-	void copyFile(Common::File &inputFile, uint32 inputSize, const char *toFileName);
-	void writeBufferToFile(uint8 *data, uint32 inputSize, const char *toFileName);
-	void writeHeader(Common::File &outputFile);
-	uint32 encodeEntry(Common::File &inputFile, uint32 inputSize, Common::File &outputFile);
+	void writeHeader(Common::File &outputFile, const QueuedEntry &entry);
+	void queueEntry(Common::File &inputFile, uint32 inputSize, QueuedEntry &entry);
+	void writeQueuedEntries(Common::File &outputFile, Record *outputTable);
 	void sagaEncode(Common::Filename *inpath, Common::Filename *outpath);
 
 	byte compression_format(AudioFormat format);
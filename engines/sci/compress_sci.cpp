@@ -46,8 +46,6 @@
 //  the samples, because SCI32 used a different scheme for decoding. I don't know yet how to detect SCI32 games easily
 //  without having resourcemanager.
 
-#define TEMP_RAW "tempfile.raw"
-#define TEMP_ENC "tempfile.enc"
 
 CompressSci::CompressSci(const std::string &name) : CompressionTool(name, TOOLTYPE_COMPRESSION) {
 	_supportsProgressBar = true;
@@ -292,27 +290,20 @@ void CompressSci::compressData(SciResourceDataType dataType) {
 		error("Unsupported datatype");
 	}
 
+	std::vector<byte> encoded;
 	if (sampleData) {
-		// Write sample data to temporary raw file
-		Common::File tempfileRaw(TEMP_RAW, "wb");
-		tempfileRaw.write(sampleData, sampleDataSize);
-		tempfileRaw.close();
+		// Compress the sample data
+		RawAudioType rawType = { true, sampleIsStereo, (uint8)sampleBits };
+		encodeRawToMemory((const char *)sampleData, sampleDataSize, sampleRate, _format, rawType, encoded);
 		delete[] sampleData;
-		// Now compress temporary raw file
-		setRawAudioType(true, sampleIsStereo, sampleBits);
-		encodeAudio(TEMP_RAW, true, sampleRate, TEMP_ENC, _format);
-		// And copy encoded file into output-file
-		Common::File tempfileEnc(TEMP_ENC, "rb");
-		newDataSize = tempfileEnc.size();
-		newData = new byte[newDataSize];
-		tempfileEnc.read_throwsOnError(newData, newDataSize);
-		tempfileEnc.close();
+		// And copy it into output-file
+		newDataSize = encoded.size();
+		newData = encoded.empty() ? NULL : &encoded[0];
 	}
 
-	_output.write(newData, newDataSize);
+	if (newDataSize)
+		_output.write(newData, newDataSize);
 
-	if ((newData) && (newData != orgData))
-		delete[] newData;
 	delete[] orgData;
 }
 
@@ -406,10 +397,6 @@ void CompressSci::execute() {
 
 		updateProgress(resourceNo, resourceCount);
 	}
-
-	/* And some clean-up :-) */
-	Common::removeFile(TEMP_RAW);
-	Common::removeFile(TEMP_ENC);
 }
 
 
@@ -28,93 +28,9 @@
 #include "common/util.h"
 #include "common/endian.h"
 #include "compress_scumm_bun.h"
+#include "sound/adpcm_decoder.h"
 
-/*
- * The "IMC" codec below (see cases 13 & 15 in decompressCodec) is actually a
- * variant of the IMA codec, see also
- *   <http://www.multimedia.cx/simpleaudio.html>
- *
- * It is somewhat different, though: the standard ADPCM codecs use a fixed
- * size for their data packets (4 bits), while the codec implemented here
- * varies the size of each "packet" between 2 and 7 bits.
- */
-
-static byte _imcTableEntryBitCount[89];
-
-static const int16 imcTable[89] = {
-		7,	  8,	9,	 10,   11,	 12,   13,	 14,
-	   16,	 17,   19,	 21,   23,	 25,   28,	 31,
-	   34,	 37,   41,	 45,   50,	 55,   60,	 66,
-	   73,	 80,   88,	 97,  107,	118,  130,	143,
-	  157,	173,  190,	209,  230,	253,  279,	307,
-	  337,	371,  408,	449,  494,	544,  598,	658,
-	  724,	796,  876,	963, 1060, 1166, 1282, 1411,
-	 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
-	 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484,
-	 7132, 7845, 8630, 9493,10442,11487,12635,13899,
-	15289,16818,18500,20350,22385,24623,27086,29794,
-	32767
-};
-
-static const byte imxOtherTable[6][64] = {
-	{
-		0xFF,
-		4
-	},
-
-	{
-		0xFF, 0xFF,
-		   2,    8
-	},
-
-	{
-		0xFF, 0xFF, 0xFF, 0xFF,
-		   1,    2,    4,    6
-	},
-
-	{
-		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-		   1,    2,    4,    6,    8,   12,   16,   32
-	},
-
-	{
-		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-		   1,    2,    4,    6,    8,   10,   12,   14,
-		  16,   18,   20,   22,   24,   26,   28,   32
-	},
-
-	{
-		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-		   1,    2,    3,    4,    5,    6,    7,    8,
-		   9,   10,   11,   12,   13,   14,   15,   16,
-		  17,   18,   19,   20,   21,   22,   23,   24,
-		  25,   26,   27,   28,   29,   30,   31,   32
-	}
-};
-
-void initializeImcTables() {
-	int pos;
-
-	for (pos = 0; pos < ARRAYSIZE(imcTable); ++pos) {
-		byte put = 0;
-		int32 tableValue = ((imcTable[pos] * 4) / 7) / 2;
-		while (tableValue != 0) {
-			tableValue /= 2;
-			put++;
-		}
-		if (put < 2) {
-			put = 2;
-		}
-		if (put > 7) {
-			put = 7;
-		}
-		_imcTableEntryBitCount[pos] = put;
-	}
-}
+#include <vector>
 
 #define NextBit                            \
 	do {                                   \
@@ -164,7 +80,7 @@ int32 CompressScummBun::compDecode(byte *src, byte *dst) {
 #undef NextBit
 
 int32 CompressScummBun::decompressCodec(int32 codec, byte *comp_input, byte *comp_output, int32 input_size) {
-	int32 output_size, channels;
+	int32 output_size;
 	int32 offset1, offset2, offset3, length, k, c, s, j, r, t, z;
 	byte *src, *t_table, *p, *ptr;
 	byte t_tmp1, t_tmp2;
@@ -483,132 +399,8 @@ int32 CompressScummBun::decompressCodec(int32 codec, byte *comp_input, byte *com
 
 	case 13:
 	case 15:
-		if (codec == 13) {
-			channels = 1;
-		} else {
-			channels = 2;
-		}
-
-		{
-			// Decoder for the the IMA ADPCM variants used in COMI.
-			// Contrary to regular IMA ADPCM, this codec uses a variable
-			// bitsize for the encoded data.
-
-			const int MAX_CHANNELS = 2;
-			int32 outputSamplesLeft;
-			int32 destPos;
-			int16 firstWord;
-			byte initialTablePos[MAX_CHANNELS] = {0, 0};
-			int32 initialimcTableEntry[MAX_CHANNELS] = {7, 7};
-			int32 initialOutputWord[MAX_CHANNELS] = {0, 0};
-			int32 totalBitOffset, curTablePos, outputWord;
-			byte *dst;
-			int i;
-
-			// We only support mono and stereo
-			assert(channels == 1 || channels == 2);
-
-			src = comp_input;
-			dst = comp_output;
-			output_size = 0x2000;
-			outputSamplesLeft = 0x1000;
-
-			// Every data packet contains 0x2000 bytes of audio data
-			// when extracted. In order to encode bigger data sets,
-			// one has to split the data into multiple blocks.
-			//
-			// Every block starts with a 2 byte word. If that word is
-			// non-zero, it indicates the size of a block of raw audio
-			// data (not encoded) following it. That data we simply copy
-			// to the output buffer and the proceed by decoding the
-			// remaining data.
-			//
-			// If on the other hand the word is zero, then what follows
-			// are 7*channels bytes containing seed data for the decoder.
-			firstWord = READ_BE_UINT16(src);
-			src += 2;
-			if (firstWord != 0) {
-				// Copy raw data
-				memcpy(dst, src, firstWord);
-				dst += firstWord;
-				src += firstWord;
-				assert((firstWord & 1) == 0);
-				outputSamplesLeft -= firstWord / 2;
-			} else {
-				// Read the seed values for the decoder.
-				for (i = 0; i < channels; i++) {
-					initialTablePos[i] = *src;
-					src += 1;
-					initialimcTableEntry[i] = READ_BE_UINT32(src);
-					src += 4;
-					initialOutputWord[i] = READ_BE_UINT32(src);
-					src += 4;
-				}
-			}
-
-			totalBitOffset = 0;
-			// The channels are encoded separately.
-			for (int chan = 0; chan < channels; chan++) {
-				// Read initial state (this makes it possible for the data stream
-				// to be split & spread across multiple data chunks.
-				curTablePos = initialTablePos[chan];
-				//imcTableEntry = initialimcTableEntry[chan];
-				outputWord = initialOutputWord[chan];
-
-				// We need to interleave the channels in the output; we achieve
-				// that by using a variables dest offset:
-				destPos = chan * 2;
-
-				const int bound = (channels == 1)
-									? outputSamplesLeft
-									: ((chan == 0)
-										? (outputSamplesLeft+1) / 2
-										: outputSamplesLeft / 2);
-				for (i = 0; i < bound; ++i) {
-					// Determine the size (in bits) of the next data packet
-					const int32 curTableEntryBitCount = _imcTableEntryBitCount[curTablePos];
-					assert(2 <= curTableEntryBitCount && curTableEntryBitCount <= 7);
-
-					// Read the next data packet
-					const byte *readPos = src + (totalBitOffset >> 3);
-					const uint16 readWord = (uint16)(READ_BE_UINT16(readPos) << (totalBitOffset & 7));
-					const byte packet = (byte)(readWord >> (16 - curTableEntryBitCount));
-
-					// Advance read position to the next data packet
-					totalBitOffset += curTableEntryBitCount;
-
-					// Decode the data packet into a delta value for the output signal.
-					const byte signBitMask = (1 << (curTableEntryBitCount - 1));
-					const byte dataBitMask = (signBitMask - 1);
-					const byte data = (packet & dataBitMask);
-
-					int32 delta = imcTable[curTablePos] * (2 * data + 1) >> (curTableEntryBitCount - 1);
-
-					// The topmost bit in the data packet tells is a sign bit
-					if ((packet & signBitMask) != 0) {
-						delta = -delta;
-					}
-
-					// Accumulate the delta onto the output data
-					outputWord += delta;
-
-					// Clip outputWord to 16 bit signed, and write it into the destination stream
-					if (outputWord > 0x7fff)
-						outputWord = 0x7fff;
-					if (outputWord < -0x8000)
-						outputWord = -0x8000;
-					WRITE_BE_UINT16(dst + destPos, outputWord);
-					destPos += channels << 1;
-
-					// Adjust the curTablePos
-					curTablePos += (int8)imxOtherTable[curTableEntryBitCount - 2][data];
-					if (curTablePos < 0)
-						curTablePos = 0;
-					else if (curTablePos >= ARRAYSIZE(imcTable))
-						curTablePos = ARRAYSIZE(imcTable) - 1;
-				}
-			}
-		}
+		// Variable bit size IMA ADPCM, see decodeIMUSEBlock()
+		output_size = Audio::decodeIMUSEBlock(comp_input, comp_output, (codec == 13) ? 1 : 2);
 		break;
 
 	default:
@@ -620,154 +412,131 @@ int32 CompressScummBun::decompressCodec(int32 codec, byte *comp_input, byte *com
 	return output_size;
 }
 
-void CompressScummBun::encodeWaveWithFlac(char *filename) {
-	char fbuf[2048];
-	char fbuf2[2048];
-	sprintf(fbuf, "%s.wav", filename);
-	sprintf(fbuf2, "%s.fla", filename);
-	encodeAudio(fbuf, false, -1, fbuf2, AUDIO_FLAC);
-}
+typedef struct { int offset, size, codec; } CompTable;
 
-void CompressScummBun::encodeWaveWithOgg(char *filename) {
-	char fbuf[2048];
-	char fbuf2[2048];
-	sprintf(fbuf, "%s.wav", filename);
-	sprintf(fbuf2, "%s.ogg", filename);
-	encodeAudio(fbuf, false, -1, fbuf2, AUDIO_VORBIS);
-}
+/**
+ * Decompresses a bundle entry on demand. Only the blocks covering the range
+ * asked for last are kept in memory, so walking an entry region by region
+ * never needs the whole decompressed sound at once.
+ */
+class BundleSoundReader {
+public:
+	BundleSoundReader(CompressScummBun &tool, Common::File &input, Common::Mutex &inputMutex, int32 entryOffset);
+
+	/**
+	 * Decompresses the given range of the entry. data is pointed at it and
+	 * stays valid until the next call. Returns the number of bytes actually
+	 * available, which is less than size if the entry ends early.
+	 */
+	int32 getData(int32 offset, int32 size, const byte *&data);
+
+private:
+	CompressScummBun &_tool;
+	Common::File &_input;
+	Common::Mutex &_inputMutex;
+	int32 _entryOffset;
+
+	std::vector<CompTable> _compTable;
+	std::vector<byte> _compInput;
+
+	std::vector<byte> _window;
+	int32 _windowStart;
+	uint _nextBlock;
+
+	void decodeNextBlock(int32 keepFrom);
+};
 
-void CompressScummBun::encodeWaveWithLame(char *filename) {
-	char fbuf[2048];
-	char fbuf2[2048];
+BundleSoundReader::BundleSoundReader(CompressScummBun &tool, Common::File &input, Common::Mutex &inputMutex, int32 entryOffset)
+	: _tool(tool), _input(input), _inputMutex(inputMutex), _entryOffset(entryOffset), _windowStart(0), _nextBlock(0) {
+	// The input is shared by all entries being converted
+	Common::StackLock lock(_inputMutex);
 
-	sprintf(fbuf, "%s.wav", filename);
-	sprintf(fbuf2, "%s.mp3", filename);
-	encodeAudio(fbuf, false, -1, fbuf2, AUDIO_MP3);
-}
+	_input.seek(_entryOffset, SEEK_SET);
 
-void CompressScummBun::writeWaveHeader(int s_size, int rate, int chan) {
-	int bits = 16;
-	byte wav[44];
-	memset(wav, 0, 44);
-	wav[0] = 'R';
-	wav[1] = 'I';
-	wav[2] = 'F';
-	wav[3] = 'F';
-	wav[4] = (s_size + 36) & 0xff;
-	wav[5] = ((s_size +	36)	>> 8) &	0xff;
-	wav[6] = ((s_size +	36)	>> 16) & 0xff;
-	wav[7] = ((s_size +	36)	>> 24) & 0xff;
-	wav[8] = 'W';
-	wav[9] = 'A';
-	wav[10]	= 'V';
-	wav[11]	= 'E';
-	wav[12]	= 'f';
-	wav[13]	= 'm';
-	wav[14]	= 't';
-	wav[15]	= 0x20;
-	wav[16]	= 16;
-	wav[20]	= 1;
-	wav[22]	= chan;
-	wav[24]	= rate & 0xff;
-	wav[25]	= (rate	>> 8) &	0xff;
-	wav[26]	= (rate	>> 16) & 0xff;
-	wav[27]	= (rate	>> 24) & 0xff;
-	wav[28]	= (rate	* chan * (bits / 8)) & 0xff;
-	wav[29]	= ((rate * chan	* (bits	/ 8))>>	8) & 0xff;
-	wav[30]	= ((rate * chan	* (bits	/ 8)) >> 16) & 0xff;
-	wav[31]	= ((rate * chan	* (bits	/ 8)) >> 24) & 0xff;
-	wav[32]	= (chan	* (bits	/ 8)) &	0xff;
-	wav[33]	= ((chan * (bits / 8)) >> 8) & 0xff;
-	wav[34]	= bits;
-	wav[36]	= 'd';
-	wav[37]	= 'a';
-	wav[38]	= 't';
-	wav[39]	= 'a';
-	wav[40]	= s_size & 0xff;
-	wav[41]	= (s_size >> 8)	& 0xff;
-	wav[42]	= (s_size >> 16) & 0xff;
-	wav[43]	= (s_size >> 24) & 0xff;
-
-	_waveTmpFile.seek(0, SEEK_SET);
-	if (_waveTmpFile.write(wav, 44) != 44) {
-		error("error writing temp wave file");
+	uint32 tag = _input.readUint32BE();
+	assert(tag == 'COMP');
+	int numCompItems = _input.readUint32BE();
+	_input.seek(8, SEEK_CUR);
+
+	_compTable.resize(numCompItems);
+	int32 maxSize = 0;
+	for (int i = 0; i < numCompItems; i++) {
+		_compTable[i].offset = _input.readUint32BE();
+		_compTable[i].size = _input.readUint32BE();
+		_compTable[i].codec = _input.readUint32BE();
+		_input.seek(4, SEEK_CUR);
+		if (_compTable[i].size > maxSize)
+			maxSize = _compTable[i].size;
 	}
-	_waveTmpFile.close();
+	// CMI hack: one more byte at the end of input buffer
+	_compInput.resize(maxSize + 1);
 }
 
-void CompressScummBun::writeToTempWave(char *fileName, byte *output_data, unsigned int size) {
-	if (!_waveTmpFile.isOpen()) {
-		_waveTmpFile.open(fileName, "wb");
-		byte wav[44];
-		memset(wav, 0, 44);
-		_waveTmpFile.write(output_data, 44);
-		_waveDataSize = 0;
+void BundleSoundReader::decodeNextBlock(int32 keepFrom) {
+	byte compOutput[0x2000];
+	const CompTable &item = _compTable[_nextBlock++];
+
+	_compInput[item.size] = 0;
+	{
+		Common::StackLock lock(_inputMutex);
+		_input.seek(_entryOffset + item.offset, SEEK_SET);
+		_input.read_throwsOnError(&_compInput[0], item.size);
 	}
-	for (unsigned int j = 0; j < size - 1; j += 2) {
-		byte tmp = output_data[j + 0];
-		output_data[j + 0] = output_data[j + 1];
-		output_data[j + 1] = tmp;
+	int outputSize = _tool.decompressCodec(item.codec, &_compInput[0], compOutput, item.size);
+	assert(outputSize <= 0x2000);
+
+	int32 blockStart = _windowStart + _window.size();
+	int32 skip = 0;
+	if (_window.empty() && keepFrom > blockStart) {
+		// Nothing before keepFrom is needed, drop it right away
+		skip = MIN<int32>(keepFrom - blockStart, outputSize);
+		_windowStart += skip;
 	}
-	_waveTmpFile.write(output_data, size);
-	_waveDataSize += size;
+	_window.insert(_window.end(), compOutput + skip, compOutput + outputSize);
 }
 
-typedef struct { int offset, size, codec; } CompTable;
-
-byte *CompressScummBun::decompressBundleSound(int index, Common::File  &input, int32 &finalSize) {
-	byte compOutput[0x2000];
-	int i;
+int32 BundleSoundReader::getData(int32 offset, int32 size, const byte *&data) {
+	if (offset < _windowStart) {
+		// Seeking backwards, start over from the first block
+		_window.clear();
+		_windowStart = 0;
+		_nextBlock = 0;
+	}
 
-	input.seek(_bundleTable[index].offset, SEEK_SET);
+	if (offset > _windowStart) {
+		int32 drop = MIN<int32>(offset - _windowStart, _window.size());
+		_window.erase(_window.begin(), _window.begin() + drop);
+		_windowStart += drop;
+	}
 
-	uint32 tag = input.readUint32BE();
-	assert(tag == 'COMP');
-	int numCompItems = input.readUint32BE();
-	input.seek(8, SEEK_CUR);
+	while (_windowStart + (int32)_window.size() < offset + size && _nextBlock < _compTable.size())
+		decodeNextBlock(offset);
 
-	CompTable *compTable = (CompTable *)malloc(sizeof(CompTable) * numCompItems);
-	int32 maxSize = 0;
-	for (i = 0; i < numCompItems; i++) {
-		compTable[i].offset = input.readUint32BE();
-		compTable[i].size = input.readUint32BE();
-		compTable[i].codec = input.readUint32BE();
-		input.seek(4, SEEK_CUR);
-		if (compTable[i].size > maxSize)
-			maxSize = compTable[i].size;
+	int32 available = _windowStart + (int32)_window.size() - offset;
+	if (available <= 0) {
+		data = NULL;
+		return 0;
 	}
-	// CMI hack: one more byte at the end of input buffer
-	byte *compInput = (byte *)malloc(maxSize + 1);
-	byte *compFinal = (byte *)malloc(numCompItems * 0x2000);
-
-	finalSize = 0;
-
-	for (i = 0; i < numCompItems; i++) {
-		compInput[compTable[i].size] = 0;
-		input.seek(_bundleTable[index].offset + compTable[i].offset, SEEK_SET);
-		input.read_throwsOnError(compInput, compTable[i].size);
-		int outputSize = decompressCodec(compTable[i].codec, compInput, compOutput, compTable[i].size);
-		assert(outputSize <= 0x2000);
-		memcpy(compFinal + finalSize, compOutput, outputSize);
-		finalSize += outputSize;
-	}
-
-	free(compInput);
-	free(compTable);
 
-	return compFinal;
+	data = &_window[offset - _windowStart];
+	return MIN(size, available);
 }
 
-byte *CompressScummBun::convertTo16bit(byte *ptr, int inputSize, int &outputSize, int bits, int freq, int channels) {
-	outputSize = inputSize;
+void CompressScummBun::convertTo16bit(const byte *ptr, int inputSize, std::vector<byte> &output, int bits) {
+	int outputSize = inputSize;
 	if (bits == 8)
 		outputSize *= 2;
 	if (bits == 12)
 		outputSize = (outputSize / 3) * 4;
 
-	byte *outputBuf = (byte *)malloc(outputSize);
+	output.resize(outputSize);
+	if (outputSize == 0)
+		return;
+
+	byte *outputBuf = &output[0];
 	if (bits == 8) {
 		byte *buf = outputBuf;
-		byte *src = ptr;
+		const byte *src = ptr;
 		for (int i = 0; i < inputSize; i++) {
 			uint16 val = (*src++ - 0x80) << 8;
 			*buf++ = (byte)(val >> 8);
@@ -777,7 +546,7 @@ byte *CompressScummBun::convertTo16bit(byte *ptr, int inputSize, int &outputSize
 	if (bits == 12) {
 		int loop_size = inputSize / 3;
 		byte *decoded = outputBuf;
-		byte *source = ptr;
+		const byte *source = ptr;
 		uint32 value;
 
 		while (loop_size--) {
@@ -795,17 +564,15 @@ byte *CompressScummBun::convertTo16bit(byte *ptr, int inputSize, int &outputSize
 	if (bits == 16) {
 		int loop_size = inputSize / 2;
 		byte *buf = outputBuf;
-		byte *src = ptr;
+		const byte *src = ptr;
 		while (loop_size--) {
 			*buf++ = *src++;
 			*buf++ = *src++;
 		}
 	}
-
-	return outputBuf;
 }
 
-void CompressScummBun::countMapElements(byte *ptr, int &numRegions, int &numJumps, int &numSyncs, int &numMarkers) {
+void CompressScummBun::countMapElements(const byte *ptr, int &numRegions, int &numJumps, int &numSyncs, int &numMarkers) {
 	uint32 tag;
 	int32 size = 0;
 
@@ -863,74 +630,74 @@ struct Marker {
 	char *ptr;
 };
 
-static Region *_region;
-static int _numRegions;
+/**
+ * Everything needed to convert a single bundle entry. Entries are converted
+ * independently of each other and then written out in their original order.
+ */
+struct BundleEntryJob {
+	int index;
+	std::vector<byte> map;
+	std::vector<Region> regions;
+	std::vector<std::vector<byte> > encodedRegions;
+};
 
-void CompressScummBun::writeRegions(byte *ptr, int bits, int freq, int channels, const char *dir, char *filename, Common::File &output) {
-	char tmpPath[200];
+/**
+ * Converts a batch of bundle entries, see CompressScummBun::execute().
+ */
+class BundleEntryTask : public Common::ParallelTask {
+public:
+	BundleEntryTask(CompressScummBun *tool, Common::File &input, std::vector<BundleEntryJob> &jobs)
+		: _tool(tool), _input(input), _jobs(jobs) {}
 
-	for (int l = 0; l < _numRegions; l++) {
-		int outputSize = 0;
-		int size = _region[l].length;
-		int offset = _region[l].offset;
-		byte *outputData = convertTo16bit(ptr + offset, size, outputSize, bits, freq, channels);
-		sprintf(tmpPath, "%s%s_reg%03d.wav", dir, filename, l);
-		writeToTempWave(tmpPath, outputData, outputSize);
-		writeWaveHeader(_waveDataSize, freq, channels);
-		free(outputData);
-		sprintf(tmpPath, "%s%s_reg%03d", dir, filename, l);
+	virtual void run(uint index) {
+		_tool->convertEntry(_input, _inputMutex, _jobs[index]);
+	}
 
-		switch (_format) {
-		case AUDIO_MP3:
-			encodeWaveWithLame(tmpPath);
-			break;
-		case AUDIO_VORBIS:
-			encodeWaveWithOgg(tmpPath);
-			break;
-		case AUDIO_FLAC:
-			encodeWaveWithFlac(tmpPath);
-			break;
-		default:
-			error("Unknown encoding method");
-		}
+private:
+	CompressScummBun *_tool;
+	Common::File &_input;
+	Common::Mutex _inputMutex;
+	std::vector<BundleEntryJob> &_jobs;
+};
 
-		sprintf(tmpPath, "%s%s_reg%03d.wav", dir, filename, l);
-		Common::removeFile(tmpPath);
+static void writeUint32BE(std::vector<byte> &buf, uint32 value) {
+	byte b[4];
+	WRITE_BE_UINT32(b, value);
+	buf.insert(buf.end(), b, b + 4);
+}
 
-		int32 startPos = output.pos();
-		switch (_format) {
-		case AUDIO_MP3:
-			sprintf(_cbundleTable[_cbundleCurIndex].filename, "%s_reg%03d.mp3", filename, l);
-			sprintf(tmpPath, "%s%s_reg%03d.mp3", dir, filename, l);
-			break;
-		case AUDIO_VORBIS:
-			sprintf(_cbundleTable[_cbundleCurIndex].filename, "%s_reg%03d.ogg", filename, l);
-			sprintf(tmpPath, "%s%s_reg%03d.ogg", dir, filename, l);
-			break;
-		case AUDIO_FLAC:
-			sprintf(_cbundleTable[_cbundleCurIndex].filename, "%s_reg%03d.fla", filename, l);
-			sprintf(tmpPath, "%s%s_reg%03d.fla", dir, filename, l);
-			break;
-		default:
-			error("Unknown encoding method");
-		}
-		_cbundleTable[_cbundleCurIndex].offset = startPos;
-
-		Common::File cmpFile(tmpPath, "rb");
-		cmpFile.seek(0, SEEK_END);
-		size = cmpFile.pos();
-		cmpFile.seek(0, SEEK_SET);
-		byte *tmpBuf = (byte *)malloc(size);
-		cmpFile.read_throwsOnError(tmpBuf, size);
-		cmpFile.close();
-		Common::removeFile(tmpPath);
-
-		output.write(tmpBuf, size);
-		free(tmpBuf);
-		_cbundleTable[_cbundleCurIndex].size = output.pos() - startPos;
-		_cbundleCurIndex++;
+void CompressScummBun::convertEntry(Common::File &input, Common::Mutex &inputMutex, BundleEntryJob &job) {
+	const char *filename = _bundleTable[job.index].filename;
+
+	BundleSoundReader reader(*this, input, inputMutex, _bundleTable[job.index].offset);
+	const byte *header;
+	reader.getData(0, getMapSize(reader, filename), header);
+
+	int offsetData = 0, bits = 0, freq = 0, channels = 0;
+	buildRMAP(header, job, filename, offsetData, bits, freq, channels);
+	encodeRegions(reader, job, offsetData, bits, freq, channels);
+}
+
+void CompressScummBun::encodeRegions(BundleSoundReader &reader, BundleEntryJob &job, int offsetData, int bits, int freq, int channels) {
+	// convertTo16bit() produces big endian samples
+	RawAudioType rawType;
+	rawType.isLittleEndian = false;
+	rawType.isStereo = (channels == 2);
+	rawType.bitsPerSample = 16;
+
+	// Regions are decompressed and converted one at a time, only their
+	// encoded data is kept until the entry is written out
+	job.encodedRegions.resize(job.regions.size());
+	for (uint l = 0; l < job.regions.size(); l++) {
+		const byte *data;
+		int32 size = reader.getData(offsetData + job.regions[l].offset, job.regions[l].length, data);
+
+		std::vector<byte> outputData;
+		convertTo16bit(data, size, outputData, bits);
+
+		const char *rawData = outputData.empty() ? NULL : (const char *)&outputData[0];
+		encodeRawToMemory(rawData, outputData.size(), freq, _format, rawType, job.encodedRegions[l]);
 	}
-	free(_region);
 }
 
 void CompressScummBun::recalcRegions(int32 &value, int bits, int freq, int channels) {
@@ -942,8 +709,23 @@ void CompressScummBun::recalcRegions(int32 &value, int bits, int freq, int chann
 	value = size;
 }
 
-void CompressScummBun::writeToRMAPFile(byte *ptr, Common::File &output, char *filename, int &offsetData, int &bits, int &freq, int &channels) {
-	byte *s_ptr = ptr;
+int32 CompressScummBun::getMapSize(BundleSoundReader &reader, const char *filename) {
+	// The map ends with the header of the DATA block
+	int32 pos = 16;
+	for (;;) {
+		const byte *ptr;
+		if (reader.getData(0, pos + 8, ptr) < pos + 8)
+			error("getMapSize() Map of sound '%s' is truncated", filename);
+
+		uint32 tag = READ_BE_UINT32(ptr + pos);
+		if (tag == 'DATA')
+			return pos + 8;
+		pos += 8 + READ_BE_UINT32(ptr + pos + 4);
+	}
+}
+
+void CompressScummBun::buildRMAP(const byte *ptr, BundleEntryJob &job, const char *filename, int &offsetData, int &bits, int &freq, int &channels) {
+	const byte *s_ptr = ptr;
 	int32 size = 0;
 	int l;
 
@@ -959,8 +741,6 @@ void CompressScummBun::writeToRMAPFile(byte *ptr, Common::File &output, char *fi
 	int numRegions = 0, numJumps = 0, numSyncs = 0, numMarkers = 0;
 	countMapElements(ptr, numRegions, numJumps, numSyncs, numMarkers);
 	Region *region = (Region *)malloc(sizeof(Region) * numRegions);
-	_region = (Region *)malloc(sizeof(Region) * numRegions);
-	_numRegions = numRegions;
 	Jump *jump = (Jump *)malloc(sizeof(Jump) * numJumps);
 	Sync *sync = (Sync *)malloc(sizeof(Sync) * numSyncs);
 	Marker *marker = (Marker *)malloc(sizeof(Marker) * numMarkers);
@@ -1013,66 +793,94 @@ void CompressScummBun::writeToRMAPFile(byte *ptr, Common::File &output, char *fi
 			ptr += 4;
 			break;
 		default:
-			error("writeToRMAPFile() Unknown tag of Map for sound '%s'", filename);
+			error("buildRMAP() Unknown tag of Map for sound '%s'", filename);
 		}
 	} while (tag != 'DATA');
 	offsetData = (int32)(ptr - s_ptr);
 
-	int32 startPos = output.pos();
-	sprintf(_cbundleTable[_cbundleCurIndex].filename, "%s.map", filename);
-	_cbundleTable[_cbundleCurIndex].offset = startPos;
-
-	output.writeUint32BE('RMAP');
-	output.writeUint32BE(3); // version
-	output.writeUint32BE(16); // bits
-	output.writeUint32BE(freq);
-	output.writeUint32BE(channels);
-	output.writeUint32BE(numRegions);
-	output.writeUint32BE(numJumps);
-	output.writeUint32BE(numSyncs);
-	output.writeUint32BE(numMarkers);
-	memcpy(_region, region, sizeof(Region) * numRegions);
+	std::vector<byte> &output = job.map;
+	writeUint32BE(output, 'RMAP');
+	writeUint32BE(output, 3); // version
+	writeUint32BE(output, 16); // bits
+	writeUint32BE(output, freq);
+	writeUint32BE(output, channels);
+	writeUint32BE(output, numRegions);
+	writeUint32BE(output, numJumps);
+	writeUint32BE(output, numSyncs);
+	writeUint32BE(output, numMarkers);
+	job.regions.assign(region, region + numRegions);
 	for (l = 0; l < numRegions; l++) {
-		_region[l].offset -= offsetData;
+		job.regions[l].offset -= offsetData;
 		region[l].offset -= offsetData;
 		recalcRegions(region[l].offset, bits, freq, channels);
 		recalcRegions(region[l].length, bits, freq, channels);
-		output.writeUint32BE(region[l].offset);
-		output.writeUint32BE(region[l].length);
+		writeUint32BE(output, region[l].offset);
+		writeUint32BE(output, region[l].length);
 	}
 	for (l = 0; l < numJumps; l++) {
 		jump[l].offset -= offsetData;
 		jump[l].dest -= offsetData;
 		recalcRegions(jump[l].offset, bits, freq, channels);
 		recalcRegions(jump[l].dest, bits, freq, channels);
-		output.writeUint32BE(jump[l].offset);
-		output.writeUint32BE(jump[l].dest);
-		output.writeUint32BE(jump[l].hookId);
-		output.writeUint32BE(jump[l].fadeDelay);
+		writeUint32BE(output, jump[l].offset);
+		writeUint32BE(output, jump[l].dest);
+		writeUint32BE(output, jump[l].hookId);
+		writeUint32BE(output, jump[l].fadeDelay);
 	}
 	for (l = 0; l < numSyncs; l++) {
-		output.writeUint32BE(sync[l].size);
-		output.write(sync[l].ptr, sync[l].size);
+		writeUint32BE(output, sync[l].size);
+		output.insert(output.end(), sync[l].ptr, sync[l].ptr + sync[l].size);
 		free(sync[l].ptr);
 	}
 	for (l = 0; l < numMarkers; l++) {
-		output.writeUint32BE(marker[l].pos);
-		output.writeUint32BE(marker[l].length);
-		output.write(marker[l].ptr, marker[l].length);
+		writeUint32BE(output, marker[l].pos);
+		writeUint32BE(output, marker[l].length);
+		output.insert(output.end(), marker[l].ptr, marker[l].ptr + marker[l].length);
 		delete[] marker[l].ptr;
 	}
 	free(region);
 	free(jump);
 	free(sync);
 	free(marker);
+}
+
+void CompressScummBun::writeEntry(const BundleEntryJob &job, Common::File &output) {
+	const char *filename = _bundleTable[job.index].filename;
+	BundleAudioTable entry;
+	memset(&entry, 0, sizeof(entry));
 
-	_cbundleTable[_cbundleCurIndex].size = output.pos() - startPos;
-	_cbundleCurIndex++;
+	snprintf(entry.filename, sizeof(entry.filename), "%s.map", filename);
+	entry.offset = output.pos();
+	entry.size = job.map.size();
+	output.write(&job.map[0], job.map.size());
+	_cbundleTable.push_back(entry);
+
+	for (uint l = 0; l < job.encodedRegions.size(); l++) {
+		const std::vector<byte> &encoded = job.encodedRegions[l];
+
+		switch (_format) {
+		case AUDIO_MP3:
+			snprintf(entry.filename, sizeof(entry.filename), "%s_reg%03u.mp3", filename, l);
+			break;
+		case AUDIO_VORBIS:
+			snprintf(entry.filename, sizeof(entry.filename), "%s_reg%03u.ogg", filename, l);
+			break;
+		case AUDIO_FLAC:
+			snprintf(entry.filename, sizeof(entry.filename), "%s_reg%03u.fla", filename, l);
+			break;
+		default:
+			error("Unknown encoding method");
+		}
+		entry.offset = output.pos();
+		entry.size = encoded.size();
+
+		if (!encoded.empty())
+			output.write(&encoded[0], encoded.size());
+		_cbundleTable.push_back(entry);
+	}
 }
 
 CompressScummBun::CompressScummBun(const std::string &name) : CompressionTool(name, TOOLTYPE_COMPRESSION) {
-	_cbundleCurIndex = 0;
-
 	_supportsProgressBar = true;
 
 	ToolInput input;
@@ -1090,7 +898,9 @@ void CompressScummBun::execute() {
 	uint32 tag;
 	int32 numFiles, offset;
 
-	Common::File input(inpath, "rb");
+	// The bundle is read in many small pieces, map it instead of going through stdio
+	Common::File input;
+	input.openMapped(inpath);
 
 	if (outpath.empty()) {
 		// Change extension for output
@@ -1105,8 +915,6 @@ void CompressScummBun::execute() {
 	output.writeUint32BE(0); // will be later
 	output.writeUint32BE(0); // will be later
 
-	initializeImcTables();
-
 	tag = input.readUint32BE();
 	assert(tag == 'LB83');
 	offset = input.readUint32BE();
@@ -1133,30 +941,42 @@ void CompressScummBun::execute() {
 		_bundleTable[i].size = input.readUint32BE();
 	}
 
-	for (int i = 0; i < numFiles; i++) {
-		if (strcmp(_bundleTable[i].filename, "PRELOAD.") == 0)
-			continue;
+	_cbundleTable.clear();
 
+	// Convert a few entries per thread at once, so that short and long
+	// entries even out, then write them out in their original order
+	uint batchSize = 4 * _numJobs;
+	std::vector<BundleEntryJob> jobs;
+	int i = 0;
+	while (i < numFiles) {
 		updateProgress(i, numFiles);
 
-		int offsetData = 0, bits = 0, freq = 0, channels = 0;
-		int32 size = 0;
-		byte *compFinal = decompressBundleSound(i, input, size);
-		writeToRMAPFile(compFinal, output, _bundleTable[i].filename, offsetData, bits, freq, channels);
-		writeRegions(compFinal + offsetData, bits, freq, channels, outpath.getPath().c_str(), _bundleTable[i].filename, output);
-		free(compFinal);
+		jobs.clear();
+		for (; i < numFiles && jobs.size() < batchSize; i++) {
+			if (strcmp(_bundleTable[i].filename, "PRELOAD.") == 0)
+				continue;
+
+			jobs.push_back(BundleEntryJob());
+			jobs.back().index = i;
+		}
+
+		BundleEntryTask task(this, input, jobs);
+		Common::runParallel(task, jobs.size(), _numJobs);
+
+		for (uint j = 0; j < jobs.size(); j++)
+			writeEntry(jobs[j], output);
 	}
 
 	int32 curPos = output.pos();
-	for (int i = 0; i < _cbundleCurIndex; i++) {
-		output.write(_cbundleTable[i].filename, 24);
-		output.writeUint32BE(_cbundleTable[i].offset);
-		output.writeUint32BE(_cbundleTable[i].size);
+	for (uint j = 0; j < _cbundleTable.size(); j++) {
+		output.write(_cbundleTable[j].filename, 24);
+		output.writeUint32BE(_cbundleTable[j].offset);
+		output.writeUint32BE(_cbundleTable[j].size);
 	}
 
 	output.seek(4, SEEK_SET);
 	output.writeUint32BE(curPos);
-	output.writeUint32BE(_cbundleCurIndex);
+	output.writeUint32BE(_cbundleTable.size());
 
 	free(_bundleTable);
 
@@ -25,6 +25,9 @@
 
 #include "compress.h"
 
+class BundleSoundReader;
+struct BundleEntryJob;
+
 class CompressScummBun : public CompressionTool {
 public:
 	CompressScummBun(const std::string &name = "compress_scumm_bun");
@@ -39,25 +42,22 @@ public:
 
 protected:
 
-	Common::File _waveTmpFile;
-	int32 _waveDataSize;
 	BundleAudioTable *_bundleTable;
-	BundleAudioTable _cbundleTable[10000]; // difficult to calculate
-	int32 _cbundleCurIndex;
+	std::vector<BundleAudioTable> _cbundleTable;
 
 	int32 compDecode(byte *src, byte *dst);
 	int32 decompressCodec(int32 codec, byte *comp_input, byte *comp_output, int32 input_size);
-	void encodeWaveWithFlac(char *filename);
-	void encodeWaveWithOgg(char *filename);
-	void encodeWaveWithLame(char *filename);
-	void writeWaveHeader(int s_size, int rate, int chan);
-	void writeToTempWave(char *fileName, byte *output_data, unsigned int size);
-	byte *decompressBundleSound(int index, Common::File  &input, int32 &finalSize);
-	byte *convertTo16bit(byte *ptr, int inputSize, int &outputSize, int bits, int freq, int channels);
-	void countMapElements(byte *ptr, int &numRegions, int &numJumps, int &numSyncs, int &numMarkers);
-	void writeRegions(byte *ptr, int bits, int freq, int channels, const char *dir, char *filename, Common::File &output);
+	void convertTo16bit(const byte *ptr, int inputSize, std::vector<byte> &output, int bits);
+	void countMapElements(const byte *ptr, int &numRegions, int &numJumps, int &numSyncs, int &numMarkers);
+	int32 getMapSize(BundleSoundReader &reader, const char *filename);
+	void convertEntry(Common::File &input, Common::Mutex &inputMutex, BundleEntryJob &job);
+	void encodeRegions(BundleSoundReader &reader, BundleEntryJob &job, int offsetData, int bits, int freq, int channels);
 	void recalcRegions(int32 &value, int bits, int freq, int channels);
-	void writeToRMAPFile(byte *ptr, Common::File &output, char *filename, int &offsetData, int &bits, int &freq, int &channels);
+	void buildRMAP(const byte *ptr, BundleEntryJob &job, const char *filename, int &offsetData, int &bits, int &freq, int &channels);
+	void writeEntry(const BundleEntryJob &job, Common::File &output);
+
+	friend class BundleSoundReader;
+	friend class BundleEntryTask;
 };
 
 #endif
@@ -25,59 +25,41 @@
 #include <string.h>
 #include <zlib.h>
 #include <stdio.h>
+#include <algorithm>
 
 #include "compress_scumm_san.h"
 #include "common/endian.h"
+#include "common/util.h"
+#include "common/thread.h"
 
-void CompressScummSan::encodeSanWaveWithOgg(const std::string &filename) {
-	std::string fbuf = filename + ".raw";
-	Common::Filename fbuf2(filename.c_str());
+uint32 CompressScummSan::encodeSanWave(SanMovie &movie, const std::string &filename) {
+	Common::Filename outname(filename.c_str());
+	outname.setExtension((_format == AUDIO_VORBIS) ? ".ogg" : ".mp3");
 
-	fbuf2.setExtension(".ogg");
-	encodeAudio(fbuf.c_str(), true, 22050, fbuf2.getFullPath().c_str(), AUDIO_VORBIS);
-}
-
-void CompressScummSan::encodeSanWaveWithLame(const std::string &filename) {
-	std::string fbuf = filename + ".raw";
-	Common::Filename fbuf2(filename.c_str());
+	std::vector<byte> encoded;
+	encodeToMemory(&movie.waveData[0], movie.waveData.size() / 2, 2, 22050, _format, encoded);
 
-	fbuf2.setExtension(".mp3");
-	encodeAudio(fbuf.c_str(), true, 22050, fbuf2.getFullPath().c_str(), AUDIO_MP3);
+	Common::File output(outname, "wb");
+	if (!encoded.empty())
+		output.write(&encoded[0], encoded.size());
+	return encoded.size();
 }
 
-void CompressScummSan::writeToTempWaveFile(const std::string &fileName, byte *output_data, unsigned int size) {
-	if (!_waveTmpFile.isOpen()) {
-		_waveTmpFile.open(fileName, "wb");
-		if (!_waveTmpFile.isOpen()) {
-			error("error writing temp wave file");
-		}
-		_waveDataSize = 0;
-	}
-	for (unsigned int j = 0; j < size - 1; j += 2) {
-		byte tmp = output_data[j + 0];
-		output_data[j + 0] = output_data[j + 1];
-		output_data[j + 1] = tmp;
-	}
-
-	_waveTmpFile.write(output_data, size);
-	_waveDataSize += size;
-}
-
-void CompressScummSan::decompressComiIACT(const std::string &fileName, byte *output_data, byte *d_src, int bsize) {
+void CompressScummSan::decompressComiIACT(SanMovie &movie, byte *output_data, byte *d_src, int bsize) {
 	byte value;
 
 	while (bsize > 0) {
-		if (_IACTpos >= 2) {
-			int32 len = READ_BE_UINT16(_IACToutput) + 2;
-			len -= _IACTpos;
+		if (movie.IACTpos >= 2) {
+			int32 len = READ_BE_UINT16(movie.IACToutput) + 2;
+			len -= movie.IACTpos;
 			if (len > bsize) {
-				memcpy(_IACToutput + _IACTpos, d_src, bsize);
-				_IACTpos += bsize;
+				memcpy(movie.IACToutput + movie.IACTpos, d_src, bsize);
+				movie.IACTpos += bsize;
 				bsize = 0;
 			} else {
-				memcpy(_IACToutput + _IACTpos, d_src, len);
+				memcpy(movie.IACToutput + movie.IACTpos, d_src, len);
 				byte *dst = output_data;
-				byte *d_src2 = _IACToutput;
+				byte *d_src2 = movie.IACToutput;
 				d_src2 += 2;
 				int32 count = 1024;
 				byte variable1 = *d_src2++;
@@ -103,183 +85,108 @@ void CompressScummSan::decompressComiIACT(const std::string &fileName, byte *out
 						*dst++ = (byte)(val);
 					}
 				} while (--count);
-				writeToTempWaveFile(fileName, output_data, 0x1000);
+				// The decoded samples are big endian stereo
+				for (int i = 0; i < 0x1000; i += 2)
+					movie.waveData.push_back((int16)READ_BE_UINT16(output_data + i));
 				bsize -= len;
 				d_src += len;
-				_IACTpos = 0;
+				movie.IACTpos = 0;
 			}
 		} else {
-			if (bsize > 1 && _IACTpos == 0) {
-				*(_IACToutput + 0) = *d_src++;
-				_IACTpos = 1;
+			if (bsize > 1 && movie.IACTpos == 0) {
+				*(movie.IACToutput + 0) = *d_src++;
+				movie.IACTpos = 1;
 				bsize--;
 			}
-			*(_IACToutput + _IACTpos) = *d_src++;
-			_IACTpos++;
+			*(movie.IACToutput + movie.IACTpos) = *d_src++;
+			movie.IACTpos++;
 			bsize--;
 		}
 	}
 }
 
-void CompressScummSan::handleComiIACT(Common::File &input, int size, const std::string &outputDir, const std::string &inputFilename) {
+void CompressScummSan::handleComiIACT(SanMovie &movie, Common::File &input, int size) {
 	input.seek(10, SEEK_CUR);
 	int bsize = size - 18;
 	byte output_data[0x1000];
 	byte *src = (byte *)malloc(bsize);
 	input.read_throwsOnError(src, bsize);
 
-	const std::string tmpPath = outputDir + inputFilename + ".raw";
-	decompressComiIACT(tmpPath, output_data, src, bsize);
+	decompressComiIACT(movie, output_data, src, bsize);
 
 	free(src);
 }
 
-CompressScummSan::AudioTrackInfo *CompressScummSan::allocAudioTrack(int trackId, int frame) {
+CompressScummSan::AudioTrackInfo *CompressScummSan::allocAudioTrack(SanMovie &movie, int trackId, int frame) {
 	for (int l = 0; l < COMPRESS_SCUMM_SAN_MAX_TRACKS; l++) {
-		if ((_audioTracks[l].animFrame != frame) && (_audioTracks[l].trackId != trackId) && (!_audioTracks[l].used))
-			return &_audioTracks[l];
+		if ((movie.audioTracks[l].animFrame != frame) && (movie.audioTracks[l].trackId != trackId) && (!movie.audioTracks[l].used))
+			return &movie.audioTracks[l];
 	}
 	return NULL;
 }
 
-CompressScummSan::AudioTrackInfo *CompressScummSan::findAudioTrack(int trackId) {
+CompressScummSan::AudioTrackInfo *CompressScummSan::findAudioTrack(SanMovie &movie, int trackId) {
 	for (int l = 0; l < COMPRESS_SCUMM_SAN_MAX_TRACKS; l++) {
-		if (_audioTracks[l].trackId == trackId && _audioTracks[l].used && _audioTracks[l].file.isOpen())
-			return &_audioTracks[l];
+		if (movie.audioTracks[l].trackId == trackId && movie.audioTracks[l].used && movie.audioTracks[l].isOpen)
+			return &movie.audioTracks[l];
 	}
 	return NULL;
 }
 
-void CompressScummSan::flushTracks(int frame) {
+void CompressScummSan::flushTracks(SanMovie &movie, int frame) {
 	for (int l = 0; l < COMPRESS_SCUMM_SAN_MAX_TRACKS; l++) {
-		if (_audioTracks[l].used && _audioTracks[l].file.isOpen() && (frame - _audioTracks[l].lastFrame) > 1) {
-			_audioTracks[l].file.close();
+		if (movie.audioTracks[l].used && movie.audioTracks[l].isOpen && (frame - movie.audioTracks[l].lastFrame) > 1) {
+			movie.audioTracks[l].isOpen = false;
 		}
 	}
 }
 
-void CompressScummSan::prepareForMixing(const std::string &outputDir, const std::string &inputFilename) {
-	char filename[200];
-
-	print("Decompressing tracks files...\n");
-	for (int l = 0; l < COMPRESS_SCUMM_SAN_MAX_TRACKS; l++) {
-		if (_audioTracks[l].used) {
-			_audioTracks[l].file.close();
-
-			sprintf(filename, "%s%s_%04d_%03d.tmp", outputDir.c_str(), inputFilename.c_str(), _audioTracks[l].animFrame, _audioTracks[l].trackId);
-			_audioTracks[l].file.open(filename, "rb");
-			_audioTracks[l].file.seek(0, SEEK_END);
-			int fileSize = _audioTracks[l].file.pos();
-			_audioTracks[l].file.seek(0, SEEK_SET);
-			byte *audioBuf = (byte *)malloc(fileSize);
-			_audioTracks[l].file.read_throwsOnError(audioBuf, fileSize);
-			_audioTracks[l].file.close();
-
-			int outputSize = fileSize;
-			if (_audioTracks[l].bits == 8)
-				outputSize *= 2;
-			if (_audioTracks[l].bits == 12)
-				outputSize = (outputSize / 3) * 4;
-			if (!_audioTracks[l].stereo)
-				outputSize *= 2;
-			if (_audioTracks[l].freq == 11025)
-				outputSize *= 2;
-
-			byte *outputBuf = (byte *)malloc(outputSize);
-			if (_audioTracks[l].bits == 8) {
-				byte *buf = outputBuf;
-				byte *src = audioBuf;
-				for (int i = 0; i < fileSize; i++) {
-					uint16 val = (*src++ - 0x80) << 8;
-					*buf++ = (byte)val;
-					*buf++ = (byte)(val >> 8);
-					if (_audioTracks[l].freq == 11025) {
-						*buf++ = (byte)val;
-						*buf++ = (byte)(val >> 8);
-					}
-					if (!_audioTracks[l].stereo) {
-						*buf++ = (byte)val;
-						*buf++ = (byte)(val >> 8);
-						if (_audioTracks[l].freq == 11025) {
-							*buf++ = (byte)val;
-							*buf++ = (byte)(val >> 8);
-						}
-					}
-				}
-			}
-			if (_audioTracks[l].bits == 12) {
-				int loop_size = fileSize / 3;
-				byte *decoded = outputBuf;
-				byte *source = audioBuf;
-				uint32 value;
-
-				while (loop_size--) {
-					byte v1 =  *source++;
-					byte v2 =  *source++;
-					byte v3 =  *source++;
-					value = ((((v2 & 0x0f) << 8) | v1) << 4) - 0x8000;
-					*decoded++ = (byte)(value & 0xff);
-					*decoded++ = (byte)((value >> 8) & 0xff);
-					if (_audioTracks[l].freq == 11025) {
-						*decoded++ = (byte)(value & 0xff);
-						*decoded++ = (byte)((value >> 8) & 0xff);
-					}
-					if (!_audioTracks[l].stereo) {
-						*decoded++ = (byte)(value & 0xff);
-						*decoded++ = (byte)((value >> 8) & 0xff);
-						if (_audioTracks[l].freq == 11025) {
-							*decoded++ = (byte)(value & 0xff);
-							*decoded++ = (byte)((value >> 8) & 0xff);
-						}
-					}
-					value = ((((v2 & 0xf0) << 4) | v3) << 4) - 0x8000;
-					*decoded++ = (byte)(value & 0xff);
-					*decoded++ = (byte)((value >> 8) & 0xff);
-					if (_audioTracks[l].freq == 11025) {
-						*decoded++ = (byte)(value & 0xff);
-						*decoded++ = (byte)((value >> 8) & 0xff);
-					}
-					if (!_audioTracks[l].stereo) {
-						*decoded++ = (byte)(value & 0xff);
-						*decoded++ = (byte)((value >> 8) & 0xff);
-						if (_audioTracks[l].freq == 11025) {
-							*decoded++ = (byte)(value & 0xff);
-							*decoded++ = (byte)((value >> 8) & 0xff);
-						}
-					}
-				}
-			}
-
-			free(audioBuf);
-			_audioTracks[l].file.open(filename, "wb");
-			_audioTracks[l].file.write(outputBuf, outputSize);
-			free(outputBuf);
+void CompressScummSan::expandTrack(const AudioTrackInfo &track, std::vector<int16> &output) {
+	// Every sample is repeated so that the track becomes 22050 Hz stereo
+	const int repeat = ((track.freq == 11025) ? 2 : 1) * (track.stereo ? 1 : 2);
+	const byte *src = track.data.empty() ? NULL : &track.data[0];
+	const int size = track.data.size();
+
+	output.clear();
+	if (track.bits == 8) {
+		output.resize(size * repeat);
+		int16 *dst = &output[0];
+		for (int i = 0; i < size; i++) {
+			int16 val = (int16)((src[i] - 0x80) << 8);
+			for (int k = 0; k < repeat; k++)
+				*dst++ = val;
+		}
+	} else if (track.bits == 12) {
+		output.resize(size / 3 * 2 * repeat);
+		int16 *dst = &output[0];
+		for (int i = 0; i + 2 < size; i += 3) {
+			byte v1 = src[i];
+			byte v2 = src[i + 1];
+			byte v3 = src[i + 2];
+			int16 val1 = (int16)(((((v2 & 0x0f) << 8) | v1) << 4) - 0x8000);
+			int16 val2 = (int16)(((((v2 & 0xf0) << 4) | v3) << 4) - 0x8000);
+			for (int k = 0; k < repeat; k++)
+				*dst++ = val1;
+			for (int k = 0; k < repeat; k++)
+				*dst++ = val2;
 		}
+	} else if (track.bits == 16) {
+		output.resize(size / 2 * repeat);
+		int16 *dst = &output[0];
+		for (int i = 0; i + 1 < size; i += 2) {
+			int16 val = (int16)READ_BE_UINT16(src + i);
+			for (int k = 0; k < repeat; k++)
+				*dst++ = val;
+		}
+	} else {
+		error("Unsupported number of bits per sample: %d", track.bits);
 	}
 }
 
-#define ST_SAMPLE_MAX 0x7fffL
-#define ST_SAMPLE_MIN (-ST_SAMPLE_MAX - 1L)
-
-static inline void clampedAdd(int16& a, int b) {
-	register int val;
-	val = a + b;
-
-	if (val > ST_SAMPLE_MAX)
-		val = ST_SAMPLE_MAX;
-	else if (val < ST_SAMPLE_MIN)
-		val = ST_SAMPLE_MIN;
-
-	a = val;
-}
-void CompressScummSan::mixing(const std::string &outputDir, const std::string &inputFilename, int frames, int fps) {
-	int l, r, z;
-
-	const std::string wavPath = outputDir + inputFilename + ".raw";
-	Common::File &wavFile(_waveTmpFile);
-
-	wavFile.open(wavPath.c_str(), "wb+");
+void CompressScummSan::mixing(SanMovie &movie, int frames, int fps) {
+	int l, z;
 
+	// Audio positions are in bytes of 16 bit stereo data
 	int frameAudioSize = 0;
 	if (fps == 12) {
 		frameAudioSize = 7352;
@@ -289,67 +196,54 @@ void CompressScummSan::mixing(const std::string &outputDir, const std::string &i
 		error("Unsupported fps value %d", fps);
 	}
 
-	print("Creating silent wav file...\n");
-	for (l = 0; l < frameAudioSize * frames; l++) {
-		wavFile.writeByte(0);
-	}
+	if (movie.verbose)
+		print("Mixing tracks...\n");
+
+	// All tracks are added up without clipping, and the result is clipped
+	// only once at the end
+	std::vector<int32> mix(frames * frameAudioSize / 2, 0);
+	std::vector<int16> trackData;
 
-	print("Mixing tracks into wav file...\n");
 	for (l = 0; l < COMPRESS_SCUMM_SAN_MAX_TRACKS; l++) {
-		if (_audioTracks[l].used) {
-			char filename[200];
-			sprintf(filename, "%s%s_%04d_%03d.tmp", outputDir.c_str(), inputFilename.c_str(), _audioTracks[l].animFrame, _audioTracks[l].trackId);
-			_audioTracks[l].file.open(filename, "rb");
-			const uint32 fileSize = _audioTracks[l].file.size();
-			byte *tmpBuf = (byte *)malloc(fileSize);
-			_audioTracks[l].file.read_throwsOnError(tmpBuf, fileSize);
-			_audioTracks[l].file.close();
-			Common::removeFile(filename);
-
-			byte *wavBuf = (byte *)malloc(fileSize);
-			memset(wavBuf, 0, fileSize);
-			wavFile.seek(frameAudioSize * _audioTracks[l].animFrame, SEEK_SET);
-			try {
-				wavFile.read_throwsOnError(wavBuf, fileSize);
-			} catch (...) {
-				// ... pass through
-				wavFile.clearErr();
+		AudioTrackInfo &track = movie.audioTracks[l];
+		if (!track.used)
+			continue;
+
+		expandTrack(track, trackData);
+		std::vector<byte>().swap(track.data);
+
+		const uint32 start = frameAudioSize * track.animFrame / 2;
+		if (mix.size() < start + trackData.size())
+			mix.resize(start + trackData.size(), 0);
+		int32 *dst = &mix[start];
+		const int16 *src = trackData.empty() ? NULL : &trackData[0];
+		const int trackSize = trackData.size();
+
+		int offset = 0;
+		for (z = 0; z < track.countFrames; z++) {
+			int length = track.sizes[z];
+			if (length == 0) {
+				warning("zero length audio frame");
+				break;
 			}
-
-			int offset = 0;
-			for (z = 0; z < _audioTracks[l].countFrames; z++) {
-				int length = _audioTracks[l].sizes[z];
-				if (length == 0) {
-					warning("zero length audio frame");
-					break;
-				}
-				if (_audioTracks[l].sdatSize != 0 && (offset + length) > _audioTracks[l].sdatSize) {
-					length = _audioTracks[l].sdatSize - offset;
-				}
-				int volume = _audioTracks[l].volumes[z];
-				for (r = 0; r < length; r += 4) {
-					int16 wavSampleL = (int16)READ_LE_UINT16(wavBuf + offset + r + 0);
-					int16 wavSampleR = (int16)READ_LE_UINT16(wavBuf + offset + r + 2);
-					int32 tmpSampleL = (int16)READ_LE_UINT16(tmpBuf + offset + r + 0);
-					int32 tmpSampleR = (int16)READ_LE_UINT16(tmpBuf + offset + r + 2);
-					tmpSampleL = (tmpSampleL * volume) / 255;
-					tmpSampleR = (tmpSampleR * volume) / 255;
-					clampedAdd(wavSampleL, tmpSampleL);
-					clampedAdd(wavSampleR, tmpSampleR);
-					WRITE_LE_UINT16(wavBuf + offset + r + 0, wavSampleL);
-					WRITE_LE_UINT16(wavBuf + offset + r + 2, wavSampleR);
-				}
-				offset += length;
+			if (track.sdatSize != 0 && (offset + length) > track.sdatSize) {
+				length = track.sdatSize - offset;
 			}
-			wavFile.seek(frameAudioSize * _audioTracks[l].animFrame, SEEK_SET);
-			wavFile.write(wavBuf, fileSize);
 
-			free(wavBuf);
-			free(tmpBuf);
+			// Whole stereo sample pairs are mixed
+			int begin = offset / 2;
+			int end = MIN(begin + (length + 3) / 4 * 2, trackSize);
+			const int volume = track.volumes[z];
+			for (int i = begin; i < end; i++)
+				dst[i] += (src[i] * volume) / 255;
+
+			offset += length;
 		}
 	}
 
-	_waveDataSize = frames * frameAudioSize;
+	movie.waveData.resize(mix.size());
+	for (uint i = 0; i < mix.size(); i++)
+		movie.waveData[i] = (int16)CLIP<int32>(mix[i], -0x8000, 0x7fff);
 }
 
 void CompressScummSan::handleMapChunk(AudioTrackInfo *audioTrack, Common::File &input) {
@@ -420,11 +314,10 @@ int32 CompressScummSan::handleSaudChunk(AudioTrackInfo *audioTrack, Common::File
 	return size;
 }
 
-void CompressScummSan::handleAudioTrack(int index, int trackId, int frame, int nbframes, Common::File &input, const std::string &outputDir,
-					  const std::string &inputFilename, int &size, int volume, int pan, bool iact) {
+void CompressScummSan::handleAudioTrack(SanMovie &movie, int index, int trackId, int frame, int nbframes, Common::File &input, int &size, int volume, int pan, bool iact) {
 	AudioTrackInfo *audioTrack = NULL;
 	if (index == 0) {
-		audioTrack = allocAudioTrack(trackId, frame);
+		audioTrack = allocAudioTrack(movie, trackId, frame);
 		assert(audioTrack);
 		audioTrack->animFrame = frame;
 		audioTrack->trackId = trackId;
@@ -448,16 +341,12 @@ void CompressScummSan::handleAudioTrack(int index, int trackId, int frame, int n
 			size -= (input.pos() - pos) + 10;
 			audioTrack->lastFrame = frame;
 		}
-		char tmpPath[1024];
-		sprintf(tmpPath, "%s%s_%04d_%03d.tmp", outputDir.c_str(), inputFilename.c_str(), frame, trackId);
-		audioTrack->file.open(tmpPath, "wb");
-		if (!audioTrack->file.isOpen()) {
-			error("error writing temp file");
-		}
+		audioTrack->data.clear();
+		audioTrack->isOpen = true;
 	} else {
 		if (!iact)
-			flushTracks(frame);
-		audioTrack = findAudioTrack(trackId);
+			flushTracks(movie, frame);
+		audioTrack = findAudioTrack(movie, trackId);
 		assert(audioTrack);
 		if (iact)
 			size -= 18;
@@ -466,10 +355,11 @@ void CompressScummSan::handleAudioTrack(int index, int trackId, int frame, int n
 			audioTrack->lastFrame = frame;
 		}
 	}
-	byte *buffer = (byte *)malloc(size);
-	input.read_throwsOnError(buffer, size);
-	audioTrack->file.write(buffer, size);
-	free(buffer);
+	if (size > 0) {
+		uint32 dataPos = audioTrack->data.size();
+		audioTrack->data.resize(dataPos + size);
+		input.read_throwsOnError(&audioTrack->data[dataPos], size);
+	}
 	audioTrack->volumes[index] = volume;
 	audioTrack->pans[index] = pan;
 	audioTrack->sizes[index] = size;
@@ -485,11 +375,11 @@ void CompressScummSan::handleAudioTrack(int index, int trackId, int frame, int n
 
 	// FIXME. This doesn't work with Russian FT
 	if ((index + 1) >= nbframes) {
-		audioTrack->file.close();
+		audioTrack->isOpen = false;
 	}
 }
 
-void CompressScummSan::handleDigIACT(Common::File &input, int size, const std::string &outputDir, const std::string &inputFilename,int flags, int track_flags, int frame) {
+void CompressScummSan::handleDigIACT(SanMovie &movie, Common::File &input, int size, int flags, int track_flags, int frame) {
 	int track = input.readUint16LE();
 	int index = input.readUint16LE();
 	int nbframes = input.readUint16LE();
@@ -517,10 +407,10 @@ void CompressScummSan::handleDigIACT(Common::File &input, int size, const std::s
 		error("handleDigIACT() Bad track_flags: %d", track_flags);
 	}
 
-	handleAudioTrack(index, trackId, frame, nbframes, input, outputDir, inputFilename, size, volume, pan, true);
+	handleAudioTrack(movie, index, trackId, frame, nbframes, input, size, volume, pan, true);
 }
 
-void CompressScummSan::handlePSAD(Common::File &input, int size, const std::string &outputDir, const std::string &inputFilename, int frame) {
+void CompressScummSan::handlePSAD(SanMovie &movie, Common::File &input, int size, int frame) {
 	int trackId = input.readUint16LE();
 	int index = input.readUint16LE();
 	int nbframes = input.readUint16LE();
@@ -528,12 +418,67 @@ void CompressScummSan::handlePSAD(Common::File &input, int size, const std::stri
 	int volume = input.readByte();
 	int pan = input.readByte();
 
-	handleAudioTrack(index, trackId, frame, nbframes, input, outputDir, inputFilename, size, volume, pan, false);
+	handleAudioTrack(movie, index, trackId, frame, nbframes, input, size, volume, pan, false);
 }
 
-CompressScummSan::CompressScummSan(const std::string &name) : CompressionTool(name, TOOLTYPE_COMPRESSION) {
-	_IACTpos = 0;
+CompressScummSan::SanMovie::SanMovie() {
+	IACTpos = 0;
+	verbose = true;
+
+	for (int l = 0; l < COMPRESS_SCUMM_SAN_MAX_TRACKS; l++) {
+		audioTracks[l].animFrame = -1;
+		audioTracks[l].trackId = 0;
+		audioTracks[l].bits = 0;
+		audioTracks[l].stereo = 0;
+		audioTracks[l].freq = 0;
+		audioTracks[l].used = 0;
+		audioTracks[l].waveDataSize = 0;
+		audioTracks[l].volumes = 0;
+		audioTracks[l].pans = 0;
+		audioTracks[l].sizes = 0;
+		audioTracks[l].nbframes = 0;
+		audioTracks[l].countFrames = 0;
+		audioTracks[l].lastFrame = 0;
+		audioTracks[l].sdatSize = 0;
+		audioTracks[l].isOpen = false;
+	}
+}
+
+CompressScummSan::SanMovie::~SanMovie() {
+	for (int l = 0; l < COMPRESS_SCUMM_SAN_MAX_TRACKS; l++) {
+		free(audioTracks[l].volumes);
+		free(audioTracks[l].pans);
+		free(audioTracks[l].sizes);
+	}
+}
+
+/**
+ * Converts the movies of a directory, one movie per item. Every worker
+ * parses, mixes and encodes its own movie, so the demuxing of some movies
+ * overlaps with the audio encoding of others.
+ */
+class SanBatchTask : public Common::ParallelTask {
+public:
+	SanBatchTask(CompressScummSan &tool, const std::vector<std::string> &inputs, const Common::Filename &outpath, std::vector<CompressScummSan::MovieStats> &stats, uint first)
+		: _tool(tool), _inputs(inputs), _outpath(outpath), _stats(stats), _first(first) {
+	}
+
+	virtual void run(uint index) {
+		index += _first;
+		Common::Filename inpath(_inputs[index]);
+		_tool.convertMovie(inpath, _outpath, false, _stats[index]);
+		_tool.print("Converted %s\n", inpath.getFullName().c_str());
+	}
 
+private:
+	CompressScummSan &_tool;
+	const std::vector<std::string> &_inputs;
+	const Common::Filename &_outpath;
+	std::vector<CompressScummSan::MovieStats> &_stats;
+	uint _first;
+};
+
+CompressScummSan::CompressScummSan(const std::string &name) : CompressionTool(name, TOOLTYPE_COMPRESSION) {
 	_supportedFormats = AudioFormat(AUDIO_MP3 | AUDIO_VORBIS);
 	_supportsProgressBar = true;
 
@@ -543,14 +488,15 @@ CompressScummSan::CompressScummSan(const std::string &name) : CompressionTool(na
 
 	_shorthelp = "Used to compress .san files found in the later SCUMM games.";
 	// TODO: Feature set seems more limited than what kCompressionAudioHelp contains
-	_helptext = "\nUsage: " + getName() + " [mode] [mode-params] [-o outpufile = inputfile.san] <inputfile>\n";
+	_helptext = "\nUsage: " + getName() + " [mode] [mode-params] [-o outpufile = inputfile.san] <inputfile>\n"
+		"\nIf <inputfile> is a directory, all the .san files in it are converted into the\n"
+		"output directory, several at once with --jobs, followed by a summary.\n";
 }
 
 void CompressScummSan::execute() {
 	if (_format == AUDIO_FLAC)
 		error("Only ogg vorbis and MP3 are supported for this tool.");
 
-	Common::Filename inpath(_inputPaths[0].path);
 	Common::Filename outpath(_outputPath);
 
 	// We default to the current directory.
@@ -563,13 +509,76 @@ void CompressScummSan::execute() {
 		outpath.setFullPath("./");	// FIXME: Crude hack. Will this work on Windows?
 	}
 
+	if (Common::isDirectory(_inputPaths[0].path.c_str())) {
+		convertDirectory(_inputPaths[0].path, outpath);
+		return;
+	}
+
+	MovieStats stats;
+	convertMovie(Common::Filename(_inputPaths[0].path), outpath, true, stats);
+}
+
+void CompressScummSan::convertDirectory(const std::string &inputDir, const Common::Filename &outpath) {
+	std::string dir = inputDir;
+	if (dir[dir.size() - 1] != '/' && dir[dir.size() - 1] != '\\')
+		dir += '/';
+
+	std::vector<std::string> names;
+	Common::listDirectory(dir.c_str(), names);
+	std::sort(names.begin(), names.end());
+
+	std::vector<std::string> inputs;
+	for (uint i = 0; i < names.size(); i++) {
+		if (Common::Filename(names[i]).hasExtension("san"))
+			inputs.push_back(dir + names[i]);
+	}
+	if (inputs.empty())
+		error("No .san files found in %s", inputDir.c_str());
+
+	print("Converting %d movies on %d threads\n", (int)inputs.size(), _numJobs);
+
+	// Each worker holds a whole movie, so there is no point in handing out
+	// more than a few of them between two progress updates
+	std::vector<MovieStats> stats(inputs.size());
+	const uint batchSize = _numJobs * 4;
+	uint32 start = Common::getMillis();
+	for (uint first = 0; first < inputs.size(); first += batchSize) {
+		updateProgress(first, inputs.size());
+		SanBatchTask task(*this, inputs, outpath, stats, first);
+		Common::runParallel(task, MIN<uint>(batchSize, inputs.size() - first), _numJobs);
+	}
+
+	printSummary(stats, Common::getMillis() - start);
+}
+
+void CompressScummSan::printSummary(const std::vector<MovieStats> &stats, uint32 millis) {
+	uint32 totalInput = 0, totalOutput = 0;
+
+	print("\n%-24s %9s %12s %12s %7s\n", "Movie", "Time (s)", "Input", "Output", "Ratio");
+	for (uint i = 0; i < stats.size(); i++) {
+		const MovieStats &movie = stats[i];
+		print("%-24s %9.2f %12u %12u %6.1f%%\n", movie.name.c_str(), movie.millis / 1000.0,
+			movie.inputSize, movie.outputSize, movie.inputSize ? 100.0 * movie.outputSize / movie.inputSize : 0.0);
+		totalInput += movie.inputSize;
+		totalOutput += movie.outputSize;
+	}
+	print("%-24s %9.2f %12u %12u %6.1f%%\n", "Total", millis / 1000.0,
+		totalInput, totalOutput, totalInput ? 100.0 * totalOutput / totalInput : 0.0);
+}
+
+void CompressScummSan::convertMovie(const Common::Filename &inpathArg, const Common::Filename &outpathArg, bool verbose, MovieStats &stats) {
+	Common::Filename inpath(inpathArg);
+	Common::Filename outpath(outpathArg);
+	uint32 start = Common::getMillis();
+
 	// Use the same filename as for the input file, and ensure the extension is right.
 	outpath.setFullName(inpath.getName());
 	outpath.setExtension(".san");
 
 	// Don't use the input file name for output by some weird accident.
 	// (This check won't catch all cases of this, but it's better than nothing.)
-	assert(inpath.getFullPath() != outpath.getFullPath());
+	if (inpath.getFullPath() == outpath.getFullPath())
+		error("Output file %s would overwrite the input file", outpath.getFullPath().c_str());
 
 	Common::File input(inpath, "rb");
 	Common::File output(outpath, "wb");
@@ -592,6 +601,9 @@ void CompressScummSan::execute() {
 		flu_out.open(flupath, "wb");
 	}
 
+	SanMovie movie;
+	movie.verbose = verbose;
+
 	int32 l, size;
 
 	output.writeUint32BE(input.readUint32BE()); // ANIM
@@ -611,34 +623,19 @@ void CompressScummSan::execute() {
 
 	FrameInfo *frameInfo = (FrameInfo *)malloc(sizeof(FrameInfo) * nbframes);
 
-	for (l = 0; l < COMPRESS_SCUMM_SAN_MAX_TRACKS; l++) {
-		_audioTracks[l].animFrame = -1;
-		_audioTracks[l].trackId = 0;
-		_audioTracks[l].bits = 0;
-		_audioTracks[l].stereo = 0;
-		_audioTracks[l].freq = 0;
-		_audioTracks[l].used = 0;
-		_audioTracks[l].waveDataSize = 0;
-		_audioTracks[l].volumes = 0;
-		_audioTracks[l].pans = 0;
-		_audioTracks[l].sizes = 0;
-		_audioTracks[l].nbframes = 0;
-		_audioTracks[l].countFrames = 0;
-		_audioTracks[l].lastFrame = 0;
-		_audioTracks[l].sdatSize = 0;
-	}
-
 	bool tracksCompress = false;
 	int fps = 0;
 	uint32 inputSize = input.size();
 
-	print("Frames: %d\n", nbframes);
+	if (verbose)
+		print("Frames: %d\n", nbframes);
 
 	for (l = 0; l < nbframes; l++) {
 		// Compression takes place in this loops, which takes the most time by far
-		updateProgress(l, nbframes);
-
-		print("frame: %d\n", l);
+		if (verbose) {
+			updateProgress(l, nbframes);
+			print("frame: %d\n", l);
+		}
 		bool first_fobj = true;
 		uint32 tag = input.readUint32BE(); // chunk tag
 		assert(tag == 'FRME');
@@ -678,8 +675,9 @@ void CompressScummSan::execute() {
 				if (result != Z_OK) {
 					error("compression error");
 				}
+				// Pad to an even size with a zero, not with whatever was in the buffer
 				if ((outputSize & 1) != 0)
-					outputSize++;
+					zlibOutputBuffer[outputSize++] = 0;
 				frameInfo[l].fobjDecompressedSize = size;
 				frameInfo[l].fobjCompressedSize = outputSize;
 				output.writeUint32BE('ZFOB');
@@ -698,9 +696,9 @@ void CompressScummSan::execute() {
 				int unk = input.readUint16LE();
 				int track_flags = input.readUint16LE();
 				if ((code == 8) && (track_flags == 0) && (unk == 0) && (flags == 46)) {
-					handleComiIACT(input, size, outpath.getPath(), inpath.getFullName());
+					handleComiIACT(movie, input, size);
 				} else if ((code == 8) && (track_flags != 0) && (unk == 0) && (flags == 46)) {
-					handleDigIACT(input, size, outpath.getPath(), inpath.getFullName(), flags, track_flags, l);
+					handleDigIACT(movie, input, size, flags, track_flags, l);
 					tracksCompress = true;
 					fps = 12;
 				} else {
@@ -716,7 +714,7 @@ void CompressScummSan::execute() {
 				continue;
 			} else if ((tag == 'PSAD') && (!flu_in.isOpen())) {
 				size = input.readUint32BE(); // chunk size
-				handlePSAD(input, size, outpath.getPath(), inpath.getFullName(), l);
+				handlePSAD(movie, input, size, l);
 				if ((size & 1) != 0) {
 					input.seek(1, SEEK_CUR);
 					size++;
@@ -746,26 +744,18 @@ skip:
 	}
 
 	if (tracksCompress) {
-		prepareForMixing(outpath.getPath(), inpath.getFullName());
 		assert(fps);
-		mixing(outpath.getPath(), inpath.getFullName(), nbframes, fps);
+		mixing(movie, nbframes, fps);
 	}
 
-	if (_waveTmpFile.isOpen()) {
-		std::string tmpPath = outpath.getPath() + inpath.getFullName();
-		setRawAudioType(true, true, 16); // LE, stereo, 16-bit
-
-		if (_format == AUDIO_VORBIS)
-			encodeSanWaveWithOgg(tmpPath);
-		else
-			encodeSanWaveWithLame(tmpPath);
-		tmpPath += ".raw";
-		Common::removeFile(tmpPath.c_str());
-	}
+	uint32 audioSize = 0;
+	if (!movie.waveData.empty())
+		audioSize = encodeSanWave(movie, outpath.getPath() + inpath.getFullName());
 
 	input.close();
 
-	print("Fixing frames header...\n");
+	if (verbose)
+		print("Fixing frames header...\n");
 	int32 sumDiff = 0;
 	for (l = 0; l < nbframes; l++) {
 		int32 diff = 0;
@@ -783,15 +773,19 @@ skip:
 		if (diff != 0)
 			output.writeUint32BE(frameInfo[l].frameSize - diff);
 	}
-	print("done.\n");
+	if (verbose)
+		print("done.\n");
 
-	print("Fixing anim header...\n");
+	if (verbose)
+		print("Fixing anim header...\n");
 	output.seek(4, SEEK_SET);
 	output.writeUint32BE(animChunkSize - sumDiff);
-	print("done.\n");
+	if (verbose)
+		print("done.\n");
 
 	if (flu_in.isOpen()) {
-		print("Fixing flu offsets...\n");
+		if (verbose)
+			print("Fixing flu offsets...\n");
 		int fsize = flu_in.size();
 		for (int k = 0; k < fsize; k++) {
 			flu_out.writeByte(flu_in.readByte());
@@ -800,12 +794,19 @@ skip:
 		for (l = 0; l < nbframes; l++) {
 			flu_out.writeUint32LE(frameInfo[l].offsetOutput - 4);
 		}
+		if (verbose)
 		print("done.\n");
 	}
 
 	free(frameInfo);
 
-	print("compression done.\n");
+	stats.name = inpath.getFullName();
+	stats.inputSize = inputSize;
+	stats.outputSize = output.size() + audioSize;
+	stats.millis = Common::getMillis() - start;
+
+	if (verbose)
+		print("compression done.\n");
 }
 
 #ifdef STANDALONE_MAIN
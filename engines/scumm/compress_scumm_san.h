@@ -51,7 +51,8 @@ public:
 		bool stereo;
 		int freq;
 		bool used;
-		Common::File file;
+		bool isOpen;
+		std::vector<byte> data;
 		int waveDataSize;
 		int *volumes;
 		int *pans;
@@ -62,29 +63,47 @@ public:
 		int32 sdatSize;
 	};
 
+	/** The state of a single movie while it is converted. */
+	struct SanMovie {
+		SanMovie();
+		~SanMovie();
+
+		byte IACToutput[0x1000];
+		int IACTpos;
+		std::vector<int16> waveData;
+		AudioTrackInfo audioTracks[COMPRESS_SCUMM_SAN_MAX_TRACKS];
+		/** If false, the progress of the movie is not printed, as in batch mode. */
+		bool verbose;
+	};
+
+	/** The outcome of converting a movie, for the batch mode summary. */
+	struct MovieStats {
+		std::string name;
+		uint32 inputSize;
+		uint32 outputSize;
+		uint32 millis;
+	};
+
 protected:
-	byte _IACToutput[0x1000];
-	int _IACTpos;
-	Common::File _waveTmpFile;
-	int32 _waveDataSize;
-	AudioTrackInfo _audioTracks[COMPRESS_SCUMM_SAN_MAX_TRACKS];
-
-	void encodeSanWaveWithOgg(const std::string &filename);
-	void encodeSanWaveWithLame(const std::string &filename);
-	void writeToTempWaveFile(const std::string &fileName, byte *output_data, unsigned int size);
-	void decompressComiIACT(const std::string &fileName, byte *output_data, byte *d_src, int bsize);
-	void handleComiIACT(Common::File &input, int size, const std::string &outputDir, const std::string &inputFilename);
-	AudioTrackInfo *allocAudioTrack(int trackId, int frame);
-	AudioTrackInfo *findAudioTrack(int trackId);
-	void flushTracks(int frame);
-	void prepareForMixing(const std::string &outputDir, const std::string &inputFilename);
-	void mixing(const std::string &outputDir, const std::string &inputFilename, int frames, int fps);
+	friend class SanBatchTask;
+
+	void convertMovie(const Common::Filename &inpath, const Common::Filename &outpath, bool verbose, MovieStats &stats);
+	void convertDirectory(const std::string &inputDir, const Common::Filename &outpath);
+	void printSummary(const std::vector<MovieStats> &stats, uint32 millis);
+
+	uint32 encodeSanWave(SanMovie &movie, const std::string &filename);
+	void decompressComiIACT(SanMovie &movie, byte *output_data, byte *d_src, int bsize);
+	void handleComiIACT(SanMovie &movie, Common::File &input, int size);
+	AudioTrackInfo *allocAudioTrack(SanMovie &movie, int trackId, int frame);
+	AudioTrackInfo *findAudioTrack(SanMovie &movie, int trackId);
+	void flushTracks(SanMovie &movie, int frame);
+	void expandTrack(const AudioTrackInfo &track, std::vector<int16> &output);
+	void mixing(SanMovie &movie, int frames, int fps);
 	void handleMapChunk(AudioTrackInfo *audioTrack, Common::File &input);
 	int32 handleSaudChunk(AudioTrackInfo *audioTrack, Common::File &input);
-	void handleAudioTrack(int index, int trackId, int frame, int nbframes, Common::File &input, const std::string &outputDir,
-		const std::string &inputFilename, int &size, int volume, int pan, bool iact);
-	void handleDigIACT(Common::File &input, int size, const std::string &outputDir, const std::string &inputFilename,int flags, int track_flags, int frame);
-	void handlePSAD(Common::File &input, int size, const std::string &outputDir, const std::string &inputFilename, int frame);
+	void handleAudioTrack(SanMovie &movie, int index, int trackId, int frame, int nbframes, Common::File &input, int &size, int volume, int pan, bool iact);
+	void handleDigIACT(SanMovie &movie, Common::File &input, int size, int flags, int track_flags, int frame);
+	void handlePSAD(SanMovie &movie, Common::File &input, int size, int frame);
 };
 
 #endif
@@ -71,8 +71,6 @@ void CompressScummSou::end_of_file() {
 	/* And some clean-up :-) */
 	Common::removeFile(TEMP_IDX);
 	Common::removeFile(TEMP_DAT);
-	Common::removeFile(TEMP_RAW);
-	Common::removeFile(tempEncoded);
 }
 
 void CompressScummSou::append_byte(int size, char buf[]) {
@@ -84,7 +82,6 @@ void CompressScummSou::append_byte(int size, char buf[]) {
 
 bool CompressScummSou::get_part() {
 	uint32 tot_size;
-	int size;
 	char buf[2048];
 	int pos = _input.pos();
 	uint32 tags;
@@ -127,15 +124,13 @@ bool CompressScummSou::get_part() {
 	print("Voice file found (pos = %d) :", pos);
 
 	/* Convert the VOC data */
-	extractAndEncodeVOC(TEMP_RAW, _input, _format);
+	std::vector<byte> encoded;
+	extractAndEncodeVOC(_input, _format, encoded);
 
 	/* Append the converted data to the master output file */
-	Common::File f(tempEncoded, "rb");
-	tot_size = 0;
-	while ((size = f.read_noThrow(buf, 2048)) > 0) {
-		tot_size += size;
-		_output_snd.write(buf, size);
-	}
+	tot_size = encoded.size();
+	if (!encoded.empty())
+		_output_snd.write(&encoded[0], encoded.size());
 
 	_output_idx.writeUint32BE(tot_size);
 
@@ -311,18 +311,19 @@ MusicFile musicNames[TOTAL_TUNES] = {
 
 int16 *CompressSword1::uncompressSpeech(Common::File &clu, uint32 idx, uint32 cSize, uint32 *returnSize) {
 	uint32 resSize, srcPos;
-	int16 *srcData, *dstData, *dstPos;
+	const int16 *srcData;
+	int16 *dstData, *dstPos;
 	uint32 headerPos = 0;
 	int16 length, cnt;
-	uint8 *fBuf = (uint8 *)malloc(cSize);
+	// The sample is decoded straight from the mapped CLU file
 	clu.seek(idx, SEEK_SET);
-	clu.read_throwsOnError(fBuf, cSize);
+	const uint8 *fBuf = clu.readSpan(cSize);
 
 	while ((READ_BE_UINT32(fBuf + headerPos) != 'data') && (headerPos < 100))
 		headerPos++;
 	if (headerPos < 100) {
 		resSize = READ_LE_UINT32(fBuf + headerPos + 4) >> 1;
-		srcData = (int16 *)(fBuf + headerPos + 8);
+		srcData = (const int16 *)(fBuf + headerPos + 8);
 		dstData = (int16 *)malloc(resSize * 2);
 		srcPos = 0;
 		dstPos = dstData;
@@ -341,13 +342,11 @@ int16 *CompressSword1::uncompressSpeech(Common::File &clu, uint32 idx, uint32 cS
 				srcPos += length;
 			}
 		}
-		free(fBuf);
 		*returnSize = resSize * 2;
 		if (_speechEndianness == UnknownEndian)
 			guessEndianness(dstData, length);
 		return dstData;
 	} else {
-		free(fBuf);
 		error("Sound::uncompressSpeech(): DATA tag not found in wave header");
 		*returnSize = 0;
 		return NULL;
@@ -376,22 +375,21 @@ void CompressSword1::guessEndianness(int16 *data, int16 length) {
 	setRawAudioType(_speechEndianness == LittleEndian, false, 16);
 }
 
-uint8 *CompressSword1::convertData(uint8 *rawData, uint32 rawSize, uint32 *resSize) {
-	uint8 *resBuf;
-
-	uint32 size;
-	Common::File temp(TEMP_RAW, "wb");
-	size = temp.write(rawData, rawSize);
-	assert(size == rawSize);
-	temp.close();
-	encodeAudio(TEMP_RAW, true, 11025, _audioOuputFilename.c_str(), _format);
-	temp.open(_audioOuputFilename, "rb");
-	temp.seek(0, SEEK_END);
-	*resSize = size = temp.pos();
-	resBuf = (uint8*)malloc(size);
-	temp.seek(0, SEEK_SET);
-	temp.read_throwsOnError(resBuf, size);
-	return resBuf;
+void CompressSword1::writeQueuedSamples(Common::File &cl3, uint32 *cl3Index) {
+	encodeQueuedAudio();
+
+	for (uint i = 0; i < _queuedSamples.size(); i++) {
+		const std::vector<byte> &encoded = getEncodedAudio(i);
+		uint32 cnt = _queuedSamples[i];
+
+		cl3Index[cnt << 1] = cl3.pos();
+		cl3Index[(cnt << 1) | 1] = encoded.size();
+		if (!encoded.empty())
+			cl3.write(&encoded[0], encoded.size());
+	}
+
+	_queuedSamples.clear();
+	clearAudioQueue();
 }
 
 void CompressSword1::convertClu(Common::File &clu, Common::File &cl3) {
@@ -400,8 +398,8 @@ void CompressSword1::convertClu(Common::File &clu, Common::File &cl3) {
 	uint32 numSamples;
 	uint32 cnt;
 	uint32 *cl3Index, *sampleIndex;
-	uint32 smpSize, mp3Size;
-	uint8 *smpData, *mp3Data;
+	uint32 smpSize;
+	uint8 *smpData;
 
 	uint32 headerSize = clu.readUint32LE();
 
@@ -434,6 +432,9 @@ void CompressSword1::convertClu(Common::File &clu, Common::File &cl3) {
 
 	print("converting %d samples\n", numSamples);
 
+	clearAudioQueue();
+	_queuedSamples.clear();
+
 	for (cnt = 0; cnt < numSamples; cnt++) {
 		if (sampleIndex[cnt << 1] | sampleIndex[(cnt << 1) | 1]) {
 			print("sample %5d: \n", cnt);
@@ -441,18 +442,19 @@ void CompressSword1::convertClu(Common::File &clu, Common::File &cl3) {
 			if ((!smpData) || (!smpSize))
 				error("unable to handle speech sample %d!\n", cnt);
 
-			mp3Data = convertData(smpData, smpSize, &mp3Size);
-			cl3Index[cnt << 1] = cl3.pos();
-			cl3Index[(cnt << 1) | 1] = mp3Size;
-			cl3.write(mp3Data, mp3Size);
-
+			// Samples are encoded in batches and written in their original order
+			queueAudio(smpData, smpSize, 11025);
+			_queuedSamples.push_back(cnt);
 			free(smpData);
-			free(mp3Data);
+
+			if (isAudioQueueFull())
+				writeQueuedSamples(cl3, cl3Index);
 		} else {
 			cl3Index[cnt << 1] = cl3Index[(cnt << 1) | 1] = 0;
 			print("sample %5d: skipped\n", cnt);
 		}
 	}
+	writeQueuedSamples(cl3, cl3Index);
 	cl3.seek((numRooms + 2) * 4, SEEK_SET);	/* Now write the sample index into the CL3 file */
 	for (cnt = 0; cnt < numSamples * 2; cnt++)
 		cl3.writeUint32LE(cl3Index[cnt]);
@@ -474,13 +476,13 @@ void CompressSword1::compressSpeech(const Common::Filename *inpath, const Common
 
 		sprintf(cluName, "%s/SPEECH/SPEECH%d.CLU", inpath->getPath().c_str(), i);
 		try {
-			clu.open(cluName, "rb");
+			clu.openMapped(cluName);
 		} catch (Common::FileException &) {
 			// Not found in SPEECH sub-directory.
 			// Looking for the file at the root of the input directory.
 			sprintf(cluName, "%s/SPEECH%d.CLU", inpath->getPath().c_str(), i);
 			try {
-				clu.open(cluName, "rb");
+				clu.openMapped(cluName);
 			} catch (Common::FileException &) {
 				print("Unable to open \"SPEECH%d.CLU\".\n", i);
 				print("Please copy the \"SPEECH.CLU\" from CD %d\nand rename it to \"SPEECH%d.CLU\".\n", i, i);
@@ -522,8 +524,6 @@ void CompressSword1::compressSpeech(const Common::Filename *inpath, const Common
 		print("Converting CD %d...\n", i);
 		convertClu(clu, cl3);
 	}
-	Common::removeFile(TEMP_RAW);
-	Common::removeFile(_audioOuputFilename.c_str());
 }
 
 void CompressSword1::compressMusic(const Common::Filename *inpath, const Common::Filename *outpath) {
@@ -764,13 +764,8 @@ void CompressSword1::execute() {
 
 	switch (_format) {
 	case AUDIO_MP3:
-		_audioOuputFilename = TEMP_MP3;
-		break;
 	case AUDIO_VORBIS:
-		_audioOuputFilename = TEMP_OGG;
-		break;
 	case AUDIO_FLAC:
-		_audioOuputFilename = TEMP_FLAC;
 		break;
 	default:
 		throw ToolException("Unknown audio format");
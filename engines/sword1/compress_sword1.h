@@ -39,10 +39,11 @@ public:
 protected:
 	void parseExtraArguments();
 
-	std::string _audioOuputFilename;
+	/** Sample numbers of the speech samples in the audio queue. */
+	std::vector<uint32> _queuedSamples;
 
 	int16 *uncompressSpeech(Common::File &clu, uint32 idx, uint32 cSize, uint32 *returnSize);
-	uint8 *convertData(uint8 *rawData, uint32 rawSize, uint32 *resSize);
+	void writeQueuedSamples(Common::File &cl3, uint32 *cl3Index);
 	void convertClu(Common::File &clu, Common::File &cl3);
 	void compressSpeech(const Common::Filename *inpath, const Common::Filename *outpath);
 	void compressMusic(const Common::Filename *inpath, const Common::Filename *outpath);
@@ -23,33 +23,48 @@
 
 #include "compress_sword2.h"
 
-#define TEMP_IDX	"tempfile.idx"
-#define TEMP_DAT	"tempfile.dat"
+#include "common/endian.h"
 
-uint32 CompressSword2::append_to_file(Common::File &f1, const char *filename) {
-	uint32 length, orig_length;
-	size_t size;
-	char fbuf[2048];
+#define GetCompressedShift(n)      ((n) >> 4)
+#define GetCompressedSign(n)       (((n) >> 3) & 1)
+#define GetCompressedAmplitude(n)  ((n) & 7)
 
-	Common::File f2(filename, "rb");
-	orig_length = length = f2.size();
+/**
+ * The difference to the previous sample, for every byte of compressed speech.
+ * The samples wrap around at 16 bits, so subtracting is adding the negated
+ * amplitude.
+ */
+static uint16 speechDeltas[256];
 
-	while (length > 0) {
-		size = f2.read_noThrow(fbuf, length > sizeof(fbuf) ? sizeof(fbuf) : length);
-		if (size <= 0) {
-			break;
+static struct SpeechDeltaInitializer {
+	SpeechDeltaInitializer() {
+		for (int data = 0; data < 256; data++) {
+			uint16 amplitude = GetCompressedAmplitude(data) << GetCompressedShift(data);
+			speechDeltas[data] = GetCompressedSign(data) ? (uint16)(0 - amplitude) : amplitude;
 		}
+	}
+} speechDeltaInitializer;
 
-		length -= size;
-		f1.write(fbuf, size);
+/**
+ * Decodes a speech sample into 16-bit little endian PCM. The first sample is
+ * stored uncompressed, each of the others as an 8-bit delta to the previous
+ * one, so decoding is a running sum over the deltas.
+ *
+ * @param src    The compressed sample.
+ * @param length Number of samples, the compressed data is one byte longer.
+ * @param dst    Receives 2 * length bytes.
+ */
+static void decodeSpeech(const byte *src, uint32 length, byte *dst) {
+	uint16 sample = READ_LE_UINT16(src);
+	WRITE_LE_UINT16(dst, sample);
+
+	const byte *deltas = src + 2;
+	for (uint32 i = 1; i < length; i++) {
+		sample += speechDeltas[deltas[i - 1]];
+		WRITE_LE_UINT16(dst + 2 * i, sample);
 	}
-	return orig_length;
 }
 
-#define GetCompressedShift(n)      ((n) >> 4)
-#define GetCompressedSign(n)       (((n) >> 3) & 1)
-#define GetCompressedAmplitude(n)  ((n) & 7)
-
 CompressSword2::CompressSword2(const std::string &name) : CompressionTool(name, TOOLTYPE_COMPRESSION) {
 	_supportsProgressBar = true;
 
@@ -62,7 +77,6 @@ CompressSword2::CompressSword2(const std::string &name) : CompressionTool(name,
 }
 
 void CompressSword2::execute() {
-	int j;
 	uint32 indexSize;
 	uint32 totalSize;
 	uint32 length;
@@ -76,15 +90,12 @@ void CompressSword2::execute() {
 
 	switch (_format) {
 	case AUDIO_MP3:
-		_audioOutputFilename = TEMP_MP3;
 		outpath.setExtension(".cl3");
 		break;
 	case AUDIO_VORBIS:
-		_audioOutputFilename = TEMP_OGG;
 		outpath.setExtension(".clg");
 		break;
 	case AUDIO_FLAC:
-		_audioOutputFilename = TEMP_FLAC;
 		outpath.setExtension(".clf");
 		break;
 	default:
@@ -92,7 +103,7 @@ void CompressSword2::execute() {
 		break;
 	}
 
-	_input.open(inpath, "rb");
+	_input.openMapped(inpath);
 
 	indexSize = _input.readUint32LE();
 	totalSize = 12 * (indexSize + 1);
@@ -101,30 +112,39 @@ void CompressSword2::execute() {
 		error("This doesn't look like a cluster file");
 	}
 
-	_output_idx.open(TEMP_IDX, "wb");
-	_output_snd.open(TEMP_DAT, "wb");
-
-	_output_idx.writeUint32LE(indexSize);
-	_output_idx.writeUint32BE(0xfff0fff0);
-	_output_idx.writeUint32BE(0xfff0fff0);
+	// The index comes before the sample data, its entries are filled in
+	// as the samples are written, and written at the end
+	_output.open(outpath, "wb");
+	_output.writeUint32LE(indexSize);
+	_output.writeUint32BE(0xfff0fff0);
+	_output.writeUint32BE(0xfff0fff0);
+
+	_outputIndex.assign(3 * indexSize, 0);
+	if (indexSize)
+		_output.writeUint32LEArray(&_outputIndex[0], _outputIndex.size());
+	_outputIndexPos = 0;
+
+	// The samples are decoded as 16-bit little endian mono PCM
+	setRawAudioType(true, false, 16);
+	clearAudioQueue();
+	_pending.clear();
+
+	// The index is an array of (position, length) pairs
+	std::vector<uint32> index(2 * indexSize);
+	_input.seek(8, SEEK_SET);
+	if (indexSize)
+		_input.readUint32LEArray(&index[0], index.size());
 
 	for (int i = 0; i < (int)indexSize; i++) {
 		// Update progress, this loop is where most of the time is spent
 		updateProgress(i, indexSize);
 
 		uint32 pos;
-		uint32 enc_length;
 
-		_input.seek(8 * (i + 1), SEEK_SET);
-
-		pos = _input.readUint32LE();
-		length = _input.readUint32LE();
+		pos = index[2 * i];
+		length = index[2 * i + 1];
 
 		if (pos != 0 && length != 0) {
-			uint16 prev;
-
-			Common::File f(TEMP_WAV, "wb");
-
 			/*
 			 * The number of decodeable 16-bit samples is one less
 			 * than the length of the resource.
@@ -132,83 +152,59 @@ void CompressSword2::execute() {
 
 			length--;
 
-			/*
-			 * Back when this tool was written, encodeAudio() had
-			 * no way of encoding 16-bit data, so it was simpler to
-			 * output a WAV file.
-			 */
-
-			f.writeUint32BE(0x52494646);	/* "RIFF" */
-			f.writeUint32LE(2 * length + 36);
-			f.writeUint32BE(0x57415645);	/* "WAVE" */
-			f.writeUint32BE(0x666d7420);	/* "fmt " */
-			f.writeUint32LE(16);
-			f.writeUint16LE(1);				/* PCM */
-			f.writeUint16LE(1);				/* mono */
-			f.writeUint32LE(22050);			/* sample rate */
-			f.writeUint32LE(44100);			/* bytes per second */
-			f.writeUint16LE(2);				/* basic block size */
-			f.writeUint16LE(16);			/* sample width */
-			f.writeUint32BE(0x64617461);	/* "data" */
-			f.writeUint32LE(2 * length);
-
 			_input.seek(pos, SEEK_SET);
+			const byte *data = _input.readSpan(length + 1);
 
-			/*
-			 * The first sample is stored uncompressed. Subsequent
-			 * samples are stored as some sort of 8-bit delta.
-			 */
+			std::vector<byte> raw(2 * length);
+			if (length)
+				decodeSpeech(data, length, &raw[0]);
 
-			prev = _input.readUint16LE();
+			PendingSample sample;
+			sample.length = length;
+			sample.job = queueAudio(raw, 22050);
+			_pending.push_back(sample);
+		} else {
+			PendingSample sample;
+			sample.length = 0;
+			sample.job = -1;
+			_pending.push_back(sample);
+		}
 
-			f.writeUint16LE(prev);
+		if (isAudioQueueFull())
+			writeQueuedSamples(totalSize);
+	}
 
-			for (j = 1; j < (int)length; j++) {
-				byte data;
-				uint16 out;
+	writeQueuedSamples(totalSize);
 
-				data = _input.readByte();
-				if (GetCompressedSign(data))
-					out = prev - (GetCompressedAmplitude(data) << GetCompressedShift(data));
-				else
-					out = prev + (GetCompressedAmplitude(data) << GetCompressedShift(data));
+	_output.seek(12, SEEK_SET);
+	if (indexSize)
+		_output.writeUint32LEArray(&_outputIndex[0], _outputIndex.size());
 
-				f.writeUint16LE(out);
-				prev = out;
-			}
+	_output.close();
+	_input.close();
+}
+
+void CompressSword2::writeQueuedSamples(uint32 &totalSize) {
+	encodeQueuedAudio();
 
-			f.close();
+	// Index entries are (position, decoded length, encoded length) triples
+	for (uint i = 0; i < _pending.size(); i++, _outputIndexPos += 3) {
+		if (_pending[i].job >= 0) {
+			const std::vector<byte> &encoded = getEncodedAudio(_pending[i].job);
+			uint32 enc_length = encoded.size();
 
-			encodeAudio(TEMP_WAV, false, -1, tempEncoded, _format);
-			enc_length = append_to_file(_output_snd, tempEncoded);
+			if (enc_length)
+				_output.write(&encoded[0], enc_length);
 
-			_output_idx.writeUint32LE(totalSize);
-			_output_idx.writeUint32LE(length);
-			_output_idx.writeUint32LE(enc_length);
+			_outputIndex[_outputIndexPos] = totalSize;
+			_outputIndex[_outputIndexPos + 1] = _pending[i].length;
+			_outputIndex[_outputIndexPos + 2] = enc_length;
 			totalSize = totalSize + enc_length;
-		} else {
-			_output_idx.writeUint32LE(0);
-			_output_idx.writeUint32LE(0);
-			_output_idx.writeUint32LE(0);
 		}
 	}
 
-	_output_snd.close();
-	_output_idx.close();
-
-	Common::File output(outpath, "wb");
-
-	append_to_file(output, TEMP_IDX);
-	append_to_file(output, TEMP_DAT);
-
-	output.close();
-
-	Common::removeFile(TEMP_DAT);
-	Common::removeFile(TEMP_IDX);
-	Common::removeFile(TEMP_MP3);
-	Common::removeFile(TEMP_OGG);
-	Common::removeFile(TEMP_FLAC);
-	Common::removeFile(TEMP_WAV);
+	_pending.clear();
+	clearAudioQueue();
 }
 
 #ifdef STANDALONE_MAIN
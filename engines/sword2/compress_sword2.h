@@ -33,10 +33,21 @@ public:
 
 protected:
 
-	Common::File _input, _output_snd, _output_idx;
-	std::string _audioOutputFilename;
+	/** An index entry waiting for its sample to be encoded. */
+	struct PendingSample {
+		uint32 length;
+		int job;	///< Index into the audio queue, -1 for an empty entry
+	};
 
-	uint32 append_to_file(Common::File &f1, const char *filename);
+	Common::File _input, _output;
+	std::vector<PendingSample> _pending;
+
+	/** The index of the output file, (position, decoded length, encoded length) triples. */
+	std::vector<uint32> _outputIndex;
+	/** Where the entries of the next pending samples go in _outputIndex. */
+	uint32 _outputIndexPos;
+
+	void writeQueuedSamples(uint32 &totalSize);
 };
 
 #endif
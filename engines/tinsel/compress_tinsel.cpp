@@ -46,8 +46,6 @@
 
 #define TEMP_IDX "compressed.idx"
 #define TEMP_SMP "compressed.smp"
-#define TEMP_RAW "tempfile.raw"
-#define TEMP_ENC "tempfile.enc"
 
 CompressTinsel::CompressTinsel(const std::string &name) : CompressionTool(name, TOOLTYPE_COMPRESSION) {
 	_supportsProgressBar = true;
@@ -66,44 +64,28 @@ CompressTinsel::CompressTinsel(const std::string &name) : CompressionTool(name,
 
 /* Converts raw-data sample in input_smp of size SampleSize to requested dataformat and writes to output_smp */
 void CompressTinsel::convertTinselRawSample (uint32 sampleSize) {
-	uint32 copyLeft = 0;
-	uint32 doneRead = 0;
-	char buffer[2048];
-	Common::File curFileHandle;
+	std::vector<byte> rawData(sampleSize);
+	std::vector<byte> encoded;
 
 	print("Assuming DW1 sample being 8-bit raw...\n");
 
-	Common::removeFile(TEMP_RAW); Common::removeFile(TEMP_ENC);
-	curFileHandle.open(TEMP_RAW, "wb");
-	copyLeft = sampleSize;
-	while (copyLeft > 0) {
-		doneRead = _input_smp.read_noThrow(buffer, copyLeft > sizeof(buffer) ? sizeof(buffer) : copyLeft);
-		if (doneRead <= 0)
-			break;
-		copyLeft -= (int)doneRead;
-		curFileHandle.write(buffer, doneRead);
-	}
-	curFileHandle.close();
+	if (sampleSize)
+		rawData.resize(_input_smp.read_noThrow(&rawData[0], sampleSize));
 
 	// Encode this raw data...
-	setRawAudioType(true, false, 8); // LE, mono, 8-bit (??)
-	encodeAudio(TEMP_RAW, true, 22050, TEMP_ENC, _format);
-
-	// Append compressed data to output_smp
-	curFileHandle.open(TEMP_ENC, "rb");
-	curFileHandle.seek(0, SEEK_END);
-	copyLeft = curFileHandle.pos();
-	curFileHandle.seek(0, SEEK_SET);
+	RawAudioType rawType = { true, false, 8 }; // LE, mono, 8-bit (??)
+	encodeRawToMemory(rawData.empty() ? NULL : (const char *)&rawData[0], rawData.size(), 22050, _format, rawType, encoded);
+
+	writeEncodedSample(encoded);
+}
+
+/* Appends an encoded sample, preceded by its size, to output_smp */
+void CompressTinsel::writeEncodedSample(const std::vector<byte> &encoded) {
 	// Write size of compressed data
-	_output_smp.writeUint32LE(copyLeft);
+	_output_smp.writeUint32LE(encoded.size());
 	// Write actual data
-	while (copyLeft > 0) {
-		doneRead = curFileHandle.read_noThrow(buffer, copyLeft > sizeof(buffer) ? sizeof(buffer) : copyLeft);
-		if (doneRead <= 0)
-			break;
-		copyLeft -= (int)doneRead;
-		_output_smp.write(buffer, doneRead);
-	}
+	if (!encoded.empty())
+		_output_smp.write(&encoded[0], encoded.size());
 }
 
 static const double TinselFilterTable[4][2] = {
@@ -139,10 +121,7 @@ void CompressTinsel::convertTinselADPCMSample (uint32 sampleSize) {
 	uint32 uncompressedSize;
 	double sample;
 
-	uint32 copyLeft = 0;
-	uint32 doneRead = 0;
-	char buffer[2048];
-	Common::File curFileHandle;
+	std::vector<byte> encoded;
 
 	print("Assuming DW2 sample using ADPCM 6-bit, decoding to 16-bit raw...\n");
 
@@ -224,34 +203,13 @@ void CompressTinsel::convertTinselADPCMSample (uint32 sampleSize) {
 		chunkPos = (chunkPos + 1) % 4;
 	}
 
-	Common::removeFile(TEMP_RAW);
-	Common::removeFile(TEMP_ENC);
-
-	curFileHandle.open(TEMP_RAW, "wb");
-	curFileHandle.write(outBuffer, decodedCount*2);
+	// Encode the decoded data...
+	encodeToMemory(outBuffer, decodedCount, 1, 22050, _format, encoded);
 
 	free(inBuffer);
 	free(outBuffer);
 
-	// Encode this raw data...
-	setRawAudioType(true, false, 16); // LE, mono, 16-bit
-	encodeAudio(TEMP_RAW, true, 22050, TEMP_ENC, _format);
-
-	// Append compressed data to output_smp
-	curFileHandle.open(TEMP_ENC, "rb");
-	curFileHandle.seek(0, SEEK_END);
-	copyLeft = curFileHandle.pos();
-	curFileHandle.seek(0, SEEK_SET);
-	// Write size of compressed data
-	_output_smp.writeUint32LE(copyLeft);
-	// Write actual data
-	while (copyLeft > 0) {
-		doneRead = curFileHandle.read_noThrow(buffer, copyLeft > sizeof(buffer) ? sizeof(buffer) : copyLeft);
-		if (doneRead <= 0)
-			break;
-		copyLeft -= (int)doneRead;
-		_output_smp.write(buffer, doneRead);
-	}
+	writeEncodedSample(encoded);
 }
 
 void CompressTinsel::execute() {
@@ -278,12 +236,16 @@ void CompressTinsel::execute() {
 	indexCount = _input_idx.pos() / sizeof(uint32);
 	_input_idx.seek(0, SEEK_SET);
 
+	std::vector<uint32> index(indexCount);
+	if (indexCount)
+		_input_idx.readUint32LEArray(&index[0], indexCount);
+
 	loopCount = indexCount;
 	while (loopCount>0) {
 		// Update progress
 		updateProgress(indexCount - loopCount, indexCount);
 
-		indexOffset = _input_idx.readUint32LE();
+		indexOffset = index[indexNo];
 		if (indexOffset) {
 			if (indexNo==0) {
 				error("The sourcefiles are already compressed, aborting...\n");
@@ -330,8 +292,6 @@ void CompressTinsel::execute() {
 	}
 
 	/* And some clean-up :-) */
-	Common::removeFile(TEMP_RAW);
-	Common::removeFile(TEMP_ENC);
 }
 
 
@@ -36,6 +36,7 @@ protected:
 
 	void convertTinselRawSample(uint32 sampleSize);
 	void convertTinselADPCMSample(uint32 sampleSize);
+	void writeEncodedSample(const std::vector<byte> &encoded);
 };
 
 #endif
@@ -64,8 +64,8 @@ InspectionMatch CompressTouche::inspectInput(const Common::Filename &filename) {
 }
 
 uint32 CompressTouche::compress_sound_data_file(uint32 current_offset, Common::File &output, Common::File &input, uint32 *offs_table, uint32 *size_table, int len) {
-	int i, size;
-	uint8 buf[2048];
+	int i;
+	uint8 buf[8];
 	uint32 start_offset = current_offset;
 
 	/* write 0 offsets/sizes table */
@@ -89,17 +89,13 @@ uint32 CompressTouche::compress_sound_data_file(uint32 current_offset, Common::F
 
 			print("VOC found (pos = %d) :\n", offs_table[i]);
 			input.seek(18, SEEK_CUR);
-			extractAndEncodeVOC(TEMP_RAW, input, _format);
+			std::vector<byte> encoded;
+			extractAndEncodeVOC(input, _format, encoded);
 
 			/* append converted data to output file */
-			Common::File temp(tempEncoded, "rb");
-
-			size_table[i] = 0;
-
-			while ((size = temp.read_noThrow(buf, 2048)) > 0) {
-				output.write(buf, size);
-				size_table[i] += size;
-			}
+			if (!encoded.empty())
+				output.write(&encoded[0], encoded.size());
+			size_table[i] = encoded.size();
 
 			offs_table[i] = current_offset;
 			current_offset += size_table[i];
@@ -172,10 +168,6 @@ void CompressTouche::compress_sound_data(Common::Filename *inpath, Common::Filen
 
 	output.close();
 
-	/* cleanup */
-	Common::removeFile(TEMP_RAW);
-	Common::removeFile(tempEncoded);
-
 	print("Done.\n");
 }
 
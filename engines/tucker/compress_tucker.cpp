@@ -54,37 +54,33 @@ CompressTucker::CompressTucker(const std::string &name) : CompressionTool(name,
 	_helptext = "\nUsage: " + getName() + " [mode params] [-o outputdir] inputdir\n";
 }
 
-int CompressTucker::append_compress_file(Common::File &output) {
-	char buf[2048];
-	int sz, compress_sz = 0;
-
-	Common::File input_temp(tempEncoded, "rb");
-	while ((sz = input_temp.read_noThrow(buf, sizeof(buf))) > 0) {
-		if ((sz = output.write(buf, sz)) > 0) {
-			compress_sz += sz;
-		}
-	}
-	return compress_sz;
+int CompressTucker::append_compress_file(const std::vector<byte> &encoded, Common::File &output) {
+	if (encoded.empty())
+		return 0;
+	return output.write(&encoded[0], encoded.size());
 }
 
 int CompressTucker::compress_file_wav(Common::File &input, Common::File &output) {
 	char buf[8];
 
 	if (input.read_noThrow(buf, 8) == 8 && memcmp(buf, "RIFF", 4) == 0) {
-		extractAndEncodeWAV(TEMP_WAV, input, _format);
-		return append_compress_file(output);
+		std::vector<byte> encoded;
+		extractAndEncodeWAV(input, _format, encoded);
+		return append_compress_file(encoded, output);
 	}
 	return 0;
 }
 
-int CompressTucker::compress_file_raw(const char *input, bool is16, Common::File &output) {
-	if (is16) {
-		setRawAudioType(true, false, 16);
-	} else {
-		setRawAudioType(false, false, 8);
-	}
-	encodeAudio(input, true, 22050, tempEncoded, _format);
-	return append_compress_file(output);
+int CompressTucker::compress_file_raw(Common::File &input, bool is16, Common::File &output) {
+	RawAudioType rawType = { is16, false, (uint8)(is16 ? 16 : 8) };
+	std::vector<byte> rawData(input.size());
+	std::vector<byte> encoded;
+
+	if (!rawData.empty())
+		input.read_throwsOnError(&rawData[0], rawData.size());
+
+	encodeRawToMemory(rawData.empty() ? NULL : (const char *)&rawData[0], rawData.size(), 22050, _format, rawType, encoded);
+	return append_compress_file(encoded, output);
 }
 
 #define SOUND_TYPES_COUNT 3
@@ -322,10 +318,10 @@ uint32 CompressTucker::compress_audio_directory(const Common::Filename *inpath,
 				temp_table[i].size = compress_file_wav(input, output);
 				break;
 			case 3:
-				temp_table[i].size = compress_file_raw(filepath, 0, output);
+				temp_table[i].size = compress_file_raw(input, 0, output);
 				break;
 			case 4:
-				temp_table[i].size = compress_file_raw(filepath, 1, output);
+				temp_table[i].size = compress_file_raw(input, 1, output);
 				break;
 			}
 		} catch (...) {
@@ -401,11 +397,6 @@ void CompressTucker::compress_sound_files(const Common::Filename *inpath, const
 
 	output.close();
 
-	/* cleanup */
-	Common::removeFile(TEMP_WAV);
-	Common::removeFile(TEMP_RAW);
-	Common::removeFile(tempEncoded);
-
 	print("Done.\n");
 }
 
@@ -429,18 +420,15 @@ void CompressTucker::execute() {
 		outpath = inpath;
 	}
 
-	// Temporary output file
+	// Output file name
 	switch(_format) {
 	case AUDIO_MP3:
-		tempEncoded = TEMP_MP3;
 		outpath.setFullName(OUTPUT_MP3);
 		break;
 	case AUDIO_VORBIS:
-		tempEncoded = TEMP_OGG;
 		outpath.setFullName(OUTPUT_OGG);
 		break;
 	case AUDIO_FLAC:
-		tempEncoded = TEMP_FLAC;
 		outpath.setFullName(OUTPUT_FLA);
 		break;
 	default:
@@ -21,6 +21,7 @@
  */
 
 #include "sound/adpcm.h"
+#include "sound/adpcm_decoder.h"
 #include "common/endian.h"
 #include "common/util.h"
 
@@ -53,19 +54,17 @@ private:
 	};
 
 	struct adpcmStatus {
-		// IMA
-		int32 last;
-		int32 stepIndex;
+		// IMA and OKI
+		ADPCMStatus ima;
 
 		// MS ADPCM
 		ADPCMChannelStatus ch[2];
 	} _status;
 
-	int16 stepAdjust(byte);
-	int16 decodeOKI(byte);
-	int16 decodeMSIMA(byte);
 	int16 decodeMS(ADPCMChannelStatus *c, byte);
 
+	uint32 readChunk(byte *data, uint32 maxSize);
+
 public:
 	ADPCMInputStream(Common::File *stream, uint32 size, typesADPCM type, int rate, int channels = 2, uint32 blockAlign = 0);
 	~ADPCMInputStream() {}
@@ -91,8 +90,8 @@ public:
 ADPCMInputStream::ADPCMInputStream(Common::File *stream, uint32 size, typesADPCM type, int rate, int channels, uint32 blockAlign)
 	: _stream(stream), _channels(channels), _type(type), _blockAlign(blockAlign), _rate(rate) {
 
-	_status.last = 0;
-	_status.stepIndex = 0;
+	_status.ima.last = 0;
+	_status.ima.stepIndex = 0;
 	memset(_status.ch, 0, sizeof(_status.ch));
 	_endpos = stream->pos() + size;
 	_blockPos = _blockLen = 0;
@@ -124,42 +123,63 @@ int ADPCMInputStream::readBuffer(int16 *buffer, const int numSamples) {
 	return 0;
 }
 
+// Reads up to maxSize bytes, without going past the end of the ADPCM data.
+uint32 ADPCMInputStream::readChunk(byte *data, uint32 maxSize) {
+	int32 left = (int32)_endpos - _stream->pos();
+	if (left <= 0 || _stream->eos())
+		return 0;
+	return _stream->read_noThrow(data, MIN<uint32>(maxSize, left));
+}
+
+// The samples are returned as little endian words
+static void fixSampleOrder(int16 *buffer, int numSamples) {
+#ifdef SCUMM_BIG_ENDIAN
+	for (int i = 0; i < numSamples; i++)
+		buffer[i] = (int16)SWAP_16((uint16)buffer[i]);
+#endif
+}
+
 int ADPCMInputStream::readBufferOKI(int16 *buffer, const int numSamples) {
-	int samples;
-	byte data;
+	byte data[1024];
+	int samples = 0;
 
 	assert(numSamples % 2 == 0);
 
-	for (samples = 0; samples < numSamples && !_stream->eos() && _stream->pos() < (int)_endpos; samples += 2) {
-		data = _stream->readByte();
-		WRITE_LE_UINT16(buffer + samples,     decodeOKI((data >> 4) & 0x0f));
-		WRITE_LE_UINT16(buffer + samples + 1, decodeOKI(data & 0x0f));
+	while (samples < numSamples) {
+		uint32 size = readChunk(data, MIN<uint32>(sizeof(data), (numSamples - samples) / 2));
+		if (size == 0)
+			break;
+		decodeOKI(_status.ima, data, size, buffer + samples);
+		fixSampleOrder(buffer + samples, size * 2);
+		samples += size * 2;
 	}
 	return samples;
 }
 
 
 int ADPCMInputStream::readBufferMSIMA1(int16 *buffer, const int numSamples) {
-	int samples;
-	byte data;
+	byte data[1024];
+	int samples = 0;
 
 	assert(numSamples % 2 == 0);
 
-	samples = 0;
-
 	while (samples < numSamples && !_stream->eos() && _stream->pos() < (int)_endpos) {
 		if (_blockPos == _blockAlign) {
 			// read block header
-			_status.last = _stream->readSint16LE();
-			_status.stepIndex = _stream->readSint16LE();
+			_status.ima.last = _stream->readSint16LE();
+			_status.ima.stepIndex = clipIMAStepIndex(_stream->readSint16LE());
 			_blockPos = 4;
 		}
 
-		for (; samples < numSamples && _blockPos < _blockAlign && !_stream->eos() && _stream->pos() < (int)_endpos; samples += 2) {
-			data = _stream->readByte();
-			_blockPos++;
-			WRITE_LE_UINT16(buffer + samples,     decodeMSIMA(data & 0x0f));
-			WRITE_LE_UINT16(buffer + samples + 1, decodeMSIMA((data >> 4) & 0x0f));
+		while (samples < numSamples && _blockPos < _blockAlign) {
+			uint32 size = MIN<uint32>(sizeof(data), MIN<uint32>((numSamples - samples) / 2, _blockAlign - _blockPos));
+			size = readChunk(data, size);
+			if (size == 0)
+				break;
+			_blockPos += size;
+			decodeIMA(_status.ima, data, size, buffer + samples);
+			fixSampleOrder(buffer + samples, size * 2);
+			samples += size * 2;
 		}
 	}
 	return samples;
@@ -179,7 +199,7 @@ int ADPCMInputStream::readBufferMSIMA2(int16 *buffer, const int numSamples) {
 
 			for (nibble = 0; nibble < 8; nibble++) {
 				byte k = ((data & 0xf0000000) >> 28);
-				WRITE_LE_UINT16(buffer + samples + channel + nibble * 2, decodeMSIMA(k));
+				WRITE_LE_UINT16(buffer + samples + channel + nibble * 2, decodeIMA(_status.ima, k));
 				data <<= 4;
 			}
 		}
@@ -243,87 +263,6 @@ int ADPCMInputStream::readBufferMS(int channels, int16 *buffer, const int numSam
 }
 
 
-// adjust the step for use on the next sample.
-int16 ADPCMInputStream::stepAdjust(byte code) {
-	static const int16 adjusts[] = {-1, -1, -1, -1, 2, 4, 6, 8};
-
-	return adjusts[code & 0x07];
-}
-
-static const int16 okiStepSize[49] = {
-	  16,   17,   19,   21,   23,   25,   28,   31,
-	  34,   37,   41,   45,   50,   55,   60,   66,
-	  73,   80,   88,   97,  107,  118,  130,  143,
-	 157,  173,  190,  209,  230,  253,  279,  307,
-	 337,  371,  408,  449,  494,  544,  598,  658,
-	 724,  796,  876,  963, 1060, 1166, 1282, 1411,
-	1552
-};
-
-// Decode Linear to ADPCM
-int16 ADPCMInputStream::decodeOKI(byte code) {
-	int16 diff, E, samp;
-
-	E = (2 * (code & 0x7) + 1) * okiStepSize[_status.stepIndex] / 8;
-	diff = (code & 0x08) ? -E : E;
-	samp = _status.last + diff;
-
-    // Clip the values to +/- 2^11 (supposed to be 12 bits)
-	if (samp > 2048)
-		samp = 2048;
-	if (samp < -2048)
-		samp = -2048;
-
-	_status.last = samp;
-	_status.stepIndex += stepAdjust(code);
-	if (_status.stepIndex < 0)
-		_status.stepIndex = 0;
-	if (_status.stepIndex > ARRAYSIZE(okiStepSize) - 1)
-		_status.stepIndex = ARRAYSIZE(okiStepSize) - 1;
-
-	// * 16 effectively converts 12-bit input to 16-bit output
-	return samp * 16;
-}
-
-
-static const uint16 imaStepTable[89] = {
-		7,	  8,	9,	 10,   11,	 12,   13,	 14,
-	   16,	 17,   19,	 21,   23,	 25,   28,	 31,
-	   34,	 37,   41,	 45,   50,	 55,   60,	 66,
-	   73,	 80,   88,	 97,  107,	118,  130,	143,
-	  157,	173,  190,	209,  230,	253,  279,	307,
-	  337,	371,  408,	449,  494,	544,  598,	658,
-	  724,	796,  876,	963, 1060, 1166, 1282, 1411,
-	 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
-	 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484,
-	 7132, 7845, 8630, 9493,10442,11487,12635,13899,
-	15289,16818,18500,20350,22385,24623,27086,29794,
-	32767
-};
-
-int16 ADPCMInputStream::decodeMSIMA(byte code) {
-	int32 diff, E, samp;
-
-	E = (2 * (code & 0x7) + 1) * imaStepTable[_status.stepIndex] / 8;
-	diff = (code & 0x08) ? -E : E;
-	samp = _status.last + diff;
-
-	if (samp < -0x8000)
-		samp = -0x8000;
-	else if (samp > 0x7fff)
-		samp = 0x7fff;
-
-	_status.last = samp;
-
-	_status.stepIndex += stepAdjust(code);
-	if (_status.stepIndex < 0)
-		_status.stepIndex = 0;
-	if (_status.stepIndex > ARRAYSIZE(imaStepTable) - 1)
-		_status.stepIndex = ARRAYSIZE(imaStepTable) - 1;
-
-	return samp;
-}
-
 static const int MSADPCMAdaptationTable[] = {
 	230, 230, 230, 230, 307, 409, 512, 614,
 	768, 614, 512, 409, 307, 230, 230, 230
@@ -0,0 +1,244 @@
+/* Scumm Tools
+ * Copyright (C) 2004-2006  The ScummVM Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#include "sound/adpcm_decoder.h"
+#include "common/endian.h"
+#include "common/util.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace Audio {
+
+static const int16 imaStepTable[89] = {
+		7,	  8,	9,	 10,   11,	 12,   13,	 14,
+	   16,	 17,   19,	 21,   23,	 25,   28,	 31,
+	   34,	 37,   41,	 45,   50,	 55,   60,	 66,
+	   73,	 80,   88,	 97,  107,	118,  130,	143,
+	  157,	173,  190,	209,  230,	253,  279,	307,
+	  337,	371,  408,	449,  494,	544,  598,	658,
+	  724,	796,  876,	963, 1060, 1166, 1282, 1411,
+	 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+	 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484,
+	 7132, 7845, 8630, 9493,10442,11487,12635,13899,
+	15289,16818,18500,20350,22385,24623,27086,29794,
+	32767
+};
+
+static const int16 okiStepTable[49] = {
+	  16,   17,   19,   21,   23,   25,   28,   31,
+	  34,   37,   41,   45,   50,   55,   60,   66,
+	  73,   80,   88,   97,  107,  118,  130,  143,
+	 157,  173,  190,  209,  230,  253,  279,  307,
+	 337,  371,  408,  449,  494,  544,  598,  658,
+	 724,  796,  876,  963, 1060, 1166, 1282, 1411,
+	1552
+};
+
+// Step index adjustments of the 4 bit codecs
+static const int8 stepAdjustTable[8] = {
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+// Step index adjustments of the iMUSE codec, by packet size and data bits
+static const byte imuseAdjustTable[6][64] = {
+	{
+		0xFF,
+		4
+	},
+
+	{
+		0xFF, 0xFF,
+		   2,    8
+	},
+
+	{
+		0xFF, 0xFF, 0xFF, 0xFF,
+		   1,    2,    4,    6
+	},
+
+	{
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		   1,    2,    4,    6,    8,   12,   16,   32
+	},
+
+	{
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		   1,    2,    4,    6,    8,   10,   12,   14,
+		  16,   18,   20,   22,   24,   26,   28,   32
+	},
+
+	{
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		   1,    2,    3,    4,    5,    6,    7,    8,
+		   9,   10,   11,   12,   13,   14,   15,   16,
+		  17,   18,   19,   20,   21,   22,   23,   24,
+		  25,   26,   27,   28,   29,   30,   31,   32
+	}
+};
+
+ADPCMStep imaSteps[89][16];
+ADPCMStep okiSteps[49][16];
+
+// The iMUSE codec reads packets of 2 to 7 bits, depending on the step index
+static byte imuseBitCount[89];
+static int32 imuseDelta[89][128];
+static byte imuseNextIndex[89][128];
+
+static void buildStepTable(ADPCMStep (*steps)[16], const int16 *stepTable, int numSteps) {
+	for (int index = 0; index < numSteps; index++) {
+		for (int code = 0; code < 16; code++) {
+			int32 diff = (2 * (code & 0x7) + 1) * stepTable[index] / 8;
+			steps[index][code].diff = (code & 0x08) ? -diff : diff;
+			steps[index][code].nextIndex = CLIP<int32>(index + stepAdjustTable[code & 0x07], 0, numSteps - 1);
+		}
+	}
+}
+
+static void buildIMUSETables() {
+	for (int index = 0; index < ARRAYSIZE(imaStepTable); index++) {
+		byte bits = 0;
+		int32 tableValue = ((imaStepTable[index] * 4) / 7) / 2;
+		while (tableValue != 0) {
+			tableValue /= 2;
+			bits++;
+		}
+		bits = CLIP<byte>(bits, 2, 7);
+		imuseBitCount[index] = bits;
+
+		// The topmost bit of a packet is the sign, the others are the data
+		const byte signBitMask = 1 << (bits - 1);
+		for (int packet = 0; packet < (1 << bits); packet++) {
+			const byte data = packet & (signBitMask - 1);
+			int32 delta = imaStepTable[index] * (2 * data + 1) >> (bits - 1);
+			imuseDelta[index][packet] = (packet & signBitMask) ? -delta : delta;
+			imuseNextIndex[index][packet] = CLIP<int32>(index + (int8)imuseAdjustTable[bits - 2][data], 0, ARRAYSIZE(imaStepTable) - 1);
+		}
+	}
+}
+
+/** Fills in the decoder tables before any of them can be used. */
+static struct ADPCMTableInitializer {
+	ADPCMTableInitializer() {
+		buildStepTable(imaSteps, imaStepTable, ARRAYSIZE(imaStepTable));
+		buildStepTable(okiSteps, okiStepTable, ARRAYSIZE(okiStepTable));
+		buildIMUSETables();
+	}
+} adpcmTableInitializer;
+
+void decodeIMA(ADPCMStatus &status, const byte *src, uint size, int16 *dst) {
+	ADPCMStatus s = status;
+	for (uint i = 0; i < size; i++) {
+		byte data = src[i];
+		*dst++ = decodeIMA(s, data & 0x0f);
+		*dst++ = decodeIMA(s, data >> 4);
+	}
+	status = s;
+}
+
+void decodeOKI(ADPCMStatus &status, const byte *src, uint size, int16 *dst) {
+	ADPCMStatus s = status;
+	for (uint i = 0; i < size; i++) {
+		byte data = src[i];
+		*dst++ = decodeOKI(s, data >> 4);
+		*dst++ = decodeOKI(s, data & 0x0f);
+	}
+	status = s;
+}
+
+int32 decodeIMUSEBlock(const byte *src, byte *dst, int channels) {
+	const int MAX_CHANNELS = 2;
+	byte initialTablePos[MAX_CHANNELS] = {0, 0};
+	int32 initialOutputWord[MAX_CHANNELS] = {0, 0};
+	int32 outputSamplesLeft = 0x1000;
+
+	// We only support mono and stereo
+	assert(channels == 1 || channels == 2);
+
+	// Every block starts with a 2 byte word. If that word is non-zero, it
+	// indicates the size of a block of raw audio data (not encoded)
+	// following it. That data we simply copy to the output buffer and then
+	// proceed by decoding the remaining data.
+	//
+	// If on the other hand the word is zero, then what follows are
+	// 9*channels bytes containing seed data for the decoder.
+	int16 firstWord = READ_BE_UINT16(src);
+	src += 2;
+	if (firstWord != 0) {
+		// Copy raw data
+		memcpy(dst, src, firstWord);
+		dst += firstWord;
+		src += firstWord;
+		assert((firstWord & 1) == 0);
+		outputSamplesLeft -= firstWord / 2;
+	} else {
+		// Read the seed values for the decoder. The second value is the
+		// step size, which is implied by the step index
+		for (int i = 0; i < channels; i++) {
+			initialTablePos[i] = *src;
+			src += 5;
+			initialOutputWord[i] = READ_BE_UINT32(src);
+			src += 4;
+		}
+	}
+
+	int32 totalBitOffset = 0;
+	const int destStride = channels << 1;
+
+	// The channels are encoded separately, one after the other, but are
+	// interleaved in the output
+	for (int chan = 0; chan < channels; chan++) {
+		int32 curTablePos = CLIP<int32>(initialTablePos[chan], 0, ARRAYSIZE(imaStepTable) - 1);
+		int32 outputWord = initialOutputWord[chan];
+		byte *out = dst + chan * 2;
+
+		const int bound = (channels == 1)
+							? outputSamplesLeft
+							: ((chan == 0)
+								? (outputSamplesLeft + 1) / 2
+								: outputSamplesLeft / 2);
+		for (int i = 0; i < bound; ++i) {
+			// Read the next data packet
+			const int32 bits = imuseBitCount[curTablePos];
+			const uint16 readWord = (uint16)(READ_BE_UINT16(src + (totalBitOffset >> 3)) << (totalBitOffset & 7));
+			const byte packet = (byte)(readWord >> (16 - bits));
+			totalBitOffset += bits;
+
+			// Accumulate the delta onto the output data, and clip it to 16 bit signed
+			outputWord += imuseDelta[curTablePos][packet];
+			outputWord = (outputWord > 0x7fff) ? 0x7fff : outputWord;
+			outputWord = (outputWord < -0x8000) ? -0x8000 : outputWord;
+			WRITE_BE_UINT16(out, outputWord);
+			out += destStride;
+
+			curTablePos = imuseNextIndex[curTablePos][packet];
+		}
+	}
+
+	return 0x2000;
+}
+
+} // End of namespace Audio
@@ -0,0 +1,117 @@
+/* Scumm Tools
+ * Copyright (C) 2004-2006  The ScummVM Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#ifndef SOUND_ADPCM_DECODER_H
+#define SOUND_ADPCM_DECODER_H
+
+#include "common/scummsys.h"
+
+namespace Audio {
+
+/**
+ * Decoders for the IMA style ADPCM variants used by the tools.
+ *
+ * All of them are driven by tables which are precomputed for every step
+ * index and code, so decoding a sample takes a table lookup, an addition
+ * and a clip, instead of recomputing the difference and adjusting the
+ * step index every time.
+ */
+
+/** The state of a single IMA or OKI ADPCM channel. */
+struct ADPCMStatus {
+	int32 last;
+	int32 stepIndex;
+};
+
+/** One entry of a decoder table: the difference to apply and the next step index. */
+struct ADPCMStep {
+	int32 diff;
+	int32 nextIndex;
+};
+
+extern ADPCMStep imaSteps[89][16];
+extern ADPCMStep okiSteps[49][16];
+
+/** Decodes one nibble of standard IMA ADPCM data. */
+inline int16 decodeIMA(ADPCMStatus &status, byte code) {
+	const ADPCMStep &step = imaSteps[status.stepIndex][code];
+	int32 samp = status.last + step.diff;
+	samp = (samp < -0x8000) ? -0x8000 : samp;
+	samp = (samp > 0x7fff) ? 0x7fff : samp;
+	status.last = samp;
+	status.stepIndex = step.nextIndex;
+	return samp;
+}
+
+/**
+ * Decodes one nibble of Dialogic/OKI ADPCM data, which holds 12 bit samples.
+ * The result is scaled to 16 bits.
+ */
+inline int16 decodeOKI(ADPCMStatus &status, byte code) {
+	const ADPCMStep &step = okiSteps[status.stepIndex][code];
+	int32 samp = status.last + step.diff;
+	samp = (samp < -2048) ? -2048 : samp;
+	samp = (samp > 2048) ? 2048 : samp;
+	status.last = samp;
+	status.stepIndex = step.nextIndex;
+	return samp * 16;
+}
+
+/**
+ * Clamps a step index read from a stream to the range of the IMA tables.
+ */
+inline int32 clipIMAStepIndex(int32 stepIndex) {
+	return (stepIndex < 0) ? 0 : ((stepIndex > 88) ? 88 : stepIndex);
+}
+
+/**
+ * Decodes size bytes of mono IMA ADPCM data into 2 * size samples, taking the
+ * low nibble of each byte first.
+ */
+void decodeIMA(ADPCMStatus &status, const byte *src, uint size, int16 *dst);
+
+/**
+ * Decodes size bytes of mono OKI ADPCM data into 2 * size samples, taking the
+ * high nibble of each byte first.
+ */
+void decodeOKI(ADPCMStatus &status, const byte *src, uint size, int16 *dst);
+
+/**
+ * Decodes a block of the variable bit size IMA variant used by iMUSE in The
+ * Dig and The Curse of Monkey Island (codecs 13 and 15 of the bundle files).
+ *
+ * A block holds either raw samples or seed values followed by the bit stream
+ * of each channel, one channel after the other. It decodes to 0x2000 bytes
+ * of interleaved big endian 16 bit samples.
+ *
+ * The bit reader may look at one byte past the end of the input.
+ *
+ * @param src      The encoded block.
+ * @param dst      Receives the decoded samples, must hold 0x2000 bytes.
+ * @param channels 1 for mono, 2 for stereo.
+ * @return The number of bytes written to dst.
+ */
+int32 decodeIMUSEBlock(const byte *src, byte *dst, int channels);
+
+} // End of namespace Audio
+
+#endif
@@ -0,0 +1,294 @@
+/* Scumm Tools
+ * Copyright (C) 2004-2006  The ScummVM Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+/*
+ * Compares the table driven ADPCM decoders with the straightforward
+ * implementations they replaced, both for speed and for identical output.
+ * Build and run it with "make bench".
+ */
+
+#include "sound/adpcm_decoder.h"
+#include "common/endian.h"
+#include "common/util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+namespace {
+
+const int16 stepTable[89] = {
+	    7,     8,     9,    10,    11,    12,    13,    14,
+	   16,    17,    19,    21,    23,    25,    28,    31,
+	   34,    37,    41,    45,    50,    55,    60,    66,
+	   73,    80,    88,    97,   107,   118,   130,   143,
+	  157,   173,   190,   209,   230,   253,   279,   307,
+	  337,   371,   408,   449,   494,   544,   598,   658,
+	  724,   796,   876,   963,  1060,  1166,  1282,  1411,
+	 1552,  1707,  1878,  2066,  2272,  2499,  2749,  3024,
+	 3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,
+	 7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+	32767
+};
+
+const int16 okiStepTable[49] = {
+	  16,   17,   19,   21,   23,   25,   28,   31,
+	  34,   37,   41,   45,   50,   55,   60,   66,
+	  73,   80,   88,   97,  107,  118,  130,  143,
+	 157,  173,  190,  209,  230,  253,  279,  307,
+	 337,  371,  408,  449,  494,  544,  598,  658,
+	 724,  796,  876,  963, 1060, 1166, 1282, 1411,
+	1552
+};
+
+const int16 adjusts[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+const byte otherTable[6][64] = {
+	{ 0xFF, 4 },
+	{ 0xFF, 0xFF, 2, 8 },
+	{ 0xFF, 0xFF, 0xFF, 0xFF, 1, 2, 4, 6 },
+	{ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	  1, 2, 4, 6, 8, 12, 16, 32 },
+	{ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	  1, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 32 },
+	{ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	  1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+	  17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32 }
+};
+
+// The IMA decoder of ADPCMInputStream, before it used the shared tables
+int16 referenceIMA(Audio::ADPCMStatus &status, byte code) {
+	int32 E = (2 * (code & 0x7) + 1) * stepTable[status.stepIndex] / 8;
+	int32 samp = status.last + ((code & 0x08) ? -E : E);
+
+	if (samp < -0x8000)
+		samp = -0x8000;
+	else if (samp > 0x7fff)
+		samp = 0x7fff;
+	status.last = samp;
+
+	status.stepIndex += adjusts[code & 0x07];
+	if (status.stepIndex < 0)
+		status.stepIndex = 0;
+	if (status.stepIndex > ARRAYSIZE(stepTable) - 1)
+		status.stepIndex = ARRAYSIZE(stepTable) - 1;
+	return samp;
+}
+
+// The OKI decoder of ADPCMInputStream, before it used the shared tables
+int16 referenceOKI(Audio::ADPCMStatus &status, byte code) {
+	int16 E = (2 * (code & 0x7) + 1) * okiStepTable[status.stepIndex] / 8;
+	int16 samp = status.last + ((code & 0x08) ? -E : E);
+
+	if (samp > 2048)
+		samp = 2048;
+	if (samp < -2048)
+		samp = -2048;
+	status.last = samp;
+
+	status.stepIndex += adjusts[code & 0x07];
+	if (status.stepIndex < 0)
+		status.stepIndex = 0;
+	if (status.stepIndex > ARRAYSIZE(okiStepTable) - 1)
+		status.stepIndex = ARRAYSIZE(okiStepTable) - 1;
+	return samp * 16;
+}
+
+// The iMUSE decoder of compress_scumm_bun, before it used the shared tables
+void referenceIMUSE(const byte *src, byte *dst, int channels) {
+	byte bitCount[89];
+	for (int pos = 0; pos < 89; pos++) {
+		byte put = 0;
+		int32 tableValue = ((stepTable[pos] * 4) / 7) / 2;
+		while (tableValue != 0) {
+			tableValue /= 2;
+			put++;
+		}
+		bitCount[pos] = CLIP<byte>(put, 2, 7);
+	}
+
+	byte initialTablePos[2] = {0, 0};
+	int32 initialOutputWord[2] = {0, 0};
+	int32 outputSamplesLeft = 0x1000;
+
+	src += 2;
+	for (int i = 0; i < channels; i++) {
+		initialTablePos[i] = *src;
+		src += 5;
+		initialOutputWord[i] = READ_BE_UINT32(src);
+		src += 4;
+	}
+
+	int32 totalBitOffset = 0;
+	for (int chan = 0; chan < channels; chan++) {
+		int32 curTablePos = initialTablePos[chan];
+		int32 outputWord = initialOutputWord[chan];
+		int32 destPos = chan * 2;
+
+		const int bound = (channels == 1) ? outputSamplesLeft : ((chan == 0) ? (outputSamplesLeft + 1) / 2 : outputSamplesLeft / 2);
+		for (int i = 0; i < bound; ++i) {
+			const int32 curTableEntryBitCount = bitCount[curTablePos];
+			const byte *readPos = src + (totalBitOffset >> 3);
+			const uint16 readWord = (uint16)(READ_BE_UINT16(readPos) << (totalBitOffset & 7));
+			const byte packet = (byte)(readWord >> (16 - curTableEntryBitCount));
+			totalBitOffset += curTableEntryBitCount;
+
+			const byte signBitMask = (1 << (curTableEntryBitCount - 1));
+			const byte dataBitMask = (signBitMask - 1);
+			const byte data = (packet & dataBitMask);
+
+			int32 delta = stepTable[curTablePos] * (2 * data + 1) >> (curTableEntryBitCount - 1);
+			if ((packet & signBitMask) != 0)
+				delta = -delta;
+
+			outputWord += delta;
+			if (outputWord > 0x7fff)
+				outputWord = 0x7fff;
+			if (outputWord < -0x8000)
+				outputWord = -0x8000;
+			WRITE_BE_UINT16(dst + destPos, outputWord);
+			destPos += channels << 1;
+
+			curTablePos += (int8)otherTable[curTableEntryBitCount - 2][data];
+			if (curTablePos < 0)
+				curTablePos = 0;
+			else if (curTablePos >= ARRAYSIZE(stepTable))
+				curTablePos = ARRAYSIZE(stepTable) - 1;
+		}
+	}
+}
+
+double seconds(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+bool benchIMA(const std::vector<byte> &input, int rounds) {
+	std::vector<int16> expected(input.size() * 2), actual(input.size() * 2);
+
+	clock_t start = clock();
+	for (int r = 0; r < rounds; r++) {
+		Audio::ADPCMStatus status = {0, 0};
+		for (uint i = 0; i < input.size(); i++) {
+			expected[2 * i] = referenceIMA(status, input[i] & 0x0f);
+			expected[2 * i + 1] = referenceIMA(status, input[i] >> 4);
+		}
+	}
+	double before = seconds(start);
+
+	start = clock();
+	for (int r = 0; r < rounds; r++) {
+		Audio::ADPCMStatus status = {0, 0};
+		Audio::decodeIMA(status, &input[0], input.size(), &actual[0]);
+	}
+	double after = seconds(start);
+
+	bool same = (expected == actual);
+	printf("IMA:          %6.3fs -> %6.3fs %s\n", before, after, same ? "" : "(output differs!)");
+	return same;
+}
+
+bool benchOKI(const std::vector<byte> &input, int rounds) {
+	std::vector<int16> expected(input.size() * 2), actual(input.size() * 2);
+
+	clock_t start = clock();
+	for (int r = 0; r < rounds; r++) {
+		Audio::ADPCMStatus status = {0, 0};
+		for (uint i = 0; i < input.size(); i++) {
+			expected[2 * i] = referenceOKI(status, input[i] >> 4);
+			expected[2 * i + 1] = referenceOKI(status, input[i] & 0x0f);
+		}
+	}
+	double before = seconds(start);
+
+	start = clock();
+	for (int r = 0; r < rounds; r++) {
+		Audio::ADPCMStatus status = {0, 0};
+		Audio::decodeOKI(status, &input[0], input.size(), &actual[0]);
+	}
+	double after = seconds(start);
+
+	bool same = (expected == actual);
+	printf("OKI:          %6.3fs -> %6.3fs %s\n", before, after, same ? "" : "(output differs!)");
+	return same;
+}
+
+bool benchIMUSE(const std::vector<byte> &input, int channels, int rounds) {
+	const uint blockSize = 0x1000;
+	const uint numBlocks = input.size() / blockSize;
+	std::vector<byte> expected(numBlocks * 0x2000), actual(numBlocks * 0x2000);
+
+	// Blocks need a zero first word to be decoded, and the decoder reads
+	// one byte past each of them
+	std::vector<byte> blocks(input);
+	blocks.push_back(0);
+	for (uint b = 0; b < numBlocks; b++)
+		WRITE_BE_UINT16(&blocks[b * blockSize], 0);
+
+	clock_t start = clock();
+	for (int r = 0; r < rounds; r++)
+		for (uint b = 0; b < numBlocks; b++)
+			referenceIMUSE(&blocks[b * blockSize], &expected[b * 0x2000], channels);
+	double before = seconds(start);
+
+	start = clock();
+	for (int r = 0; r < rounds; r++)
+		for (uint b = 0; b < numBlocks; b++)
+			Audio::decodeIMUSEBlock(&blocks[b * blockSize], &actual[b * 0x2000], channels);
+	double after = seconds(start);
+
+	bool same = (expected == actual);
+	printf("iMUSE %s: %6.3fs -> %6.3fs %s\n", (channels == 1) ? "mono  " : "stereo", before, after, same ? "" : "(output differs!)");
+	return same;
+}
+
+} // End of anonymous namespace
+
+int main(int argc, char *argv[]) {
+	const int rounds = (argc > 1) ? atoi(argv[1]) : 20;
+
+	std::vector<byte> input(1 << 20);
+	srand(1);
+	for (uint i = 0; i < input.size(); i++)
+		input[i] = (byte)(rand() >> 4);
+
+	// iMUSE seeds have to be valid step indices
+	std::vector<byte> imuseInput(input);
+	for (uint b = 0; b < imuseInput.size(); b += 0x1000) {
+		imuseInput[b + 2] %= 89;
+		imuseInput[b + 11] %= 89;
+	}
+
+	printf("Decoding %d times 1 MB of ADPCM data, before -> after\n", rounds);
+	bool ok = benchIMA(input, rounds);
+	ok = benchOKI(input, rounds) && ok;
+	ok = benchIMUSE(imuseInput, 1, rounds) && ok;
+	ok = benchIMUSE(imuseInput, 2, rounds) && ok;
+
+	return ok ? 0 : 1;
+}
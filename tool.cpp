@@ -234,6 +234,7 @@ void Tool::warning(const char *format, ...) {
 	vsnprintf(buf, 4096, format, va);
 	va_end(va);
 
+	Common::StackLock lock(_printMutex);
 	_internalPrint(_print_udata, (std::string("Warning: ") + buf).c_str());
 }
 
@@ -245,7 +246,10 @@ void Tool::print(const char *format, ...) {
 	vsnprintf(buf, 4096, format, va);
 	va_end(va);
 
-	_internalPrint(_print_udata, buf);
+	{
+		Common::StackLock lock(_printMutex);
+		_internalPrint(_print_udata, buf);
+	}
 
 	// We notify of progress here
 	// This way, almost all tools will be able to exit gracefully (as they print stuff)
@@ -253,7 +257,10 @@ void Tool::print(const char *format, ...) {
 }
 
 void Tool::print(const std::string &msg) {
-	_internalPrint(_print_udata, msg.c_str());
+	{
+		Common::StackLock lock(_printMutex);
+		_internalPrint(_print_udata, msg.c_str());
+	}
 
 	// We notify of progress here
 	// This way, almost all tools will be able to exit gracefully (as they print stuff)
@@ -294,6 +301,29 @@ void Tool::parseOutputArguments() {
 	}
 }
 
+void Tool::parseJobsArgument(uint &numJobs) {
+	if (_arguments.empty() || _arguments.front() != "--jobs")
+		return;
+
+	_arguments.pop_front();
+	if (_arguments.empty())
+		throw ToolException("Could not parse command line options, expected value after --jobs");
+
+	std::string arg = _arguments.front();
+	int jobs = atoi(arg.c_str());
+
+	if (jobs == 0 && arg != "0")
+		throw ToolException("Number of jobs (--jobs) must be a number.");
+
+	if (jobs < 0)
+		throw ToolException("Number of jobs (--jobs) must not be negative.");
+
+	_arguments.pop_front();
+
+	// Zero means one job per processor
+	numJobs = (jobs == 0) ? Common::getNumProcessors() : (uint)jobs;
+}
+
 void Tool::parseExtraArguments() {
 }
 
@@ -28,6 +28,7 @@
 #include <string>
 
 #include "common/file.h"
+#include "common/thread.h"
 
 /**
  * Different types of tools, used to differentiate them when
@@ -115,7 +116,7 @@ public:
 
 	/**
 	 * Prints a formatted message, to either stdout or the GUI. Always use this
-	 * instead of printf.
+	 * instead of printf. May be called from worker threads.
 	 */
 	void print(const char *format, ...);
 
@@ -201,6 +202,14 @@ protected:
 	virtual void setTempFileName();
 	void parseOutputArguments();
 
+	/**
+	 * Parses a '--jobs <n>' argument, if it is the next one.
+	 * Zero jobs means one per processor.
+	 *
+	 * @param numJobs Receives the number of jobs, left alone if there is no such argument.
+	 */
+	void parseJobsArgument(uint &numJobs);
+
 	/** Parses the arguments only this tool takes. */
 	virtual void parseExtraArguments();
 
@@ -240,6 +249,8 @@ private:
 	typedef void (*PrintFunction)(void *, const char *);
 	PrintFunction _internalPrint;
 	void *_print_udata;
+	/** Serializes calls to the print function. */
+	Common::Mutex _printMutex;
 
 	typedef void (*ProgressFunction)(void *, int, int);
 	ProgressFunction _internalProgress;